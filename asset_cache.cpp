@@ -0,0 +1,185 @@
+#include "asset_cache.h"
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <print>
+#include <thread>
+#include <cstring>
+#include <array>
+#include <bit>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+//a 64 bit hash going through the data 32 bytes at a time on 4 independent lanes the way xxHash64 does, it's there to tell files apart,
+//not to stand up to anyone crafting collisions on purpose
+static uint64_t hashBytes(std::span<const uint8_t> bytes, uint64_t seed)
+{
+    static constexpr uint64_t PRIME1 = 0x9e3779b185ebca87;
+    static constexpr uint64_t PRIME2 = 0xc2b2ae3d27d4eb4f;
+    static constexpr uint64_t PRIME3 = 0x165667b19e3779f9;
+    static constexpr uint64_t PRIME4 = 0x85ebca77c2b2ae63;
+    static constexpr uint64_t PRIME5 = 0x27d4eb2f165667c5;
+
+    const auto round = [](uint64_t acc, uint64_t input)
+    {
+        return std::rotl(acc + input * PRIME2, 31) * PRIME1;
+    };
+
+    const auto read64 = [&](size_t offset)
+    {
+        uint64_t value;
+        std::memcpy(&value, bytes.data() + offset, sizeof(uint64_t));
+        return value;
+    };
+
+    const size_t size = bytes.size();
+    size_t offset = 0;
+    uint64_t h = 0;
+
+    if(size >= 32)
+    {
+        std::array<uint64_t, 4> lanes{seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+
+        for(; offset + 32 <= size; offset += 32)
+        {
+            for(uint32_t lane = 0; lane < 4; lane++)
+            {
+                lanes[lane] = round(lanes[lane], read64(offset + 8 * lane));
+            }
+        }
+
+        h = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+
+        for(uint64_t lane : lanes)
+        {
+            h = (h ^ round(0, lane)) * PRIME1 + PRIME4;
+        }
+    }
+    else
+    {
+        h = seed + PRIME5;
+    }
+
+    h += size;
+
+    for(; offset + 8 <= size; offset += 8)
+    {
+        h = std::rotl(h ^ round(0, read64(offset)), 27) * PRIME1 + PRIME4;
+    }
+
+    for(; offset < size; offset++)
+    {
+        h = std::rotl(h ^ (bytes[offset] * PRIME5), 11) * PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+std::span<const uint8_t> AssetCache::Entry::data() const noexcept
+{
+    if(m_file.isOpen())
+    {
+        return std::span<const uint8_t>(m_file.data() + PAYLOAD_OFFSET, m_file.size() - PAYLOAD_OFFSET);
+    }
+
+    return m_baked;
+}
+
+void AssetCache::Entry::pageIn(uint64_t offset, uint64_t size) const noexcept
+{
+    if(m_file.isOpen())
+    {
+        m_file.pageIn(PAYLOAD_OFFSET + offset, size);
+    }
+}
+
+std::unique_ptr<AssetCache::Entry> AssetCache::load(const std::string& source_filename, std::string_view bake_kind, uint32_t baker_version, const Baker& bake)
+{
+    uint64_t key = 0;
+    {
+        const std::string bake_id = std::format("{} {} {}", bake_kind, baker_version, ENTRY_VERSION);
+
+        MappedFile source;
+        source.open(source_filename);
+        key = hashBytes(std::span<const uint8_t>(source.data(), source.size()), hashBytes(std::span<const uint8_t>(reinterpret_cast<const uint8_t*>(bake_id.data()), bake_id.size()), 0));
+    }
+
+    const std::string entry_filename = std::format("{}{}_{:016x}", ASSET_CACHE_DIRECTORY, bake_kind, key);
+    auto entry = std::make_unique<Entry>();
+    std::error_code ec;
+
+    if(std::filesystem::exists(entry_filename, ec))
+    {
+        entry->m_file.open(entry_filename);
+
+        EntryHeader header{};
+
+        if(entry->m_file.size() >= PAYLOAD_OFFSET)
+        {
+            std::memcpy(&header, entry->m_file.data(), sizeof(EntryHeader));
+        }
+
+        if((header.magic == ENTRY_MAGIC) && (header.version == ENTRY_VERSION) && (header.key == key) && (header.payload_size == entry->m_file.size() - PAYLOAD_OFFSET))
+        {
+            return entry;
+        }
+
+        //entries are written under a temporary name and renamed, so this takes an entry damaged after the fact, it's just baked again
+        entry->m_file.close();
+    }
+
+    entry->m_baked = bake();
+    store(entry_filename, key, entry->m_baked);
+
+    return entry;
+}
+
+void AssetCache::store(const std::string& entry_filename, uint64_t key, std::span<const uint8_t> payload)
+{
+    //the cache only saves time, an entry that can't be written is baked again on the next launch instead of failing the load
+    std::error_code ec;
+    std::filesystem::create_directories(ASSET_CACHE_DIRECTORY, ec);
+
+    //the process and thread ids keep two processes, or two threads of one, baking the same entry from writing into the same temporary file
+#ifdef _WIN32
+    const int process_id = _getpid();
+#else
+    const int process_id = getpid();
+#endif
+    const std::string tmp_filename = std::format("{}.{}.{}.tmp", entry_filename, process_id, std::hash<std::thread::id>()(std::this_thread::get_id()));
+    {
+        std::ofstream file(tmp_filename, std::ios::binary | std::ios::trunc);
+
+        const EntryHeader header{ENTRY_MAGIC, ENTRY_VERSION, key, payload.size()};
+        static constexpr char padding[PAYLOAD_OFFSET - sizeof(EntryHeader)]{};
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(EntryHeader));
+        file.write(padding, sizeof(padding));
+        file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+        file.close();
+
+        if(!file)
+        {
+            std::println("Failed to write asset cache entry {}", entry_filename);
+            std::filesystem::remove(tmp_filename, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(tmp_filename, entry_filename, ec);
+
+    if(ec)
+    {
+        std::println("Failed to write asset cache entry {}: {}", entry_filename, ec.message());
+        std::filesystem::remove(tmp_filename, ec);
+    }
+}
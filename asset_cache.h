@@ -0,0 +1,59 @@
+#ifndef ASSET_CACHE_H
+#define ASSET_CACHE_H
+
+#include "mapped_file.h"
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//the GPU ready versions of the assets are baked into ASSET_CACHE_DIRECTORY, every entry is named after a hash of its source file's
+//content, the kind of bake and the baker's version - changing the source or the baker makes a new entry instead of reading a stale one,
+//the old entries are just left behind and the whole directory can be deleted at any time
+class AssetCache
+{
+public:
+    //the payload of an entry, mapped out of the cache or held in memory when it was just baked
+    class Entry
+    {
+    public:
+        std::span<const uint8_t> data() const noexcept;
+        //blocks until the given range of the payload is read into memory, baked entries are in memory already
+        void pageIn(uint64_t offset, uint64_t size) const noexcept;
+
+    private:
+        friend class AssetCache;
+
+        MappedFile m_file;
+        std::vector<uint8_t> m_baked;
+    };
+
+    using Baker = std::function<std::vector<uint8_t>()>;
+
+    //returns the entry of the source file for the given kind of bake and baker version, on a miss bake() is called and what it returns
+    //is stored for the next time - safe to call from any thread as long as no two of them load the same entry at the same time
+    static std::unique_ptr<Entry> load(const std::string& source_filename, std::string_view bake_kind, uint32_t baker_version, const Baker& bake);
+
+private:
+    static constexpr const char* ASSET_CACHE_DIRECTORY = "cache/";
+    static constexpr uint32_t ENTRY_MAGIC = 0x48434341; //"ACCH"
+    static constexpr uint32_t ENTRY_VERSION = 0;
+    //the payloads start 16 byte aligned, the mesh chunks rely on it
+    static constexpr uint64_t PAYLOAD_OFFSET = 32;
+
+    struct EntryHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint64_t payload_size;
+    };
+
+    static_assert(sizeof(EntryHeader) <= PAYLOAD_OFFSET);
+
+    static void store(const std::string& entry_filename, uint64_t key, std::span<const uint8_t> payload);
+};
+
+#endif // ASSET_CACHE_H
@@ -261,6 +261,31 @@ std::pair<float, float> AABB::computeInterval(vec3 axis) const
     return ::computeInterval(m_verts, axis);
 }
 
+bool AABB::intersect(const std::array<vec4, 6>& frustum, bool& inside) const
+{
+    inside = true;
+
+    for(const auto& plane : frustum)
+    {
+        //the corners furthest along and against the plane normal
+        const vec3 p(plane.x >= 0.0f ? m_max.x : m_min.x, plane.y >= 0.0f ? m_max.y : m_min.y, plane.z >= 0.0f ? m_max.z : m_min.z);
+        const vec3 n(plane.x >= 0.0f ? m_min.x : m_max.x, plane.y >= 0.0f ? m_min.y : m_max.y, plane.z >= 0.0f ? m_min.z : m_max.z);
+
+        if(p.x * plane.x + p.y * plane.y + p.z * plane.z + plane.w < 0.0f)
+        {
+            inside = false;
+            return false;
+        }
+
+        if(n.x * plane.x + n.y * plane.y + n.z * plane.z + plane.w < 0.0f)
+        {
+            inside = false;
+        }
+    }
+
+    return true;
+}
+
 //Bounding Box
 BoundingBox::BoundingBox(const std::array<vec3, 8>& verts, const std::array<vec3, 3>& face_normals)
     : m_verts(verts)
@@ -387,6 +412,20 @@ bool intersect(const Ray& ray, const AABB& aabb)
     return t_far >= t_near;
 }
 
+bool intersect(const Ray& ray, const AABB& aabb, float& d)
+{
+    const vec3 t_min = (aabb.m_min - ray.origin) / ray.dir;
+    const vec3 t_max = (aabb.m_max - ray.origin) / ray.dir;
+    const vec3 t1 = min(t_min, t_max);
+    const vec3 t2 = max(t_min, t_max);
+    const float t_near = std::max(std::max(std::max(t1.x, t1.y), t1.z), 0.0f);
+    const float t_far = std::min(std::min(t2.x, t2.y), t2.z);
+
+    d = t_near;
+
+    return t_far >= t_near;
+}
+
 #if 0
 //triangle-aabb
 static bool triangleAABBAxisTest(const vec3& axis, const vec3& aabb_extents, const vec3& t0, const vec3& t1, const vec3& t2)
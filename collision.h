@@ -56,6 +56,7 @@ class AABB
     friend bool intersect(const AABB&, const BoundingBox&);
     friend bool intersect(const AABB&, const Sphere&);
     friend bool intersect(const Ray&, const AABB&);
+    friend bool intersect(const Ray&, const AABB&, float& d);
 
 public:
     AABB() = default;
@@ -67,6 +68,9 @@ public:
     void transform(vec3 translation, vec3 scaling);
     std::pair<float, float> computeInterval(vec3 axis) const;
 
+    //returns false if the box is completely outside the frustum, inside is set if the box is completely inside it
+    bool intersect(const std::array<vec4, 6>& frustum, bool& inside) const;
+
 private:
     vec3 m_min;
     vec3 m_max;
@@ -118,5 +122,7 @@ bool intersect(const BoundingBox& bb, const AABB& aabb);
 bool intersect(const Sphere& sphere, const AABB& aabb);
 bool intersect(const Sphere& sphere, const BoundingBox& bb);
 bool intersect(const Ray& ray, const vec3& p0, const vec3& p1, const vec3& p2, float& d);
+//d is the distance along the ray at which it enters the box, 0 if the origin is inside
+bool intersect(const Ray& ray, const AABB& aabb, float& d);
 
 #endif // COLLISION_H
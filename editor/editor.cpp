@@ -297,6 +297,7 @@ void Editor::onKeyPressedImpl(Key key, const InputState& input_state)
 {
     if(key == VKeyF5)
     {
+        m_scene.terrain().finishEdits(m_renderer);
         m_scene.saveToFile("scene.scn");
         return;
     }
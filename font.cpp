@@ -1,6 +1,8 @@
 #include "font.h"
 #include "game_utils.h"
+#include "asset_cache.h"
 #include <print>
+#include <cstring>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -21,6 +23,52 @@ static std::string freetypeErrorString(FT_Error error)
 }
 
 Font::Font(const std::string& font_filename, uint32_t font_size)
+{
+    const auto baked = AssetCache::load(font_filename, std::format("font{}", font_size), BAKED_FONT_VERSION, [&]
+    {
+        rasterize(font_filename, font_size);
+        return bake();
+    });
+
+    loadBaked(font_filename, baked->data());
+}
+
+std::vector<uint8_t> Font::bake() const
+{
+    const BakedFontHeader header{m_baseline_distance, m_font_height, m_tex_width, m_tex_height};
+    std::vector<uint8_t> baked(sizeof(BakedFontHeader) + sizeof(m_glyphs) + m_bitmaps.size());
+
+    std::memcpy(baked.data(), &header, sizeof(BakedFontHeader));
+    std::memcpy(baked.data() + sizeof(BakedFontHeader), m_glyphs.data(), sizeof(m_glyphs));
+    std::memcpy(baked.data() + sizeof(BakedFontHeader) + sizeof(m_glyphs), m_bitmaps.data(), m_bitmaps.size());
+
+    return baked;
+}
+
+void Font::loadBaked(const std::string& font_filename, std::span<const uint8_t> baked)
+{
+    BakedFontHeader header{};
+
+    if(baked.size() >= sizeof(BakedFontHeader) + sizeof(m_glyphs))
+    {
+        std::memcpy(&header, baked.data(), sizeof(BakedFontHeader));
+    }
+
+    if(baked.size() != sizeof(BakedFontHeader) + sizeof(m_glyphs) + char_count * uint64_t(header.tex_width) * header.tex_height)
+    {
+        error(std::format("Baked font of {} is corrupted.", font_filename));
+    }
+
+    m_baseline_distance = header.baseline_distance;
+    m_font_height = header.font_height;
+    m_tex_width = header.tex_width;
+    m_tex_height = header.tex_height;
+
+    std::memcpy(m_glyphs.data(), baked.data() + sizeof(BakedFontHeader), sizeof(m_glyphs));
+    m_bitmaps.assign(baked.begin() + sizeof(BakedFontHeader) + sizeof(m_glyphs), baked.end());
+}
+
+void Font::rasterize(const std::string& font_filename, uint32_t font_size)
 {
     FT_Library library;
     FT_Face face;
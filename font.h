@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <string>
+#include <span>
 #include "geometry.h"
 
 enum class FontType
@@ -42,6 +43,22 @@ public:
     uint32_t height() const noexcept;
 
 private:
+    //the glyphs, metrics and bitmaps of a font at one size are kept in the asset cache as a BakedFontHeader followed by m_glyphs and m_bitmaps
+    struct BakedFontHeader
+    {
+        uint32_t baseline_distance;
+        uint32_t font_height;
+        uint32_t tex_width;
+        uint32_t tex_height;
+    };
+
+    static constexpr uint32_t BAKED_FONT_VERSION = 0;
+
+    //renders the glyphs with freetype and reads the kerning table
+    void rasterize(const std::string& font_filename, uint32_t font_size);
+    std::vector<uint8_t> bake() const;
+    void loadBaked(const std::string& font_filename, std::span<const uint8_t> baked);
+
     static constexpr size_t first_char = 32;
     static constexpr size_t last_char = 126;
     static constexpr size_t char_count = last_char - first_char + 1;
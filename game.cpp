@@ -5,6 +5,8 @@
 #include <fstream>
 #include <numeric>
 #include <algorithm>
+#include <random>
+#include <ranges>
 
 void Game::setDefaultIni()
 {
@@ -139,7 +141,7 @@ void Game::updateFpsLabel()
         dt = 1.0 / static_cast<double>(m_timer.getFps());
     }
 
-    m_fps_label->setText(std::format("Fps: {} | {:.2f}ms", m_timer.getFps(), dt * 1000.0));
+    m_fps_label->setText(std::format("Fps: {} | {:.2f}ms | shadows: {:.2f}ms", m_timer.getFps(), dt * 1000.0, m_renderer->shadowPassGpuTime()));
 }
 
 void Game::processConsoleCmd(const std::string& text)
@@ -226,6 +228,275 @@ void Game::processConsoleCmd(const std::string& text)
         return;
     }
 
+    if("layered_shadows" == words[0])
+    {
+        if(words.size() != 2)
+        {
+            m_console->print("layered_shadows: command expects exactly 1 argument.");
+            return;
+        }
+
+        if("on" == words[1])
+        {
+            if(m_renderer->enableLayeredShadows(true))
+            {
+                m_console->print("Layered shadows enabled.");
+            }
+            else
+            {
+                m_console->print("Failed to enable layered shadows.");
+            }
+        }
+        else if("off" == words[1])
+        {
+            if(m_renderer->enableLayeredShadows(false))
+            {
+                m_console->print("Layered shadows disabled.");
+            }
+            else
+            {
+                m_console->print("Failed to disable layered shadows.");
+            }
+        }
+        else
+        {
+            m_console->print("layered_shadows: unknown argument - \"" + words[1] + "\"");
+        }
+
+        return;
+    }
+
+    if("terrain_radius" == words[0])
+    {
+        if(words.size() != 2)
+        {
+            m_console->print("terrain_radius: command expects exactly 1 argument.");
+            return;
+        }
+
+        const float radius = static_cast<float>(std::atof(words[1].c_str()));
+
+        m_scene->terrain().setStreamingRadius(radius);
+        m_console->print(std::format("Terrain streaming radius set to {}", radius));
+        return;
+    }
+
+    if("terrain_budget" == words[0])
+    {
+        if(words.size() != 2)
+        {
+            m_console->print("terrain_budget: command expects exactly 1 argument.");
+            return;
+        }
+
+        const uint32_t slot_count = static_cast<uint32_t>(std::atoi(words[1].c_str()));
+
+        m_scene->terrain().setHeightmapBudget(*m_renderer, slot_count);
+        m_console->print(std::format("Terrain heightmap budget set to {} patches", m_scene->terrain().heightmapBudget()));
+        return;
+    }
+
+    if("terrain_vt_pages" == words[0])
+    {
+        m_console->print(std::format("{} terrain virtual texture pages resident", m_scene->terrain().residentVirtualTexturePages()));
+        return;
+    }
+
+#if EDITOR_ENABLE
+    if("terrain_vt_bake" == words[0])
+    {
+        m_scene->terrain().bakeVirtualTexture(*m_renderer);
+        m_console->print("Terrain virtual texture baked");
+        return;
+    }
+
+    if("terrain_generate" == words[0])
+    {
+        if((words.size() != 3) && (words.size() != 4))
+        {
+            m_console->print("terrain_generate: command expects 2 or 3 arguments - patch count, size and an optional seed.");
+            return;
+        }
+
+        const uint32_t patch_count = static_cast<uint32_t>(std::atoi(words[1].c_str()));
+        const float size = static_cast<float>(std::atof(words[2].c_str()));
+        const uint32_t seed = (words.size() == 4) ? static_cast<uint32_t>(std::atoi(words[3].c_str())) : 0;
+
+        if((patch_count == 0) || (size <= 0.0f))
+        {
+            m_console->print("terrain_generate: patch count and size have to be greater than 0.");
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        m_scene->terrain().generate(*m_renderer, patch_count, size, seed);
+        const auto end = std::chrono::steady_clock::now();
+
+        m_console->print(std::format("Generated a {}x{} patch terrain in {:.3f}s", patch_count, patch_count, std::chrono::duration<double>(end - start).count()));
+        return;
+    }
+#endif
+
+    if("terrain_shadow_tess" == words[0])
+    {
+        if(words.size() != 3)
+        {
+            m_console->print("terrain_shadow_tess: command expects exactly 2 arguments.");
+            return;
+        }
+
+        const uint32_t cascade = static_cast<uint32_t>(std::atoi(words[1].c_str()));
+        const float scale = static_cast<float>(std::atof(words[2].c_str()));
+
+        if(cascade >= MAX_DIR_SHADOW_MAP_PARTITIONS)
+        {
+            m_console->print(std::format("terrain_shadow_tess: cascade has to be less than {}.", MAX_DIR_SHADOW_MAP_PARTITIONS));
+            return;
+        }
+
+        m_renderer->setTerrainShadowTessScale(cascade, scale);
+        m_console->print(std::format("Terrain tessellation scale of shadow cascade {} set to {}", cascade, scale));
+        return;
+    }
+
+    if("terrain_shadow_mesh" == words[0])
+    {
+        if(words.size() != 2)
+        {
+            m_console->print("terrain_shadow_mesh: command expects exactly 1 argument.");
+            return;
+        }
+
+        if("off" == words[1])
+        {
+            m_renderer->setTerrainShadowMeshCascade(MAX_DIR_SHADOW_MAP_PARTITIONS);
+            m_console->print("Terrain shadow mesh disabled.");
+            return;
+        }
+
+        const uint32_t cascade = static_cast<uint32_t>(std::atoi(words[1].c_str()));
+
+        m_renderer->setTerrainShadowMeshCascade(cascade);
+        m_console->print(std::format("Terrain shadow mesh drawn from shadow cascade {} on", m_renderer->terrainShadowMeshCascade()));
+        return;
+    }
+
+    if(("mesh_lod_bias" == words[0]) || ("mesh_shadow_lod_bias" == words[0]))
+    {
+        if(words.size() != 2)
+        {
+            m_console->print(std::format("{}: command expects exactly 1 argument.", words[0]));
+            return;
+        }
+
+        const float bias = static_cast<float>(std::atof(words[1].c_str()));
+
+        if("mesh_lod_bias" == words[0])
+        {
+            m_renderer->setMeshLodBias(bias);
+            m_console->print(std::format("Mesh lods allow {} pixels of error", m_renderer->meshLodPixelError()));
+        }
+        else
+        {
+            m_renderer->setMeshShadowLodBias(bias);
+            m_console->print(std::format("Mesh lods allow {} pixels of error in the shadow maps", m_renderer->meshShadowLodPixelError()));
+        }
+
+        return;
+    }
+
+    //times random picking rays and character sized collision boxes against the terrain, and checks the batched collisions against the single ones
+    if("terrain_benchmark" == words[0])
+    {
+        if(words.size() > 2)
+        {
+            m_console->print("terrain_benchmark: command expects at most 1 argument.");
+            return;
+        }
+
+        const uint32_t query_count = (words.size() == 2) ? static_cast<uint32_t>(std::atoi(words[1].c_str())) : 10000;
+        const Terrain& terrain = m_scene->terrain();
+        const float half_size = 0.5f * terrain.size();
+
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<float> pos_dist(-half_size, half_size);
+        std::uniform_real_distribution<float> height_dist(-50.0f, 50.0f);
+        std::uniform_real_distribution<float> dir_dist(-1.0f, 1.0f);
+
+        std::vector<Ray> rays(query_count);
+        std::vector<AABB> boxes(query_count);
+
+        for(uint32_t i = 0; i < query_count; i++)
+        {
+            rays[i] = Ray(vec3(pos_dist(rng), 100.0f, pos_dist(rng)), glm::normalize(vec3(dir_dist(rng), -1.0f, dir_dist(rng))));
+
+            const vec3 box_min(pos_dist(rng), height_dist(rng), pos_dist(rng));
+            boxes[i] = AABB(box_min, box_min + vec3(0.5f, 1.8f, 0.5f));
+        }
+
+        uint32_t hit_count = 0;
+        const auto rays_start = std::chrono::steady_clock::now();
+
+        for(const auto& ray : rays)
+        {
+            float d;
+            hit_count += terrain.rayIntersection(ray, d);
+        }
+
+        const auto boxes_start = std::chrono::steady_clock::now();
+        uint32_t collision_count = 0;
+
+        std::vector<float> dhs(query_count);
+
+        for(uint32_t i = 0; i < query_count; i++)
+        {
+            dhs[i] = terrain.collision(boxes[i], 0.5f);
+            collision_count += (dhs[i] > 0.5f);
+        }
+
+        const auto batch_start = std::chrono::steady_clock::now();
+
+        std::vector<float> batch_dhs(query_count);
+        terrain.collision(boxes, 0.5f, batch_dhs);
+
+        const auto end = std::chrono::steady_clock::now();
+
+        //the batch has to give exactly the same results as the boxes one by one
+        const auto mismatch_count = std::ranges::count_if(std::views::iota(0u, query_count), [&](uint32_t i){ return dhs[i] != batch_dhs[i]; });
+
+        m_console->print(std::format("{} rays: {:.3f}ms, {} hits", query_count, std::chrono::duration<double, std::milli>(boxes_start - rays_start).count(), hit_count));
+        m_console->print(std::format("{} boxes: {:.3f}ms, {} collisions", query_count, std::chrono::duration<double, std::milli>(batch_start - boxes_start).count(), collision_count));
+        m_console->print(std::format("{} boxes batched: {:.3f}ms, {} mismatches", query_count, std::chrono::duration<double, std::milli>(end - batch_start).count(), mismatch_count));
+
+        if(mismatch_count != 0)
+        {
+            error(std::format("terrain_benchmark: {} of {} batched terrain collisions differ from the single ones.", mismatch_count, query_count));
+        }
+
+        return;
+    }
+
+    //times reading the scene's mesh files one after another against reading them on all cores
+    if("mesh_load_benchmark" == words[0])
+    {
+        const auto result = m_scene->meshManager().benchmarkLoading();
+        m_console->print(std::format("{} meshes: serial {:.3f}ms, parallel {:.3f}ms", result.mesh_count, result.serial_ms, result.parallel_ms));
+        return;
+    }
+
+    //times the quadtree culling against a frustum test per patch, from the current camera position
+    if("terrain_cull_benchmark" == words[0])
+    {
+        for(const auto& result : m_scene->terrain().benchmarkCulling(*m_renderer))
+        {
+            m_console->print(std::format("{}x{} patches: quadtree {:.3f}ms ({} nodes, {} patches selected), per patch {:.3f}ms ({} patches visible)",
+                                         result.patch_count, result.patch_count, result.quadtree_ms, result.quadtree_node_count, result.selected_patch_count,
+                                         result.per_patch_ms, result.visible_patch_count));
+        }
+
+        return;
+    }
+
     m_console->print(words[0] + ": unknown command.");
 }
 
@@ -285,6 +556,16 @@ void Game::run()
             }
         }
 
+        //the views have to be known before drawing, so that geometry can be culled against the camera and shadow map frusta
+#if EDITOR_ENABLE
+        if(m_edit_mode)
+        {
+            m_renderer->updateViews(m_editor->camera());
+        }
+        else
+#endif
+        m_renderer->updateViews(m_gameplay->camera());
+
         RenderData render_data;
 #if EDITOR_ENABLE
         if(m_edit_mode)
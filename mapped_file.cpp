@@ -0,0 +1,168 @@
+#include "mapped_file.h"
+#include "game_utils.h"
+#include <format>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#ifdef _WIN32
+void MappedFile::open(const std::string& filename)
+{
+    close();
+
+    m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(INVALID_HANDLE_VALUE == m_file)
+    {
+        m_file = nullptr;
+        error(std::format("Failed to open file {}.", filename));
+    }
+
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(m_file, &file_size) || (0 == file_size.QuadPart))
+    {
+        close();
+        error(std::format("Failed to get the size of file {}.", filename));
+    }
+
+    m_mapping = CreateFileMappingA(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    if(!m_mapping)
+    {
+        close();
+        error(std::format("Failed to create a file mapping for {}.", filename));
+    }
+
+    m_data = static_cast<uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0));
+    if(!m_data)
+    {
+        close();
+        error(std::format("Failed to map file {}.", filename));
+    }
+
+    m_size = static_cast<uint64_t>(file_size.QuadPart);
+}
+
+void MappedFile::close() noexcept
+{
+    if(m_data)
+    {
+        UnmapViewOfFile(m_data);
+    }
+
+    if(m_mapping)
+    {
+        CloseHandle(m_mapping);
+    }
+
+    if(m_file)
+    {
+        CloseHandle(m_file);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+    m_file = nullptr;
+}
+#elif defined(__linux__)
+void MappedFile::open(const std::string& filename)
+{
+    close();
+
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        error(std::format("Failed to open file {}.", filename));
+    }
+
+    struct stat file_stat;
+    if((fstat(fd, &file_stat) != 0) || (0 == file_stat.st_size))
+    {
+        ::close(fd);
+        error(std::format("Failed to get the size of file {}.", filename));
+    }
+
+    //the mapping keeps its own reference to the file, so the descriptor isn't needed past this point
+    void* data = mmap(NULL, file_stat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if(MAP_FAILED == data)
+    {
+        error(std::format("Failed to map file {}.", filename));
+    }
+
+    m_data = static_cast<uint8_t*>(data);
+    m_size = static_cast<uint64_t>(file_stat.st_size);
+}
+
+void MappedFile::close() noexcept
+{
+    if(m_data)
+    {
+        munmap(m_data, m_size);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+}
+#endif
+
+bool MappedFile::isOpen() const noexcept
+{
+    return m_data != nullptr;
+}
+
+uint64_t MappedFile::pageSize() noexcept
+{
+    static const uint64_t page_size = []
+    {
+#ifdef _WIN32
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        return static_cast<uint64_t>(system_info.dwPageSize);
+#elif defined(__linux__)
+        return static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }();
+
+    return page_size;
+}
+
+void MappedFile::pageIn(uint64_t offset, uint64_t size) const noexcept
+{
+    const uint64_t page_size = pageSize();
+
+#if defined(__linux__)
+    //madvise wants a page aligned address, the page size is always a power of 2
+    const uint64_t page_offset = offset & ~(page_size - 1);
+    madvise(m_data + page_offset, offset + size - page_offset, MADV_WILLNEED);
+#endif
+
+    //touching every page makes sure it's resident by the time this returns
+    volatile uint8_t page_byte;
+    for(uint64_t i = offset; i < offset + size; i += page_size)
+    {
+        page_byte = m_data[i];
+    }
+}
+
+uint8_t* MappedFile::data() const noexcept
+{
+    return m_data;
+}
+
+uint64_t MappedFile::size() const noexcept
+{
+    return m_size;
+}
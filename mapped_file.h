@@ -0,0 +1,40 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstdint>
+
+//maps a whole file into memory copy-on-write - the pages are only read from disk when they're first accessed and can be
+//evicted by the OS again, writes stay private to the process and never make it back to the file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void open(const std::string& filename);
+    void close() noexcept;
+    bool isOpen() const noexcept;
+
+    //blocks until the given range is read into memory, meant to be called from a worker thread
+    void pageIn(uint64_t offset, uint64_t size) const noexcept;
+
+    uint8_t* data() const noexcept;
+    uint64_t size() const noexcept;
+
+    //the granularity the OS pages files in with, queried once
+    static uint64_t pageSize() noexcept;
+
+private:
+    uint8_t* m_data = nullptr;
+    uint64_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#endif
+};
+
+#endif // MAPPED_FILE_H
@@ -1,154 +1,608 @@
 #include "mesh.h"
 #include <fstream>
+#include <filesystem>
+#include <cstring>
+#include <limits>
+#include <exception>
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include "game_utils.h"
+#include "parallel.h"
+#include "mesh_optimizer.h"
+#include "asset_cache.h"
 
-AnimatedMeshData readAnimatedMeshData(std::ifstream& mesh_file, uint8_t bone_count)
+//the chunk has to be in bounds and aligned for T, the file could've been truncated or hand edited
+template<typename T>
+static std::span<const T> chunkPayload(std::span<const uint8_t> file, std::string_view filename, uint64_t offset, uint64_t count)
 {
-    AnimatedMeshData anim_data;
+    if((offset > file.size()) || (count > (file.size() - offset) / sizeof(T)) || ((offset % alignof(T)) != 0))
+    {
+        error(std::format("Mesh file {} is corrupted.", filename));
+    }
+
+    return std::span<const T>(reinterpret_cast<const T*>(file.data() + offset), count);
+}
 
-    anim_data.bone_count = bone_count;
-    anim_data.bone_parent_ids.resize(anim_data.bone_count);
-    mesh_file.read(reinterpret_cast<char*>(anim_data.bone_parent_ids.data()), anim_data.bone_count * sizeof(int8_t));
+template<typename T>
+static T readValue(std::ifstream& file)
+{
+    T value{};
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
 
-    anim_data.bone_offset_transforms.resize(anim_data.bone_count);
-    mesh_file.read(reinterpret_cast<char*>(anim_data.bone_offset_transforms.data()), anim_data.bone_count * sizeof(mat4x4));
+static std::string readName(std::ifstream& file)
+{
+    std::string name(readValue<uint8_t>(file), '\0');
+    file.read(name.data(), name.size());
+    return name;
+}
 
-    anim_data.bone_to_root_transforms.resize(anim_data.bone_count);
-    for(uint32_t bone_id = 0; bone_id < anim_data.bone_count; bone_id++)
+//a lod that doesn't get rid of at least this much of the one before it isn't worth switching to, locked seams and borders can stop the simplifier early
+static constexpr float MAX_LOD_INDEX_RATIO = 0.8f;
+
+//every lod is simplified from the full detail mesh so the errors don't pile up, its indices are added after the ones of the lod before it
+static std::vector<MeshLod> generateLods(std::vector<uint32_t>& indices, std::span<const VertexDefault> vertices, const vec3& pos_offset, const vec3& pos_scale)
+{
+    //the quadrics have to be built in mesh units, a quantized unit isn't as long on every axis
+    std::vector<vec3> positions(vertices.size());
+
+    for(size_t i = 0; i < vertices.size(); i++)
     {
-        anim_data.bone_to_root_transforms[bone_id] = inverse(anim_data.bone_offset_transforms[bone_id]);
+        positions[i] = pos_offset + vec3(vertices[i].pos.x, vertices[i].pos.y, vertices[i].pos.z) / 65535.0f * pos_scale;
     }
 
-    uint8_t pose_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&pose_count), sizeof(uint8_t));
+    const uint32_t full_index_count = indices.size();
+    std::vector<MeshLod> lods{MeshLod{0, full_index_count, 0.0f}};
 
-    for(uint8_t pose = 0; pose < pose_count; pose++)
+    while((lods.size() < MAX_MESH_LOD_COUNT) && (lods.back().index_count != 0))
     {
-        uint8_t name_length;
-        mesh_file.read(reinterpret_cast<char*>(&name_length), sizeof(uint8_t));
-        std::string name(name_length, '\0');
-        mesh_file.read(reinterpret_cast<char*>(name.data()), name_length);
+        const uint32_t target_index_count = lods.back().index_count / 6 * 3;
+        float lod_error = 0.0f;
+        auto lod_indices = simplifyMesh(std::span(indices.data(), full_index_count), positions, target_index_count, lod_error);
+
+        if(lod_indices.empty() || (lod_indices.size() > MAX_LOD_INDEX_RATIO * lods.back().index_count))
+        {
+            break;
+        }
+
+        optimizeVertexCache(lod_indices, vertices.size());
 
-        anim_data.poses[name.c_str()].resize(anim_data.bone_count);
-        mesh_file.read(reinterpret_cast<char*>(anim_data.poses[name.c_str()].data()), anim_data.bone_count * sizeof(KeyFrame));
+        //the errors are estimates, a coarser lod must never claim to be closer than a finer one or the selection would skip over it
+        lods.push_back(MeshLod{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod_indices.size()), std::max(lod_error, lods.back().error)});
+        indices.insert(indices.end(), lod_indices.begin(), lod_indices.end());
     }
 
-    uint8_t animation_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&animation_count), sizeof(uint8_t));
+    return lods;
+}
+
+std::vector<uint8_t> MeshManager::bakeMeshFile(const std::string& filename)
+{
+    std::ifstream old_file(filename, std::ios::binary);
+
+    if(!old_file)
+    {
+        error(std::format("Failed to open mesh file: {}", filename));
+    }
+
+    struct Chunk
+    {
+        ChunkType type;
+        uint32_t key_frame_count = 0;
+        std::string name;
+        std::vector<uint8_t> payload;
+    };
+
+    std::vector<Chunk> chunks;
+
+    auto add_chunk = [&](ChunkType type, std::string name, uint64_t size, uint32_t key_frame_count = 0) -> uint8_t*
+    {
+        auto& chunk = chunks.emplace_back(type, key_frame_count, std::move(name));
+        chunk.payload.resize(size);
+        return chunk.payload.data();
+    };
+
+    const uint64_t old_file_size = std::filesystem::file_size(filename);
+    uint32_t bone_count = 0;
+    FileHeader header{};
+    old_file.read(reinterpret_cast<char*>(&header), sizeof(FileHeader));
+
+    if(old_file && (header.magic == MESH_FILE_MAGIC))
+    {
+        //version 2 has the same chunks, just never any indices
+        bone_count = header.bone_count;
+        std::vector<ChunkInfo> chunk_infos(std::min<uint64_t>(header.chunk_count, old_file_size / sizeof(ChunkInfo)));
+        old_file.read(reinterpret_cast<char*>(chunk_infos.data()), chunk_infos.size() * sizeof(ChunkInfo));
+
+        for(const auto& chunk : chunk_infos)
+        {
+            if((chunk.offset > old_file_size) || (chunk.size > old_file_size - chunk.offset) || (chunk.name_offset > old_file_size) || (chunk.name_length > old_file_size - chunk.name_offset))
+            {
+                error(std::format("Mesh file {} is corrupted.", filename));
+            }
+
+            std::string name(chunk.name_length, '\0');
+            old_file.seekg(chunk.name_offset);
+            old_file.read(name.data(), name.size());
 
-    for(uint8_t anim = 0; anim < animation_count; anim++)
+            auto payload = add_chunk(chunk.type, std::move(name), chunk.size, chunk.key_frame_count);
+            old_file.seekg(chunk.offset);
+            old_file.read(reinterpret_cast<char*>(payload), chunk.size);
+        }
+    }
+    else
     {
-        uint8_t name_length;
-        mesh_file.read(reinterpret_cast<char*>(&name_length), sizeof(uint8_t));
-        std::string name(name_length, '\0');
-        mesh_file.read(reinterpret_cast<char*>(name.data()), name_length);
+        old_file.clear();
+        old_file.seekg(0);
 
-        uint8_t keyframe_count = 0;
-        mesh_file.read(reinterpret_cast<char*>(&keyframe_count), sizeof(uint8_t));
-        anim_data.animations[name.c_str()].key_frame_times.resize(keyframe_count);
-        mesh_file.read(reinterpret_cast<char*>(anim_data.animations[name.c_str()].key_frame_times.data()), keyframe_count * sizeof(float));
+        bone_count = readValue<uint8_t>(old_file);
 
-        anim_data.animations[name.c_str()].key_frames.resize(anim_data.bone_count);
+        if(bone_count != 0)
+        {
+            old_file.read(reinterpret_cast<char*>(add_chunk(ChunkType::BoneParents, "", bone_count * sizeof(int8_t))), bone_count * sizeof(int8_t));
+            old_file.read(reinterpret_cast<char*>(add_chunk(ChunkType::BoneOffsets, "", bone_count * sizeof(mat4x4))), bone_count * sizeof(mat4x4));
+
+            const uint8_t pose_count = readValue<uint8_t>(old_file);
 
-        for(auto& key_frames : anim_data.animations[name.c_str()].key_frames)
+            for(uint8_t pose = 0; pose < pose_count; pose++)
+            {
+                auto name = readName(old_file);
+                old_file.read(reinterpret_cast<char*>(add_chunk(ChunkType::Pose, std::move(name), bone_count * sizeof(KeyFrame))), bone_count * sizeof(KeyFrame));
+            }
+
+            const uint8_t animation_count = readValue<uint8_t>(old_file);
+
+            for(uint8_t anim = 0; anim < animation_count; anim++)
+            {
+                auto name = readName(old_file);
+                const uint8_t key_frame_count = readValue<uint8_t>(old_file);
+                const uint64_t times_size = key_frame_count * sizeof(float);
+                const uint64_t key_frames_size = uint64_t(bone_count) * key_frame_count * sizeof(KeyFrame);
+                //the key frames come bone by bone in both versions, so the whole block is copied as is
+                auto payload = add_chunk(ChunkType::Animation, std::move(name), roundUp(times_size, MESH_CHUNK_ALIGNMENT) + key_frames_size, key_frame_count);
+                old_file.read(reinterpret_cast<char*>(payload), times_size);
+                old_file.read(reinterpret_cast<char*>(payload + roundUp(times_size, MESH_CHUNK_ALIGNMENT)), key_frames_size);
+            }
+        }
+
+        if(auto texture_filename = readName(old_file); !texture_filename.empty())
         {
-            key_frames.resize(keyframe_count);
-            mesh_file.read(reinterpret_cast<char*>(key_frames.data()), keyframe_count * sizeof(KeyFrame));
+            add_chunk(ChunkType::Texture, std::move(texture_filename), 0);
         }
+
+        if(auto normal_map_filename = readName(old_file); !normal_map_filename.empty())
+        {
+            add_chunk(ChunkType::NormalMap, std::move(normal_map_filename), 0);
+        }
+
+        const uint64_t vertex_count = readValue<uint64_t>(old_file);
+        old_file.read(reinterpret_cast<char*>(add_chunk(ChunkType::Vertices, "", vertex_count * sizeof(VertexDefaultUnpacked))), vertex_count * sizeof(VertexDefaultUnpacked));
+
+        //the bounding volumes after the vertices were never used, they're dropped
+    }
+
+    if(!old_file)
+    {
+        error(std::format("Mesh file {} is corrupted.", filename));
     }
 
-    return anim_data;
+    old_file.close();
+
+    //the vertices are packed before they're indexed, vertices that only differed by less than the quantization step are merged too
+    if(std::ranges::find(chunks, ChunkType::PositionBounds, &Chunk::type) == chunks.end())
+    {
+        const auto vertex_chunk = std::ranges::find(chunks, ChunkType::Vertices, &Chunk::type);
+
+        if(vertex_chunk != chunks.end())
+        {
+            const std::span<const VertexDefaultUnpacked> vertices(reinterpret_cast<const VertexDefaultUnpacked*>(vertex_chunk->payload.data()), vertex_chunk->payload.size() / sizeof(VertexDefaultUnpacked));
+            std::array<vec3, 2> pos_bounds;
+            const auto packed_vertices = quantizeVertices(vertices, pos_bounds[0], pos_bounds[1]);
+
+            vertex_chunk->payload.resize(packed_vertices.size() * sizeof(VertexDefault));
+            std::memcpy(vertex_chunk->payload.data(), packed_vertices.data(), vertex_chunk->payload.size());
+            std::memcpy(add_chunk(ChunkType::PositionBounds, "", sizeof(pos_bounds)), pos_bounds.data(), sizeof(pos_bounds));
+        }
+    }
+
+    //the vertices are indexed if they aren't yet and the lods generated from the indices, then the triangles are reordered
+    //for the post transform cache and the vertices for fetching
+    const auto vertex_chunk = std::ranges::find(chunks, ChunkType::Vertices, &Chunk::type);
+    const auto pos_bounds_chunk = std::ranges::find(chunks, ChunkType::PositionBounds, &Chunk::type);
+
+    if((vertex_chunk != chunks.end()) && (std::ranges::find(chunks, ChunkType::Lods, &Chunk::type) == chunks.end()))
+    {
+        if((pos_bounds_chunk == chunks.end()) || (pos_bounds_chunk->payload.size() != 2 * sizeof(vec3)))
+        {
+            error(std::format("Mesh file {} is corrupted.", filename));
+        }
+
+        std::array<vec3, 2> pos_bounds;
+        std::memcpy(pos_bounds.data(), pos_bounds_chunk->payload.data(), sizeof(pos_bounds));
+
+        std::vector<VertexDefault> vertices(vertex_chunk->payload.size() / sizeof(VertexDefault));
+        std::memcpy(vertices.data(), vertex_chunk->payload.data(), vertices.size() * sizeof(VertexDefault));
+        std::vector<uint32_t> indices;
+
+        const auto index_chunk = std::ranges::find_if(chunks, [](const Chunk& chunk){ return (chunk.type == ChunkType::Indices16) || (chunk.type == ChunkType::Indices32); });
+
+        if(index_chunk == chunks.end())
+        {
+            std::vector<VertexDefault> unique_vertices;
+            indices = indexVertices(vertices, unique_vertices);
+            vertices = std::move(unique_vertices);
+            optimizeVertexCache(indices, vertices.size());
+        }
+        else
+        {
+            if(index_chunk->type == ChunkType::Indices16)
+            {
+                const auto indices16 = reinterpret_cast<const uint16_t*>(index_chunk->payload.data());
+                indices.assign(indices16, indices16 + index_chunk->payload.size() / sizeof(uint16_t));
+            }
+            else
+            {
+                indices.resize(index_chunk->payload.size() / sizeof(uint32_t));
+                std::memcpy(indices.data(), index_chunk->payload.data(), indices.size() * sizeof(uint32_t));
+            }
+
+            if((indices.size() % 3 != 0) || std::ranges::any_of(indices, [&](uint32_t index){ return index >= vertices.size(); }))
+            {
+                error(std::format("Mesh file {} is corrupted.", filename));
+            }
+        }
+
+        //the simplifier only looks at the positions, it would merge vertices skinned to different bones and tear the mesh apart
+        //once it's animated, so skinned meshes only get their full detail lod
+        const auto lods = (bone_count == 0) ? generateLods(indices, vertices, pos_bounds[0], pos_bounds[1])
+                                            : std::vector<MeshLod>{MeshLod{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+        optimizeVertexFetch(indices, vertices);
+
+        vertex_chunk->payload.resize(vertices.size() * sizeof(VertexDefault));
+        std::memcpy(vertex_chunk->payload.data(), vertices.data(), vertex_chunk->payload.size());
+
+        if(index_chunk != chunks.end())
+        {
+            chunks.erase(index_chunk);
+        }
+
+        if(vertices.size() <= std::numeric_limits<uint16_t>::max() + 1u)
+        {
+            auto indices16 = reinterpret_cast<uint16_t*>(add_chunk(ChunkType::Indices16, "", indices.size() * sizeof(uint16_t)));
+            std::ranges::copy(indices, indices16);
+        }
+        else
+        {
+            std::memcpy(add_chunk(ChunkType::Indices32, "", indices.size() * sizeof(uint32_t)), indices.data(), indices.size() * sizeof(uint32_t));
+        }
+
+        std::memcpy(add_chunk(ChunkType::Lods, "", lods.size() * sizeof(MeshLod)), lods.data(), lods.size() * sizeof(MeshLod));
+    }
+    else if(const auto lod_chunk = std::ranges::find(chunks, ChunkType::Lods, &Chunk::type); (bone_count != 0) && (lod_chunk != chunks.end()))
+    {
+        //version 5 files of skinned meshes have simplified lods too, only the full detail one is kept, it comes first
+        lod_chunk->payload.resize(std::min(lod_chunk->payload.size(), sizeof(MeshLod)));
+    }
+
+    //names go right after the chunk table, the payloads after them
+    std::vector<ChunkInfo> chunk_infos(chunks.size());
+    uint64_t offset = sizeof(FileHeader) + chunks.size() * sizeof(ChunkInfo);
+
+    for(uint32_t i = 0; i < chunks.size(); i++)
+    {
+        chunk_infos[i].type = chunks[i].type;
+        chunk_infos[i].key_frame_count = chunks[i].key_frame_count;
+        chunk_infos[i].name_offset = offset;
+        chunk_infos[i].name_length = chunks[i].name.size();
+        offset += chunks[i].name.size();
+    }
+
+    for(uint32_t i = 0; i < chunks.size(); i++)
+    {
+        offset = roundUp(offset, MESH_CHUNK_ALIGNMENT);
+        chunk_infos[i].offset = offset;
+        chunk_infos[i].size = chunks[i].payload.size();
+        offset += chunks[i].payload.size();
+    }
+
+    //the padding between the payloads stays zeroed
+    std::vector<uint8_t> baked(offset, 0);
+
+    const FileHeader header{MESH_FILE_MAGIC, MESH_FILE_VERSION, static_cast<uint32_t>(chunks.size()), bone_count};
+    std::memcpy(baked.data(), &header, sizeof(FileHeader));
+    std::memcpy(baked.data() + sizeof(FileHeader), chunk_infos.data(), chunk_infos.size() * sizeof(ChunkInfo));
+
+    for(uint32_t i = 0; i < chunks.size(); i++)
+    {
+        std::ranges::copy(chunks[i].name, baked.begin() + chunk_infos[i].name_offset);
+        std::ranges::copy(chunks[i].payload, baked.begin() + chunk_infos[i].offset);
+    }
+
+    return baked;
 }
 
-MeshData MeshManager::readMeshData(Renderer& renderer, std::ifstream& mesh_file)
+void MeshManager::readMeshFile(LoadedMeshFile& mesh_file)
 {
-    MeshData mesh_data;
+    //the source files are never touched, whatever version they are they're converted into the asset cache once and loaded from there
+    const auto& filename = mesh_file.filename;
+    mesh_file.file = AssetCache::load(filename, "mesh", MESH_FILE_VERSION, [&]{ return bakeMeshFile(filename); });
+    const auto file = mesh_file.file->data();
+
+    FileHeader header{};
 
-    uint8_t texture_filename_length = 0;
-    mesh_file.read(reinterpret_cast<char*>(&texture_filename_length), sizeof(uint8_t));
+    if(file.size() >= sizeof(FileHeader))
+    {
+        std::memcpy(&header, file.data(), sizeof(FileHeader));
+    }
 
-    if(texture_filename_length > 0)
+    if((header.magic != MESH_FILE_MAGIC) || (header.version != MESH_FILE_VERSION) || (header.bone_count > std::numeric_limits<uint8_t>::max()))
     {
-        std::string texture_filename;
-        texture_filename.resize(texture_filename_length);
-        mesh_file.read(reinterpret_cast<char*>(texture_filename.data()), texture_filename_length);
-        mesh_data.tex_id = renderer.loadTexture(texture_filename);
+        error(std::format("Mesh file {} is corrupted.", filename));
     }
 
-    uint8_t normal_map_filename_length = 0;
-    mesh_file.read(reinterpret_cast<char*>(&normal_map_filename_length), sizeof(uint8_t));
+    const auto chunk_infos = chunkPayload<ChunkInfo>(file, filename, sizeof(FileHeader), header.chunk_count);
 
-    if(normal_map_filename_length > 0)
+    auto& anim_data = mesh_file.anim_data;
+    anim_data.bone_count = header.bone_count;
+
+    for(const auto& chunk : chunk_infos)
     {
-        std::string normal_map_filename;
-        normal_map_filename.resize(normal_map_filename_length);
-        mesh_file.read(reinterpret_cast<char*>(normal_map_filename.data()), normal_map_filename_length);
-        mesh_data.normal_map_id = renderer.loadNormalMap(normal_map_filename);
+        const auto name_chars = chunkPayload<char>(file, filename, chunk.name_offset, chunk.name_length);
+        std::string name(name_chars.begin(), name_chars.end());
+
+        switch(chunk.type)
+        {
+        case ChunkType::Texture:
+            mesh_file.texture_filename = std::move(name);
+            break;
+        case ChunkType::NormalMap:
+            mesh_file.normal_map_filename = std::move(name);
+            break;
+        case ChunkType::Vertices:
+            mesh_file.vertices = chunkPayload<VertexDefault>(file, filename, chunk.offset, chunk.size / sizeof(VertexDefault));
+            //the renderer copies the vertices out of the mapping on the next frame, reading them in here keeps that from stalling on the disk
+            mesh_file.file->pageIn(chunk.offset, mesh_file.vertices.size_bytes());
+            break;
+        case ChunkType::Indices16:
+            mesh_file.indices16 = chunkPayload<uint16_t>(file, filename, chunk.offset, chunk.size / sizeof(uint16_t));
+            break;
+        case ChunkType::Indices32:
+            mesh_file.indices32 = chunkPayload<uint32_t>(file, filename, chunk.offset, chunk.size / sizeof(uint32_t));
+            break;
+        case ChunkType::PositionBounds:
+            mesh_file.pos_bounds = chunkPayload<vec3>(file, filename, chunk.offset, 2);
+            break;
+        case ChunkType::Lods:
+            mesh_file.lods = chunkPayload<MeshLod>(file, filename, chunk.offset, chunk.size / sizeof(MeshLod));
+            break;
+        case ChunkType::BoneParents:
+            anim_data.bone_parent_ids = chunkPayload<int8_t>(file, filename, chunk.offset, anim_data.bone_count);
+            break;
+        case ChunkType::BoneOffsets:
+            anim_data.bone_offset_transforms = chunkPayload<mat4x4>(file, filename, chunk.offset, anim_data.bone_count);
+            break;
+        case ChunkType::Pose:
+            anim_data.poses[name] = chunkPayload<KeyFrame>(file, filename, chunk.offset, anim_data.bone_count);
+            break;
+        case ChunkType::Animation:
+        {
+            auto& animation = anim_data.animations[name];
+            animation.key_frame_times = chunkPayload<float>(file, filename, chunk.offset, chunk.key_frame_count);
+            const auto key_frames = chunkPayload<KeyFrame>(file, filename, chunk.offset + roundUp(animation.key_frame_times.size_bytes(), MESH_CHUNK_ALIGNMENT),
+                                                           uint64_t(anim_data.bone_count) * chunk.key_frame_count);
+
+            animation.key_frames.resize(anim_data.bone_count);
+
+            for(uint32_t bone_id = 0; bone_id < anim_data.bone_count; bone_id++)
+            {
+                animation.key_frames[bone_id] = key_frames.subspan(bone_id * chunk.key_frame_count, chunk.key_frame_count);
+            }
+            break;
+        }
+        default:
+            //chunks from newer exporters are skipped
+            break;
+        }
     }
 
-    uint64_t vertex_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&vertex_count), sizeof(uint64_t));
+    //an index past the vertices would read another mesh's vertices, or past the end of the vertex buffer
+    const auto index_out_of_range = [&](uint32_t index){ return index >= mesh_file.vertices.size(); };
+    const uint64_t index_count = std::max(mesh_file.indices16.size(), mesh_file.indices32.size());
+    const auto lod_out_of_range = [&](const MeshLod& lod){ return (uint64_t(lod.first_index) + lod.index_count > index_count) || (lod.index_count % 3 != 0); };
 
-    mesh_data.vertex_data.resize(vertex_count);
-    mesh_file.read(reinterpret_cast<char*>(mesh_data.vertex_data.data()), vertex_count * sizeof(VertexDefault));
+    if(std::ranges::any_of(mesh_file.indices16, index_out_of_range) || std::ranges::any_of(mesh_file.indices32, index_out_of_range)
+       || (!mesh_file.vertices.empty() && mesh_file.pos_bounds.empty())
+       || ((index_count != 0) && mesh_file.lods.empty()) || (mesh_file.lods.size() > MAX_MESH_LOD_COUNT) || std::ranges::any_of(mesh_file.lods, lod_out_of_range))
+    {
+        error(std::format("Mesh file {} is corrupted.", filename));
+    }
 
-    mesh_data.vb_alloc = renderer.reqVBAlloc<VertexDefault>(vertex_count);
-    renderer.updateVertexData(mesh_data.vb_alloc.vb, mesh_data.vb_alloc.data_offset, sizeof(VertexDefault) * vertex_count, mesh_data.vertex_data.data());
-#if EDITOR_ENABLE
-    m_mesh_data_size += vertex_count * sizeof(VertexDefault);
-#endif
+    if(anim_data.bone_count != 0)
+    {
+        if((anim_data.bone_parent_ids.size() != anim_data.bone_count) || (anim_data.bone_offset_transforms.size() != anim_data.bone_count))
+        {
+            error(std::format("Mesh file {} is corrupted.", filename));
+        }
 
-    /*------ TODO: REMOVE AFTER REMOVED FROM EXPORT SCRIPT --------*/
-    Sphere bounding_sphere;
-    mesh_file.read(reinterpret_cast<char*>(&bounding_sphere), sizeof(Sphere));
+        anim_data.bone_to_root_transforms.resize(anim_data.bone_count);
+        for(uint32_t bone_id = 0; bone_id < anim_data.bone_count; bone_id++)
+        {
+            anim_data.bone_to_root_transforms[bone_id] = inverse(anim_data.bone_offset_transforms[bone_id]);
+        }
+    }
+}
+
+MeshManager::LoadBenchmarkResult MeshManager::benchmarkLoading() const
+{
+    std::vector<std::string> filenames;
+
+    for(const auto& mesh_data : m_mesh_data)
+    {
+        filenames.emplace_back(mesh_data.first);
+    }
 
-    uint8_t aabb_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&aabb_count), sizeof(uint8_t));
-    std::vector<AABB> aabbs(aabb_count);
-    mesh_file.read(reinterpret_cast<char*>(aabbs.data()), aabb_count * sizeof(AABB));
+    for(const auto& mesh_data : m_animated_mesh_data)
+    {
+        filenames.emplace_back(mesh_data.first);
+    }
 
-    uint8_t bb_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&bb_count), sizeof(uint8_t));
-    std::vector<BoundingBox> bbs(bb_count);
-    mesh_file.read(reinterpret_cast<char*>(bbs.data()), bb_count * sizeof(BoundingBox));
+    //every pass maps the files again, they're only unmapped once the time is taken
+    auto time_reading = [&](bool parallel)
+    {
+        std::vector<LoadedMeshFile> mesh_files(filenames.size());
 
-    uint8_t sphere_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&sphere_count), sizeof(uint8_t));
-    std::vector<Sphere> spheres(sphere_count);
-    mesh_file.read(reinterpret_cast<char*>(spheres.data()), sphere_count * sizeof(Sphere));
+        for(size_t i = 0; i < filenames.size(); i++)
+        {
+            mesh_files[i].filename = filenames[i];
+        }
 
-    /*-------------------------------------------------------------*/
+        const auto start = std::chrono::steady_clock::now();
 
-    return mesh_data;
+        if(parallel)
+        {
+            parallelFor(static_cast<uint32_t>(mesh_files.size()), [&](uint32_t i){ readMeshFile(mesh_files[i]); });
+        }
+        else
+        {
+            for(auto& mesh_file : mesh_files)
+            {
+                readMeshFile(mesh_file);
+            }
+        }
+
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    };
+
+    LoadBenchmarkResult result;
+    result.mesh_count = static_cast<uint32_t>(filenames.size());
+    result.serial_ms = time_reading(false);
+    result.parallel_ms = time_reading(true);
+
+    return result;
 }
 
 void MeshManager::loadMeshData(Renderer& renderer, std::string_view mesh_filename)
 {
-    std::ifstream mesh_file(mesh_filename.data(), std::ios::binary);
+    const std::string filename(mesh_filename);
+    loadMeshData(renderer, std::span<const std::string>(&filename, 1));
+}
+
+void MeshManager::loadMeshData(Renderer& renderer, std::span<const std::string> mesh_filenames)
+{
+    std::vector<LoadedMeshFile> mesh_files;
+    mesh_files.reserve(mesh_filenames.size());
 
-    if(!mesh_file)
+    for(const auto& filename : mesh_filenames)
     {
-        error(std::format("Failed to open mesh file: {}", mesh_filename));
+        //two threads converting the same old file would trample each other
+        if(!m_mesh_data.contains(filename) && !m_animated_mesh_data.contains(filename)
+           && std::ranges::none_of(mesh_files, [&](const auto& mesh_file){ return mesh_file.filename == filename; }))
+        {
+            mesh_files.emplace_back().filename = filename;
+        }
     }
 
-    uint8_t bone_count = 0;
-    mesh_file.read(reinterpret_cast<char*>(&bone_count), sizeof(uint8_t));
+    /*--- reading, conversion and paging in on all cores ---*/
+    std::vector<std::exception_ptr> exceptions(mesh_files.size());
+
+    parallelFor(static_cast<uint32_t>(mesh_files.size()), [&](uint32_t i)
+    {
+        try
+        {
+            readMeshFile(mesh_files[i]);
+        }
+        catch(...)
+        {
+            exceptions[i] = std::current_exception();
+        }
+    });
 
-    if(bone_count != 0)
+    for(const auto& exception : exceptions)
     {
-        auto anim_mesh_data = readAnimatedMeshData(mesh_file, bone_count);
-        auto mesh_data = readMeshData(renderer, mesh_file);
-        m_animated_mesh_data.emplace(std::move(mesh_data), std::move(anim_mesh_data));
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
     }
-    else
+
+    /*--- one batch of textures and normal maps ---*/
+    std::vector<std::string_view> texture_filenames;
+    std::vector<std::string_view> normal_map_filenames;
+
+    for(const auto& mesh_file : mesh_files)
     {
-        m_mesh_data.emplace(readMeshData(renderer, mesh_file));
+        if(!mesh_file.texture_filename.empty())
+        {
+            texture_filenames.emplace_back(mesh_file.texture_filename);
+        }
+
+        if(!mesh_file.normal_map_filename.empty())
+        {
+            normal_map_filenames.emplace_back(mesh_file.normal_map_filename);
+        }
     }
 
+    const auto tex_ids = renderer.loadTextures(texture_filenames);
+    const auto normal_map_ids = renderer.loadNormalMaps(normal_map_filenames);
+    uint32_t next_tex_id = 0;
+    uint32_t next_normal_map_id = 0;
+
+    /*--- vertex uploads, they're all copied to the GPU on the next frame ---*/
+    for(auto& mesh_file : mesh_files)
+    {
+        MeshData mesh_data;
+
+        if(!mesh_file.texture_filename.empty())
+        {
+            mesh_data.tex_id = tex_ids[next_tex_id++];
+        }
 
+        if(!mesh_file.normal_map_filename.empty())
+        {
+            mesh_data.normal_map_id = normal_map_ids[next_normal_map_id++];
+        }
+
+        mesh_data.vertex_count = mesh_file.vertices.size();
+
+        if(!mesh_file.pos_bounds.empty())
+        {
+            mesh_data.pos_offset = mesh_file.pos_bounds[0];
+            mesh_data.pos_scale = mesh_file.pos_bounds[1];
+        }
+
+        mesh_data.vb_alloc = renderer.reqVBAlloc<VertexDefault>(mesh_file.vertices.size());
+        renderer.updateVertexData(mesh_data.vb_alloc.vb, mesh_data.vb_alloc.data_offset, mesh_file.vertices.size_bytes(), mesh_file.vertices.data());
+
+        if(!mesh_file.indices16.empty())
+        {
+            mesh_data.lods = mesh_file.lods;
+            mesh_data.ib_alloc = renderer.reqIBAlloc<uint16_t>(mesh_file.indices16.size());
+            renderer.updateIndexData(mesh_data.ib_alloc.ib, mesh_data.ib_alloc.data_offset, mesh_file.indices16.size_bytes(), mesh_file.indices16.data());
+        }
+        else if(!mesh_file.indices32.empty())
+        {
+            mesh_data.lods = mesh_file.lods;
+            mesh_data.ib_alloc = renderer.reqIBAlloc<uint32_t>(mesh_file.indices32.size());
+            renderer.updateIndexData(mesh_data.ib_alloc.ib, mesh_data.ib_alloc.data_offset, mesh_file.indices32.size_bytes(), mesh_file.indices32.data());
+        }
 #if EDITOR_ENABLE
-    m_mesh_filenames.emplace_back(mesh_filename);
+        mesh_data.vertex_data = mesh_file.vertices;
+        m_mesh_data_size += mesh_file.vertices.size_bytes() + mesh_data.ib_alloc.size;
+        m_mesh_filenames.emplace_back(mesh_file.filename);
 #endif
+
+        if(mesh_file.anim_data.bone_count != 0)
+        {
+            m_animated_mesh_data.emplace(std::piecewise_construct, std::forward_as_tuple(mesh_file.filename), std::forward_as_tuple(std::move(mesh_data), std::move(mesh_file.anim_data)));
+        }
+        else
+        {
+            m_mesh_data.emplace(mesh_file.filename, std::move(mesh_data));
+        }
+
+        m_mesh_files.emplace_back(std::move(mesh_file.file));
+    }
 }
 
 Mesh MeshManager::mesh(std::string_view mesh_name) const
@@ -194,13 +648,67 @@ uint32_t Mesh::vertexBufferOffset() const
 
 uint32_t Mesh::vertexCount() const
 {
-    return m_mesh_data->vertex_data.size();
+    return m_mesh_data->vertex_count;
 }
 
-const std::vector<VertexDefault>& Mesh::vertexData() const
+uint32_t Mesh::lodCount() const
+{
+    return std::max<uint32_t>(m_mesh_data->lods.size(), 1);
+}
+
+uint32_t Mesh::indexCount(uint32_t lod) const
+{
+    return m_mesh_data->lods.empty() ? 0 : m_mesh_data->lods[lod].index_count;
+}
+
+uint32_t Mesh::selectLod(uint32_t curr_lod, float pixels_per_unit, float max_pixel_error) const
+{
+    const auto& lods = m_mesh_data->lods;
+    uint32_t lod = std::min(curr_lod, lodCount() - 1);
+
+    while((lod + 1 < lods.size()) && (lods[lod + 1].error * pixels_per_unit <= max_pixel_error))
+    {
+        lod++;
+    }
+
+    while((lod > 0) && (lods[lod].error * pixels_per_unit > (1.0f + MESH_LOD_HYSTERESIS) * max_pixel_error))
+    {
+        lod--;
+    }
+
+    return lod;
+}
+
+const vec3& Mesh::positionOffset() const
+{
+    return m_mesh_data->pos_offset;
+}
+
+const vec3& Mesh::positionScale() const
+{
+    return m_mesh_data->pos_scale;
+}
+
+void Mesh::draw(Renderer& renderer, RenderMode render_mode, uint32_t instance_id, uint32_t lod, RenderViewId view) const
+{
+    if(!m_mesh_data->lods.empty())
+    {
+        const auto& mesh_lod = m_mesh_data->lods[std::min<uint32_t>(lod, m_mesh_data->lods.size() - 1)];
+        renderer.drawIndexed(render_mode, m_mesh_data->vb_alloc.vb, m_mesh_data->vb_alloc.vertex_offset, m_mesh_data->ib_alloc.ib,
+                             m_mesh_data->ib_alloc.first_index + mesh_lod.first_index, mesh_lod.index_count, instance_id, view);
+    }
+    else
+    {
+        renderer.draw(render_mode, m_mesh_data->vb_alloc.vb, m_mesh_data->vb_alloc.vertex_offset, m_mesh_data->vertex_count, instance_id, view);
+    }
+}
+
+#if EDITOR_ENABLE
+std::span<const VertexDefault> Mesh::vertexData() const
 {
     return m_mesh_data->vertex_data;
 }
+#endif
 
 AnimatedMesh::AnimatedMesh(Renderer& renderer, const MeshData* mesh_data, const AnimatedMeshData* anim_mesh_data)
     : Mesh(mesh_data)
@@ -297,7 +805,7 @@ void AnimatedMesh::playAnimation(std::string_view name)
 
 void AnimatedMesh::setPose(std::string_view pose_name)
 {
-    const Pose& pose = m_animated_mesh_data->poses.at(pose_name.data());
+    const auto& pose = m_animated_mesh_data->poses.at(pose_name.data());
 
     for(uint32_t bone_id = 0; bone_id < m_animated_mesh_data->bone_count; bone_id++)
     {
@@ -316,7 +824,7 @@ void AnimatedMesh::setPose(std::string_view pose_name)
     }
 
     m_play_animation = false;
-    m_curr_pose = m_animated_mesh_data->poses.at(pose_name.data());
+    m_curr_pose.assign(pose.begin(), pose.end());
 }
 
 void AnimatedMesh::animationUpdate(Renderer& renderer, float dt)
@@ -2,10 +2,13 @@
 #define MESH_H
 
 #include <string_view>
+#include <span>
+#include <memory>
 #include "vertex.h"
 #include "collision.h"
 #include "shaders/shader_constants.h"
 #include "renderer.h"
+#include "asset_cache.h"
 
 struct KeyFrame
 {
@@ -13,21 +16,44 @@ struct KeyFrame
     vec3 pos;
 };
 
+//the key frames and their times point into the mapped mesh file
 struct Animation
 {
-    std::vector<std::vector<KeyFrame>> key_frames;
-    std::vector<float> key_frame_times;
+    //one span of key_frame_times.size() key frames per bone
+    std::vector<std::span<const KeyFrame>> key_frames;
+    std::span<const float> key_frame_times;
 };
 
 using Pose = std::vector<KeyFrame>;
 
+//the full detail mesh and up to 3 simplified ones, each with about half the triangles of the one before
+constexpr uint32_t MAX_MESH_LOD_COUNT = 4;
+//how far past the allowed error a lod's error has to go before a finer lod is picked again
+constexpr float MESH_LOD_HYSTERESIS = 0.25f;
+
+//a range of the mesh's indices, every lod indexes the same vertices
+struct MeshLod
+{
+    uint32_t first_index;
+    uint32_t index_count;
+    //the largest distance the simplified surface is estimated to be from the full detail one, in mesh units - 0 for the full detail mesh
+    float error;
+};
+
 struct MeshData
 {
+    uint32_t vertex_count = 0;
+    //points into the mapped mesh file, empty for meshes drawn as plain triangle lists
+    std::span<const MeshLod> lods;
 #if EDITOR_ENABLE
-    //TODO: do we even need vertex data even in editor?
-    std::vector<VertexDefault> vertex_data;
+    //points into the mapped mesh file, these are the unique vertices the indices point to
+    std::span<const VertexDefault> vertex_data;
 #endif
     VertexBufferAllocation vb_alloc;
+    IndexBufferAllocation ib_alloc;
+    //the vertex positions are quantized to the bounds of the mesh, the vertex shaders undo it with these
+    vec3 pos_offset = vec3(0.0f);
+    vec3 pos_scale = vec3(1.0f);
     uint32_t tex_id = 0;
     uint32_t normal_map_id = NORMAL_MAP_ID_NONE;
 };
@@ -42,8 +68,17 @@ public:
     VertexBuffer* vertexBuffer() const;
     uint32_t vertexBufferOffset() const;
     uint32_t vertexCount() const;
-    const std::vector<VertexDefault>& vertexData() const;
+    uint32_t lodCount() const;
+    uint32_t indexCount(uint32_t lod = 0) const;
+    const vec3& positionOffset() const;
+    const vec3& positionScale() const;
+    //the coarsest lod whose error covers at most max_pixel_error pixels when a mesh unit covers pixels_per_unit pixels,
+    //it only goes back to a finer lod once the current one's error is past that by a margin, so the lod doesn't flicker at the switching distance
+    uint32_t selectLod(uint32_t curr_lod, float pixels_per_unit, float max_pixel_error) const;
+    //indexed if the mesh has indices
+    void draw(Renderer& renderer, RenderMode render_mode, uint32_t instance_id, uint32_t lod = 0, RenderViewId view = RENDER_VIEW_ALL) const;
 #if EDITOR_ENABLE
+    std::span<const VertexDefault> vertexData() const;
     bool rayIntersetion(const Ray& rayL, float min_d, float& d) const;
 #endif
 
@@ -51,13 +86,14 @@ protected:
     const MeshData* const m_mesh_data = nullptr;
 };
 
+//everything but bone_to_root_transforms points into the mapped mesh file
 struct AnimatedMeshData
 {
     uint8_t bone_count = 0;
-    std::vector<int8_t> bone_parent_ids;
-    std::vector<mat4x4> bone_offset_transforms;
+    std::span<const int8_t> bone_parent_ids;
+    std::span<const mat4x4> bone_offset_transforms;
     std::vector<mat4x4> bone_to_root_transforms;
-    std::unordered_map<std::string, Pose> poses;
+    std::unordered_map<std::string, std::span<const KeyFrame>> poses;
     std::unordered_map<std::string, Animation> animations;
 };
 
@@ -107,18 +143,108 @@ class MeshManager
 {
 public:
     void loadMeshData(Renderer& renderer, std::string_view mesh_filename);
+    //the files are read on all cores first, then their textures and vertices go to the renderer in one batch
+    void loadMeshData(Renderer& renderer, std::span<const std::string> mesh_filenames);
     Mesh mesh(std::string_view mesh_name) const;
     AnimatedMesh animatedMesh(Renderer&, std::string_view mesh_name) const;
+
+    struct LoadBenchmarkResult
+    {
+        uint32_t mesh_count;
+        double serial_ms;
+        double parallel_ms;
+    };
+
+    //times reading the files of every loaded mesh one after another against reading them on all cores the way loadMeshData does,
+    //nothing goes to the renderer - the files are already baked into the asset cache, so the mapping, checking and paging in are timed
+    LoadBenchmarkResult benchmarkLoading() const;
 #if EDITOR_ENABLE
     uint64_t meshDataSize() const;
     const std::vector<std::string>& meshFilenames() const;
 #endif
 
 private:
-    MeshData readMeshData(Renderer& renderer, std::ifstream& mesh_file);
+    /*--- file layout ---*/
+    //header, chunk table and then the chunk payloads, each one aligned to MESH_CHUNK_ALIGNMENT so the vertices, bones and key frames
+    //are used straight out of the mapped file - the payloads are in the in-memory layout, so the files aren't portable across endianness
+    //version 1 is the unversioned layout from before, which had everything one field after another, version 2 didn't have indices
+    //version 3 had VertexDefaultUnpacked vertices, version 4 didn't have lods and version 5 simplified skinned meshes too - they're all
+    //converted into the asset cache on load, the vertices are packed and deduplicated, the lods of static meshes are generated and
+    //the triangles and vertices reordered for the GPU on the way
+    //the version is part of the cache key, so any change to the conversion has to bump it
+    static constexpr uint32_t MESH_FILE_MAGIC = 0x4853454d; //"MESH"
+    static constexpr uint32_t MESH_FILE_VERSION = 6;
+    static constexpr uint64_t MESH_CHUNK_ALIGNMENT = 16;
+
+    enum class ChunkType : uint32_t
+    {
+        //the texture chunks have no payload, just the filename as their name
+        Texture,
+        NormalMap,
+        //VertexDefault[], VertexDefaultUnpacked[] before version 4
+        Vertices,
+        //int8_t[bone_count], -1 for the root
+        BoneParents,
+        //mat4x4[bone_count]
+        BoneOffsets,
+        //KeyFrame[bone_count]
+        Pose,
+        //float[key_frame_count] key frame times followed by KeyFrame[bone_count][key_frame_count]
+        Animation,
+        //uint16_t[] or uint32_t[] triangle list indices into the vertices, the 16 bit ones are used when there are few enough vertices
+        //the indices of every lod are in here, one after the other
+        Indices16,
+        Indices32,
+        //vec3 pos_offset and vec3 pos_scale the vertex positions are quantized to
+        PositionBounds,
+        //MeshLod[], from the full detail mesh down
+        Lods
+    };
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t chunk_count;
+        uint32_t bone_count;
+    };
+
+    struct ChunkInfo
+    {
+        ChunkType type;
+        //only used by animations
+        uint32_t key_frame_count;
+        uint64_t offset;
+        uint64_t size;
+        //the name isn't null terminated, it's somewhere after the chunk table
+        uint64_t name_offset;
+        uint64_t name_length;
+    };
+
+    //a mesh file mapped and checked by a worker thread, waiting for its textures and vertices to be handed to the renderer
+    struct LoadedMeshFile
+    {
+        std::string filename;
+        std::unique_ptr<AssetCache::Entry> file;
+        std::string texture_filename;
+        std::string normal_map_filename;
+        std::span<const VertexDefault> vertices;
+        std::span<const uint16_t> indices16;
+        std::span<const uint32_t> indices32;
+        std::span<const vec3> pos_bounds;
+        std::span<const MeshLod> lods;
+        AnimatedMeshData anim_data;
+    };
+
+    //converts a mesh file of any version into the current one
+    static std::vector<uint8_t> bakeMeshFile(const std::string& filename);
+    //doesn't touch the renderer, so it's safe to call from any thread
+    static void readMeshFile(LoadedMeshFile& mesh_file);
 
     std::unordered_map<std::string, const MeshData> m_mesh_data;
     std::unordered_map<std::string, std::pair<const MeshData, const AnimatedMeshData>> m_animated_mesh_data;
+    //kept around for as long as the meshes are, the vertex data is only copied to the GPU on the next frame
+    std::vector<std::unique_ptr<AssetCache::Entry>> m_mesh_files;
 #if EDITOR_ENABLE
     uint64_t m_mesh_data_size = 0;
     std::vector<std::string> m_mesh_filenames;
@@ -0,0 +1,620 @@
+#include "mesh_optimizer.h"
+#include "game_utils.h"
+#include <unordered_map>
+#include <string_view>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <array>
+#include <limits>
+#include <numeric>
+#include <format>
+#include <glm/gtc/packing.hpp>
+
+//maps the unit sphere onto an octahedron and unfolds that onto the [-1, 1] square, the shaders undo it with octDecode
+static vec2 octEncode(const vec3& n)
+{
+    const vec3 p = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+
+    if(p.z >= 0.0f)
+    {
+        return vec2(p.x, p.y);
+    }
+
+    return vec2((1.0f - std::abs(p.y)) * ((p.x >= 0.0f) ? 1.0f : -1.0f), (1.0f - std::abs(p.x)) * ((p.y >= 0.0f) ? 1.0f : -1.0f));
+}
+
+template<typename T>
+static T quantizeSnorm(float v)
+{
+    constexpr float max = std::numeric_limits<T>::max();
+    return static_cast<T>(std::round(std::clamp(v, -1.0f, 1.0f) * max));
+}
+
+std::vector<VertexDefault> quantizeVertices(std::span<const VertexDefaultUnpacked> vertices, vec3& pos_offset, vec3& pos_scale)
+{
+    vec3 pos_min(std::numeric_limits<float>::max());
+    vec3 pos_max(std::numeric_limits<float>::lowest());
+
+    for(const auto& v : vertices)
+    {
+        pos_min = glm::min(pos_min, v.pos);
+        pos_max = glm::max(pos_max, v.pos);
+    }
+
+    if(vertices.empty())
+    {
+        pos_min = vec3(0.0f);
+        pos_max = vec3(0.0f);
+    }
+
+    pos_offset = pos_min;
+    pos_scale = pos_max - pos_min;
+
+    //a flat mesh has no extent along one of the axes, its positions there are all 0
+    const vec3 inv_scale = glm::mix(vec3(0.0f), 1.0f / pos_scale, glm::greaterThan(pos_scale, vec3(0.0f)));
+
+    std::vector<VertexDefault> packed(vertices.size());
+
+    for(size_t i = 0; i < vertices.size(); i++)
+    {
+        const auto& v = vertices[i];
+        auto& p = packed[i];
+
+        const vec3 pos = glm::round(glm::clamp((v.pos - pos_offset) * inv_scale, 0.0f, 1.0f) * 65535.0f);
+        p.pos = glm::u16vec4(pos.x, pos.y, pos.z, 0);
+
+        const vec2 normal = (glm::dot(v.normal, v.normal) > 0.0f) ? octEncode(glm::normalize(v.normal)) : vec2(0.0f, 0.0f);
+        p.normal = glm::i16vec2(quantizeSnorm<int16_t>(normal.x), quantizeSnorm<int16_t>(normal.y));
+
+        //degenerate triangles and uvs can leave zero vectors, they still have to decode to unit vectors
+        const vec2 tangent = (glm::dot(v.tangent, v.tangent) > 0.0f) ? octEncode(glm::normalize(v.tangent)) : vec2(1.0f, 0.0f);
+        p.tangent = glm::i8vec2(quantizeSnorm<int8_t>(tangent.x), quantizeSnorm<int8_t>(tangent.y));
+
+        if(v.bone_id > std::numeric_limits<uint8_t>::max())
+        {
+            error(std::format("Vertex bone id {} doesn't fit into 8 bits.", v.bone_id));
+        }
+
+        p.bone_id = static_cast<uint8_t>(v.bone_id);
+        p.tex_coords = glm::u16vec2(glm::packHalf1x16(v.tex_coords.x), glm::packHalf1x16(v.tex_coords.y));
+    }
+
+    return packed;
+}
+
+//the key is the raw bytes of the value, so only vertices or positions that are the same down to the bit are merged
+template<typename T>
+struct BytesHash
+{
+    size_t operator()(const T* v) const noexcept
+    {
+        return std::hash<std::string_view>()(std::string_view(reinterpret_cast<const char*>(v), sizeof(T)));
+    }
+};
+
+template<typename T>
+struct BytesEqual
+{
+    bool operator()(const T* a, const T* b) const noexcept
+    {
+        return 0 == std::memcmp(a, b, sizeof(T));
+    }
+};
+
+std::vector<uint32_t> indexVertices(std::span<const VertexDefault> vertices, std::vector<VertexDefault>& unique_vertices)
+{
+    std::vector<uint32_t> indices;
+    indices.reserve(vertices.size());
+    std::unordered_map<const VertexDefault*, uint32_t, BytesHash<VertexDefault>, BytesEqual<VertexDefault>> vertex_ids;
+    vertex_ids.reserve(vertices.size());
+
+    unique_vertices.clear();
+
+    for(size_t t = 0; t + 2 < vertices.size(); t += 3)
+    {
+        std::array<uint32_t, 3> triangle;
+
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            const auto [it, inserted] = vertex_ids.try_emplace(&vertices[t + i], static_cast<uint32_t>(unique_vertices.size()));
+
+            if(inserted)
+            {
+                unique_vertices.push_back(vertices[t + i]);
+            }
+
+            triangle[i] = it->second;
+        }
+
+        //triangles that collapsed into a line or a point don't draw anything
+        if((triangle[0] != triangle[1]) && (triangle[1] != triangle[2]) && (triangle[0] != triangle[2]))
+        {
+            indices.insert(indices.end(), triangle.begin(), triangle.end());
+        }
+    }
+
+    return indices;
+}
+
+/*--- vertex cache optimisation ---*/
+static constexpr int32_t CACHE_SIZE = 32;
+static constexpr float CACHE_DECAY_POWER = 1.5f;
+static constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+static constexpr float VALENCE_BOOST_SCALE = 2.0f;
+static constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+//vertices near the top of the cache score higher, except for the ones the last triangle used - using them
+//again right away makes for strips, which are worse than fans for the cache - and vertices with few triangles
+//left get a boost so they're finished off instead of being left as lone triangles for later
+static float vertexScore(int32_t cache_pos, uint32_t remaining_triangle_count)
+{
+    if(0 == remaining_triangle_count)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+
+    if(cache_pos >= 0)
+    {
+        if(cache_pos < 3)
+        {
+            score = LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            score = std::pow(1.0f - static_cast<float>(cache_pos - 3) / (CACHE_SIZE - 3), CACHE_DECAY_POWER);
+        }
+    }
+
+    return score + VALENCE_BOOST_SCALE * std::pow(static_cast<float>(remaining_triangle_count), -VALENCE_BOOST_POWER);
+}
+
+void optimizeVertexCache(std::span<uint32_t> indices, uint32_t vertex_count)
+{
+    const uint32_t triangle_count = indices.size() / 3;
+
+    if(triangle_count < 2)
+    {
+        return;
+    }
+
+    /*the triangles using every vertex, packed into one array*/
+    std::vector<uint32_t> vertex_triangle_offsets(vertex_count + 1, 0);
+    std::vector<uint32_t> remaining_triangle_counts(vertex_count, 0);
+
+    for(uint32_t index : indices)
+    {
+        remaining_triangle_counts[index]++;
+    }
+
+    for(uint32_t v = 0; v < vertex_count; v++)
+    {
+        vertex_triangle_offsets[v + 1] = vertex_triangle_offsets[v] + remaining_triangle_counts[v];
+    }
+
+    std::vector<uint32_t> vertex_triangles(indices.size());
+    {
+        std::vector<uint32_t> fill(vertex_triangle_offsets.begin(), vertex_triangle_offsets.end() - 1);
+
+        for(uint32_t t = 0; t < triangle_count; t++)
+        {
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                vertex_triangles[fill[indices[3 * t + i]]++] = t;
+            }
+        }
+    }
+
+    std::vector<float> vertex_scores(vertex_count);
+
+    for(uint32_t v = 0; v < vertex_count; v++)
+    {
+        vertex_scores[v] = vertexScore(-1, remaining_triangle_counts[v]);
+    }
+
+    std::vector<float> triangle_scores(triangle_count);
+    std::vector<bool> triangle_emitted(triangle_count, false);
+
+    for(uint32_t t = 0; t < triangle_count; t++)
+    {
+        triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+    }
+
+    //the cache holds 3 more entries than CACHE_SIZE, the vertices of the new triangle push the others down before the overflow is dropped
+    std::array<uint32_t, CACHE_SIZE + 3> cache;
+    uint32_t cache_count = 0;
+
+    std::vector<uint32_t> new_indices;
+    new_indices.reserve(indices.size());
+
+    uint32_t best_triangle = std::ranges::max_element(triangle_scores) - triangle_scores.begin();
+    //where to continue looking for a triangle when nothing in the cache has any left
+    uint32_t next_unemitted_triangle = 0;
+
+    for(uint32_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+    {
+        if(best_triangle == triangle_count)
+        {
+            while(triangle_emitted[next_unemitted_triangle])
+            {
+                next_unemitted_triangle++;
+            }
+
+            best_triangle = next_unemitted_triangle;
+        }
+
+        triangle_emitted[best_triangle] = true;
+
+        std::array<uint32_t, CACHE_SIZE + 3> new_cache;
+        uint32_t new_cache_count = 0;
+
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            const uint32_t v = indices[3 * best_triangle + i];
+            new_indices.push_back(v);
+            new_cache[new_cache_count++] = v;
+
+            //the triangle is taken out of the vertex's list
+            const auto first = vertex_triangles.begin() + vertex_triangle_offsets[v];
+            const auto last = first + remaining_triangle_counts[v];
+            std::iter_swap(std::find(first, last, best_triangle), last - 1);
+            remaining_triangle_counts[v]--;
+        }
+
+        for(uint32_t i = 0; i < cache_count; i++)
+        {
+            const uint32_t v = cache[i];
+
+            if((v != new_cache[0]) && (v != new_cache[1]) && (v != new_cache[2]))
+            {
+                new_cache[new_cache_count++] = v;
+            }
+        }
+
+        for(uint32_t i = CACHE_SIZE; i < new_cache_count; i++)
+        {
+            vertex_scores[new_cache[i]] = vertexScore(-1, remaining_triangle_counts[new_cache[i]]);
+        }
+
+        cache_count = std::min<uint32_t>(new_cache_count, CACHE_SIZE);
+        std::copy_n(new_cache.begin(), cache_count, cache.begin());
+
+        for(uint32_t i = 0; i < cache_count; i++)
+        {
+            vertex_scores[cache[i]] = vertexScore(i, remaining_triangle_counts[cache[i]]);
+        }
+
+        //only the triangles of the cached vertices changed score, the best of them goes next
+        best_triangle = triangle_count;
+        float best_score = -1.0f;
+
+        for(uint32_t i = 0; i < cache_count; i++)
+        {
+            const uint32_t v = cache[i];
+
+            for(uint32_t j = 0; j < remaining_triangle_counts[v]; j++)
+            {
+                const uint32_t t = vertex_triangles[vertex_triangle_offsets[v] + j];
+                triangle_scores[t] = vertex_scores[indices[3 * t]] + vertex_scores[indices[3 * t + 1]] + vertex_scores[indices[3 * t + 2]];
+
+                if(triangle_scores[t] > best_score)
+                {
+                    best_score = triangle_scores[t];
+                    best_triangle = t;
+                }
+            }
+        }
+    }
+
+    std::ranges::copy(new_indices, indices.begin());
+}
+
+void optimizeVertexFetch(std::span<uint32_t> indices, std::vector<VertexDefault>& vertices)
+{
+    static constexpr uint32_t UNUSED = 0xffffffff;
+
+    std::vector<uint32_t> remap(vertices.size(), UNUSED);
+    std::vector<VertexDefault> new_vertices;
+    new_vertices.reserve(vertices.size());
+
+    for(auto& index : indices)
+    {
+        if(remap[index] == UNUSED)
+        {
+            remap[index] = static_cast<uint32_t>(new_vertices.size());
+            new_vertices.push_back(vertices[index]);
+        }
+
+        index = remap[index];
+    }
+
+    //vertices no triangle uses are dropped
+    vertices = std::move(new_vertices);
+}
+
+/*--- simplification ---*/
+//rejects collapses that turn a triangle by more than about 75 degrees, which is where they start folding over their neighbours
+static constexpr float MAX_COLLAPSE_NORMAL_COS = 0.25f;
+
+//the sum of the squared distances to a set of planes, weighted by the areas of the triangles they come from (Garland and Heckbert)
+//the weight is kept too, so the error can be turned back into a distance
+struct Quadric
+{
+    double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double w = 0.0;
+
+    Quadric& operator+=(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        w += q.w;
+        return *this;
+    }
+
+    double error(const vec3& p) const
+    {
+        const double x = p.x, y = p.y, z = p.z;
+        const double e = a00 * x * x + a11 * y * y + a22 * z * z + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                       + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+
+        return std::max(e, 0.0);
+    }
+};
+
+static Quadric triangleQuadric(const vec3& p0, const vec3& p1, const vec3& p2)
+{
+    const vec3 n = glm::cross(p1 - p0, p2 - p0);
+    const float double_area = glm::length(n);
+
+    if(double_area == 0.0f)
+    {
+        return Quadric{};
+    }
+
+    const double w = 0.5 * double_area;
+    const double nx = n.x / double_area, ny = n.y / double_area, nz = n.z / double_area;
+    const double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+
+    return Quadric{w * nx * nx, w * nx * ny, w * nx * nz, w * ny * ny, w * ny * nz, w * nz * nz, w * nx * d, w * ny * d, w * nz * d, w * d * d, w};
+}
+
+struct Collapse
+{
+    double error;
+    uint32_t from;
+    uint32_t to;
+};
+
+std::vector<uint32_t> simplifyMesh(std::span<const uint32_t> src_indices, std::span<const vec3> positions, uint32_t target_index_count, float& error)
+{
+    const uint32_t vertex_count = positions.size();
+    std::vector<uint32_t> indices(src_indices.begin(), src_indices.end());
+    double max_collapse_error = 0.0;
+
+    /*vertices that share a position with another one sit on a uv or normal seam and the ones on the border have nothing on one side,
+      moving either would tear the mesh open, so they're locked*/
+    std::vector<uint32_t> position_ids(vertex_count);
+    std::vector<uint32_t> position_vertex_counts;
+    {
+        std::unordered_map<const vec3*, uint32_t, BytesHash<vec3>, BytesEqual<vec3>> ids;
+        ids.reserve(vertex_count);
+
+        for(uint32_t v = 0; v < vertex_count; v++)
+        {
+            const auto [it, inserted] = ids.try_emplace(&positions[v], static_cast<uint32_t>(position_vertex_counts.size()));
+
+            if(inserted)
+            {
+                position_vertex_counts.push_back(0);
+            }
+
+            position_ids[v] = it->second;
+            position_vertex_counts[it->second]++;
+        }
+    }
+
+    std::vector<bool> locked_positions(position_vertex_counts.size(), false);
+
+    for(uint32_t p = 0; p < position_vertex_counts.size(); p++)
+    {
+        locked_positions[p] = position_vertex_counts[p] > 1;
+    }
+
+    {
+        //an edge is on the border if only one triangle uses it, seams are found by position so the triangles on both sides count
+        std::unordered_map<uint64_t, uint32_t> edge_triangle_counts;
+        edge_triangle_counts.reserve(indices.size());
+
+        for(uint32_t i = 0; i < indices.size(); i++)
+        {
+            const uint32_t a = position_ids[indices[i]];
+            const uint32_t b = position_ids[indices[(i % 3 == 2) ? i - 2 : i + 1]];
+            edge_triangle_counts[(uint64_t(std::min(a, b)) << 32) | std::max(a, b)]++;
+        }
+
+        for(const auto& [edge, triangle_count] : edge_triangle_counts)
+        {
+            if(triangle_count == 1)
+            {
+                locked_positions[edge >> 32] = true;
+                locked_positions[edge & 0xffffffff] = true;
+            }
+        }
+    }
+
+    std::vector<Quadric> quadrics(vertex_count);
+
+    for(uint32_t t = 0; t < indices.size(); t += 3)
+    {
+        const Quadric q = triangleQuadric(positions[indices[t]], positions[indices[t + 1]], positions[indices[t + 2]]);
+
+        for(uint32_t i = 0; i < 3; i++)
+        {
+            quadrics[indices[t + i]] += q;
+        }
+    }
+
+    /*collapses are done in passes, every pass takes the cheapest collapses that don't touch each other's triangles*/
+    std::vector<uint32_t> vertex_triangle_offsets(vertex_count + 1);
+    std::vector<uint32_t> vertex_triangles;
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<bool> touched;
+    std::vector<Collapse> collapses;
+
+    while(indices.size() > target_index_count)
+    {
+        std::ranges::fill(vertex_triangle_offsets, 0);
+
+        for(uint32_t index : indices)
+        {
+            vertex_triangle_offsets[index + 1]++;
+        }
+
+        for(uint32_t v = 0; v < vertex_count; v++)
+        {
+            vertex_triangle_offsets[v + 1] += vertex_triangle_offsets[v];
+        }
+
+        vertex_triangles.resize(indices.size());
+        {
+            std::vector<uint32_t> fill(vertex_triangle_offsets.begin(), vertex_triangle_offsets.end() - 1);
+
+            for(uint32_t i = 0; i < indices.size(); i++)
+            {
+                vertex_triangles[fill[indices[i]]++] = i / 3;
+            }
+        }
+
+        //the collapsed vertex is moved onto the one it's collapsed into, so the error is measured there
+        collapses.clear();
+
+        for(uint32_t i = 0; i < indices.size(); i++)
+        {
+            const uint32_t a = indices[i];
+            const uint32_t b = indices[(i % 3 == 2) ? i - 2 : i + 1];
+
+            for(const auto& [from, to] : {std::pair(a, b), std::pair(b, a)})
+            {
+                if(!locked_positions[position_ids[from]])
+                {
+                    Quadric q = quadrics[from];
+                    q += quadrics[to];
+                    collapses.emplace_back((q.w > 0.0) ? q.error(positions[to]) / q.w : 0.0, from, to);
+                }
+            }
+        }
+
+        std::ranges::sort(collapses, {}, &Collapse::error);
+
+        std::iota(remap.begin(), remap.end(), 0);
+        touched.assign(vertex_count, false);
+        uint64_t index_count = indices.size();
+        uint32_t collapse_count = 0;
+
+        for(const auto& collapse : collapses)
+        {
+            if(index_count <= target_index_count)
+            {
+                break;
+            }
+
+            if(touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+
+            const auto triangles = std::span(vertex_triangles).subspan(vertex_triangle_offsets[collapse.from], vertex_triangle_offsets[collapse.from + 1] - vertex_triangle_offsets[collapse.from]);
+            bool flips = false;
+            uint32_t removed_triangle_count = 0;
+
+            for(uint32_t t : triangles)
+            {
+                std::array<vec3, 3> p;
+                bool removed = false;
+
+                for(uint32_t i = 0; i < 3; i++)
+                {
+                    p[i] = positions[indices[3 * t + i]];
+                    removed |= indices[3 * t + i] == collapse.to;
+                }
+
+                if(removed)
+                {
+                    removed_triangle_count++;
+                    continue;
+                }
+
+                const vec3 n_before = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+                for(uint32_t i = 0; i < 3; i++)
+                {
+                    if(indices[3 * t + i] == collapse.from)
+                    {
+                        p[i] = positions[collapse.to];
+                    }
+                }
+
+                const vec3 n_after = glm::cross(p[1] - p[0], p[2] - p[0]);
+
+                //triangles that were degenerate already can't flip
+                if((glm::dot(n_before, n_before) > 0.0f) && (glm::dot(n_before, n_after) <= MAX_COLLAPSE_NORMAL_COS * glm::length(n_before) * glm::length(n_after)))
+                {
+                    flips = true;
+                    break;
+                }
+            }
+
+            if(flips)
+            {
+                continue;
+            }
+
+            //every triangle around the collapsed vertex changes, so none of their vertices can be collapsed again in this pass
+            for(uint32_t t : triangles)
+            {
+                for(uint32_t i = 0; i < 3; i++)
+                {
+                    touched[indices[3 * t + i]] = true;
+                }
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+            max_collapse_error = std::max(max_collapse_error, collapse.error);
+            index_count -= 3 * removed_triangle_count;
+            collapse_count++;
+        }
+
+        if(0 == collapse_count)
+        {
+            break;
+        }
+
+        uint32_t new_index_count = 0;
+
+        for(uint32_t t = 0; t < indices.size(); t += 3)
+        {
+            const uint32_t a = remap[indices[t]];
+            const uint32_t b = remap[indices[t + 1]];
+            const uint32_t c = remap[indices[t + 2]];
+
+            if((a != b) && (b != c) && (a != c))
+            {
+                indices[new_index_count++] = a;
+                indices[new_index_count++] = b;
+                indices[new_index_count++] = c;
+            }
+        }
+
+        indices.resize(new_index_count);
+    }
+
+    error = static_cast<float>(std::sqrt(max_collapse_error));
+
+    return indices;
+}
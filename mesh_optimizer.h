@@ -0,0 +1,29 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <span>
+#include <cstdint>
+#include "vertex.h"
+
+//packs the vertices into VertexDefault, the positions are quantized to the bounds of the mesh, which go from pos_offset to pos_offset + pos_scale
+std::vector<VertexDefault> quantizeVertices(std::span<const VertexDefaultUnpacked> vertices, vec3& pos_offset, vec3& pos_scale);
+
+//turns a triangle list into indexed triangles, bitwise identical vertices are merged into one and degenerate triangles are dropped
+//the unique vertices are in the order they first show up in
+std::vector<uint32_t> indexVertices(std::span<const VertexDefault> vertices, std::vector<VertexDefault>& unique_vertices);
+
+//reorders the triangles so that their vertices get reused while they're still in the post transform cache
+//(Tom Forsyth's linear-speed vertex cache optimisation), the cache is modelled as a 32 entry LRU
+void optimizeVertexCache(std::span<uint32_t> indices, uint32_t vertex_count);
+
+//reorders the vertices into the order the triangles first use them in so the vertex fetches walk through memory, the indices are remapped
+void optimizeVertexFetch(std::span<uint32_t> indices, std::vector<VertexDefault>& vertices);
+
+//simplifies an indexed triangle list down to about target_index_count indices by collapsing edges, cheapest quadric error first
+//the vertices aren't changed, the result indexes the same ones - vertices on the border of the mesh and on uv or normal seams don't move,
+//so a mesh made mostly of those can't get much simpler. error is the largest distance the simplified surface is estimated to be from the
+//original one, in the same units as the positions
+std::vector<uint32_t> simplifyMesh(std::span<const uint32_t> indices, std::span<const vec3> positions, uint32_t target_index_count, float& error);
+
+#endif // MESH_OPTIMIZER_H
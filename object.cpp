@@ -1,5 +1,8 @@
 #include "object.h"
 
+//keeps the camera inside an object from dividing by 0, it's drawn at full detail there anyway
+static constexpr float MIN_LOD_DISTANCE = 0.01f;
+
 Object::Object(Renderer& renderer, std::ifstream& scene_file)
 {
     uint8_t mesh_filename_length = 0;
@@ -14,6 +17,7 @@ Object::Object(Renderer& renderer, std::ifstream& scene_file)
 
     m_mesh = std::make_unique<Mesh>(renderer, model_filename);
     m_instance_data.resize(m_mesh->mehes().size());
+    m_mesh_lods.resize(m_mesh->mehes().size());
     m_instance_id = renderer.reqInstanceVBAlloc(m_instance_data.size());
 
     for(auto& instance_data : m_instance_data)
@@ -37,6 +41,7 @@ Object::Object(Renderer& renderer, std::string_view model_filename, RenderMode r
 {
     m_mesh = std::make_unique<Mesh>(renderer, model_filename);
     m_instance_data.resize(m_mesh->mehes().size());
+    m_mesh_lods.resize(m_mesh->mehes().size());
     m_instance_id = renderer.reqInstanceVBAlloc(m_instance_data.size());
 
     for(auto& instance_data : m_instance_data)
@@ -59,17 +64,37 @@ void Object::update(Renderer& renderer, float dt)
 
 void Object::draw(Renderer& renderer)
 {
+    //the lods are picked by how many pixels their error covers from the camera, shadows are looked at through the camera too,
+    //so the shadow maps use the same measure, just with more error allowed
+    const auto& camera_view = renderer.cameraView();
+    const float distance = std::max(glm::distance(camera_view.pos, m_pos), MIN_LOD_DISTANCE);
+    const float pixels_per_unit = camera_view.pixels_per_unit * std::max({m_scale.x, m_scale.y, m_scale.z}) / distance;
+
     for(uint32_t i = 0; i < m_mesh->mehes().size(); i++)
     {
        const auto& mesh = m_mesh->mehes()[i];
+       auto& lods = m_mesh_lods[i];
 
        //TODO: only update instance data if the instance data has really changed (measure if any performance boost)
        //TODO: for translation, don't multiply, but directly set the row/column corresponding to translation
        m_instance_data[i].W = glm::translate(m_pos) * m_rot * glm::scale(m_scale);
        m_instance_data[i].tex_id = mesh.textureId();
        m_instance_data[i].normal_map_id = mesh.normalMapId();
-
-        renderer.draw(m_render_mode, mesh.vertexBuffer(), mesh.vertexBufferOffset(), mesh.vertexCount(), m_instance_id + i);
+       m_instance_data[i].pos_offset = mesh.positionOffset();
+       m_instance_data[i].pos_scale = mesh.positionScale();
+
+       lods.lod = mesh.selectLod(lods.lod, pixels_per_unit, renderer.meshLodPixelError());
+       lods.shadow_lod = mesh.selectLod(lods.shadow_lod, pixels_per_unit, renderer.meshShadowLodPixelError());
+
+       if(lods.lod == lods.shadow_lod)
+       {
+           mesh.draw(renderer, m_render_mode, m_instance_id + i, lods.lod);
+       }
+       else
+       {
+           mesh.draw(renderer, m_render_mode, m_instance_id + i, lods.lod, RENDER_VIEW_CAMERA);
+           mesh.draw(renderer, m_render_mode, m_instance_id + i, lods.shadow_lod, RENDER_VIEW_SHADOW_MAPS);
+       }
     }
 
     renderer.updateInstanceVertexData(m_instance_id, m_instance_data.size(), m_instance_data.data());
@@ -226,9 +251,10 @@ void Object::serialize(std::ofstream& outfile) const
 
 void Object::drawHighlight(Renderer& renderer)
 {
-    for(const auto& mesh : m_mesh->mehes())
+    //the outline has to match the lod the object is drawn with
+    for(uint32_t i = 0; i < m_mesh->mehes().size(); i++)
     {
-        renderer.draw(RenderMode::Highlight, mesh.vertexBuffer(), mesh.vertexBufferOffset(), mesh.vertexCount(), m_instance_id);
+        m_mesh->mehes()[i].draw(renderer, RenderMode::Highlight, m_instance_id, m_mesh_lods[i].lod);
     }
 }
 
@@ -74,7 +74,15 @@ protected:
     RenderMode m_render_mode = RenderMode::Default;
 
 private:
+    //the lods picked last frame, kept to apply the hysteresis
+    struct MeshLods
+    {
+        uint32_t lod = 0;
+        uint32_t shadow_lod = 0;
+    };
+
     std::vector<InstanceVertexData> m_instance_data;
+    std::vector<MeshLods> m_mesh_lods;
     uint32_t m_instance_id = 0;
 #if EDITOR_ENABLE
     std::string m_mesh_filename;
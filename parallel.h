@@ -0,0 +1,160 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+
+//the threads parallelFor hands its jobs to, they're started on first use and kept until exit,
+//so spreading work over them is cheap enough to do every frame
+class WorkerPool
+{
+public:
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    static WorkerPool& instance()
+    {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    //a job that calls run() again, or a thread calling it while another one is using the workers, runs the jobs itself
+    template<typename Job>
+    void run(uint32_t count, Job&& job)
+    {
+        std::unique_lock run_lock(m_run_mutex, std::defer_lock);
+
+        if(t_running || m_threads.empty() || (count < 2) || !run_lock.try_lock())
+        {
+            for(uint32_t i = 0; i < count; i++)
+            {
+                job(i);
+            }
+
+            return;
+        }
+
+        std::atomic<uint32_t> next_job = 0;
+        std::atomic_flag failed;
+        std::exception_ptr exception;
+
+        //a thread whose job throws stops the others from starting any more, the first exception is rethrown
+        //once every thread is done with the run
+        auto work = [&]
+        {
+            t_running = true;
+
+            try
+            {
+                for(uint32_t i = next_job++; i < count; i = next_job++)
+                {
+                    job(i);
+                }
+            }
+            catch(...)
+            {
+                if(!failed.test_and_set())
+                {
+                    exception = std::current_exception();
+                }
+
+                next_job = count;
+            }
+
+            t_running = false;
+        };
+
+        {
+            std::lock_guard lock(m_mutex);
+            m_work = [](void* ctx){ (*static_cast<decltype(work)*>(ctx))(); };
+            m_work_ctx = &work;
+            m_finished_count = 0;
+            m_generation++;
+        }
+
+        m_work_cv.notify_all();
+        work();
+
+        //every worker takes part in every run, even if there's nothing left for it, so none of them can still be
+        //about to read the work of this run once it returns
+        {
+            std::unique_lock lock(m_mutex);
+            m_finished_cv.wait(lock, [this]{ return m_finished_count == m_threads.size(); });
+        }
+
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+private:
+    WorkerPool()
+    {
+        const uint32_t thread_count = std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+        m_threads.reserve(thread_count - 1);
+
+        for(uint32_t i = 1; i < thread_count; i++)
+        {
+            m_threads.emplace_back([this](std::stop_token stop_token){ workerLoop(stop_token); });
+        }
+    }
+
+    void workerLoop(std::stop_token stop_token)
+    {
+        uint64_t generation = 0;
+
+        while(true)
+        {
+            {
+                std::unique_lock lock(m_mutex);
+
+                if(!m_work_cv.wait(lock, stop_token, [&]{ return m_generation != generation; }))
+                {
+                    return;
+                }
+
+                generation = m_generation;
+            }
+
+            m_work(m_work_ctx);
+
+            {
+                std::lock_guard lock(m_mutex);
+                m_finished_count++;
+            }
+
+            m_finished_cv.notify_one();
+        }
+    }
+
+    static inline thread_local bool t_running = false;
+
+    std::mutex m_run_mutex;
+    std::mutex m_mutex;
+    std::condition_variable_any m_work_cv;
+    std::condition_variable m_finished_cv;
+    void (*m_work)(void*) = nullptr;
+    void* m_work_ctx = nullptr;
+    uint64_t m_generation = 0;
+    size_t m_finished_count = 0;
+    //after everything they read, so they're stopped before any of it is destroyed
+    std::vector<std::jthread> m_threads;
+};
+
+//calls job(i) for every i in [0, count) spread over all hardware threads, the calling thread takes part too
+//the jobs are handed out one at a time, so they don't have to take the same amount of time
+//returns once all of them are done, if a job throws the ones not started yet are skipped and the exception is rethrown here
+template<typename Job>
+void parallelFor(uint32_t count, Job&& job)
+{
+    WorkerPool::instance().run(count, job);
+}
+
+#endif // PARALLEL_H
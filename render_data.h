@@ -16,6 +16,14 @@ enum class RenderMode
     TerrainPointShadowMap,
     Highlight,
     Billboard,
+    //shadow map render modes without a geometry shader, the layer is selected by the instance index
+    DirShadowMapLayered,
+    TerrainDirShadowMapLayered,
+    PointShadowMapLayered,
+    TerrainPointShadowMapLayered,
+    //the low resolution terrain mesh drawn into the far dir shadow map cascades, without tessellation
+    TerrainDirShadowMapMesh,
+    TerrainDirShadowMapMeshLayered,
 #if EDITOR_ENABLE
     TerrainWireframe,
 #endif
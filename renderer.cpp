@@ -8,9 +8,16 @@
 #include <fstream>
 #include <list>
 #include <print>
+#include <bit>
+#include <cmath>
+#include <limits>
 #include "vertex.h"
-
-#include <png.h>
+#include "collision.h"
+#include "parallel.h"
+#include "asset_cache.h"
+#include "texture_loader.h"
+#include <exception>
+#include <unordered_map>
 
 #if VULKAN_VALIDATION_ENABLE
 static VkBool32 debugReportCallback(VkDebugUtilsMessageSeverityFlagBitsEXT, VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT*, void*);
@@ -445,6 +452,18 @@ std::vector<uint32_t> Renderer::loadNormalMaps(const std::vector<std::string_vie
     return loadTexturesGeneric(texture_filenames, m_normal_maps, true);
 }
 
+std::string Renderer::textureFilename(uint32_t tex_id) const
+{
+    const auto it = std::ranges::find(m_textures.ids, tex_id, [](const auto& id){ return id.second; });
+
+    if(it == m_textures.ids.end())
+    {
+        error(std::format("Invalid texture id {}.", tex_id));
+    }
+
+    return it->first;
+}
+
 void Renderer::deviceWaitIdle()
 {
     VkResult res = vkDeviceWaitIdle(m_device);
@@ -461,6 +480,9 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
 
     std::vector<uint32_t> ret(texture_filenames.size());
     std::vector<uint32_t> textures_to_load;
+    //a texture asked for more than once is loaded once, the other requests get the id of the first
+    std::unordered_map<std::string_view, uint32_t> load_indices;
+    std::vector<std::pair<size_t, uint32_t>> duplicates;
 
     for(size_t i = 0; i < texture_filenames.size(); i++)
     {
@@ -468,8 +490,13 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
         {
             ret[i] = tex_col.ids[texture_filenames[i].data()];
         }
+        else if(const auto it = load_indices.find(texture_filenames[i]); it != load_indices.end())
+        {
+            duplicates.emplace_back(i, it->second);
+        }
         else
         {
+            load_indices.emplace(texture_filenames[i], static_cast<uint32_t>(textures_to_load.size()));
             textures_to_load.emplace_back(i);
         }
     }
@@ -482,7 +509,6 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
     m_update_descriptors = true;
 
     VkResult res;
-    std::vector<uvec2> img_sizes(textures_to_load.size());
 
     VkImageCreateInfo img_create_info{};
     img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -494,10 +520,6 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
     img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
     img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
     img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    if(generate_mipmaps)
-    {
-        img_create_info.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    }
     img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     img_create_info.queueFamilyIndexCount = 1;
     img_create_info.pQueueFamilyIndices = &m_queue_family_index;
@@ -512,125 +534,77 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
     img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
     img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0, 1};
 
-    VkDeviceSize total_size = 0;
+    /*the textures come out of the asset cache with their mips, only the ones that aren't in it yet are decoded, on all cores*/
+    std::vector<std::unique_ptr<AssetCache::Entry>> baked_textures(textures_to_load.size());
+    std::vector<TextureLoader::BakedTextureHeader> headers(textures_to_load.size());
+    std::vector<std::exception_ptr> exceptions(textures_to_load.size());
 
-    /*for each texture to load*/
-    for(size_t i = 0; i < textures_to_load.size(); i++)
+    parallelFor(static_cast<uint32_t>(textures_to_load.size()), [&](uint32_t t)
     {
-        auto file = std::fopen(texture_filenames[textures_to_load[i]].data(), "rb");
-
-        if(!file)
-        {
-            error(std::format("Failed to open a texture file: {}", texture_filenames[textures_to_load[i]]));
-        }
-
-        uint8_t sig[8];
-        fread(sig, 1, 8, file);
-
-        if(auto check = png_check_sig(sig, 8); !check)
+        try
         {
-            fclose(file);
-            error(std::format("Texture file {} is not a valid .png file.", texture_filenames[textures_to_load[i]]));
-        }
-
-        auto png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        auto info_ptr = png_create_info_struct(png_ptr);
-
-        png_init_io(png_ptr, file);
-        png_set_sig_bytes(png_ptr, 8);
-        png_read_info(png_ptr, info_ptr);
-
-        const auto w = png_get_image_width(png_ptr, info_ptr);
-        const auto h = png_get_image_height(png_ptr, info_ptr);
-
-        total_size += w*h;
-        img_sizes[i].x = w;
-        img_sizes[i].y = h;
-
-        /*clean up*/
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-        fclose(file);
-    }
-
-    /*now we have to create a vulkan buffer to store all the image data
-    and read all the png files raw data and copy it to the vulkan buffer;
-    then we'll have to copy the image data from the vulkan buffer to the
-    respective vulkan images for each texture*/
-    VkBufferWrapper tex_buf(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true, false);
-    createBuffer(tex_buf, total_size * 4);
-
-    /*having created the texture buffer and allocated and bound memory to it
-    we now have to read raw image data and copy it into the buffer*/
-    void* tex_buf_ptr = nullptr;
-    vkMapMemory(m_device, tex_buf.mem, 0, VK_WHOLE_SIZE, 0, &tex_buf_ptr);
-
-    size_t base_offset = 0;
-
-    for(size_t t = 0; t < textures_to_load.size(); t++)
-    {
-        const auto w = img_sizes[t].x;
-        const auto h = img_sizes[t].y;
-
-        auto file = std::fopen(texture_filenames[textures_to_load[t]].data(), "rb");
-
-        auto png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-        auto info_ptr = png_create_info_struct(png_ptr);
+            const auto& filename = texture_filenames[textures_to_load[t]];
+            baked_textures[t] = AssetCache::load(filename, generate_mipmaps ? "texture" : "texture_no_mips", TextureLoader::BAKED_TEXTURE_VERSION,
+                                                 [&]{ return TextureLoader::bakeTexture(filename, generate_mipmaps); });
 
-        png_init_io(png_ptr, file);
-        png_read_info(png_ptr, info_ptr);
-
-        const auto color_type = png_get_color_type(png_ptr, info_ptr);
-        const auto bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-
-        if(16 == bit_depth)
-        {
-            png_set_strip_16(png_ptr);
-        }
+            const auto baked = baked_textures[t]->data();
+            uint64_t texel_size = 0;
 
-        if(color_type == PNG_COLOR_TYPE_PALETTE)
-        {
-            png_set_palette_to_rgb(png_ptr);
-        }
+            if(baked.size() >= sizeof(TextureLoader::BakedTextureHeader))
+            {
+                std::memcpy(&headers[t], baked.data(), sizeof(TextureLoader::BakedTextureHeader));
 
-        if((PNG_COLOR_TYPE_GRAY == color_type) && (bit_depth < 8))
-        {
-            png_set_expand_gray_1_2_4_to_8(png_ptr);
-        }
+                for(uint32_t mip = 0; mip < headers[t].mip_count; mip++)
+                {
+                    const uvec2 mip_size = TextureLoader::mipSize(headers[t], mip);
+                    texel_size += uint64_t(mip_size.x) * mip_size.y * sizeof(uint32_t);
+                }
+            }
 
-        if(png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
-        {
-            png_set_tRNS_to_alpha(png_ptr);
+            if((baked.size() < sizeof(TextureLoader::BakedTextureHeader)) || (headers[t].mip_count == 0) || (headers[t].mip_count > static_cast<uint32_t>(std::bit_width(std::max(headers[t].width, headers[t].height))))
+               || (baked.size() != sizeof(TextureLoader::BakedTextureHeader) + texel_size))
+            {
+                error(std::format("Baked texture of {} is corrupted.", filename));
+            }
         }
-
-        if((PNG_COLOR_TYPE_RGB == color_type) || (PNG_COLOR_TYPE_GRAY == color_type) || (PNG_COLOR_TYPE_PALETTE == color_type))
+        catch(...)
         {
-            png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+            exceptions[t] = std::current_exception();
         }
+    });
 
-        if((PNG_COLOR_TYPE_GRAY == color_type) || (PNG_COLOR_TYPE_GRAY_ALPHA == color_type))
+    for(const auto& exception : exceptions)
+    {
+        if(exception)
         {
-            png_set_gray_to_rgb(png_ptr);
+            std::rethrow_exception(exception);
         }
+    }
 
-        png_read_update_info(png_ptr, info_ptr);
-
-        std::vector<uint8_t*> row_ptrs(h);
-        for(size_t i = 0; i < h; i++)
-        {
-            row_ptrs[i] = reinterpret_cast<uint8_t*>(tex_buf_ptr) + base_offset + i*w*4;
-        }
+    std::vector<size_t> base_offsets(textures_to_load.size());
+    VkDeviceSize total_size = 0;
 
-        png_read_image(png_ptr, row_ptrs.data());
+    for(size_t t = 0; t < textures_to_load.size(); t++)
+    {
+        base_offsets[t] = total_size;
+        total_size += baked_textures[t]->data().size() - sizeof(TextureLoader::BakedTextureHeader);
+    }
 
-        base_offset += w*h*4;
+    /*all the mips of all the textures go into one staging buffer, they're copied from there to the images*/
+    VkBufferWrapper tex_buf(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true, false);
+    createBuffer(tex_buf, total_size);
 
-        png_read_end(png_ptr, NULL);
-        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    void* tex_buf_ptr = nullptr;
+    vkMapMemory(m_device, tex_buf.mem, 0, VK_WHOLE_SIZE, 0, &tex_buf_ptr);
 
-        fclose(file);
-    }
+    parallelFor(static_cast<uint32_t>(textures_to_load.size()), [&](uint32_t t)
+    {
+        const auto texels = baked_textures[t]->data().subspan(sizeof(TextureLoader::BakedTextureHeader));
+        std::memcpy(reinterpret_cast<uint8_t*>(tex_buf_ptr) + base_offsets[t], texels.data(), texels.size());
+    });
 
     vkUnmapMemory(m_device, tex_buf.mem);
+    baked_textures.clear();
 
     /*now we'll have to record commands to copy the buffer contents to vulkan images*/
     VkCommandBufferBeginInfo begin_info{};
@@ -642,8 +616,6 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
     res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
     assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
 
-    base_offset = 0;
-
     for(size_t t = 0; t < textures_to_load.size(); t++)
     {
         uint32_t tex_id = 0;
@@ -663,27 +635,18 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
         tex_col.ids[texture_filenames[textures_to_load[t]].data()] = tex_id;
         VkImageWrapper& texture = tex_col.textures[tex_id];
 
-        const auto w = img_sizes[t].x;
-        const auto h = img_sizes[t].y;
+        const auto& header = headers[t];
 
         /*update vulkan create info and create an image for the texture*/
-        img_create_info.extent = {w, h, 1};
+        img_create_info.extent = {header.width, header.height, 1};
         //TODO: why set arrayLayers here when it's always 1? can set it earlier before the loop
         img_create_info.arrayLayers = 1;
+        img_create_info.mipLevels = header.mip_count;
 
         //TODO: why set image here when it's set inside createImage()?
         img_view_create_info.image = texture.img;
         img_view_create_info.subresourceRange.layerCount = img_create_info.arrayLayers;
 
-        if(generate_mipmaps)
-        {
-            img_create_info.mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(static_cast<float>(w), static_cast<float>(h))))) + 1;
-        }
-        else
-        {
-            img_create_info.mipLevels = 1;
-        }
-
         createImage(texture, img_create_info, img_view_create_info);
 
         VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, img_create_info.mipLevels, 0, 1};
@@ -693,67 +656,34 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
 
         vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
 
-        VkBufferImageCopy buf_img_copy{};
-        buf_img_copy.bufferOffset = base_offset;
-        buf_img_copy.bufferRowLength = 0;
-        buf_img_copy.bufferImageHeight = 0;
-
-        buf_img_copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        buf_img_copy.imageSubresource.mipLevel = 0;
-        buf_img_copy.imageSubresource.baseArrayLayer = 0;
-        buf_img_copy.imageSubresource.layerCount = 1;
-
-        buf_img_copy.imageOffset = {0, 0, 0};
-        buf_img_copy.imageExtent = {w, h, 1};
-
-        vkCmdCopyBufferToImage(m_transfer_cmd_buf, tex_buf.buf, texture.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buf_img_copy);
-
-        base_offset += 4*w*h;
+        std::vector<VkBufferImageCopy> buf_img_copies(header.mip_count);
+        VkDeviceSize mip_offset = base_offsets[t];
 
-        if(generate_mipmaps && img_create_info.mipLevels > 1)
+        for(uint32_t mip = 0; mip < header.mip_count; mip++)
         {
-            for(uint32_t i = 0; i < img_create_info.mipLevels - 1; i++)
-            {
-                img_sub_range.baseMipLevel = i;
-                img_sub_range.levelCount = 1;
-                img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, texture.img, img_sub_range};
-
-                vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
-
-                VkImageBlit img_blit{};
-                img_blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
-                img_blit.srcOffsets[0] = {0, 0, 0};
-                img_blit.srcOffsets[1] = {std::max(1, static_cast<int>(w / std::pow(2, i))), std::max(1, static_cast<int>(h / std::pow(2, i))), 1};
-                img_blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i + 1, 0, 1};
-                img_blit.dstOffsets[0] = {0, 0, 0};
-                img_blit.dstOffsets[1] = {std::max(1, static_cast<int>(w / std::pow(2, i + 1))), std::max(1, static_cast<int>(h / std::pow(2, i + 1))), 1};
-
-                vkCmdBlitImage(m_transfer_cmd_buf, texture.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &img_blit, VK_FILTER_LINEAR);
-            }
+            const uvec2 mip_size = TextureLoader::mipSize(header, mip);
 
-            //TODO: put these 2 barriers together into a single vkCmdPipelineBarrier() call
-            img_sub_range.baseMipLevel = 0;
-            img_sub_range.levelCount = img_create_info.mipLevels - 1;
-            img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, texture.img, img_sub_range};
+            buf_img_copies[mip].bufferOffset = mip_offset;
+            buf_img_copies[mip].bufferRowLength = 0;
+            buf_img_copies[mip].bufferImageHeight = 0;
+            buf_img_copies[mip].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+            buf_img_copies[mip].imageOffset = {0, 0, 0};
+            buf_img_copies[mip].imageExtent = {mip_size.x, mip_size.y, 1};
 
-            vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+            mip_offset += VkDeviceSize(mip_size.x) * mip_size.y * 4;
+        }
 
-            img_sub_range.baseMipLevel = img_create_info.mipLevels - 1;
-            img_sub_range.levelCount = 1;
-            img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, texture.img, img_sub_range};
+        vkCmdCopyBufferToImage(m_transfer_cmd_buf, tex_buf.buf, texture.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(buf_img_copies.size()), buf_img_copies.data());
 
-            vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
-        }
-        else
-        {
-            img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, texture.img, img_sub_range};
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, texture.img, img_sub_range};
 
-            vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
-        }
+        vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+    }
+
+    for(const auto& [i, t] : duplicates)
+    {
+        ret[i] = ret[textures_to_load[t]];
     }
 
     res = vkEndCommandBuffer(m_transfer_cmd_buf);
@@ -787,10 +717,14 @@ std::vector<uint32_t> Renderer::loadTexturesGeneric(const std::vector<std::strin
 /*---------------- main methods ----------------*/
 
 Renderer::Renderer(const Window& window, std::string_view app_name)
-    : m_dir_shadow_map_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT)
-    , m_point_shadow_map_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT)
+    : m_dir_shadow_map_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT)
+    , m_point_shadow_map_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT)
     , m_bone_transform_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT)
-    , m_terrain_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT)
+    , m_dir_light_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, false)
+    , m_dir_light_ids_buffer(VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_FORMAT_R16_UINT, false)
+    , m_point_light_buffer(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, false)
+    , m_point_light_ids_buffer(VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_FORMAT_R16_UINT, false)
+    , m_light_cluster_buffer(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false)
 {
     try
     {
@@ -803,9 +737,11 @@ Renderer::Renderer(const Window& window, std::string_view app_name)
         createCommandPool();
         createCommandBuffers();
         createSynchronizationPrimitives();
+        createQueryPools();
         createRenderTargets();
         createSamplers();
         createBuffers();
+        createPointShadowMaps();
 
         m_render_batches.reserve(10000);
         m_render_batches_ui.reserve(10000);
@@ -840,23 +776,31 @@ void Renderer::destroy() noexcept
         for(auto& per_frame_data : m_per_frame_data)
         {
             destroyBuffer(*per_frame_data.common_buffer);
-            destroyBuffer(*per_frame_data.dir_light_buffer);
-            destroyBuffer(*per_frame_data.dir_light_valid_buffer);
-            destroyBuffer(*per_frame_data.point_light_buffer);
-            destroyBuffer(*per_frame_data.point_light_valid_buffer);
+            destroyBuffer(*per_frame_data.terrain_heightmap_staging_buffer);
+            destroyBuffer(*per_frame_data.terrain_splat_map_staging_buffer);
+            destroyBuffer(*per_frame_data.terrain_vt_staging_buffer);
+            destroyBuffer(*per_frame_data.terrain_heightmap_readback_buffer);
         }
 
+        destroyBuffer(m_dir_light_buffer);
+        destroyBuffer(m_dir_light_ids_buffer);
+        destroyBuffer(m_point_light_buffer);
+        destroyBuffer(m_point_light_ids_buffer);
+
         for(auto& vb : m_vertex_buffers)
         {
             destroyBuffer(vb.second);
         }
 
         destroyBuffer(m_instance_vertex_buffer);
+        destroyBuffer(m_index_buffer16);
+        destroyBuffer(m_index_buffer32);
         destroyBuffer(m_dir_shadow_map_buffer);
         destroyBuffer(m_point_shadow_map_buffer);
         destroyBuffer(m_bone_transform_buffer);
-        destroyBuffer(m_terrain_buffer);
+        destroyBuffer(m_light_cluster_buffer);
 
+        destroyQueryPools();
         destroySynchronizationPrimitives();
         destroyCommandPool();
         destroyPipelines();
@@ -883,9 +827,9 @@ void Renderer::resizeBuffers()
     {
         if(buf->req_size > buf->size)
         {
-            //TODO: this is a hack - currently only vertex buffers don't use descriptors so this works,
+            //TODO: this is a hack - currently only vertex and index buffers don't use descriptors so this works,
             //but we should use a more robust way of checking if resizing/recreating a buffer requires a descriptor update
-            if(!(buf->usage_flags & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT))
+            if(!(buf->usage_flags & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT)))
             {
                 m_update_descriptors = true;
             }
@@ -971,6 +915,89 @@ void Renderer::updateBuffers()
     m_buffer_update_reqs.clear();
 }
 
+//extracts the world space planes of the frustum described by a view-projection matrix with [0,1] depth,
+//the planes point inwards, same as the ones returned by Camera::viewFrustumPlanesW
+static std::array<vec4, 6> frustumPlanes(const mat4x4& VP)
+{
+    const mat4x4 M = transpose(VP);
+
+    std::array<vec4, 6> planes = {M[3] + M[0], M[3] - M[0], M[3] + M[1], M[3] - M[1], M[2], M[3] - M[2]};
+
+    for(auto& plane : planes)
+    {
+        plane /= length(vec3(plane));
+    }
+
+    return planes;
+}
+
+void Renderer::updateViews(const Camera& camera)
+{
+    //update all dir shadow maps every frame as they depend on the camera and we can assume the camera will change every frame
+    //TODO: verify the above, as it may no longer be true
+    for(DirLightId i = 0; i < m_common_buffer_data.dir_light_count; i++)
+    {
+        if(m_dir_lights_valid[i] && m_dir_lights[i].shadow_map_count)
+        {
+            updateDirShadowMap(camera, m_dir_lights[i]);
+        }
+    }
+
+    cullLights(camera);
+
+    //pick which point lights get a shadow map this frame and at what resolution
+    assignPointShadowMaps(camera);
+
+    m_camera_view.id = RENDER_VIEW_CAMERA;
+    m_camera_view.pos = camera.pos();
+    m_camera_view.pixels_per_unit = 0.5f * static_cast<float>(m_surface_height) * camera.imagePlaneDistance();
+    m_camera_view.frustum_count = 1;
+    m_camera_view.frusta[0] = camera.viewFrustumPlanesW();
+
+    m_shadow_views.clear();
+
+    for(uint32_t dir_shadow_map_id = 0; dir_shadow_map_id < m_dir_shadow_map_count; dir_shadow_map_id++)
+    {
+        if(!m_dir_shadow_maps_valid[dir_shadow_map_id])
+        {
+            continue;
+        }
+
+        auto& view = m_shadow_views.emplace_back();
+        view.id = RENDER_VIEW_DIR_SHADOW_MAP + dir_shadow_map_id;
+        view.frustum_count = m_dir_shadow_maps[dir_shadow_map_id].count;
+
+        for(uint32_t i = 0; i < view.frustum_count; i++)
+        {
+            view.frusta[i] = frustumPlanes(m_dir_shadow_map_data[dir_shadow_map_id][i].P);
+        }
+    }
+
+    for(uint32_t point_shadow_map_id = 0; point_shadow_map_id < MAX_POINT_SHADOW_MAP_COUNT; point_shadow_map_id++)
+    {
+        const auto& shadow_map = m_point_shadow_maps[point_shadow_map_id];
+
+        if((shadow_map.light_id == POINT_LIGHT_ID_NONE) || (shadow_map.last_used_frame != m_point_shadow_map_frame))
+        {
+            continue;
+        }
+
+        const auto& light = m_point_lights[shadow_map.light_id];
+
+        //the 6 faces of a cube map together cover the cube around the light that bounds its sphere of influence
+        auto& view = m_shadow_views.emplace_back();
+        view.id = RENDER_VIEW_POINT_SHADOW_MAP + point_shadow_map_id;
+        view.pos = light.pos;
+        view.frustum_count = 1;
+        view.frusta[0] = {vec4( 1.0f,  0.0f,  0.0f, light.max_d - light.pos.x),
+                          vec4(-1.0f,  0.0f,  0.0f, light.max_d + light.pos.x),
+                          vec4( 0.0f,  1.0f,  0.0f, light.max_d - light.pos.y),
+                          vec4( 0.0f, -1.0f,  0.0f, light.max_d + light.pos.y),
+                          vec4( 0.0f,  0.0f,  1.0f, light.max_d - light.pos.z),
+                          vec4( 0.0f,  0.0f, -1.0f, light.max_d + light.pos.z)};
+    }
+}
+
 void Renderer::updateAndRender(const RenderData& render_data, const Camera& camera)
 {
     m_frame_id = (m_frame_id + 1) % FRAMES_IN_FLIGHT;
@@ -987,26 +1014,21 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
     m_common_buffer_data.editor_terrain_tool_inner_radius = render_data.editor_terrain_tool_inner_radius;
     m_common_buffer_data.editor_terrain_tool_outer_radius = render_data.editor_terrain_tool_outer_radius;
     m_common_buffer_data.terrain_patch_size = render_data.terrain_patch_size;
-
-    //update all dir shadow maps every frame as they depend on the camera and we can assume the camera will change every frame
-    //TODO: verify the above, as it may no longer be true
-    for(DirLightId i = 0; i < m_common_buffer_data.dir_light_count; i++)
-    {
-        if(m_dir_lights_valid[i] && m_dir_lights[i].shadow_map_count)
-        {
-            updateDirShadowMap(camera, m_dir_lights[i]);
-        }
-    }
+    m_common_buffer_data.tan_half_fov = vec2(camera.aspectRatio(), 1.0f) / camera.imagePlaneDistance();
+    m_common_buffer_data.camera_near = camera.near();
+    m_common_buffer_data.camera_far = camera.far();
+    m_common_buffer_data.pixels_per_unit = 0.5f * static_cast<float>(m_surface_height) * camera.imagePlaneDistance();
+    m_common_buffer_data.terrain_vt_feedback_phase = (m_common_buffer_data.terrain_vt_feedback_phase + 1) % (TERRAIN_VT_FEEDBACK_STRIDE * TERRAIN_VT_FEEDBACK_STRIDE);
 
     //only update point shadow maps for the point lights that have changed this frame
-    for(PointLightId id : per_frame_data.point_lights_to_update)
+    for(PointLightId id : m_point_lights_to_update)
     {
         //TODO: updating point shadow maps is pretty expensive
         //and it only has to be done if either the position or max_d of the light has changed
         //other changes don't require the shadow map update
         //maybe it would be worth checking if those specific values have changed and only then update the shadow map
         //this should be profiled in the future once we have specific use cases to check what's optimal
-        if(m_point_lights_valid[id] && m_point_lights[id].shadow_map_res)
+        if(m_point_lights_valid[id] && m_point_lights[id].shadow_map_id != POINT_SHADOW_MAP_ID_NONE)
         {
             updatePointShadowMap(m_point_lights[id]);
         }
@@ -1060,41 +1082,40 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
     }
     per_frame_data.bufs_to_destroy.clear();
 
+    //shadow maps queued here were marked for destroy right after this frame was last submitted,
+    //so now that its fence has been signaled no frame in flight can be using them anymore
     for(auto id : per_frame_data.dir_shadow_maps_to_destroy)
     {
-        destroyDirShadowMap(per_frame_data.dir_shadow_maps[id]);
+        destroyDirShadowMap(m_dir_shadow_maps[id]);
 
-        if(m_frame_id == m_dir_shadow_map_free_id_frame_ids[id])
+        if(id == m_dir_shadow_map_count - 1)
         {
-            if(id == m_dir_shadow_map_count - 1)
-            {
-                m_dir_shadow_map_count--;
-            }
-            else
-            {
-                m_dir_shadow_maps_free_ids.push(id);
-            }
+            m_dir_shadow_map_count--;
+        }
+        else
+        {
+            m_dir_shadow_maps_free_ids.push(id);
         }
     }
     per_frame_data.dir_shadow_maps_to_destroy.clear();
 
-    for(auto id : per_frame_data.point_shadow_maps_to_destroy)
+    //the fence guarantees the timestamps of this frame's previous submission are available
+    if(per_frame_data.timestamps_written)
     {
-        destroyPointShadowMap(per_frame_data.point_shadow_maps[id]);
+        std::array<uint64_t, 2> timestamps;
+        res = vkGetQueryPoolResults(m_device, per_frame_data.timestamp_query_pool, 0, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
 
-        if(m_frame_id == m_point_shadow_map_free_id_frame_ids[id])
+        if(res == VK_SUCCESS)
         {
-            if(id == m_point_shadow_map_count - 1)
-            {
-                m_point_shadow_map_count--;
-            }
-            else
-            {
-                m_point_shadow_maps_free_ids.push(id);
-            }
+            m_shadow_pass_gpu_time = static_cast<float>(timestamps[1] - timestamps[0]) * m_physical_device_properties.limits.timestampPeriod / 1000000.0f;
         }
+
+        per_frame_data.timestamps_written = false;
     }
-    per_frame_data.point_shadow_maps_to_destroy.clear();
+
+    //same for the brush results this frame copied back last time
+    readBackTerrainHeightmaps(per_frame_data);
+    readBackTerrainVTFeedback(per_frame_data);
 
     /*--------------------- command recording begin ---------------------*/
     VkCommandBufferBeginInfo begin_info{};
@@ -1106,6 +1127,11 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
     res = vkBeginCommandBuffer(cmd_buf, &begin_info);
     assertVkSuccess(res, "An error occurred while begining a command buffer.");
 
+    if(m_timestamp_support)
+    {
+        vkCmdResetQueryPool(cmd_buf, per_frame_data.timestamp_query_pool, 0, 2);
+    }
+
     //TODO: group all the transfer barriers together and use them in a single call
     /*--- update buffers ---*/
     {
@@ -1115,51 +1141,151 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
         vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
     }
 
+    //light buffers are shared between frames in flight, so before overwriting them
+    //we have to wait for the previous frame's shaders to finish reading them
+    if(!m_dir_lights_to_update.empty() || !m_point_lights_to_update.empty() || m_common_buffer_data.dir_light_count != 0 || m_common_buffer_data.point_light_count != 0)
+    {
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+    }
+
     //TODO: we can store the min and max index of the lights that actually changed this frame and update from the min to max instead of all
-    if(!per_frame_data.dir_lights_to_update.empty())
+    if(!m_dir_lights_to_update.empty())
     {
-        for(DirLightId id : per_frame_data.dir_lights_to_update)
+        for(DirLightId id : m_dir_lights_to_update)
         {
-            vkCmdUpdateBuffer(cmd_buf, per_frame_data.dir_light_buffer->buf, id * sizeof(DirLightShaderData), sizeof(DirLightShaderData), &m_dir_lights[id]);
+            vkCmdUpdateBuffer(cmd_buf, m_dir_light_buffer.buf, id * sizeof(DirLightShaderData), sizeof(DirLightShaderData), &m_dir_lights[id]);
         }
 
-        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, per_frame_data.dir_light_buffer->buf, 0, m_common_buffer_data.dir_light_count * sizeof(DirLightShaderData)};
+        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_dir_light_buffer.buf, 0, m_common_buffer_data.dir_light_count * sizeof(DirLightShaderData)};
         vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
     }
 
     //TODO: we can store the min and max index of the lights that actually changed this frame and update from the min to max instead of all
-    if(!per_frame_data.point_lights_to_update.empty())
+    if(!m_point_lights_to_update.empty())
     {
-        for(PointLightId id : per_frame_data.point_lights_to_update)
+        for(PointLightId id : m_point_lights_to_update)
         {
-            vkCmdUpdateBuffer(cmd_buf, per_frame_data.point_light_buffer->buf, id * sizeof(PointLightShaderData), sizeof(PointLightShaderData), &m_point_lights[id]);
+            vkCmdUpdateBuffer(cmd_buf, m_point_light_buffer.buf, id * sizeof(PointLightShaderData), sizeof(PointLightShaderData), &m_point_lights[id]);
         }
 
-        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, per_frame_data.point_light_buffer->buf, 0, m_common_buffer_data.point_light_count * sizeof(PointLightShaderData)};
+        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_point_light_buffer.buf, 0, m_common_buffer_data.point_light_count * sizeof(PointLightShaderData)};
         vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
     }
 
-    //TODO: set some flag if we need to update light valid buffers if we actually change any lights
-    if(m_common_buffer_data.dir_light_count != 0)
+    //the visible light id lists change with the camera, so they get uploaded every frame
+    //vkCmdUpdateBuffer needs the size to be a multiple of 4, the array sizes are even so reading the padding id is fine
+    if(m_common_buffer_data.visible_dir_light_count != 0)
     {
-        const VkDeviceSize data_size = roundUp(m_common_buffer_data.dir_light_count, 4u);
+        const VkDeviceSize data_size = roundUp<VkDeviceSize>(m_common_buffer_data.visible_dir_light_count * sizeof(uint16_t), 4);
 
-        vkCmdUpdateBuffer(cmd_buf, per_frame_data.dir_light_valid_buffer->buf, 0, data_size, m_dir_lights_valid.data());
-        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, per_frame_data.dir_light_valid_buffer->buf, 0, data_size};
-        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
+        vkCmdUpdateBuffer(cmd_buf, m_dir_light_ids_buffer.buf, 0, data_size, m_visible_dir_light_ids.data());
+        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_dir_light_ids_buffer.buf, 0, data_size};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
     }
 
-    if(m_common_buffer_data.point_light_count != 0)
+    if(m_common_buffer_data.visible_point_light_count != 0)
+    {
+        const VkDeviceSize data_size = roundUp<VkDeviceSize>(m_common_buffer_data.visible_point_light_count * sizeof(uint16_t), 4);
+
+        vkCmdUpdateBuffer(cmd_buf, m_point_light_ids_buffer.buf, 0, data_size, m_visible_point_light_ids.data());
+        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_point_light_ids_buffer.buf, 0, data_size};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
+    }
+
+    m_dir_lights_to_update.clear();
+    m_point_lights_to_update.clear();
+
+    if(m_terrain_vt_page_table.img)
     {
-        const VkDeviceSize data_size = roundUp(m_common_buffer_data.point_light_count, 4u);
+        //the feedback this buffer held last time has been read back after the fence wait, so it can start over
+        const VkBufferWrapper& feedback_buf = *per_frame_data.terrain_vt_feedback_buffer;
+        vkCmdFillBuffer(cmd_buf, feedback_buf.buf, 0, VK_WHOLE_SIZE, 0);
+
+        const VkBufferMemoryBarrier buf_mem_bar{VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+                                                VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, feedback_buf.buf, 0, VK_WHOLE_SIZE};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
+
+        per_frame_data.terrain_vt_feedback_written = true;
+    }
+
+    //the page data and the page table entries pointing to it are copied in the same frame, so the shaders never see one without the other
+    if(!m_terrain_vt_upload_reqs.empty())
+    {
+        constexpr uint64_t page_size = TERRAIN_VT_PADDED_PAGE_RES * TERRAIN_VT_PADDED_PAGE_RES * sizeof(uint32_t);
+        //the page table entries are staged after the pages, 4 bytes apart to keep the copy offsets aligned
+        constexpr uint64_t entries_offset = MAX_TERRAIN_VT_UPLOADS_PER_FRAME * page_size;
+        const VkBufferWrapper& staging_buf = *per_frame_data.terrain_vt_staging_buffer;
+        const uint32_t upload_count = std::min<uint32_t>(static_cast<uint32_t>(m_terrain_vt_upload_reqs.size()), MAX_TERRAIN_VT_UPLOADS_PER_FRAME);
+
+        void* staging_data = nullptr;
+        res = vkMapMemory(m_device, staging_buf.mem, 0, VK_WHOLE_SIZE, 0, &staging_data);
+        assertVkSuccess(res, "Failed to map buffer memory");
+
+        std::array<VkBufferImageCopy, MAX_TERRAIN_VT_UPLOADS_PER_FRAME> page_copies;
+        std::vector<VkBufferImageCopy> entry_copies;
+        uint32_t entry_count = 0;
+
+        auto stageEntry = [&](uint32_t mip, const uvec2& page, uint16_t entry)
+        {
+            const uint64_t offset = entries_offset + entry_count * sizeof(uint32_t);
+            std::memcpy(static_cast<uint8_t*>(staging_data) + offset, &entry, sizeof(entry));
+            entry_copies.push_back(VkBufferImageCopy{offset, 0, 0, {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1},
+                                                     {static_cast<int32_t>(page.x), static_cast<int32_t>(page.y), 0}, {1, 1, 1}});
+            entry_count++;
+        };
+
+        for(uint32_t i = 0; i < upload_count; i++)
+        {
+            const auto& req = m_terrain_vt_upload_reqs[i];
+            std::memcpy(static_cast<uint8_t*>(staging_data) + i * page_size, req.data, page_size);
+
+            const uvec2 cache_pos = uvec2(req.cache_slot % TERRAIN_VT_CACHE_PAGES, req.cache_slot / TERRAIN_VT_CACHE_PAGES) * static_cast<uint32_t>(TERRAIN_VT_PADDED_PAGE_RES);
+
+            page_copies[i].bufferOffset = i * page_size;
+            page_copies[i].bufferRowLength = 0;
+            page_copies[i].bufferImageHeight = 0;
+            page_copies[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            page_copies[i].imageOffset = {static_cast<int32_t>(cache_pos.x), static_cast<int32_t>(cache_pos.y), 0};
+            page_copies[i].imageExtent = {TERRAIN_VT_PADDED_PAGE_RES, TERRAIN_VT_PADDED_PAGE_RES, 1};
 
-        vkCmdUpdateBuffer(cmd_buf, per_frame_data.point_light_valid_buffer->buf, 0, data_size, m_point_lights_valid.data());
-        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, per_frame_data.point_light_valid_buffer->buf, 0, data_size};
-        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_GEOMETRY_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
+            if(req.evicted)
+            {
+                stageEntry(req.evicted_mip, req.evicted_page, TERRAIN_VT_PAGE_NONE);
+            }
+
+            stageEntry(req.mip, req.page, static_cast<uint16_t>(req.cache_slot));
+        }
+
+        vkUnmapMemory(m_device, staging_buf.mem);
+
+        const VkImageSubresourceRange cache_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        const VkImageSubresourceRange page_table_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, m_common_buffer_data.terrain_vt_mip_count, 0, 1};
+
+        std::array<VkImageMemoryBarrier, 2> img_mem_bars
+        {
+            VkImageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_vt_cache.img, cache_sub_range},
+            VkImageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_vt_page_table.img, page_table_sub_range}
+        };
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, static_cast<uint32_t>(img_mem_bars.size()), img_mem_bars.data());
+
+        vkCmdCopyBufferToImage(cmd_buf, staging_buf.buf, m_terrain_vt_cache.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload_count, page_copies.data());
+        vkCmdCopyBufferToImage(cmd_buf, staging_buf.buf, m_terrain_vt_page_table.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, entry_count, entry_copies.data());
+
+        for(auto& img_mem_bar : img_mem_bars)
+        {
+            img_mem_bar.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            img_mem_bar.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            img_mem_bar.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            img_mem_bar.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, static_cast<uint32_t>(img_mem_bars.size()), img_mem_bars.data());
+
+        m_terrain_vt_upload_reqs.erase(m_terrain_vt_upload_reqs.begin(), m_terrain_vt_upload_reqs.begin() + upload_count);
     }
 
-    per_frame_data.dir_lights_to_update.clear();
-    per_frame_data.point_lights_to_update.clear();
+    recordTerrainHeightmapUpdates(cmd_buf, per_frame_data);
 
     /*bind vertex buffer*/
     const VkDeviceSize vb_offset = 0;
@@ -1168,7 +1294,35 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
     /*bind descriptor sets*/
     vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &per_frame_data.descriptor_set, 0, NULL);
 
+    /*light clustering*/
+    {
+        //make the light data uploaded above visible to the compute shader
+        //and wait for the previous frame's fragment shaders to finish reading the shared cluster buffer before overwriting it
+        VkMemoryBarrier mem_bar = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &mem_bar, 0, NULL, 0, NULL);
+
+        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_light_clustering_pipeline);
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 1, &per_frame_data.descriptor_set, 0, NULL);
+        vkCmdDispatch(cmd_buf, (LIGHT_CLUSTER_COUNT + LIGHT_CLUSTERING_GROUP_SIZE - 1) / LIGHT_CLUSTERING_GROUP_SIZE, 1, 1);
+
+        VkBufferMemoryBarrier buf_mem_bar = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_light_cluster_buffer.buf, 0, m_light_cluster_buffer.size};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 1, &buf_mem_bar, 0, NULL);
+    }
+
     /*shadow map rendering*/
+    if(m_timestamp_support)
+    {
+        vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, per_frame_data.timestamp_query_pool, 0);
+    }
+
+    //the layered pipelines write gl_Layer from the vertex/tessellation stages, one instance per layer,
+    //so every draw has to be issued with the instance count equal to the number of layers
+    const RenderMode dir_sm_render_mode = m_layered_shadows ? RenderMode::DirShadowMapLayered : RenderMode::DirShadowMap;
+    const RenderMode terrain_dir_sm_render_mode = m_layered_shadows ? RenderMode::TerrainDirShadowMapLayered : RenderMode::TerrainDirShadowMap;
+    const RenderMode terrain_dir_sm_mesh_render_mode = m_layered_shadows ? RenderMode::TerrainDirShadowMapMeshLayered : RenderMode::TerrainDirShadowMapMesh;
+    const RenderMode point_sm_render_mode = m_layered_shadows ? RenderMode::PointShadowMapLayered : RenderMode::PointShadowMap;
+    const RenderMode terrain_point_sm_render_mode = m_layered_shadows ? RenderMode::TerrainPointShadowMapLayered : RenderMode::TerrainPointShadowMap;
+
     if(m_dir_shadow_map_count != 0)
     {
         uint32_t prev_viewport_width = 0;
@@ -1181,7 +1335,7 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
                 continue;
             }
 
-            const auto& shadow_map = per_frame_data.dir_shadow_maps[dir_shadow_map_id];
+            const auto& shadow_map = m_dir_shadow_maps[dir_shadow_map_id];
 
             if((prev_viewport_width != shadow_map.res_x) || (prev_viewport_height != shadow_map.res_y))
             {
@@ -1196,30 +1350,56 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
                 vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
             }
 
-            push_const.shadow_map_count = shadow_map.count;
             push_const.shadow_map_offset = dir_shadow_map_id * MAX_DIR_SHADOW_MAP_PARTITIONS;
-            vkCmdPushConstants(cmd_buf, m_pipeline_layout, VK_SHADER_STAGE_GEOMETRY_BIT, 0, sizeof(push_const), &push_const);
+
+            //the tessellated terrain patches are only drawn into the near cascades, the far ones get the terrain's shadow mesh
+            const uint32_t terrain_mesh_cascade = std::min(m_terrain_shadow_mesh_cascade, shadow_map.count);
 
             vkCmdBeginRenderPass(cmd_buf, &shadow_map.render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
             for(const auto& rb : m_render_batches)
             {
+                if(!rb.drawnIn(RENDER_VIEW_DIR_SHADOW_MAP + dir_shadow_map_id))
+                {
+                    continue;
+                }
+
+                uint32_t first_layer = 0;
+                uint32_t layer_count = shadow_map.count;
+
                 if(rb.render_mode == RenderMode::Default)
                 {
-                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(RenderMode::DirShadowMap));
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[sizeof(VertexDefault)].buf, &vb_offset);
+                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(dir_sm_render_mode));
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[typeid(VertexDefault)].buf, &vb_offset);
                 }
                 else if(rb.render_mode == RenderMode::Terrain)
                 {
-                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(RenderMode::TerrainDirShadowMap));
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[sizeof(VertexTerrain)].buf, &vb_offset);
+                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(terrain_dir_sm_render_mode));
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[typeid(VertexTerrain)].buf, &vb_offset);
+                    layer_count = terrain_mesh_cascade;
+                }
+                else if(rb.render_mode == RenderMode::TerrainDirShadowMapMesh)
+                {
+                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(terrain_dir_sm_mesh_render_mode));
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[typeid(VertexTerrainShadowMesh)].buf, &vb_offset);
+                    first_layer = terrain_mesh_cascade;
+                    layer_count = shadow_map.count - terrain_mesh_cascade;
                 }
                 else
                 {
                     continue;
                 }
 
-                vkCmdDraw(cmd_buf, rb.vertex_count, 1, rb.vertex_offset, rb.instance_id);
+                if(0 == layer_count)
+                {
+                    continue;
+                }
+
+                push_const.first_shadow_map = first_layer;
+                push_const.shadow_map_count = first_layer + layer_count;
+                vkCmdPushConstants(cmd_buf, m_pipeline_layout, push_const_ranges[0].stageFlags, 0, sizeof(push_const), &push_const);
+
+                drawShadowMapBatch(cmd_buf, rb, first_layer, layer_count);
             }
 
             vkCmdEndRenderPass(cmd_buf);
@@ -1231,79 +1411,103 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
         }
     }
 
-    if(m_point_shadow_map_count != 0)
+    if(m_common_buffer_data.point_light_count != 0)
     {
-        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(RenderMode::PointShadowMap));
-        vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[sizeof(VertexDefault)].buf, &vb_offset);
-
         uint32_t prev_viewport_res = 0;
 
         //TODO: add frustum culling for point shadow map rendering?
-        for(uint32_t point_shadow_map_id = 0; point_shadow_map_id < m_point_shadow_map_count; point_shadow_map_id++)
+        for(uint32_t point_shadow_map_id = 0; point_shadow_map_id < MAX_POINT_SHADOW_MAP_COUNT; point_shadow_map_id++)
         {
-            if(!m_point_shadow_maps_valid[point_shadow_map_id])
+            const auto& shadow_map = m_point_shadow_maps[point_shadow_map_id];
+
+            //only render the shadow maps of the lights that were assigned a slot this frame
+            if((shadow_map.light_id == POINT_LIGHT_ID_NONE) || (shadow_map.last_used_frame != m_point_shadow_map_frame))
             {
                 continue;
             }
 
-            const auto& shadow_map = per_frame_data.point_shadow_maps[point_shadow_map_id];
+            const auto& tier = m_point_shadow_map_tiers[shadow_map.tier];
 
-            if(prev_viewport_res != shadow_map.res)
+            if(prev_viewport_res != tier.res)
             {
                 VkViewport viewport;
                 viewport.x = 0.0f;
-                viewport.y = static_cast<float>(shadow_map.res);
-                viewport.width = static_cast<float>(shadow_map.res);
-                viewport.height = -static_cast<float>(shadow_map.res);
+                viewport.y = static_cast<float>(tier.res);
+                viewport.width = static_cast<float>(tier.res);
+                viewport.height = -static_cast<float>(tier.res);
                 viewport.maxDepth = 1.0f;
                 viewport.minDepth = 0.0f;
 
                 vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
+                prev_viewport_res = tier.res;
             }
 
             push_const.shadow_map_offset = point_shadow_map_id;
-            vkCmdPushConstants(cmd_buf, m_pipeline_layout, VK_SHADER_STAGE_GEOMETRY_BIT, 0, sizeof(push_const), &push_const);
+            push_const.first_shadow_map = 0;
+            vkCmdPushConstants(cmd_buf, m_pipeline_layout, push_const_ranges[0].stageFlags, 0, sizeof(push_const), &push_const);
 
             vkCmdBeginRenderPass(cmd_buf, &shadow_map.render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
             for(const auto& rb : m_render_batches)
             {
+                if(!rb.drawnIn(RENDER_VIEW_POINT_SHADOW_MAP + point_shadow_map_id))
+                {
+                    continue;
+                }
+
                 if(rb.render_mode == RenderMode::Default)
                 {
-                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(RenderMode::PointShadowMap));
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[sizeof(VertexDefault)].buf, &vb_offset);
+                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(point_sm_render_mode));
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[typeid(VertexDefault)].buf, &vb_offset);
                 }
                 else if(rb.render_mode == RenderMode::Terrain)
                 {
-                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(RenderMode::TerrainPointShadowMap));
-                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[sizeof(VertexTerrain)].buf, &vb_offset);
+                    vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(terrain_point_sm_render_mode));
+                    vkCmdBindVertexBuffers(cmd_buf, 0, 1, &m_vertex_buffers[typeid(VertexTerrain)].buf, &vb_offset);
                 }
                 else
                 {
                     continue;
                 }
 
-                vkCmdDraw(cmd_buf, rb.vertex_count, 1, rb.vertex_offset, rb.instance_id);
+                drawShadowMapBatch(cmd_buf, rb, 0, 6);
             }
 
             vkCmdEndRenderPass(cmd_buf);
 
             //TODO: is the barrier necessary? or does the end of the render pass do what we want?
-            VkImageSubresourceRange subres_range = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 6};
-            VkImageMemoryBarrier img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, shadow_map.depth_img.img, subres_range};
+            VkImageSubresourceRange subres_range = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 6 * shadow_map.layer, 6};
+            VkImageMemoryBarrier img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, tier.depth_img.img, subres_range};
             vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
         }
     }
 
+    if(m_layered_shadows)
+    {
+        //the layered shadow map draws rebind the instance buffer per batch
+        vkCmdBindVertexBuffers(cmd_buf, 1, 1, &m_instance_vertex_buffer.buf, &vb_offset);
+    }
+
+    if(m_timestamp_support)
+    {
+        vkCmdWriteTimestamp(cmd_buf, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, per_frame_data.timestamp_query_pool, 1);
+        per_frame_data.timestamps_written = true;
+    }
+
     /*main render pass*/
     vkCmdBeginRenderPass(cmd_buf, &m_render_targets[image_id].render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
 
     for(const auto& rb : m_render_batches)
     {
+        if(!rb.drawnIn(RENDER_VIEW_CAMERA))
+        {
+            continue;
+        }
+
         vkCmdPushConstants(cmd_buf, m_pipeline_layout, push_const_ranges[0].stageFlags, 0, sizeof(push_const), &push_const);
         vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, getPipeline(rb.render_mode));
         vkCmdBindVertexBuffers(cmd_buf, 0, 1, &rb.vb->buf, &vb_offset);
-        vkCmdDraw(cmd_buf, rb.vertex_count, 1, rb.vertex_offset, rb.instance_id);
+        drawBatch(cmd_buf, rb, 1, rb.instance_id);
     }
     m_render_batches.clear();
 
@@ -1327,6 +1531,12 @@ void Renderer::updateAndRender(const RenderData& render_data, const Camera& came
 
     vkCmdEndRenderPass(cmd_buf);
 
+    if(per_frame_data.terrain_vt_feedback_written)
+    {
+        const VkMemoryBarrier mem_bar = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &mem_bar, 0, NULL, 0, NULL);
+    }
+
     res = vkEndCommandBuffer(cmd_buf);
     assertVkSuccess(res, "Failed to record command buffer.");
     /*--------------------- command recording end ---------------------*/
@@ -1545,12 +1755,14 @@ void Renderer::destroyTextures() noexcept
 
     m_normal_maps.clear();
 
-    for(auto& heightmap : m_terrain_heightmaps)
-    {
-        destroyImage(heightmap);
-    }
+    destroyImage(m_terrain_heightmaps);
+    destroyImage(m_terrain_slope_maps);
+    destroyImage(m_terrain_splat_maps);
+    m_terrain_heightmap_slot_count = 0;
+    m_terrain_heightmap_update_reqs.clear();
+    m_terrain_splat_map_update_reqs.clear();
 
-    m_terrain_heightmaps.clear();
+    destroyTerrainVirtualTexture();
 }
 
 void Renderer::destroyFontTextures() noexcept
@@ -1604,7 +1816,99 @@ bool Renderer::enableVsync(bool vsync)
     return true;
 }
 
-void initStaticVB(uint64_t data_size)
+bool Renderer::enableLayeredShadows(bool layered_shadows)
+{
+    if(!m_layered_shadow_support)
+    {
+        return false;
+    }
+
+    m_layered_shadows = layered_shadows;
+
+    return true;
+}
+
+float Renderer::shadowPassGpuTime() const noexcept
+{
+    return m_shadow_pass_gpu_time;
+}
+
+void Renderer::setTerrainShadowTessScale(uint32_t cascade, float scale)
+{
+    if(cascade >= MAX_DIR_SHADOW_MAP_PARTITIONS)
+    {
+        error(std::format("Terrain shadow tessellation scale set for cascade {}. Max = {}", cascade, MAX_DIR_SHADOW_MAP_PARTITIONS - 1));
+    }
+
+    //picked up by updateDirShadowMap with the rest of the cascade data
+    m_terrain_shadow_tess_scales[cascade] = std::clamp(scale, 0.0f, 1.0f);
+}
+
+void Renderer::setTerrainShadowMeshCascade(uint32_t cascade)
+{
+    m_terrain_shadow_mesh_cascade = std::min<uint32_t>(cascade, MAX_DIR_SHADOW_MAP_PARTITIONS);
+}
+
+uint32_t Renderer::terrainShadowMeshCascade() const noexcept
+{
+    return m_terrain_shadow_mesh_cascade;
+}
+
+void Renderer::setMeshLodBias(float bias)
+{
+    m_mesh_lod_pixel_error = MESH_LOD_PIXEL_ERROR * std::exp2(bias);
+}
+
+void Renderer::setMeshShadowLodBias(float bias)
+{
+    m_mesh_shadow_lod_pixel_error = MESH_LOD_PIXEL_ERROR * std::exp2(bias);
+}
+
+float Renderer::meshLodPixelError() const noexcept
+{
+    return m_mesh_lod_pixel_error;
+}
+
+float Renderer::meshShadowLodPixelError() const noexcept
+{
+    return m_mesh_shadow_lod_pixel_error;
+}
+
+void Renderer::drawShadowMapBatch(VkCommandBuffer cmd_buf, const RenderBatch& rb, uint32_t first_layer, uint32_t layer_count)
+{
+    if(!m_layered_shadows)
+    {
+        drawBatch(cmd_buf, rb, 1, rb.instance_id);
+        return;
+    }
+
+    //the layered pipelines read the instance data with a zero stride, so instead of firstInstance
+    //the batch's instance is selected by the binding offset and gl_InstanceIndex is left to pick the layer
+    if(rb.render_mode == RenderMode::Default)
+    {
+        const VkDeviceSize instance_offset = rb.instance_id * sizeof(InstanceVertexData);
+        vkCmdBindVertexBuffers(cmd_buf, 1, 1, &m_instance_vertex_buffer.buf, &instance_offset);
+    }
+
+    //the layer is gl_InstanceIndex, which firstInstance is added to
+    drawBatch(cmd_buf, rb, layer_count, first_layer);
+}
+
+void Renderer::drawBatch(VkCommandBuffer cmd_buf, const RenderBatch& rb, uint32_t instance_count, uint32_t first_instance)
+{
+    if(rb.ib)
+    {
+        //every batch binds its index buffer, there are only two of them so the rebinds are cheap
+        vkCmdBindIndexBuffer(cmd_buf, rb.ib->buf, 0, rb.ib->index_type);
+        vkCmdDrawIndexed(cmd_buf, rb.index_count, instance_count, rb.first_index, static_cast<int32_t>(rb.vertex_offset), first_instance);
+    }
+    else
+    {
+        vkCmdDraw(cmd_buf, rb.vertex_count, instance_count, rb.vertex_offset, first_instance);
+    }
+}
+
+void initStaticVB(uint64_t data_size)
 {
 
 }
@@ -1616,175 +1920,797 @@ uint32_t Renderer::reqInstanceVBAlloc(uint32_t instance_count)
     return instance_id;
 }
 
-uint32_t Renderer::reqBoneBufAlloc(uint32_t bone_count)
-{
-    const uint64_t offset = m_bone_transform_buffer.alloc(bone_count * sizeof(mat4x4));
-    const uint32_t bone_transform_id = offset / sizeof(mat4x4);
-    return bone_transform_id;
-}
+uint32_t Renderer::reqBoneBufAlloc(uint32_t bone_count)
+{
+    const uint64_t offset = m_bone_transform_buffer.alloc(bone_count * sizeof(mat4x4));
+    const uint32_t bone_transform_id = offset / sizeof(mat4x4);
+    return bone_transform_id;
+}
+
+void Renderer::freeVertexBufferAllocation(const VertexBufferAllocation& vb_alloc)
+{
+    vb_alloc.vb->free(vb_alloc.data_offset, vb_alloc.size);
+}
+
+void Renderer::freeIndexBufferAllocation(const IndexBufferAllocation& ib_alloc)
+{
+    ib_alloc.ib->free(ib_alloc.data_offset, ib_alloc.size);
+}
+
+void Renderer::freeInstanceVertexBufferAllocation(uint32_t instance_id, uint32_t instance_count)
+{
+    m_instance_vertex_buffer.free(instance_id * sizeof(InstanceVertexData), instance_count * sizeof(instance_count));
+}
+
+void Renderer::freeBoneTransformBufferAllocation(uint32_t bone_id, uint32_t bone_count)
+{
+    m_bone_transform_buffer.free(bone_id * sizeof(mat4x4), bone_count * sizeof(mat4x4));
+}
+
+void Renderer::requestBufferUpdate(VkBufferWrapper* buf, uint64_t data_offset, uint64_t data_size, const void* data)
+{
+    m_buffer_update_reqs[buf].emplace_back(data_offset, data_size, data);
+}
+
+void Renderer::updateVertexData(VertexBuffer* vb, uint64_t data_offset, uint64_t data_size, const void* data)
+{
+    requestBufferUpdate(vb, data_offset, data_size, data);
+}
+
+void Renderer::updateIndexData(IndexBuffer* ib, uint64_t data_offset, uint64_t data_size, const void* data)
+{
+    requestBufferUpdate(ib, data_offset, data_size, data);
+}
+
+void Renderer::updateInstanceVertexData(uint32_t instance_id, uint32_t instance_count, const void* data)
+{
+    requestBufferUpdate(&m_instance_vertex_buffer, instance_id * sizeof(InstanceVertexData), instance_count * sizeof(InstanceVertexData), data);
+}
+
+void Renderer::updateBoneTransformData(uint32_t bone_offset, uint32_t bone_count, const mat4x4* data)
+{
+    requestBufferUpdate(&m_bone_transform_buffer, bone_offset * sizeof(mat4x4), bone_count * sizeof(mat4x4), data);
+}
+
+void Renderer::reqTerrainHeightmapSlots(uint32_t slot_count, std::span<const uint32_t> kept_slots)
+{
+    //the old images are only destroyed once the kept slots have been copied out of them
+    const std::array<VkImageWrapper, 3> old_images{m_terrain_heightmaps, m_terrain_slope_maps, m_terrain_splat_maps};
+    const uint32_t old_slot_count = m_terrain_heightmap_slot_count;
+
+    if(m_terrain_heightmaps.img)
+    {
+        deviceWaitIdle();
+    }
+
+    //requests for the kept slots follow them to their new layers, the ones for the other slots are dropped
+    constexpr uint32_t dropped_slot = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> new_slots(old_slot_count, dropped_slot);
+
+    for(uint32_t i = 0; i < kept_slots.size(); i++)
+    {
+        new_slots[kept_slots[i]] = i;
+    }
+
+    auto remapSlots = [&](auto& reqs)
+    {
+        for(auto& req : reqs)
+        {
+            req.slot = new_slots[req.slot];
+        }
+
+        std::erase_if(reqs, [](const auto& req){ return req.slot == dropped_slot; });
+    };
+
+    remapSlots(m_terrain_heightmap_update_reqs);
+    remapSlots(m_terrain_splat_map_update_reqs);
+    remapSlots(m_terrain_brush_reqs);
+    remapSlots(m_terrain_slope_map_reqs);
+
+    m_terrain_heightmap_slot_count = slot_count;
+
+    VkImageCreateInfo img_create_info{};
+    img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    img_create_info.pNext = NULL;
+    img_create_info.flags = 0;
+    img_create_info.imageType = VK_IMAGE_TYPE_2D;
+    img_create_info.format = VK_FORMAT_R16_UNORM;
+    img_create_info.extent = {TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES, 1};
+    img_create_info.mipLevels = 1;
+    img_create_info.arrayLayers = slot_count;
+    img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    img_create_info.queueFamilyIndexCount = 1;
+    img_create_info.pQueueFamilyIndices = &m_queue_family_index;
+    img_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImageViewCreateInfo img_view_create_info{};
+    img_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    img_view_create_info.pNext = NULL;
+    img_view_create_info.flags = 0;
+    img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    img_view_create_info.format = img_create_info.format;
+    img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+    img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, slot_count};
+
+    createImage(m_terrain_heightmaps, img_create_info, img_view_create_info);
+
+    img_create_info.format = VK_FORMAT_R16G16_SFLOAT;
+    img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT;
+    img_view_create_info.format = img_create_info.format;
+
+    createImage(m_terrain_slope_maps, img_create_info, img_view_create_info);
+
+    img_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    img_create_info.extent = {TERRAIN_SPLAT_MAP_RES, TERRAIN_SPLAT_MAP_RES, 1};
+    img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    img_view_create_info.format = img_create_info.format;
+
+    createImage(m_terrain_splat_maps, img_create_info, img_view_create_info);
+
+#if VULKAN_VALIDATION_ENABLE
+    setDebugObjectName(m_terrain_heightmaps.img, "TerrainHeightmaps");
+    setDebugObjectName(m_terrain_slope_maps.img, "TerrainSlopeMaps");
+    setDebugObjectName(m_terrain_splat_maps.img, "TerrainSplatMaps");
+#endif
+
+    //the slots stay in the shader read layout for their whole lifetime, uploads transition them back and forth in the frame command buffer
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = NULL;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
+
+    VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
+    assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
+
+    const std::array<VkImage, 3> new_images{m_terrain_heightmaps.img, m_terrain_slope_maps.img, m_terrain_splat_maps.img};
+    const std::array<VkExtent3D, 3> extents{VkExtent3D{TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES, 1}, VkExtent3D{TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES, 1},
+                                            VkExtent3D{TERRAIN_SPLAT_MAP_RES, TERRAIN_SPLAT_MAP_RES, 1}};
+    const bool copy_kept_slots = !kept_slots.empty();
+
+    std::array<VkImageMemoryBarrier, 6> img_mem_bars;
+    uint32_t img_mem_bar_count = 0;
+
+    for(uint32_t i = 0; i < new_images.size(); i++)
+    {
+        img_mem_bars[img_mem_bar_count++] = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, copy_kept_slots ? VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                             copy_kept_slots ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                             new_images[i], img_view_create_info.subresourceRange};
+
+        if(copy_kept_slots)
+        {
+            img_mem_bars[img_mem_bar_count++] = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                                 old_images[i].img, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, old_slot_count}};
+        }
+    }
+
+    vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         copy_kept_slots ? VK_PIPELINE_STAGE_TRANSFER_BIT : (VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT),
+                         0, 0, NULL, 0, NULL, img_mem_bar_count, img_mem_bars.data());
+
+    //the patches that stay resident keep their heightmaps, slope maps and splat maps, only packed into the first layers
+    if(copy_kept_slots)
+    {
+        std::vector<VkImageCopy> img_copies(kept_slots.size());
+
+        for(uint32_t i = 0; i < new_images.size(); i++)
+        {
+            for(uint32_t slot = 0; slot < kept_slots.size(); slot++)
+            {
+                img_copies[slot] = {{VK_IMAGE_ASPECT_COLOR_BIT, 0, kept_slots[slot], 1}, {0, 0, 0}, {VK_IMAGE_ASPECT_COLOR_BIT, 0, slot, 1}, {0, 0, 0}, extents[i]};
+            }
+
+            vkCmdCopyImage(m_transfer_cmd_buf, old_images[i].img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, new_images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(img_copies.size()), img_copies.data());
+        }
+
+        for(uint32_t i = 0; i < new_images.size(); i++)
+        {
+            img_mem_bars[i] = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, new_images[i], img_view_create_info.subresourceRange};
+        }
+
+        vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                             0, 0, NULL, 0, NULL, static_cast<uint32_t>(new_images.size()), img_mem_bars.data());
+    }
+
+    res = vkEndCommandBuffer(m_transfer_cmd_buf);
+    assertVkSuccess(res, "An error occurred while ending the transfer command buffer.");
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = NULL;
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.pWaitSemaphores = NULL;
+    submit_info.pWaitDstStageMask = NULL;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &m_transfer_cmd_buf;
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = NULL;
+
+    res = vkResetFences(m_device, 1, &m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while reseting transfer cmd buf fence.");
+
+    res = vkQueueSubmit(m_queue, 1, &submit_info, m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while submitting the transfer command buffer.");
+
+    res = vkWaitForFences(m_device, 1, &m_transfer_cmd_buf_fence, VK_TRUE, UINT64_MAX);
+    assertVkSuccess(res, "An error occured while waiting for a transfer cmd buf fence.");
+
+    for(auto old_image : old_images)
+    {
+        if(old_image.img)
+        {
+            destroyImage(old_image);
+        }
+    }
+
+    m_update_descriptors = true;
+}
+
+void Renderer::updateTerrainHeightmap(uint32_t slot, const uint16_t* data, const vec2& height_range)
+{
+    //all the uploads of a frame go into one copy whose regions land in no particular order, so only the last one queued for a slot is kept
+    std::erase_if(m_terrain_heightmap_update_reqs, [slot](const TerrainHeightmapUpdateReq& req){ return req.slot == slot; });
+
+    m_terrain_heightmap_update_reqs.emplace_back(slot, data, height_range);
+}
+
+void Renderer::updateTerrainSplatMap(uint32_t slot, const uint32_t* data)
+{
+    m_terrain_splat_map_update_reqs.emplace_back(slot, data);
+}
+
+void Renderer::setTerrainMaterials(const std::array<uint32_t, TERRAIN_MATERIAL_COUNT>& tex_ids)
+{
+    for(uint32_t tex_id : tex_ids)
+    {
+        if(tex_id >= m_textures.textures.size())
+        {
+            error(std::format("Terrain material uses texture {}, but only {} textures are loaded.", tex_id, m_textures.textures.size()));
+        }
+    }
+
+    m_common_buffer_data.terrain_material_tex_ids = uvec4(tex_ids[0], tex_ids[1], tex_ids[2], tex_ids[3]);
+}
+
+void Renderer::reqTerrainSlopeMap(uint32_t slot, const vec2& height_range)
+{
+    auto req = std::ranges::find(m_terrain_slope_map_reqs, slot, &TerrainSlopeMapReq::slot);
+
+    if(req != m_terrain_slope_map_reqs.end())
+    {
+        req->height_range = height_range;
+    }
+    else
+    {
+        m_terrain_slope_map_reqs.emplace_back(slot, height_range);
+    }
+}
+
+void Renderer::brushTerrainHeightmap(uint32_t slot, const vec2& patch_origin, float cell_size, const vec2& old_height_range, const vec2& new_height_range,
+                                     const uvec2& offset, const uvec2& extent, const vec3& center, float radius, float dh, uint16_t* readback_dst, vec2* height_range_dst)
+{
+    if((old_height_range != new_height_range) && (extent != uvec2(TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES)))
+    {
+        error("A terrain brush changing the height range has to cover the whole heightmap.");
+    }
+
+    m_terrain_brush_reqs.emplace_back(slot, patch_origin, cell_size, old_height_range, new_height_range, offset, extent, center, radius, dh, readback_dst, height_range_dst);
+}
+
+std::vector<TerrainHeightmapRegion> Renderer::takeFinishedTerrainHeightmapReadbacks()
+{
+    return std::exchange(m_finished_terrain_heightmap_readbacks, {});
+}
+
+void Renderer::finishTerrainHeightmapReadbacks()
+{
+    deviceWaitIdle();
+
+    //frames in flight finish in the order they were submitted, the one after the current frame is the oldest
+    for(uint32_t i = 1; i <= FRAMES_IN_FLIGHT; i++)
+    {
+        readBackTerrainHeightmaps(m_per_frame_data[(m_frame_id + i) % FRAMES_IN_FLIGHT]);
+    }
+
+    //the heightmap images may have been recreated since the last frame
+    if(m_update_descriptors)
+    {
+        destroyPipelines();
+        destroyPipelineLayout();
+        destroyDescriptorSets();
+
+        createDescriptorSets();
+        createPipelineLayout();
+        createPipelines();
+        updateDescriptorSets();
+
+        m_update_descriptors = false;
+    }
+
+    //whatever is still queued is recorded the same way a frame would, a frame's worth at a time, and waited for right away
+    //with the whole GPU idle the current frame's buffers are free to use
+    PerFrameData& per_frame_data = m_per_frame_data[m_frame_id];
+
+    while(!m_terrain_brush_reqs.empty() || !m_terrain_heightmap_update_reqs.empty() || !m_terrain_splat_map_update_reqs.empty())
+    {
+        VkCommandBufferBeginInfo begin_info{};
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.pNext = NULL;
+        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        begin_info.pInheritanceInfo = NULL;
+
+        VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
+        assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
+
+        recordTerrainHeightmapUpdates(m_transfer_cmd_buf, per_frame_data);
+
+        res = vkEndCommandBuffer(m_transfer_cmd_buf);
+        assertVkSuccess(res, "An error occurred while ending the transfer command buffer.");
+
+        VkSubmitInfo submit_info{};
+        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.pNext = NULL;
+        submit_info.waitSemaphoreCount = 0;
+        submit_info.pWaitSemaphores = NULL;
+        submit_info.pWaitDstStageMask = NULL;
+        submit_info.commandBufferCount = 1;
+        submit_info.pCommandBuffers = &m_transfer_cmd_buf;
+        submit_info.signalSemaphoreCount = 0;
+        submit_info.pSignalSemaphores = NULL;
+
+        res = vkResetFences(m_device, 1, &m_transfer_cmd_buf_fence);
+        assertVkSuccess(res, "An error occurred while reseting transfer cmd buf fence.");
+
+        res = vkQueueSubmit(m_queue, 1, &submit_info, m_transfer_cmd_buf_fence);
+        assertVkSuccess(res, "An error occurred while submitting the transfer command buffer.");
+
+        res = vkWaitForFences(m_device, 1, &m_transfer_cmd_buf_fence, VK_TRUE, UINT64_MAX);
+        assertVkSuccess(res, "An error occured while waiting for a transfer cmd buf fence.");
+
+        readBackTerrainHeightmaps(per_frame_data);
+    }
+}
+
+void Renderer::recordTerrainHeightmapUpdates(VkCommandBuffer cmd_buf, PerFrameData& per_frame_data)
+{
+    VkResult res;
+
+    //the heightmap array is shared between frames in flight, the barrier before the copies makes sure
+    //the previous frame is done sampling a slot before it gets overwritten
+    if(!m_terrain_heightmap_update_reqs.empty())
+    {
+        constexpr uint64_t heightmap_size = TERRAIN_HEIGHTMAP_RES * TERRAIN_HEIGHTMAP_RES * sizeof(uint16_t);
+        const VkBufferWrapper& staging_buf = *per_frame_data.terrain_heightmap_staging_buffer;
+        const uint32_t upload_count = std::min<uint32_t>(static_cast<uint32_t>(m_terrain_heightmap_update_reqs.size()), MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME);
+
+        void* staging_data = nullptr;
+        res = vkMapMemory(m_device, staging_buf.mem, 0, VK_WHOLE_SIZE, 0, &staging_data);
+        assertVkSuccess(res, "Failed to map buffer memory");
+
+        std::array<VkBufferImageCopy, MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME> buf_img_copies;
+
+        //edits are brushed on the GPU, so only the whole heightmaps of patches being streamed in are uploaded,
+        //whatever doesn't fit this frame is left for the next one
+        for(uint32_t i = 0; i < upload_count; i++)
+        {
+            const auto& req = m_terrain_heightmap_update_reqs[i];
+            std::memcpy(static_cast<uint8_t*>(staging_data) + i * heightmap_size, req.data, heightmap_size);
+
+            buf_img_copies[i].bufferOffset = i * heightmap_size;
+            buf_img_copies[i].bufferRowLength = 0;
+            buf_img_copies[i].bufferImageHeight = 0;
+            buf_img_copies[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, req.slot, 1};
+            buf_img_copies[i].imageOffset = {0, 0, 0};
+            buf_img_copies[i].imageExtent = {TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES, 1};
+
+            reqTerrainSlopeMap(req.slot, req.height_range);
+        }
+
+        vkUnmapMemory(m_device, staging_buf.mem);
+
+        const VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, m_terrain_heightmap_slot_count};
+
+        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_heightmaps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        vkCmdCopyBufferToImage(cmd_buf, staging_buf.buf, m_terrain_heightmaps.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload_count, buf_img_copies.data());
+
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_heightmaps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        m_terrain_heightmap_update_reqs.erase(m_terrain_heightmap_update_reqs.begin(), m_terrain_heightmap_update_reqs.begin() + upload_count);
+    }
+
+    //splat maps are always uploaded whole, a slot is only ever sampled by the terrain fragment shader
+    if(!m_terrain_splat_map_update_reqs.empty())
+    {
+        constexpr uint64_t splat_map_size = TERRAIN_SPLAT_MAP_RES * TERRAIN_SPLAT_MAP_RES * sizeof(uint32_t);
+        const VkBufferWrapper& staging_buf = *per_frame_data.terrain_splat_map_staging_buffer;
+        const uint32_t upload_count = std::min<uint32_t>(static_cast<uint32_t>(m_terrain_splat_map_update_reqs.size()), MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME);
+
+        void* staging_data = nullptr;
+        res = vkMapMemory(m_device, staging_buf.mem, 0, VK_WHOLE_SIZE, 0, &staging_data);
+        assertVkSuccess(res, "Failed to map buffer memory");
+
+        std::array<VkBufferImageCopy, MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME> buf_img_copies;
+
+        for(uint32_t i = 0; i < upload_count; i++)
+        {
+            const auto& req = m_terrain_splat_map_update_reqs[i];
+            std::memcpy(static_cast<uint8_t*>(staging_data) + i * splat_map_size, req.data, splat_map_size);
+
+            buf_img_copies[i].bufferOffset = i * splat_map_size;
+            buf_img_copies[i].bufferRowLength = 0;
+            buf_img_copies[i].bufferImageHeight = 0;
+            buf_img_copies[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, req.slot, 1};
+            buf_img_copies[i].imageOffset = {0, 0, 0};
+            buf_img_copies[i].imageExtent = {TERRAIN_SPLAT_MAP_RES, TERRAIN_SPLAT_MAP_RES, 1};
+        }
+
+        vkUnmapMemory(m_device, staging_buf.mem);
+
+        const VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, m_terrain_heightmap_slot_count};
+
+        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_splat_maps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        vkCmdCopyBufferToImage(cmd_buf, staging_buf.buf, m_terrain_splat_maps.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, upload_count, buf_img_copies.data());
+
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_splat_maps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        m_terrain_splat_map_update_reqs.erase(m_terrain_splat_map_update_reqs.begin(), m_terrain_splat_map_update_reqs.begin() + upload_count);
+    }
+
+    //the brush runs after the uploads so it's applied on top of heightmaps streamed in this frame,
+    //the heightmaps it changes are copied back so the CPU side copy stays in sync for collision and saving
+    if(!m_terrain_brush_reqs.empty())
+    {
+        const uint32_t dispatch_count = std::min<uint32_t>(static_cast<uint32_t>(m_terrain_brush_reqs.size()), MAX_TERRAIN_BRUSH_DISPATCHES_PER_FRAME);
+        const uint64_t readback_stride = TERRAIN_HEIGHTMAP_RES * TERRAIN_HEIGHTMAP_RES * sizeof(uint16_t);
+        const VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, m_terrain_heightmap_slot_count};
+
+        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_heightmaps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_terrain_brush_pipeline);
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 1, &per_frame_data.descriptor_set, 0, NULL);
+
+        std::array<VkBufferImageCopy, MAX_TERRAIN_BRUSH_DISPATCHES_PER_FRAME> img_buf_copies;
+
+        for(uint32_t i = 0; i < dispatch_count; i++)
+        {
+            const auto& req = m_terrain_brush_reqs[i];
+
+            //deferred brushes can hit the same texels more than once, each one has to see the result of the previous one
+            if(i > 0)
+            {
+                const VkMemoryBarrier mem_bar = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+                vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &mem_bar, 0, NULL, 0, NULL);
+            }
+
+            //only the rectangle under the brush is dispatched and read back, it's the whole heightmap when the range changes
+            const TerrainBrushPushConstants brush_push_const{req.center, req.radius, req.patch_origin, req.cell_size, req.dh, req.old_height_range, req.new_height_range, req.offset, req.slot};
+            vkCmdPushConstants(cmd_buf, m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, TERRAIN_COMPUTE_PUSH_CONST_OFFSET, sizeof(brush_push_const), &brush_push_const);
+            vkCmdDispatch(cmd_buf, (req.extent.x + TERRAIN_BRUSH_GROUP_SIZE - 1) / TERRAIN_BRUSH_GROUP_SIZE, (req.extent.y + TERRAIN_BRUSH_GROUP_SIZE - 1) / TERRAIN_BRUSH_GROUP_SIZE, 1);
+
+            //tightly packed, the buffer has room for a whole heightmap per brush
+            img_buf_copies[i].bufferOffset = i * readback_stride;
+            img_buf_copies[i].bufferRowLength = 0;
+            img_buf_copies[i].bufferImageHeight = 0;
+            img_buf_copies[i].imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, req.slot, 1};
+            img_buf_copies[i].imageOffset = {static_cast<int32_t>(req.offset.x), static_cast<int32_t>(req.offset.y), 0};
+            img_buf_copies[i].imageExtent = {req.extent.x, req.extent.y, 1};
+
+            const TerrainHeightmapRegion region{req.slot, req.offset, req.extent};
+            per_frame_data.terrain_heightmap_readbacks.emplace_back(region, i * readback_stride, req.readback_dst, req.new_height_range, req.height_range_dst);
+            reqTerrainSlopeMap(req.slot, req.new_height_range);
+        }
+
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_heightmaps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        vkCmdCopyImageToBuffer(cmd_buf, m_terrain_heightmaps.img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, per_frame_data.terrain_heightmap_readback_buffer->buf, dispatch_count, img_buf_copies.data());
+
+        //the readback is mapped once this frame's fence is signaled, the fence alone doesn't make the copy visible to the host
+        const VkMemoryBarrier mem_bar = {VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT};
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_heightmaps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+                             0, 1, &mem_bar, 0, NULL, 1, &img_mem_bar);
+
+        m_terrain_brush_reqs.erase(m_terrain_brush_reqs.begin(), m_terrain_brush_reqs.begin() + dispatch_count);
+    }
+
+    //the slope maps of the slots uploaded or brushed above are recalculated from their new heights,
+    //the previous frame has to be done sampling them first just like with the heightmaps
+    if(!m_terrain_slope_map_reqs.empty())
+    {
+        const VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, m_terrain_heightmap_slot_count};
+
+        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                         VK_IMAGE_LAYOUT_GENERAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_slope_maps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_terrain_slope_map_pipeline);
+        vkCmdBindDescriptorSets(cmd_buf, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0, 1, &per_frame_data.descriptor_set, 0, NULL);
+
+        for(const auto& req : m_terrain_slope_map_reqs)
+        {
+            const TerrainSlopeMapPushConstants slope_map_push_const{req.height_range, req.slot};
+            vkCmdPushConstants(cmd_buf, m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, TERRAIN_COMPUTE_PUSH_CONST_OFFSET, sizeof(slope_map_push_const), &slope_map_push_const);
+            vkCmdDispatch(cmd_buf, (TERRAIN_HEIGHTMAP_RES + TERRAIN_SLOPE_MAP_GROUP_SIZE - 1) / TERRAIN_SLOPE_MAP_GROUP_SIZE, (TERRAIN_HEIGHTMAP_RES + TERRAIN_SLOPE_MAP_GROUP_SIZE - 1) / TERRAIN_SLOPE_MAP_GROUP_SIZE, 1);
+        }
+
+        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_GENERAL,
+                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_slope_maps.img, img_sub_range};
+        vkCmdPipelineBarrier(cmd_buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        m_terrain_slope_map_reqs.clear();
+    }
+}
+
+void Renderer::readBackTerrainHeightmaps(PerFrameData& per_frame_data)
+{
+    if(per_frame_data.terrain_heightmap_readbacks.empty())
+    {
+        return;
+    }
+
+    const VkBufferWrapper& readback_buf = *per_frame_data.terrain_heightmap_readback_buffer;
+
+    void* readback_data = nullptr;
+    VkResult res = vkMapMemory(m_device, readback_buf.mem, 0, VK_WHOLE_SIZE, 0, &readback_data);
+    assertVkSuccess(res, "Failed to map buffer memory");
+
+    for(const auto& readback : per_frame_data.terrain_heightmap_readbacks)
+    {
+        const TerrainHeightmapRegion& region = readback.region;
+        const uint64_t row_size = region.extent.x * sizeof(uint16_t);
+
+        for(uint32_t row = 0; row < region.extent.y; row++)
+        {
+            uint16_t* dst = readback.dst + (region.offset.y + row) * TERRAIN_HEIGHTMAP_RES + region.offset.x;
+            std::memcpy(dst, static_cast<const uint8_t*>(readback_data) + readback.buffer_offset + row * row_size, row_size);
+        }
+
+        //the texels only make sense together with the range they were quantized to
+        *readback.height_range_dst = readback.height_range;
+
+        m_finished_terrain_heightmap_readbacks.push_back(region);
+    }
+
+    vkUnmapMemory(m_device, readback_buf.mem);
+
+    per_frame_data.terrain_heightmap_readbacks.clear();
+}
+
+void Renderer::reqTerrainVirtualTexture(uint32_t page_count)
+{
+    deviceWaitIdle();
+    destroyTerrainVirtualTexture();
+
+    if(0 == page_count)
+    {
+        return;
+    }
+
+    if(!std::has_single_bit(page_count) || (page_count > TERRAIN_VT_PAGE_NONE))
+    {
+        error(std::format("Invalid terrain virtual texture page count {}.", page_count));
+    }
+
+    const uint32_t mip_count = static_cast<uint32_t>(std::countr_zero(page_count)) + 1;
+
+    m_common_buffer_data.terrain_vt_page_count = page_count;
+    m_common_buffer_data.terrain_vt_mip_count = mip_count;
+
+    VkImageCreateInfo img_create_info{};
+    img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    img_create_info.pNext = NULL;
+    img_create_info.flags = 0;
+    img_create_info.imageType = VK_IMAGE_TYPE_2D;
+    img_create_info.format = VK_FORMAT_R16_UINT;
+    img_create_info.extent = {page_count, page_count, 1};
+    img_create_info.mipLevels = mip_count;
+    img_create_info.arrayLayers = 1;
+    img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    img_create_info.queueFamilyIndexCount = 1;
+    img_create_info.pQueueFamilyIndices = &m_queue_family_index;
+    img_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    VkImageViewCreateInfo img_view_create_info{};
+    img_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    img_view_create_info.pNext = NULL;
+    img_view_create_info.flags = 0;
+    img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    img_view_create_info.format = img_create_info.format;
+    img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+    img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mip_count, 0, 1};
+
+    createImage(m_terrain_vt_page_table, img_create_info, img_view_create_info);
+
+    const VkImageSubresourceRange page_table_sub_range = img_view_create_info.subresourceRange;
+
+    img_create_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+    img_create_info.extent = {TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_PADDED_PAGE_RES, TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_PADDED_PAGE_RES, 1};
+    img_create_info.mipLevels = 1;
+    img_view_create_info.format = img_create_info.format;
+    img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+    createImage(m_terrain_vt_cache, img_create_info, img_view_create_info);
+
+    //one bit per page of every mip
+    const uint64_t feedback_size = roundUp<uint64_t>((4ull * page_count * page_count - 1) / 3, 32) / 8;
+
+    for(size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        m_per_frame_data[i].terrain_vt_feedback_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, true);
+        createBuffer(*m_per_frame_data[i].terrain_vt_feedback_buffer, feedback_size);
+        m_per_frame_data[i].terrain_vt_feedback_written = false;
+
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(m_per_frame_data[i].terrain_vt_feedback_buffer->buf, "TerrainVTFeedbackBuffer_" + std::to_string(i));
+#endif
+    }
+
+#if VULKAN_VALIDATION_ENABLE
+    setDebugObjectName(m_terrain_vt_page_table.img, "TerrainVTPageTable");
+    setDebugObjectName(m_terrain_vt_cache.img, "TerrainVTCache");
+#endif
+
+    //nothing is resident yet, so every page table entry starts out empty
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = NULL;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
+
+    VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
+    assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
+
+    VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_vt_page_table.img, page_table_sub_range};
+    vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+    VkClearColorValue clear_value{};
+    clear_value.uint32[0] = TERRAIN_VT_PAGE_NONE;
+    vkCmdClearColorImage(m_transfer_cmd_buf, m_terrain_vt_page_table.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_value, 1, &page_table_sub_range);
+
+    const std::array<VkImageMemoryBarrier, 2> img_mem_bars
+    {
+        VkImageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_vt_page_table.img, page_table_sub_range},
+        VkImageMemoryBarrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                             VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, m_terrain_vt_cache.img, img_view_create_info.subresourceRange}
+    };
+    vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL,
+                         static_cast<uint32_t>(img_mem_bars.size()), img_mem_bars.data());
+
+    res = vkEndCommandBuffer(m_transfer_cmd_buf);
+    assertVkSuccess(res, "An error occurred while ending the transfer command buffer.");
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = NULL;
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.pWaitSemaphores = NULL;
+    submit_info.pWaitDstStageMask = NULL;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &m_transfer_cmd_buf;
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = NULL;
+
+    res = vkResetFences(m_device, 1, &m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while reseting transfer cmd buf fence.");
 
-void Renderer::reqTerrainBufAlloc(uint64_t size)
-{
-    m_terrain_buffer.alloc(size);
-}
+    res = vkQueueSubmit(m_queue, 1, &submit_info, m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while submitting the transfer command buffer.");
 
-void Renderer::freeVertexBufferAllocation(const VertexBufferAllocation& vb_alloc)
-{
-    vb_alloc.vb->free(vb_alloc.data_offset, vb_alloc.size);
-}
+    res = vkWaitForFences(m_device, 1, &m_transfer_cmd_buf_fence, VK_TRUE, UINT64_MAX);
+    assertVkSuccess(res, "An error occured while waiting for a transfer cmd buf fence.");
 
-void Renderer::freeInstanceVertexBufferAllocation(uint32_t instance_id, uint32_t instance_count)
-{
-    m_instance_vertex_buffer.free(instance_id * sizeof(InstanceVertexData), instance_count * sizeof(instance_count));
+    m_update_descriptors = true;
 }
 
-void Renderer::freeBoneTransformBufferAllocation(uint32_t bone_id, uint32_t bone_count)
+void Renderer::destroyTerrainVirtualTexture()
 {
-    m_bone_transform_buffer.free(bone_id * sizeof(mat4x4), bone_count * sizeof(mat4x4));
-}
+    destroyImage(m_terrain_vt_page_table);
+    destroyImage(m_terrain_vt_cache);
 
-void Renderer::freeTerrainBufferAllocation()
-{
-    m_terrain_buffer.free(0, m_terrain_buffer.size);
-}
+    for(auto& per_frame_data : m_per_frame_data)
+    {
+        if(per_frame_data.terrain_vt_feedback_buffer)
+        {
+            destroyBuffer(*per_frame_data.terrain_vt_feedback_buffer);
+            per_frame_data.terrain_vt_feedback_buffer.reset();
+        }
 
-void Renderer::requestBufferUpdate(VkBufferWrapper* buf, uint64_t data_offset, uint64_t data_size, const void* data)
-{
-    m_buffer_update_reqs[buf].emplace_back(data_offset, data_size, data);
-}
+        per_frame_data.terrain_vt_feedback_written = false;
+    }
 
-void Renderer::updateVertexData(VertexBuffer* vb, uint64_t data_offset, uint64_t data_size, const void* data)
-{
-    requestBufferUpdate(vb, data_offset, data_size, data);
+    m_terrain_vt_upload_reqs.clear();
+    m_terrain_vt_feedback.clear();
+    m_common_buffer_data.terrain_vt_page_count = 0;
+    m_common_buffer_data.terrain_vt_mip_count = 0;
 }
 
-void Renderer::updateInstanceVertexData(uint32_t instance_id, uint32_t instance_count, const void* data)
+void Renderer::setTerrainVirtualTextureArea(const vec2& origin, float size)
 {
-    requestBufferUpdate(&m_instance_vertex_buffer, instance_id * sizeof(InstanceVertexData), instance_count * sizeof(InstanceVertexData), data);
+    m_common_buffer_data.terrain_vt_origin = origin;
+    m_common_buffer_data.terrain_vt_size = size;
 }
 
-void Renderer::updateBoneTransformData(uint32_t bone_offset, uint32_t bone_count, const mat4x4* data)
+void Renderer::uploadTerrainVTPage(const TerrainVTPageUpload& upload)
 {
-    requestBufferUpdate(&m_bone_transform_buffer, bone_offset * sizeof(mat4x4), bone_count * sizeof(mat4x4), data);
+    m_terrain_vt_upload_reqs.push_back(upload);
 }
 
-void Renderer::updateTerrainData(void* data, uint64_t offset, uint64_t size)
+std::vector<uint32_t> Renderer::takeTerrainVTFeedback()
 {
-    requestBufferUpdate(&m_terrain_buffer, offset, size, data);
+    return std::exchange(m_terrain_vt_feedback, {});
 }
 
-std::vector<uint32_t> Renderer::requestTerrainHeightmaps(std::span<std::pair<float*, uint32_t>> heightmap_data)
+void Renderer::readBackTerrainVTFeedback(PerFrameData& per_frame_data)
 {
-    m_terrain_heightmaps.resize(heightmap_data.size());
-    std::vector<uint32_t> heightmap_ids(heightmap_data.size());
-
-    for(size_t i = 0; i < heightmap_data.size(); i++)
+    if(!per_frame_data.terrain_vt_feedback_written)
     {
-        auto& hd = heightmap_data[i];
-        auto& img = m_terrain_heightmaps[i];
-
-        //TODO:make these structures static/constexpr w/e, as well as all other such structures that would otherwise be set up many times the same way
-        VkImageCreateInfo img_create_info{};
-        img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-        img_create_info.pNext = NULL;
-        img_create_info.flags = 0;
-        img_create_info.imageType = VK_IMAGE_TYPE_2D;
-        img_create_info.format = VK_FORMAT_R32_SFLOAT;
-        //TODO: set extent using some terrain heightmap resolution constant
-        img_create_info.extent = {static_cast<uint32_t>(MAX_TESS_LEVEL) + 1u, static_cast<uint32_t>(MAX_TESS_LEVEL) + 1u, 1};
-        img_create_info.mipLevels = 1;
-        img_create_info.arrayLayers = 1;
-        img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-        img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-        img_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-        img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        img_create_info.queueFamilyIndexCount = 1;
-        img_create_info.pQueueFamilyIndices = &m_queue_family_index;
-        img_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-
-        VkImageViewCreateInfo img_view_create_info{};
-        img_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        img_view_create_info.pNext = NULL;
-        img_view_create_info.flags = 0;
-        img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        img_view_create_info.format = img_create_info.format;
-        img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
-        img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-
-        createImage(img, img_create_info, img_view_create_info);
-
-        VkBufferWrapper img_buf(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
-        const uint64_t buffer_size = static_cast<uint64_t>(img_create_info.extent.width) * static_cast<uint64_t>(img_create_info.extent.height) * sizeof(float);
-        createBuffer(img_buf, buffer_size);
-
-        void* img_buf_ptr = nullptr;
-        vkMapMemory(m_device, img_buf.mem, 0, VK_WHOLE_SIZE, 0, &img_buf_ptr);
-        std::memcpy(img_buf_ptr, hd.first, buffer_size);
-        vkUnmapMemory(m_device, img_buf.mem);
-
-        VkCommandBufferBeginInfo begin_info{};
-        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        begin_info.pNext = NULL;
-        begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        begin_info.pInheritanceInfo = NULL;
-
-        VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
-        assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
-
-        VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
-
-        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
-                                     VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, img.img, img_sub_range};
-
-        vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
-
-        VkBufferImageCopy buf_img_copy{};
-        buf_img_copy.bufferOffset = 0;
-        buf_img_copy.bufferRowLength = 0;
-        buf_img_copy.bufferImageHeight = 0;
-        buf_img_copy.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-        buf_img_copy.imageOffset = {0, 0, 0};
-        buf_img_copy.imageExtent = img_create_info.extent;
-
-        vkCmdCopyBufferToImage(m_transfer_cmd_buf, img_buf.buf, img.img, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buf_img_copy);
+        return;
+    }
 
-        img_mem_bar = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, img.img, img_sub_range};
+    const VkBufferWrapper& feedback_buf = *per_frame_data.terrain_vt_feedback_buffer;
+    const size_t word_count = feedback_buf.size / sizeof(uint32_t);
 
-        vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TESSELLATION_EVALUATION_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+    void* feedback_data = nullptr;
+    VkResult res = vkMapMemory(m_device, feedback_buf.mem, 0, VK_WHOLE_SIZE, 0, &feedback_data);
+    assertVkSuccess(res, "Failed to map buffer memory");
 
-        res = vkEndCommandBuffer(m_transfer_cmd_buf);
-        assertVkSuccess(res, "An error occurred while ending the transfer command buffer.");
+    //the frames finished since the feedback was last taken are merged
+    m_terrain_vt_feedback.resize(word_count, 0);
 
-        VkSubmitInfo submit_info{};
-        submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.pNext = NULL;
-        submit_info.waitSemaphoreCount = 0;
-        submit_info.pWaitSemaphores = NULL;
-        submit_info.pWaitDstStageMask = NULL;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers = &m_transfer_cmd_buf;
-        submit_info.signalSemaphoreCount = 0;
-        submit_info.pSignalSemaphores = NULL;
+    for(size_t i = 0; i < word_count; i++)
+    {
+        m_terrain_vt_feedback[i] |= static_cast<const uint32_t*>(feedback_data)[i];
+    }
 
-        res = vkResetFences(m_device, 1, &m_transfer_cmd_buf_fence);
-        assertVkSuccess(res, "An error occurred while reseting transfer cmd buf fence.");
+    vkUnmapMemory(m_device, feedback_buf.mem);
 
-        res = vkQueueSubmit(m_queue, 1, &submit_info, m_transfer_cmd_buf_fence);
-        assertVkSuccess(res, "An error occurred while submitting the transfer command buffer.");
+    per_frame_data.terrain_vt_feedback_written = false;
+}
 
-        res = vkWaitForFences(m_device, 1, &m_transfer_cmd_buf_fence, VK_TRUE, UINT64_MAX);
-        assertVkSuccess(res, "An error occured while waiting for a transfer cmd buf fence.");
+void Renderer::draw(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, uint32_t instance_id, RenderViewId view)
+{
+    m_render_batches.emplace_back(render_mode, vb, vertex_offset, vertex_count, instance_id, view);
+}
 
-        destroyBuffer(img_buf);
-    }
+void Renderer::drawIndexed(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, IndexBuffer* ib, uint32_t first_index, uint32_t index_count, uint32_t instance_id, RenderViewId view)
+{
+    m_render_batches.emplace_back(render_mode, vb, vertex_offset, ib, first_index, index_count, instance_id, view);
+}
 
-    return heightmap_ids;
+const RenderView& Renderer::cameraView() const noexcept
+{
+    return m_camera_view;
 }
 
-void Renderer::draw(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, uint32_t instance_id)
+const std::vector<RenderView>& Renderer::shadowViews() const noexcept
 {
-    m_render_batches.emplace_back(render_mode, vb, vertex_offset, vertex_count, instance_id);
+    return m_shadow_views;
 }
 
 void Renderer::drawUi(RenderModeUi render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, const Quad& scissor)
@@ -1808,10 +2734,7 @@ DirLightId Renderer::addDirLight(const DirLight& dir_light)
     }
 
     m_dir_lights_valid[id] = 1;
-    for(auto& per_frame_data : m_per_frame_data)
-    {
-        per_frame_data.dir_lights_to_update.push_back(id);
-    }
+    m_dir_lights_to_update.push_back(id);
 
     m_dir_lights[id] = dir_light;
 
@@ -1842,10 +2765,7 @@ void Renderer::updateDirLight(DirLightId id, const DirLight& dir_light)
 
     m_dir_lights[id] = dir_light;
 
-    for(auto& per_frame_data : m_per_frame_data)
-    {
-        per_frame_data.dir_lights_to_update.push_back(id);
-    }
+    m_dir_lights_to_update.push_back(id);
 }
 
 void Renderer::removeDirLight(DirLightId id)
@@ -1883,53 +2803,32 @@ PointLightId Renderer::addPointLight(const PointLight& point_light)
     }
 
     m_point_lights_valid[id] = 1;
-    for(auto& per_frame_data : m_per_frame_data)
-    {
-        per_frame_data.point_lights_to_update.push_back(id);
-    }
+    m_point_lights_to_update.push_back(id);
 
     m_point_lights[id] = point_light;
-
-    if(point_light.shadow_map_res != 0)
-    {
-        m_point_lights[id].shadow_map_id = createPointShadowMap(point_light);
-        updatePointShadowMap(m_point_lights[id]);
-    }
+    m_point_lights[id].shadow_map_id = POINT_SHADOW_MAP_ID_NONE;
 
     return id;
 }
 
 void Renderer::updatePointLight(PointLightId id, const PointLight& point_light)
 {
-    if(point_light.shadow_map_res != m_point_lights[id].shadow_map_res)
+    //shadow map slots get reassigned every frame based on the light's shadow_map_res, so only release it if shadows got disabled
+    if(point_light.shadow_map_res == 0)
     {
-        if(m_point_lights[id].shadow_map_res != 0)
-        {
-            markPointShadowMapForDestroy(m_point_lights[id].shadow_map_id);
-        }
-
-        if(point_light.shadow_map_res != 0)
-        {
-            m_point_lights[id].shadow_map_id = createPointShadowMap(point_light);
-        }
+        releasePointShadowMap(id);
     }
 
     m_point_lights[id] = point_light;
 
-    for(auto& per_frame_data : m_per_frame_data)
-    {
-        per_frame_data.point_lights_to_update.push_back(id);
-    }
+    m_point_lights_to_update.push_back(id);
 }
 
 void Renderer::removePointLight(PointLightId id)
 {
     m_point_lights_valid[id] = 0;
 
-    if(m_point_lights[id].shadow_map_res != 0)
-    {
-        markPointShadowMapForDestroy(m_point_lights[id].shadow_map_id);
-    }
+    releasePointShadowMap(id);
 
     if(id == m_common_buffer_data.point_light_count - 1)
     {
@@ -1961,40 +2860,23 @@ void Renderer::updateDescriptorSets() noexcept
         font_img_infos[i] = {VK_NULL_HANDLE, m_font_textures[i].image.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
     }
 
-    std::vector<VkDescriptorBufferInfo> dir_light_buf_infos(FRAMES_IN_FLIGHT);
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
-    {
-        dir_light_buf_infos[i] = {m_per_frame_data[i].dir_light_buffer->buf, 0, VK_WHOLE_SIZE};
-    }
-
-    std::vector<VkDescriptorBufferInfo> point_light_buf_infos(FRAMES_IN_FLIGHT);
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
-    {
-        point_light_buf_infos[i] = {m_per_frame_data[i].point_light_buffer->buf, 0, VK_WHOLE_SIZE};
-    }
+    VkDescriptorBufferInfo dir_light_buf_info = {m_dir_light_buffer.buf, 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo point_light_buf_info = {m_point_light_buffer.buf, 0, VK_WHOLE_SIZE};
 
     VkDescriptorBufferInfo dir_shadow_map_buf_info = {m_dir_shadow_map_buffer.buf, 0, m_dir_shadow_map_buffer.size};
 
-    std::vector<std::vector<VkDescriptorImageInfo>> dir_shadow_map_img_infos(FRAMES_IN_FLIGHT);
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    std::vector<VkDescriptorImageInfo> dir_shadow_map_img_infos(m_dir_shadow_map_count);
+    for(uint32_t i = 0; i < dir_shadow_map_img_infos.size(); i++)
     {
-        dir_shadow_map_img_infos[i].resize(m_dir_shadow_map_count);
-        for(uint32_t j = 0; j < dir_shadow_map_img_infos[i].size(); j++)
-        {
-            dir_shadow_map_img_infos[i][j] = {VK_NULL_HANDLE, m_per_frame_data[i].dir_shadow_maps[j].depth_img.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-        }
+        dir_shadow_map_img_infos[i] = {VK_NULL_HANDLE, m_dir_shadow_maps[i].depth_img.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
     }
 
     VkDescriptorBufferInfo point_shadow_map_buf_info = {m_point_shadow_map_buffer.buf, 0, m_point_shadow_map_buffer.size};
 
-    std::vector<std::vector<VkDescriptorImageInfo>> point_shadow_map_img_infos(FRAMES_IN_FLIGHT);
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    std::vector<VkDescriptorImageInfo> point_shadow_map_img_infos(POINT_SHADOW_MAP_TIER_COUNT);
+    for(uint32_t i = 0; i < point_shadow_map_img_infos.size(); i++)
     {
-        point_shadow_map_img_infos[i].resize(m_point_shadow_map_count);
-        for(uint32_t j = 0; j < point_shadow_map_img_infos[i].size(); j++)
-        {
-            point_shadow_map_img_infos[i][j] = {VK_NULL_HANDLE, m_per_frame_data[i].point_shadow_maps[j].depth_img.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-        }
+        point_shadow_map_img_infos[i] = {VK_NULL_HANDLE, m_point_shadow_map_tiers[i].depth_img.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
     }
 
     std::vector<VkDescriptorImageInfo> normal_map_img_infos(m_normal_maps.textures.size());
@@ -2003,13 +2885,16 @@ void Renderer::updateDescriptorSets() noexcept
         normal_map_img_infos[i] = {VK_NULL_HANDLE, m_normal_maps.textures[i].img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
     }
 
-    VkDescriptorBufferInfo terrain_buf_info = {m_terrain_buffer.buf, 0, m_terrain_buffer.size};
-    std::vector<VkDescriptorImageInfo> terrain_heightmap_infos(m_terrain_heightmap_desc_count);
-    for(size_t i = 0; i < m_terrain_heightmaps.size(); i++)
-    {
-        terrain_heightmap_infos[i] = {VK_NULL_HANDLE, m_terrain_heightmaps[i].img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
-    }
+    VkDescriptorImageInfo terrain_heightmap_info = {VK_NULL_HANDLE, m_terrain_heightmaps.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo terrain_heightmap_storage_info = {VK_NULL_HANDLE, m_terrain_heightmaps.img_view, VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo terrain_slope_map_info = {VK_NULL_HANDLE, m_terrain_slope_maps.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo terrain_slope_map_storage_info = {VK_NULL_HANDLE, m_terrain_slope_maps.img_view, VK_IMAGE_LAYOUT_GENERAL};
+    VkDescriptorImageInfo terrain_splat_map_info = {VK_NULL_HANDLE, m_terrain_splat_maps.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo terrain_vt_page_table_info = {VK_NULL_HANDLE, m_terrain_vt_page_table.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    VkDescriptorImageInfo terrain_vt_cache_info = {VK_NULL_HANDLE, m_terrain_vt_cache.img_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+    std::array<VkDescriptorBufferInfo, FRAMES_IN_FLIGHT> terrain_vt_feedback_buf_infos;
     VkDescriptorBufferInfo bone_transform_buf_info = {m_bone_transform_buffer.buf, 0, m_bone_transform_buffer.size};
+    VkDescriptorBufferInfo light_cluster_buf_info = {m_light_cluster_buffer.buf, 0, m_light_cluster_buffer.size};
 
     std::vector<VkWriteDescriptorSet> desc_set_writes;
     for(size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
@@ -2023,24 +2908,24 @@ void Renderer::updateDescriptorSets() noexcept
         }
 
         desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, FONT_BINDING,                0, m_font_desc_count,           m_font_desc_type, font_img_infos.data(), NULL, NULL});
-        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_LIGHTS_BINDING,          0, m_dir_lights_desc_count,     m_dir_lights_desc_type, NULL, &dir_light_buf_infos[i], NULL});
-        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_LIGHTS_VALID_BINDING,    0, m_dir_lights_valid_desc_count, m_dir_lights_valid_desc_type, NULL, NULL, &m_per_frame_data[i].dir_light_valid_buffer->buf_view});
-        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_LIGHTS_BINDING,        0, m_point_lights_desc_count,   m_point_lights_desc_type, NULL, &point_light_buf_infos[i], NULL});
-        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_LIGHTS_VALID_BINDING,  0, m_point_lights_valid_desc_count, m_point_lights_valid_desc_type, NULL, NULL, &m_per_frame_data[i].point_light_valid_buffer->buf_view});
+        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_LIGHTS_BINDING,          0, m_dir_lights_desc_count,     m_dir_lights_desc_type, NULL, &dir_light_buf_info, NULL});
+        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_LIGHT_IDS_BINDING,       0, m_dir_light_ids_desc_count, m_dir_light_ids_desc_type, NULL, NULL, &m_dir_light_ids_buffer.buf_view});
+        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_LIGHTS_BINDING,        0, m_point_lights_desc_count,   m_point_lights_desc_type, NULL, &point_light_buf_info, NULL});
+        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_LIGHT_IDS_BINDING,     0, m_point_light_ids_desc_count, m_point_light_ids_desc_type, NULL, NULL, &m_point_light_ids_buffer.buf_view});
         desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_SM_BUF_BINDING,          0, m_dir_sm_buf_desc_count,     m_dir_sm_buf_desc_type, NULL, &dir_shadow_map_buf_info, NULL});
 
-        const uint32_t valid_dir_sm_desc_count = static_cast<uint32_t>(dir_shadow_map_img_infos[i].size());
+        const uint32_t valid_dir_sm_desc_count = static_cast<uint32_t>(dir_shadow_map_img_infos.size());
         if(valid_dir_sm_desc_count > 0)
         {
-            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_SM_BINDING, 0, valid_dir_sm_desc_count, m_dir_sm_desc_type, dir_shadow_map_img_infos[i].data(), NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, DIR_SM_BINDING, 0, valid_dir_sm_desc_count, m_dir_sm_desc_type, dir_shadow_map_img_infos.data(), NULL, NULL});
         }
 
         desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_SM_BUF_BINDING, 0, m_point_sm_buf_desc_count, m_point_sm_buf_desc_type, NULL, &point_shadow_map_buf_info, NULL});
 
-        const uint32_t valid_point_sm_desc_count = static_cast<uint32_t>(point_shadow_map_img_infos[i].size());
+        const uint32_t valid_point_sm_desc_count = static_cast<uint32_t>(point_shadow_map_img_infos.size());
         if(valid_point_sm_desc_count > 0)
         {
-            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_SM_BINDING, 0, valid_point_sm_desc_count, m_point_sm_desc_type, point_shadow_map_img_infos[i].data(), NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, POINT_SM_BINDING, 0, valid_point_sm_desc_count, m_point_sm_desc_type, point_shadow_map_img_infos.data(), NULL, NULL});
         }
 
         const uint32_t valid_normal_map_desc_count = static_cast<uint32_t>(normal_map_img_infos.size());
@@ -2049,12 +2934,25 @@ void Renderer::updateDescriptorSets() noexcept
             desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, NORMAL_MAP_BINDING, 0, valid_normal_map_desc_count, m_normal_map_desc_type, normal_map_img_infos.data(), NULL, NULL});
         }
 
-        if(m_terrain_buffer.buf)
+        if(m_terrain_heightmaps.img_view)
+        {
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_HEIGHTMAP_BINDING, 0, m_terrain_heightmap_desc_count, m_terrain_heightmap_desc_type, &terrain_heightmap_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_HEIGHTMAP_STORAGE_BINDING, 0, m_terrain_heightmap_storage_desc_count, m_terrain_heightmap_storage_desc_type, &terrain_heightmap_storage_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_SLOPE_MAP_BINDING, 0, m_terrain_slope_map_desc_count, m_terrain_slope_map_desc_type, &terrain_slope_map_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_SLOPE_MAP_STORAGE_BINDING, 0, m_terrain_slope_map_storage_desc_count, m_terrain_slope_map_storage_desc_type, &terrain_slope_map_storage_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_SPLAT_MAP_BINDING, 0, m_terrain_splat_map_desc_count, m_terrain_splat_map_desc_type, &terrain_splat_map_info, NULL, NULL});
+        }
+
+        if(m_terrain_vt_page_table.img_view)
         {
-            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_BUF_BINDING, 0, m_terrain_buf_desc_count, m_terrain_buf_desc_type, NULL, &terrain_buf_info, NULL});
-            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_HEIGHTMAP_BINDING, 0, m_terrain_heightmap_desc_count, m_terrain_heightmap_desc_type, terrain_heightmap_infos.data(), NULL, NULL});
+            terrain_vt_feedback_buf_infos[i] = {m_per_frame_data[i].terrain_vt_feedback_buffer->buf, 0, m_per_frame_data[i].terrain_vt_feedback_buffer->size};
+
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_VT_PAGE_TABLE_BINDING, 0, m_terrain_vt_page_table_desc_count, m_terrain_vt_page_table_desc_type, &terrain_vt_page_table_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_VT_CACHE_BINDING, 0, m_terrain_vt_cache_desc_count, m_terrain_vt_cache_desc_type, &terrain_vt_cache_info, NULL, NULL});
+            desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, TERRAIN_VT_FEEDBACK_BINDING, 0, m_terrain_vt_feedback_desc_count, m_terrain_vt_feedback_desc_type, NULL, &terrain_vt_feedback_buf_infos[i], NULL});
         }
         desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, BONE_TRANSFORM_BUF_BINDING, 0, m_bone_transform_buf_desc_count, m_bone_transform_buf_desc_type, NULL, &bone_transform_buf_info, NULL});
+        desc_set_writes.emplace_back(VkWriteDescriptorSet{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, NULL, m_per_frame_data[i].descriptor_set, LIGHT_CLUSTER_BUF_BINDING, 0, m_light_cluster_buf_desc_count, m_light_cluster_buf_desc_type, NULL, &light_cluster_buf_info, NULL});
     }
 
     vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(desc_set_writes.size()), desc_set_writes.data(), 0, NULL);
@@ -2169,12 +3067,41 @@ void Renderer::createDevice()
     REQ_PHY_DEV_FEAT_SUPPORT(fillModeNonSolid);
     REQ_PHY_DEV_FEAT_SUPPORT(samplerAnisotropy);
     REQ_PHY_DEV_FEAT_SUPPORT(shaderImageGatherExtended);
+    REQ_PHY_DEV_FEAT_SUPPORT(imageCubeArray);
+    REQ_PHY_DEV_FEAT_SUPPORT(shaderStorageImageExtendedFormats);
     REQ_PHY_DEV_VULKAN_1_2_FEAT_SUPPORT(descriptorBindingPartiallyBound);
     REQ_PHY_DEV_VULKAN_1_2_FEAT_SUPPORT(runtimeDescriptorArray);
 
 #undef REQ_PHY_DEV_FEAT_SUPPORT
 #undef REQ_PHY_DEV_VULKAN_1_2_FEAT_SUPPORT
 
+    /*optional: writing gl_Layer from the vertex/tessellation stages lets shadow maps skip the geometry shader*/
+    if(physical_device_12_features.shaderOutputLayer == VK_TRUE)
+    {
+        m_physical_device_12_features.shaderOutputLayer = VK_TRUE;
+        m_layered_shadow_support = true;
+    }
+
+    m_layered_shadows = m_layered_shadow_support;
+
+    /*the terrain heightmaps and slope maps are written by compute shaders*/
+    const std::array<std::pair<VkFormat, const char*>, 2> storage_image_formats
+    {
+        std::pair{VK_FORMAT_R16_UNORM, "R16_UNORM storage images"},
+        std::pair{VK_FORMAT_R16G16_SFLOAT, "R16G16_SFLOAT storage images"}
+    };
+
+    for(const auto& [format, name] : storage_image_formats)
+    {
+        VkFormatProperties format_properties;
+        vkGetPhysicalDeviceFormatProperties(m_physical_device, format, &format_properties);
+
+        if(!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT))
+        {
+            unsupported_phy_dev_feats.push_back(name);
+        }
+    }
+
     if(!unsupported_phy_dev_feats.empty())
     {
         std::string error_msg = "Required physical device features not supported:\n\n";
@@ -2195,13 +3122,16 @@ void Renderer::createDevice()
 
     for(uint32_t i = 0; i < queue_family_properties.size(); i++)
     {
-        if(queue_family_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        if((queue_family_properties[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))
         {
            m_queue_family_index = i;
            break;
         }
     }
 
+    m_timestamp_support = (m_physical_device_properties.limits.timestampComputeAndGraphics == VK_TRUE) &&
+                          (queue_family_properties[m_queue_family_index].timestampValidBits != 0);
+
     float queue_priorities = 1.0f;
 
     VkDeviceQueueCreateInfo queue_create_info{};
@@ -2568,6 +3498,17 @@ void Renderer::createShadowMapRenderPass()
     subpass_desc.preserveAttachmentCount = 0;
     subpass_desc.pPreserveAttachments = NULL;
 
+    //shadow maps are shared between frames in flight, so the layout transition and depth writes
+    //of this frame must wait for the previous frame's fragment shaders to finish sampling the shadow map
+    VkSubpassDependency subpass_dependency{};
+    subpass_dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+    subpass_dependency.dstSubpass = 0;
+    subpass_dependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    subpass_dependency.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    subpass_dependency.srcAccessMask = 0;
+    subpass_dependency.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    subpass_dependency.dependencyFlags = 0;
+
     VkRenderPassCreateInfo create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
     create_info.pNext = NULL;
@@ -2576,8 +3517,8 @@ void Renderer::createShadowMapRenderPass()
     create_info.pAttachments = &depth_att_desc;
     create_info.subpassCount = 1;
     create_info.pSubpasses = &subpass_desc;
-    create_info.dependencyCount = 0;
-    create_info.pDependencies = NULL;
+    create_info.dependencyCount = 1;
+    create_info.pDependencies = &subpass_dependency;
 
     VkResult res = vkCreateRenderPass(m_device, &create_info, NULL, &m_shadow_map_render_pass);
     assertVkSuccess(res, "Failed to create shadow map render pass.");
@@ -2595,18 +3536,24 @@ void Renderer::createDescriptorSets()
     m_normal_map_desc_count = std::max<uint32_t>(1, static_cast<uint32_t>(m_normal_maps.textures.size()));
     m_font_desc_count = static_cast<uint32_t>(m_font_textures.size());
     m_dir_lights_desc_count = 1;
-    m_dir_lights_valid_desc_count = 1;
+    m_dir_light_ids_desc_count = 1;
     m_point_lights_desc_count = 1;
-    m_point_lights_valid_desc_count = 1;
+    m_point_light_ids_desc_count = 1;
     m_dir_sm_buf_desc_count = 1;
     //TODO: should we immediately create descriptors for max possible shadow maps or start low and scale up if we need to?
     m_dir_sm_desc_count = std::max<uint32_t>(1, static_cast<uint32_t>(MAX_DIR_SHADOW_MAP_COUNT));
     m_point_sm_buf_desc_count = 1;
-    //TODO: should we immediately create descriptors for max possible shadow maps or start low and scale up if we need to?
-    m_point_sm_desc_count = std::max<uint32_t>(1, static_cast<uint32_t>(MAX_POINT_SHADOW_MAP_COUNT));
-    m_terrain_buf_desc_count = 1;
-    m_terrain_heightmap_desc_count = 4;
+    m_point_sm_desc_count = POINT_SHADOW_MAP_TIER_COUNT;
+    m_terrain_splat_map_desc_count = 1;
+    m_terrain_vt_page_table_desc_count = 1;
+    m_terrain_vt_cache_desc_count = 1;
+    m_terrain_vt_feedback_desc_count = 1;
+    m_terrain_heightmap_desc_count = 1;
+    m_terrain_heightmap_storage_desc_count = 1;
+    m_terrain_slope_map_desc_count = 1;
+    m_terrain_slope_map_storage_desc_count = 1;
     m_bone_transform_buf_desc_count = 1;
+    m_light_cluster_buf_desc_count = 1;
 
     std::vector<VkSampler> tex_samplers(m_tex_desc_count, m_sampler);
     std::vector<VkSampler> font_samplers(m_font_desc_count, m_font_sampler);
@@ -2615,24 +3562,36 @@ void Renderer::createDescriptorSets()
     std::vector<VkSampler> point_shadow_map_samplers(m_point_sm_desc_count, m_shadow_map_sampler);
     std::vector<VkSampler> normal_map_samplers(m_normal_map_desc_count, m_sampler);
     std::vector<VkSampler> terrain_heightmap_samplers(m_terrain_heightmap_desc_count, m_terrain_heightmap_sampler);
+    std::vector<VkSampler> terrain_slope_map_samplers(m_terrain_slope_map_desc_count, m_terrain_heightmap_sampler);
+    std::vector<VkSampler> terrain_splat_map_samplers(m_terrain_splat_map_desc_count, m_terrain_heightmap_sampler);
+    //the page table is only ever fetched from, the cache is filtered bilinearly within the borders of its pages
+    std::vector<VkSampler> terrain_vt_page_table_samplers(m_terrain_vt_page_table_desc_count, m_terrain_heightmap_sampler);
+    std::vector<VkSampler> terrain_vt_cache_samplers(m_terrain_vt_cache_desc_count, m_terrain_heightmap_sampler);
 
     std::vector<VkDescriptorSetLayoutBinding> desc_set_layout_bindings =
     {
-          {COMMON_BUF_BINDING, m_common_buf_desc_type, m_common_buf_desc_count, VK_SHADER_STAGE_ALL_GRAPHICS, NULL} //common buffer
+          {COMMON_BUF_BINDING, m_common_buf_desc_type, m_common_buf_desc_count, VK_SHADER_STAGE_ALL_GRAPHICS | VK_SHADER_STAGE_COMPUTE_BIT, NULL} //common buffer
         , {TEX_BINDING, m_tex_desc_type, m_tex_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, tex_samplers.data()} //textures
         , {NORMAL_MAP_BINDING, m_normal_map_desc_type, m_normal_map_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, normal_map_samplers.data()} //normal_maps
         , {FONT_BINDING, m_font_desc_type, m_font_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, font_samplers.data()} //font textures
         , {DIR_LIGHTS_BINDING, m_dir_lights_desc_type, m_dir_lights_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // directional lights
-        , {DIR_LIGHTS_VALID_BINDING, m_dir_lights_valid_desc_type, m_dir_lights_valid_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // directional lights valid
-        , {POINT_LIGHTS_BINDING, m_point_lights_desc_type, m_point_lights_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // point lights
-        , {POINT_LIGHTS_VALID_BINDING, m_point_lights_valid_desc_type, m_point_lights_valid_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // point lights valid
-        , {DIR_SM_BUF_BINDING, m_dir_sm_buf_desc_type, m_dir_sm_buf_desc_count, VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // dir shadow map data
+        , {DIR_LIGHT_IDS_BINDING, m_dir_light_ids_desc_type, m_dir_light_ids_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // visible directional light ids
+        , {POINT_LIGHTS_BINDING, m_point_lights_desc_type, m_point_lights_desc_count, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // point lights
+        , {POINT_LIGHT_IDS_BINDING, m_point_light_ids_desc_type, m_point_light_ids_desc_count, VK_SHADER_STAGE_COMPUTE_BIT, NULL} // visible point light ids
+        , {DIR_SM_BUF_BINDING, m_dir_sm_buf_desc_type, m_dir_sm_buf_desc_count, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // dir shadow map data
         , {DIR_SM_BINDING, m_dir_sm_desc_type, m_dir_sm_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, dir_shadow_map_samplers.data()} // dir shadow maps
-        , {POINT_SM_BUF_BINDING, m_point_sm_buf_desc_type, m_point_sm_buf_desc_count, VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // point shadow map data
+        , {POINT_SM_BUF_BINDING, m_point_sm_buf_desc_type, m_point_sm_buf_desc_count, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_GEOMETRY_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // point shadow map data
         , {POINT_SM_BINDING, m_point_sm_desc_type, m_point_sm_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, point_shadow_map_samplers.data()} // point shadow maps
-        , {TERRAIN_BUF_BINDING, m_terrain_buf_desc_type, m_terrain_buf_desc_count, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, NULL} // terrain per vertex data
-        , {TERRAIN_HEIGHTMAP_BINDING, m_terrain_heightmap_desc_type, m_terrain_heightmap_desc_count, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, terrain_heightmap_samplers.data()} // terrain heightmap
+        , {TERRAIN_SPLAT_MAP_BINDING, m_terrain_splat_map_desc_type, m_terrain_splat_map_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, terrain_splat_map_samplers.data()} // terrain material splat maps
+        , {TERRAIN_HEIGHTMAP_BINDING, m_terrain_heightmap_desc_type, m_terrain_heightmap_desc_count, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_COMPUTE_BIT, terrain_heightmap_samplers.data()} // terrain heightmap
         , {BONE_TRANSFORM_BUF_BINDING, m_bone_transform_buf_desc_type, m_bone_transform_buf_desc_count, VK_SHADER_STAGE_VERTEX_BIT, NULL} // bone transform buffer
+        , {LIGHT_CLUSTER_BUF_BINDING, m_light_cluster_buf_desc_type, m_light_cluster_buf_desc_count, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // light clusters
+        , {TERRAIN_HEIGHTMAP_STORAGE_BINDING, m_terrain_heightmap_storage_desc_type, m_terrain_heightmap_storage_desc_count, VK_SHADER_STAGE_COMPUTE_BIT, NULL} // terrain heightmap written by the editor brush
+        , {TERRAIN_SLOPE_MAP_BINDING, m_terrain_slope_map_desc_type, m_terrain_slope_map_desc_count, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, terrain_slope_map_samplers.data()} // terrain slope maps
+        , {TERRAIN_SLOPE_MAP_STORAGE_BINDING, m_terrain_slope_map_storage_desc_type, m_terrain_slope_map_storage_desc_count, VK_SHADER_STAGE_COMPUTE_BIT, NULL} // terrain slope maps written by their compute shader
+        , {TERRAIN_VT_PAGE_TABLE_BINDING, m_terrain_vt_page_table_desc_type, m_terrain_vt_page_table_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, terrain_vt_page_table_samplers.data()} // terrain virtual texture page table
+        , {TERRAIN_VT_CACHE_BINDING, m_terrain_vt_cache_desc_type, m_terrain_vt_cache_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, terrain_vt_cache_samplers.data()} // terrain virtual texture page cache
+        , {TERRAIN_VT_FEEDBACK_BINDING, m_terrain_vt_feedback_desc_type, m_terrain_vt_feedback_desc_count, VK_SHADER_STAGE_FRAGMENT_BIT, NULL} // pages requested by the terrain fragment shader
     };
 
     std::vector<VkDescriptorBindingFlags> desc_binding_flags =
@@ -2649,9 +3608,16 @@ void Renderer::createDescriptorSets()
         VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
         0,
         VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
         0,
+        0,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
         VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
-        0
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
     };
 
     VkDescriptorSetLayoutBindingFlagsCreateInfo desc_set_layout_binding_flags{};
@@ -2672,10 +3638,11 @@ void Renderer::createDescriptorSets()
 
     std::vector<VkDescriptorPoolSize> desc_pool_sizes =
     {
-          {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (m_tex_desc_count + m_font_desc_count + m_dir_sm_desc_count + m_point_sm_desc_count + m_normal_map_desc_count * m_terrain_heightmap_desc_count) * FRAMES_IN_FLIGHT}
+          {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (m_tex_desc_count + m_font_desc_count + m_dir_sm_desc_count + m_point_sm_desc_count + m_normal_map_desc_count + m_terrain_heightmap_desc_count + m_terrain_slope_map_desc_count + m_terrain_splat_map_desc_count + m_terrain_vt_page_table_desc_count + m_terrain_vt_cache_desc_count) * FRAMES_IN_FLIGHT}
         , {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, (m_common_buf_desc_count + m_dir_lights_desc_count + m_point_lights_desc_count) * FRAMES_IN_FLIGHT + m_dir_sm_buf_desc_count + m_point_sm_buf_desc_count}
-        , {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, (m_dir_lights_valid_desc_count + m_point_lights_valid_desc_count) * FRAMES_IN_FLIGHT}
-        , {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_terrain_buf_desc_count * FRAMES_IN_FLIGHT + m_bone_transform_buf_desc_count}
+        , {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, (m_dir_light_ids_desc_count + m_point_light_ids_desc_count) * FRAMES_IN_FLIGHT}
+        , {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, (m_light_cluster_buf_desc_count + m_terrain_vt_feedback_desc_count) * FRAMES_IN_FLIGHT + m_bone_transform_buf_desc_count}
+        , {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, (m_terrain_heightmap_storage_desc_count + m_terrain_slope_map_storage_desc_count) * FRAMES_IN_FLIGHT}
     };
 
     VkDescriptorPoolCreateInfo desc_pool_create_info{};
@@ -3794,6 +4761,107 @@ void Renderer::createPipelines()
         }
 
         assertVkSuccess(res, "Failed to create graphics pipeline.");
+
+        /*--- layered variant without the geometry shader ---*/
+        if(m_layered_shadow_support)
+        {
+            //every instance renders into one layer, so all instances of a draw have to read the same instance data
+            vertex_binding_desc[1].stride = 0;
+
+            VkBool32 point_shadow_map = VK_FALSE;
+            VkSpecializationMapEntry spec_info_map_entry{};
+            spec_info_map_entry.constantID = 0;
+            spec_info_map_entry.offset = 0;
+            spec_info_map_entry.size = sizeof(point_shadow_map);
+
+            VkSpecializationInfo spec_info{};
+            spec_info.pData = &point_shadow_map;
+            spec_info.dataSize = sizeof(point_shadow_map);
+            spec_info.pMapEntries = &spec_info_map_entry;
+            spec_info.mapEntryCount = 1;
+
+            std::vector<VkShaderModule> layered_shader_modules(1, VK_NULL_HANDLE);
+            std::vector<VkPipelineShaderStageCreateInfo> layered_shader_stage_infos;
+
+            layered_shader_stage_infos.emplace_back(loadShader(VS_SHADOWMAP_LAYERED_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &layered_shader_modules[0], &spec_info));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(layered_shader_modules[0], "DirShadowMapLayeredVS");
+#endif
+
+            pipeline_create_info.stageCount = static_cast<uint32_t>(layered_shader_stage_infos.size());
+            pipeline_create_info.pStages = layered_shader_stage_infos.data();
+
+            res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::DirShadowMapLayered));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(getPipeline(RenderMode::DirShadowMapLayered), "PipelineDirShadowMapLayered");
+#endif
+
+            for(auto& sm : layered_shader_modules)
+            {
+                vkDestroyShaderModule(m_device, sm, NULL);
+            }
+
+            assertVkSuccess(res, "Failed to create graphics pipeline.");
+        }
+
+        /*--- terrain shadow mesh variants, same state with just positions as vertex input ---*/
+        const VkVertexInputBindingDescription terrain_mesh_vertex_binding_desc = {0, sizeof(VertexTerrainShadowMesh), VK_VERTEX_INPUT_RATE_VERTEX};
+
+        vertex_input_state_create_info.vertexBindingDescriptionCount = 1;
+        vertex_input_state_create_info.pVertexBindingDescriptions = &terrain_mesh_vertex_binding_desc;
+        vertex_input_state_create_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_terrain_shadow_mesh_attr_desc.size());
+        vertex_input_state_create_info.pVertexAttributeDescriptions = vertex_terrain_shadow_mesh_attr_desc.data();
+
+        std::vector<VkShaderModule> terrain_mesh_shader_modules(2, VK_NULL_HANDLE);
+        std::vector<VkPipelineShaderStageCreateInfo> terrain_mesh_shader_stage_infos;
+
+        terrain_mesh_shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_SHADOW_MESH_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &terrain_mesh_shader_modules[0]));
+        terrain_mesh_shader_stage_infos.emplace_back(loadShader(GS_DIR_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_GEOMETRY_BIT, &terrain_mesh_shader_modules[1]));
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(terrain_mesh_shader_modules[0], "TerrainDirShadowMapMeshVS");
+        setDebugObjectName(terrain_mesh_shader_modules[1], "TerrainDirShadowMapMeshGS");
+#endif
+
+        pipeline_create_info.stageCount = static_cast<uint32_t>(terrain_mesh_shader_stage_infos.size());
+        pipeline_create_info.pStages = terrain_mesh_shader_stage_infos.data();
+
+        res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::TerrainDirShadowMapMesh));
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(getPipeline(RenderMode::TerrainDirShadowMapMesh), "PipelineTerrainDirShadowMapMesh");
+#endif
+
+        for(auto& sm : terrain_mesh_shader_modules)
+        {
+            vkDestroyShaderModule(m_device, sm, NULL);
+        }
+
+        assertVkSuccess(res, "Failed to create graphics pipeline.");
+
+        if(m_layered_shadow_support)
+        {
+            std::vector<VkShaderModule> layered_shader_modules(1, VK_NULL_HANDLE);
+            std::vector<VkPipelineShaderStageCreateInfo> layered_shader_stage_infos;
+
+            layered_shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_SHADOW_MESH_LAYERED_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &layered_shader_modules[0]));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(layered_shader_modules[0], "TerrainDirShadowMapMeshLayeredVS");
+#endif
+
+            pipeline_create_info.stageCount = static_cast<uint32_t>(layered_shader_stage_infos.size());
+            pipeline_create_info.pStages = layered_shader_stage_infos.data();
+
+            res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::TerrainDirShadowMapMeshLayered));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(getPipeline(RenderMode::TerrainDirShadowMapMeshLayered), "PipelineTerrainDirShadowMapMeshLayered");
+#endif
+
+            for(auto& sm : layered_shader_modules)
+            {
+                vkDestroyShaderModule(m_device, sm, NULL);
+            }
+
+            assertVkSuccess(res, "Failed to create graphics pipeline.");
+        }
     }
 
     /*--- TerrainDirShadowMap ---*/
@@ -3914,12 +4982,30 @@ void Renderer::createPipelines()
         pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
         pipeline_create_info.basePipelineIndex = -1;
 
+        //the shadow map passes use lower tessellation levels and can't cull patches against the camera frustum
+        //shadow_map, point_shadow_map and layered constants of the TCS, the layered variant below sets the last one
+        std::array<VkBool32, 3> tcs_spec_consts = {VK_TRUE, VK_FALSE, VK_FALSE};
+        std::array<VkSpecializationMapEntry, 3> tcs_spec_info_map_entries{};
+
+        for(uint32_t i = 0; i < tcs_spec_info_map_entries.size(); i++)
+        {
+            tcs_spec_info_map_entries[i].constantID = i;
+            tcs_spec_info_map_entries[i].offset = i * sizeof(VkBool32);
+            tcs_spec_info_map_entries[i].size = sizeof(VkBool32);
+        }
+
+        VkSpecializationInfo tcs_spec_info{};
+        tcs_spec_info.pData = tcs_spec_consts.data();
+        tcs_spec_info.dataSize = sizeof(tcs_spec_consts);
+        tcs_spec_info.pMapEntries = tcs_spec_info_map_entries.data();
+        tcs_spec_info.mapEntryCount = static_cast<uint32_t>(tcs_spec_info_map_entries.size());
+
         /*---------------------------- shaders ----------------------------*/
         std::vector<VkShaderModule> shader_modules(4, VK_NULL_HANDLE);
         std::vector<VkPipelineShaderStageCreateInfo> shader_stage_infos;
 
         shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &shader_modules[0]));
-        shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &shader_modules[1]));
+        shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &shader_modules[1], &tcs_spec_info));
         shader_stage_infos.emplace_back(loadShader(TES_TERRAIN_SHADOWMAP_FILENAME, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, &shader_modules[2]));
         shader_stage_infos.emplace_back(loadShader(GS_DIR_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_GEOMETRY_BIT, &shader_modules[3]));
 #if VULKAN_VALIDATION_ENABLE
@@ -3943,6 +5029,52 @@ void Renderer::createPipelines()
         }
 
         assertVkSuccess(res, "Failed to create graphics pipeline.");
+
+        /*--- layered variant without the geometry shader ---*/
+        if(m_layered_shadow_support)
+        {
+            VkBool32 point_shadow_map = VK_FALSE;
+            VkSpecializationMapEntry spec_info_map_entry{};
+            spec_info_map_entry.constantID = 0;
+            spec_info_map_entry.offset = 0;
+            spec_info_map_entry.size = sizeof(point_shadow_map);
+
+            VkSpecializationInfo spec_info{};
+            spec_info.pData = &point_shadow_map;
+            spec_info.dataSize = sizeof(point_shadow_map);
+            spec_info.pMapEntries = &spec_info_map_entry;
+            spec_info.mapEntryCount = 1;
+
+            //the non layered pipeline has already been created, so its constants can be changed
+            tcs_spec_consts[2] = VK_TRUE;
+
+            std::vector<VkShaderModule> layered_shader_modules(3, VK_NULL_HANDLE);
+            std::vector<VkPipelineShaderStageCreateInfo> layered_shader_stage_infos;
+
+            layered_shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &layered_shader_modules[0]));
+            layered_shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &layered_shader_modules[1], &tcs_spec_info));
+            layered_shader_stage_infos.emplace_back(loadShader(TES_TERRAIN_SHADOWMAP_LAYERED_FILENAME, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, &layered_shader_modules[2], &spec_info));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(layered_shader_modules[0], "TerrainDirShadowMapLayeredVS");
+            setDebugObjectName(layered_shader_modules[1], "TerrainDirShadowMapLayeredTCS");
+            setDebugObjectName(layered_shader_modules[2], "TerrainDirShadowMapLayeredTES");
+#endif
+
+            pipeline_create_info.stageCount = static_cast<uint32_t>(layered_shader_stage_infos.size());
+            pipeline_create_info.pStages = layered_shader_stage_infos.data();
+
+            res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::TerrainDirShadowMapLayered));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(getPipeline(RenderMode::TerrainDirShadowMapLayered), "PipelineTerrainDirShadowMapLayered");
+#endif
+
+            for(auto& sm : layered_shader_modules)
+            {
+                vkDestroyShaderModule(m_device, sm, NULL);
+            }
+
+            assertVkSuccess(res, "Failed to create graphics pipeline.");
+        }
     }
 
     /*--- PointShadowMap ---*/
@@ -4084,6 +5216,50 @@ void Renderer::createPipelines()
         }
 
         assertVkSuccess(res, "Failed to create graphics pipeline.");
+
+        /*--- layered variant without the geometry shader ---*/
+        if(m_layered_shadow_support)
+        {
+            //every instance renders into one layer, so all instances of a draw have to read the same instance data
+            vertex_binding_desc[1].stride = 0;
+
+            VkBool32 point_shadow_map = VK_TRUE;
+            VkSpecializationMapEntry spec_info_map_entry{};
+            spec_info_map_entry.constantID = 0;
+            spec_info_map_entry.offset = 0;
+            spec_info_map_entry.size = sizeof(point_shadow_map);
+
+            VkSpecializationInfo spec_info{};
+            spec_info.pData = &point_shadow_map;
+            spec_info.dataSize = sizeof(point_shadow_map);
+            spec_info.pMapEntries = &spec_info_map_entry;
+            spec_info.mapEntryCount = 1;
+
+            std::vector<VkShaderModule> layered_shader_modules(2, VK_NULL_HANDLE);
+            std::vector<VkPipelineShaderStageCreateInfo> layered_shader_stage_infos;
+
+            layered_shader_stage_infos.emplace_back(loadShader(VS_SHADOWMAP_LAYERED_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &layered_shader_modules[0], &spec_info));
+            layered_shader_stage_infos.emplace_back(loadShader(FS_POINT_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_FRAGMENT_BIT, &layered_shader_modules[1]));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(layered_shader_modules[0], "PointShadowMapLayeredVS");
+            setDebugObjectName(layered_shader_modules[1], "PointShadowMapLayeredFS");
+#endif
+
+            pipeline_create_info.stageCount = static_cast<uint32_t>(layered_shader_stage_infos.size());
+            pipeline_create_info.pStages = layered_shader_stage_infos.data();
+
+            res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::PointShadowMapLayered));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(getPipeline(RenderMode::PointShadowMapLayered), "PipelinePointShadowMapLayered");
+#endif
+
+            for(auto& sm : layered_shader_modules)
+            {
+                vkDestroyShaderModule(m_device, sm, NULL);
+            }
+
+            assertVkSuccess(res, "Failed to create graphics pipeline.");
+        }
     }
 
     /*--- TerrainPointShadowMap ---*/
@@ -4204,12 +5380,30 @@ void Renderer::createPipelines()
         pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
         pipeline_create_info.basePipelineIndex = -1;
 
+        //the shadow map passes use lower tessellation levels and can't cull patches against the camera frustum
+        //shadow_map, point_shadow_map and layered constants of the TCS, the layered variant below sets the last one
+        std::array<VkBool32, 3> tcs_spec_consts = {VK_TRUE, VK_TRUE, VK_FALSE};
+        std::array<VkSpecializationMapEntry, 3> tcs_spec_info_map_entries{};
+
+        for(uint32_t i = 0; i < tcs_spec_info_map_entries.size(); i++)
+        {
+            tcs_spec_info_map_entries[i].constantID = i;
+            tcs_spec_info_map_entries[i].offset = i * sizeof(VkBool32);
+            tcs_spec_info_map_entries[i].size = sizeof(VkBool32);
+        }
+
+        VkSpecializationInfo tcs_spec_info{};
+        tcs_spec_info.pData = tcs_spec_consts.data();
+        tcs_spec_info.dataSize = sizeof(tcs_spec_consts);
+        tcs_spec_info.pMapEntries = tcs_spec_info_map_entries.data();
+        tcs_spec_info.mapEntryCount = static_cast<uint32_t>(tcs_spec_info_map_entries.size());
+
         /*---------------------------- shaders ----------------------------*/
         std::vector<VkShaderModule> shader_modules(5, VK_NULL_HANDLE);
         std::vector<VkPipelineShaderStageCreateInfo> shader_stage_infos;
 
         shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &shader_modules[0]));
-        shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &shader_modules[1]));
+        shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &shader_modules[1], &tcs_spec_info));
         shader_stage_infos.emplace_back(loadShader(TES_TERRAIN_SHADOWMAP_FILENAME, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, &shader_modules[2]));
         shader_stage_infos.emplace_back(loadShader(GS_POINT_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_GEOMETRY_BIT, &shader_modules[3]));
         shader_stage_infos.emplace_back(loadShader(FS_POINT_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_FRAGMENT_BIT, &shader_modules[4]));
@@ -4235,6 +5429,54 @@ void Renderer::createPipelines()
         }
 
         assertVkSuccess(res, "Failed to create graphics pipeline.");
+
+        /*--- layered variant without the geometry shader ---*/
+        if(m_layered_shadow_support)
+        {
+            VkBool32 point_shadow_map = VK_TRUE;
+            VkSpecializationMapEntry spec_info_map_entry{};
+            spec_info_map_entry.constantID = 0;
+            spec_info_map_entry.offset = 0;
+            spec_info_map_entry.size = sizeof(point_shadow_map);
+
+            VkSpecializationInfo spec_info{};
+            spec_info.pData = &point_shadow_map;
+            spec_info.dataSize = sizeof(point_shadow_map);
+            spec_info.pMapEntries = &spec_info_map_entry;
+            spec_info.mapEntryCount = 1;
+
+            //the non layered pipeline has already been created, so its constants can be changed
+            tcs_spec_consts[2] = VK_TRUE;
+
+            std::vector<VkShaderModule> layered_shader_modules(4, VK_NULL_HANDLE);
+            std::vector<VkPipelineShaderStageCreateInfo> layered_shader_stage_infos;
+
+            layered_shader_stage_infos.emplace_back(loadShader(VS_TERRAIN_FILENAME, VK_SHADER_STAGE_VERTEX_BIT, &layered_shader_modules[0]));
+            layered_shader_stage_infos.emplace_back(loadShader(TCS_TERRAIN_FILENAME, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT, &layered_shader_modules[1], &tcs_spec_info));
+            layered_shader_stage_infos.emplace_back(loadShader(TES_TERRAIN_SHADOWMAP_LAYERED_FILENAME, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, &layered_shader_modules[2], &spec_info));
+            layered_shader_stage_infos.emplace_back(loadShader(FS_POINT_SHADOW_MAP_FILENAME, VK_SHADER_STAGE_FRAGMENT_BIT, &layered_shader_modules[3]));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(layered_shader_modules[0], "TerrainPointShadowMapLayeredVS");
+            setDebugObjectName(layered_shader_modules[1], "TerrainPointShadowMapLayeredTCS");
+            setDebugObjectName(layered_shader_modules[2], "TerrainPointShadowMapLayeredTES");
+            setDebugObjectName(layered_shader_modules[3], "TerrainPointShadowMapLayeredFS");
+#endif
+
+            pipeline_create_info.stageCount = static_cast<uint32_t>(layered_shader_stage_infos.size());
+            pipeline_create_info.pStages = layered_shader_stage_infos.data();
+
+            res = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &getPipeline(RenderMode::TerrainPointShadowMapLayered));
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(getPipeline(RenderMode::TerrainPointShadowMapLayered), "PipelineTerrainPointShadowMapLayered");
+#endif
+
+            for(auto& sm : layered_shader_modules)
+            {
+                vkDestroyShaderModule(m_device, sm, NULL);
+            }
+
+            assertVkSuccess(res, "Failed to create graphics pipeline.");
+        }
     }
 
     /*--- Highlight ---*/
@@ -4581,6 +5823,84 @@ void Renderer::createPipelines()
 
         assertVkSuccess(res, "Failed to create graphics pipeline.");
     }
+
+    /*--- Light clustering ---*/
+    {
+        VkShaderModule shader_module = VK_NULL_HANDLE;
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.pNext = NULL;
+        pipeline_create_info.flags = 0;
+        pipeline_create_info.stage = loadShader(CS_LIGHT_CLUSTERING_FILENAME, VK_SHADER_STAGE_COMPUTE_BIT, &shader_module);
+        pipeline_create_info.layout = m_pipeline_layout;
+        pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex = -1;
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(shader_module, "LightClusteringCS");
+#endif
+
+        VkResult res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &m_light_clustering_pipeline);
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(m_light_clustering_pipeline, "PipelineLightClustering");
+#endif
+
+        vkDestroyShaderModule(m_device, shader_module, NULL);
+
+        assertVkSuccess(res, "Failed to create compute pipeline.");
+    }
+
+    /*--- Terrain brush ---*/
+    {
+        VkShaderModule shader_module = VK_NULL_HANDLE;
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.pNext = NULL;
+        pipeline_create_info.flags = 0;
+        pipeline_create_info.stage = loadShader(CS_TERRAIN_BRUSH_FILENAME, VK_SHADER_STAGE_COMPUTE_BIT, &shader_module);
+        pipeline_create_info.layout = m_pipeline_layout;
+        pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex = -1;
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(shader_module, "TerrainBrushCS");
+#endif
+
+        VkResult res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &m_terrain_brush_pipeline);
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(m_terrain_brush_pipeline, "PipelineTerrainBrush");
+#endif
+
+        vkDestroyShaderModule(m_device, shader_module, NULL);
+
+        assertVkSuccess(res, "Failed to create compute pipeline.");
+    }
+
+    /*--- Terrain slope maps ---*/
+    {
+        VkShaderModule shader_module = VK_NULL_HANDLE;
+
+        VkComputePipelineCreateInfo pipeline_create_info{};
+        pipeline_create_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        pipeline_create_info.pNext = NULL;
+        pipeline_create_info.flags = 0;
+        pipeline_create_info.stage = loadShader(CS_TERRAIN_SLOPE_MAP_FILENAME, VK_SHADER_STAGE_COMPUTE_BIT, &shader_module);
+        pipeline_create_info.layout = m_pipeline_layout;
+        pipeline_create_info.basePipelineHandle = VK_NULL_HANDLE;
+        pipeline_create_info.basePipelineIndex = -1;
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(shader_module, "TerrainSlopeMapCS");
+#endif
+
+        VkResult res = vkCreateComputePipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, NULL, &m_terrain_slope_map_pipeline);
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(m_terrain_slope_map_pipeline, "PipelineTerrainSlopeMap");
+#endif
+
+        vkDestroyShaderModule(m_device, shader_module, NULL);
+
+        assertVkSuccess(res, "Failed to create compute pipeline.");
+    }
 }
 
 void Renderer::createCommandBuffers()
@@ -4651,6 +5971,28 @@ void Renderer::createSynchronizationPrimitives()
 #endif
 }
 
+void Renderer::createQueryPools()
+{
+    if(!m_timestamp_support)
+    {
+        return;
+    }
+
+    VkQueryPoolCreateInfo query_pool_create_info{};
+    query_pool_create_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_pool_create_info.pNext = NULL;
+    query_pool_create_info.flags = 0;
+    query_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_pool_create_info.queryCount = 2;
+    query_pool_create_info.pipelineStatistics = 0;
+
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        VkResult res = vkCreateQueryPool(m_device, &query_pool_create_info, NULL, &m_per_frame_data[i].timestamp_query_pool);
+        assertVkSuccess(res, "Failed to create query pool.");
+    }
+}
+
 void Renderer::createRenderTargets()
 {
     VkResult res;
@@ -4894,41 +6236,49 @@ void Renderer::createBuffers()
         m_per_frame_data[i].common_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, false);
         createBuffer(*m_per_frame_data[i].common_buffer, sizeof(m_common_buffer_data));
 
-        m_per_frame_data[i].dir_light_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, false);
-        createBuffer(*m_per_frame_data[i].dir_light_buffer, MAX_DIR_LIGHT_COUNT * sizeof(DirLightShaderData));
+        m_per_frame_data[i].terrain_heightmap_staging_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        createBuffer(*m_per_frame_data[i].terrain_heightmap_staging_buffer, MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME * TERRAIN_HEIGHTMAP_RES * TERRAIN_HEIGHTMAP_RES * sizeof(uint16_t));
 
-        m_per_frame_data[i].dir_light_valid_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_FORMAT_R8_UINT, false);
-        createBuffer(*m_per_frame_data[i].dir_light_valid_buffer, MAX_DIR_LIGHT_COUNT);
+        m_per_frame_data[i].terrain_splat_map_staging_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        createBuffer(*m_per_frame_data[i].terrain_splat_map_staging_buffer, MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME * TERRAIN_SPLAT_MAP_RES * TERRAIN_SPLAT_MAP_RES * sizeof(uint32_t));
 
-        m_per_frame_data[i].point_light_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, false);
-        createBuffer(*m_per_frame_data[i].point_light_buffer, MAX_POINT_LIGHT_COUNT * sizeof(PointLightShaderData));
+        //every upload changes at most 2 page table entries
+        m_per_frame_data[i].terrain_vt_staging_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_TRANSFER_SRC_BIT, true);
+        createBuffer(*m_per_frame_data[i].terrain_vt_staging_buffer, MAX_TERRAIN_VT_UPLOADS_PER_FRAME * (TERRAIN_VT_PADDED_PAGE_RES * TERRAIN_VT_PADDED_PAGE_RES + 2) * sizeof(uint32_t));
 
-        m_per_frame_data[i].point_light_valid_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_FORMAT_R8_UINT, false);
-        createBuffer(*m_per_frame_data[i].point_light_valid_buffer, MAX_POINT_LIGHT_COUNT);
+        m_per_frame_data[i].terrain_heightmap_readback_buffer = std::make_unique<VkBufferWrapper>(VK_BUFFER_USAGE_TRANSFER_DST_BIT, true);
+        createBuffer(*m_per_frame_data[i].terrain_heightmap_readback_buffer, MAX_TERRAIN_BRUSH_DISPATCHES_PER_FRAME * TERRAIN_HEIGHTMAP_RES * TERRAIN_HEIGHTMAP_RES * sizeof(uint16_t));
 
         //TODO: when buffers are later destroyed and created anew when they need to be resized, we lose these debug names
         //should find a way to make sure we can set the debug names even after we recreate them later
 #if VULKAN_VALIDATION_ENABLE
         setDebugObjectName(m_per_frame_data[i].common_buffer->buf, "CommonBuffer_" + std::to_string(i));
-        setDebugObjectName(m_per_frame_data[i].dir_light_buffer->buf, "DitLightBuffer_" + std::to_string(i));
-        setDebugObjectName(m_per_frame_data[i].dir_light_valid_buffer->buf, "DirLightValidBuffer_" + std::to_string(i));
-        setDebugObjectName(m_per_frame_data[i].point_light_buffer->buf, "PointLightBuffer_" + std::to_string(i));
-        setDebugObjectName(m_per_frame_data[i].point_light_valid_buffer->buf, "PointLightValidBuffer_" + std::to_string(i));
+        setDebugObjectName(m_per_frame_data[i].terrain_heightmap_staging_buffer->buf, "TerrainHeightmapStagingBuffer_" + std::to_string(i));
+        setDebugObjectName(m_per_frame_data[i].terrain_splat_map_staging_buffer->buf, "TerrainSplatMapStagingBuffer_" + std::to_string(i));
+        setDebugObjectName(m_per_frame_data[i].terrain_vt_staging_buffer->buf, "TerrainVTStagingBuffer_" + std::to_string(i));
+        setDebugObjectName(m_per_frame_data[i].terrain_heightmap_readback_buffer->buf, "TerrainHeightmapReadbackBuffer_" + std::to_string(i));
 #endif
     }
 
+    createBuffer(m_dir_light_buffer, MAX_DIR_LIGHT_COUNT * sizeof(DirLightShaderData));
+    createBuffer(m_dir_light_ids_buffer, MAX_DIR_LIGHT_COUNT * sizeof(uint16_t));
+    createBuffer(m_point_light_buffer, MAX_POINT_LIGHT_COUNT * sizeof(PointLightShaderData));
+    createBuffer(m_point_light_ids_buffer, MAX_POINT_LIGHT_COUNT * sizeof(uint16_t));
     createBuffer(m_dir_shadow_map_buffer, sizeof(m_dir_shadow_map_data));
     createBuffer(m_point_shadow_map_buffer, sizeof(m_point_shadow_map_data));
+    createBuffer(m_light_cluster_buffer, LIGHT_CLUSTER_COUNT * (MAX_LIGHTS_PER_LIGHT_CLUSTER + 1) * sizeof(uint32_t));
 
 #if VULKAN_VALIDATION_ENABLE
+    setDebugObjectName(m_dir_light_buffer.buf, "DirLightBuffer");
+    setDebugObjectName(m_dir_light_ids_buffer.buf, "DirLightIdsBuffer");
+    setDebugObjectName(m_point_light_buffer.buf, "PointLightBuffer");
+    setDebugObjectName(m_point_light_ids_buffer.buf, "PointLightIdsBuffer");
     setDebugObjectName(m_dir_shadow_map_buffer.buf, "DirShadowMapBuffer");
     setDebugObjectName(m_point_shadow_map_buffer.buf, "PointShadowMapBuffer");
-//    setDebugObjectName(m_terrain_buffer.buf, "TerrainBuffer");
+    setDebugObjectName(m_light_cluster_buffer.buf, "LightClusterBuffer");
 #endif
 
     //initialize buffers
-    std::vector<uint8_t> zero_data(std::max(m_per_frame_data[0].dir_light_valid_buffer->size, m_per_frame_data[0].point_light_valid_buffer->size), 0);
-
     VkCommandBufferBeginInfo begin_info{};
     begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
     begin_info.pNext = NULL;
@@ -4938,12 +6288,6 @@ void Renderer::createBuffers()
     VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
     assertVkSuccess(res, "An error occurred while begining the transfer command buffer.");
 
-    for(size_t i = 0; i < FRAMES_IN_FLIGHT; i++)
-    {
-        vkCmdUpdateBuffer(m_transfer_cmd_buf, m_per_frame_data[i].dir_light_valid_buffer->buf, 0, m_per_frame_data[i].dir_light_valid_buffer->size, zero_data.data());
-        vkCmdUpdateBuffer(m_transfer_cmd_buf, m_per_frame_data[i].point_light_valid_buffer->buf, 0, m_per_frame_data[i].point_light_valid_buffer->size, zero_data.data());
-    }
-
     //TODO: this is only here because we force all 3d object vertices to have a bone transform currently, even if they have no animation
     //for that reason we put an identity matrix at index 0 in the buffer for all non-animated objects to use
     //we should later separate animated and non-animated objects and have separate vertex types for them, but for now this trick will do
@@ -5041,39 +6385,33 @@ uint32_t Renderer::createDirShadowMap(const DirLight& light)
 
     m_update_descriptors = true;
 
-    for(auto& per_frame_data : m_per_frame_data)
-    {
-        DirShadowMap& shadow_map = per_frame_data.dir_shadow_maps[shadow_map_id];
+    DirShadowMap& shadow_map = m_dir_shadow_maps[shadow_map_id];
 
-        shadow_map.count = light.shadow_map_count;
-        shadow_map.res_x = light.shadow_map_res_x;
-        shadow_map.res_y = light.shadow_map_res_y;
+    shadow_map.count = light.shadow_map_count;
+    shadow_map.res_x = light.shadow_map_res_x;
+    shadow_map.res_y = light.shadow_map_res_y;
 
-        shadow_map.depth_img = createImage(depth_img_create_info, depth_img_view_create_info);
+    shadow_map.depth_img = createImage(depth_img_create_info, depth_img_view_create_info);
 
-        framebuffer_create_info.pAttachments = &shadow_map.depth_img.img_view;
+    framebuffer_create_info.pAttachments = &shadow_map.depth_img.img_view;
 
-        VkResult res = vkCreateFramebuffer(m_device, &framebuffer_create_info, NULL, &shadow_map.framebuffer);
-        assertVkSuccess(res, "Failed to create shadow map framebuffer.");
+    VkResult res = vkCreateFramebuffer(m_device, &framebuffer_create_info, NULL, &shadow_map.framebuffer);
+    assertVkSuccess(res, "Failed to create shadow map framebuffer.");
 
-        shadow_map.render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        shadow_map.render_pass_begin_info.pNext = NULL;
-        shadow_map.render_pass_begin_info.renderPass = m_shadow_map_render_pass;
-        shadow_map.render_pass_begin_info.framebuffer = shadow_map.framebuffer;
-        shadow_map.render_pass_begin_info.renderArea.extent = {light.shadow_map_res_x, light.shadow_map_res_y};
-        shadow_map.render_pass_begin_info.renderArea.offset = {0, 0};
-        shadow_map.render_pass_begin_info.clearValueCount = 1;
-        shadow_map.render_pass_begin_info.pClearValues = &m_shadow_map_clear_value;
-    }
+    shadow_map.render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    shadow_map.render_pass_begin_info.pNext = NULL;
+    shadow_map.render_pass_begin_info.renderPass = m_shadow_map_render_pass;
+    shadow_map.render_pass_begin_info.framebuffer = shadow_map.framebuffer;
+    shadow_map.render_pass_begin_info.renderArea.extent = {light.shadow_map_res_x, light.shadow_map_res_y};
+    shadow_map.render_pass_begin_info.renderArea.offset = {0, 0};
+    shadow_map.render_pass_begin_info.clearValueCount = 1;
+    shadow_map.render_pass_begin_info.pClearValues = &m_shadow_map_clear_value;
 
 #if VULKAN_VALIDATION_ENABLE
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
-    {
-        setDebugObjectName(m_per_frame_data[i].dir_shadow_maps[shadow_map_id].framebuffer, "DirShadowMapFramebuffer_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].dir_shadow_maps[shadow_map_id].depth_img.img, "DirShadowMapImg_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].dir_shadow_maps[shadow_map_id].depth_img.img_view, "DirShadowMapImgView_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].dir_shadow_maps[shadow_map_id].depth_img.mem, "DirShadowMapImgMem_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-    }
+    setDebugObjectName(shadow_map.framebuffer, "DirShadowMapFramebuffer_" + std::to_string(shadow_map_id));
+    setDebugObjectName(shadow_map.depth_img.img, "DirShadowMapImg_" + std::to_string(shadow_map_id));
+    setDebugObjectName(shadow_map.depth_img.img_view, "DirShadowMapImgView_" + std::to_string(shadow_map_id));
+    setDebugObjectName(shadow_map.depth_img.mem, "DirShadowMapImgMem_" + std::to_string(shadow_map_id));
 #endif
 
     m_dir_shadow_maps_valid[shadow_map_id] = true;
@@ -5173,130 +6511,329 @@ void Renderer::updateDirShadowMap(const Camera& camera, const DirLightShaderData
                                                 0.5f, 0.5f, 0.0f, 1.0f);
 
         shadow_map_data[i].tex_P = to_tex_coords * shadow_map_data[i].P;
+        shadow_map_data[i].terrain_tess_scale = m_terrain_shadow_tess_scales[i];
     }
 
     requestBufferUpdate(&m_dir_shadow_map_buffer, light.shadow_map_id * sizeof(shadow_map_data), shadow_map_count * sizeof(DirShadowMapData), shadow_map_data.data());
 }
 
-uint32_t Renderer::createPointShadowMap(const PointLight& light)
+void Renderer::createPointShadowMaps()
 {
-    VkFramebufferCreateInfo framebuffer_create_info{};
-    framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebuffer_create_info.pNext = NULL;
-    framebuffer_create_info.flags = 0;
-    framebuffer_create_info.renderPass = m_shadow_map_render_pass;
-    framebuffer_create_info.attachmentCount = 1;
-    framebuffer_create_info.width = light.shadow_map_res;
-    framebuffer_create_info.height = light.shadow_map_res;
-    framebuffer_create_info.layers = 6;
+    static_assert(MAX_POINT_SHADOW_MAP_COUNT == POINT_SHADOW_MAP_TIER_0_SLOT_COUNT + POINT_SHADOW_MAP_TIER_1_SLOT_COUNT + POINT_SHADOW_MAP_TIER_2_SLOT_COUNT);
 
-    VkImageCreateInfo depth_img_create_info{};
-    depth_img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    depth_img_create_info.pNext = NULL;
-    depth_img_create_info.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-    depth_img_create_info.imageType = VK_IMAGE_TYPE_2D;
-    depth_img_create_info.format = VK_FORMAT_D16_UNORM;
-    depth_img_create_info.extent = {light.shadow_map_res, light.shadow_map_res, 1};
-    depth_img_create_info.mipLevels = 1;
-    depth_img_create_info.arrayLayers = 6;
-    depth_img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
-    depth_img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
-    depth_img_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
-    depth_img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    depth_img_create_info.queueFamilyIndexCount = 1;
-    depth_img_create_info.pQueueFamilyIndices = &m_queue_family_index;
-    depth_img_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    constexpr std::array<std::pair<uint32_t, uint32_t>, POINT_SHADOW_MAP_TIER_COUNT> tier_res_and_slot_counts =
+    {{
+        {POINT_SHADOW_MAP_TIER_0_RES, POINT_SHADOW_MAP_TIER_0_SLOT_COUNT},
+        {POINT_SHADOW_MAP_TIER_1_RES, POINT_SHADOW_MAP_TIER_1_SLOT_COUNT},
+        {POINT_SHADOW_MAP_TIER_2_RES, POINT_SHADOW_MAP_TIER_2_SLOT_COUNT},
+    }};
 
-    VkImageViewCreateInfo depth_img_view_create_info{};
-    depth_img_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-    depth_img_view_create_info.pNext = NULL;
-    depth_img_view_create_info.flags = 0;
-    depth_img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-    depth_img_view_create_info.format = depth_img_create_info.format;
-    depth_img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
-    depth_img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 6};
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.pNext = NULL;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    begin_info.pInheritanceInfo = NULL;
 
-    uint32_t shadow_map_id = 0;
+    VkResult res = vkBeginCommandBuffer(m_transfer_cmd_buf, &begin_info);
+    assertVkSuccess(res, "An error occurred while beginning the transfer command buffer.");
+
+    uint32_t first_slot = 0;
+
+    for(uint32_t tier_id = 0; tier_id < POINT_SHADOW_MAP_TIER_COUNT; tier_id++)
+    {
+        auto& tier = m_point_shadow_map_tiers[tier_id];
+        tier.res = tier_res_and_slot_counts[tier_id].first;
+        tier.slot_count = tier_res_and_slot_counts[tier_id].second;
+        tier.first_slot = first_slot;
+        first_slot += tier.slot_count;
+
+        VkImageCreateInfo depth_img_create_info{};
+        depth_img_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        depth_img_create_info.pNext = NULL;
+        depth_img_create_info.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+        depth_img_create_info.imageType = VK_IMAGE_TYPE_2D;
+        depth_img_create_info.format = VK_FORMAT_D16_UNORM;
+        depth_img_create_info.extent = {tier.res, tier.res, 1};
+        depth_img_create_info.mipLevels = 1;
+        depth_img_create_info.arrayLayers = 6 * tier.slot_count;
+        depth_img_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        depth_img_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        depth_img_create_info.usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        depth_img_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        depth_img_create_info.queueFamilyIndexCount = 1;
+        depth_img_create_info.pQueueFamilyIndices = &m_queue_family_index;
+        depth_img_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        VkImageViewCreateInfo depth_img_view_create_info{};
+        depth_img_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        depth_img_view_create_info.pNext = NULL;
+        depth_img_view_create_info.flags = 0;
+        depth_img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+        depth_img_view_create_info.format = depth_img_create_info.format;
+        depth_img_view_create_info.components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY};
+        depth_img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 6 * tier.slot_count};
+
+        tier.depth_img = createImage(depth_img_create_info, depth_img_view_create_info);
+
+#if VULKAN_VALIDATION_ENABLE
+        setDebugObjectName(tier.depth_img.img, "PointShadowMapImg_" + std::to_string(tier_id));
+        setDebugObjectName(tier.depth_img.img_view, "PointShadowMapImgView_" + std::to_string(tier_id));
+        setDebugObjectName(tier.depth_img.mem, "PointShadowMapImgMem_" + std::to_string(tier_id));
+#endif
+
+        //slots that were never rendered to still get sampled through the cube map array view, so they need a valid layout
+        VkImageSubresourceRange img_sub_range{VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 6 * tier.slot_count};
+
+        VkImageMemoryBarrier img_mem_bar{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER, NULL, 0, VK_ACCESS_SHADER_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED,
+                                     VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, tier.depth_img.img, img_sub_range};
+
+        vkCmdPipelineBarrier(m_transfer_cmd_buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &img_mem_bar);
+
+        VkImageViewCreateInfo slot_img_view_create_info = depth_img_view_create_info;
+        slot_img_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+
+        VkFramebufferCreateInfo framebuffer_create_info{};
+        framebuffer_create_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebuffer_create_info.pNext = NULL;
+        framebuffer_create_info.flags = 0;
+        framebuffer_create_info.renderPass = m_shadow_map_render_pass;
+        framebuffer_create_info.attachmentCount = 1;
+        framebuffer_create_info.width = tier.res;
+        framebuffer_create_info.height = tier.res;
+        framebuffer_create_info.layers = 6;
+
+        for(uint32_t layer = 0; layer < tier.slot_count; layer++)
+        {
+            const uint32_t shadow_map_id = tier.first_slot + layer;
+            PointShadowMap& shadow_map = m_point_shadow_maps[shadow_map_id];
 
-    if(m_point_shadow_maps_free_ids.empty())
+            shadow_map.tier = tier_id;
+            shadow_map.layer = layer;
+
+            slot_img_view_create_info.image = tier.depth_img.img;
+            slot_img_view_create_info.subresourceRange = {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 6 * layer, 6};
+
+            res = vkCreateImageView(m_device, &slot_img_view_create_info, NULL, &shadow_map.img_view);
+            assertVkSuccess(res, "Failed to create point shadow map image view.");
+
+            framebuffer_create_info.pAttachments = &shadow_map.img_view;
+
+            res = vkCreateFramebuffer(m_device, &framebuffer_create_info, NULL, &shadow_map.framebuffer);
+            assertVkSuccess(res, "Failed to create shadow map framebuffer.");
+
+            shadow_map.render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            shadow_map.render_pass_begin_info.pNext = NULL;
+            shadow_map.render_pass_begin_info.renderPass = m_shadow_map_render_pass;
+            shadow_map.render_pass_begin_info.framebuffer = shadow_map.framebuffer;
+            shadow_map.render_pass_begin_info.renderArea.extent = {tier.res, tier.res};
+            shadow_map.render_pass_begin_info.renderArea.offset = {0, 0};
+            shadow_map.render_pass_begin_info.clearValueCount = 1;
+            shadow_map.render_pass_begin_info.pClearValues = &m_shadow_map_clear_value;
+
+#if VULKAN_VALIDATION_ENABLE
+            setDebugObjectName(shadow_map.framebuffer, "PointShadowMapFramebuffer_" + std::to_string(shadow_map_id));
+            setDebugObjectName(shadow_map.img_view, "PointShadowMapSlotImgView_" + std::to_string(shadow_map_id));
+#endif
+        }
+    }
+
+    res = vkEndCommandBuffer(m_transfer_cmd_buf);
+    assertVkSuccess(res, "An error occurred while ending the transfer command buffer.");
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = NULL;
+    submit_info.waitSemaphoreCount = 0;
+    submit_info.pWaitSemaphores = NULL;
+    submit_info.pWaitDstStageMask = NULL;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &m_transfer_cmd_buf;
+    submit_info.signalSemaphoreCount = 0;
+    submit_info.pSignalSemaphores = NULL;
+
+    res = vkResetFences(m_device, 1, &m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while reseting transfer cmd buf fence.");
+
+    res = vkQueueSubmit(m_queue, 1, &submit_info, m_transfer_cmd_buf_fence);
+    assertVkSuccess(res, "An error occurred while submitting the transfer command buffer.");
+
+    res = vkWaitForFences(m_device, 1, &m_transfer_cmd_buf_fence, VK_TRUE, UINT64_MAX);
+    assertVkSuccess(res, "An error occured while waiting for a transfer cmd buf fence.");
+}
+
+//builds the lists of light ids the fragment shader loops over, so the lighting cost depends on the number of visible lights
+//rather than on the number of allocated light slots
+void Renderer::cullLights(const Camera& camera)
+{
+    m_common_buffer_data.visible_dir_light_count = 0;
+
+    for(DirLightId id = 0; id < m_common_buffer_data.dir_light_count; id++)
     {
-        shadow_map_id = m_point_shadow_map_count;
-        m_point_shadow_map_count++;
+        if(m_dir_lights_valid[id])
+        {
+            m_visible_dir_light_ids[m_common_buffer_data.visible_dir_light_count++] = static_cast<uint16_t>(id);
+        }
     }
-    else
+
+    const auto view_frustum = camera.viewFrustumPlanesW();
+
+    m_common_buffer_data.visible_point_light_count = 0;
+
+    for(PointLightId id = 0; id < m_common_buffer_data.point_light_count; id++)
     {
-        shadow_map_id = m_point_shadow_maps_free_ids.front();
-        m_point_shadow_maps_free_ids.pop();
+        const auto& light = m_point_lights[id];
+
+        if(m_point_lights_valid[id] && Sphere(light.pos, light.max_d).intersect(view_frustum))
+        {
+            m_visible_point_light_ids[m_common_buffer_data.visible_point_light_count++] = static_cast<uint16_t>(id);
+        }
     }
+}
 
-    m_update_descriptors = true;
+void Renderer::assignPointShadowMaps(const Camera& camera)
+{
+    m_point_shadow_map_frame++;
 
-    for(auto& per_frame_data : m_per_frame_data)
+    //how many pixels a unit long segment at distance 1 from the camera covers on screen
+    const float pixels_per_unit = 0.5f * static_cast<float>(m_surface_height) * camera.imagePlaneDistance();
+
+    m_point_shadow_map_requests.clear();
+
+    //lights whose sphere of influence isn't visible don't need a shadow map this frame,
+    //but they keep their slot until it gets evicted in case they become visible again
+    for(uint32_t i = 0; i < m_common_buffer_data.visible_point_light_count; i++)
     {
-        PointShadowMap& shadow_map = per_frame_data.point_shadow_maps[shadow_map_id];
+        const PointLightId id = m_visible_point_light_ids[i];
+        const auto& light = m_point_lights[id];
 
-        shadow_map.res = light.shadow_map_res;
+        if(light.shadow_map_res == 0)
+        {
+            continue;
+        }
 
-        shadow_map.depth_img = createImage(depth_img_create_info, depth_img_view_create_info);
+        const float d = glm::distance(camera.pos(), light.pos);
 
-        framebuffer_create_info.pAttachments = &shadow_map.depth_img.img_view;
+        //the light's shadow_map_res acts as the max resolution the light is allowed to get
+        float res = static_cast<float>(light.shadow_map_res);
 
-        VkResult res = vkCreateFramebuffer(m_device, &framebuffer_create_info, NULL, &shadow_map.framebuffer);
-        assertVkSuccess(res, "Failed to create shadow map framebuffer.");
+        if(d > light.max_d)
+        {
+            res = std::min(res, 2.0f * light.max_d * pixels_per_unit / d);
+        }
 
-        shadow_map.render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        shadow_map.render_pass_begin_info.pNext = NULL;
-        shadow_map.render_pass_begin_info.renderPass = m_shadow_map_render_pass;
-        shadow_map.render_pass_begin_info.framebuffer = shadow_map.framebuffer;
-        shadow_map.render_pass_begin_info.renderArea.extent = {light.shadow_map_res, light.shadow_map_res};
-        shadow_map.render_pass_begin_info.renderArea.offset = {0, 0};
-        shadow_map.render_pass_begin_info.clearValueCount = 1;
-        shadow_map.render_pass_begin_info.pClearValues = &m_shadow_map_clear_value;
+        m_point_shadow_map_requests.emplace_back(res, id);
     }
 
-#if VULKAN_VALIDATION_ENABLE
-    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    //the most important lights get to pick their slots first
+    std::sort(m_point_shadow_map_requests.begin(), m_point_shadow_map_requests.end(), [](const auto& a, const auto& b){ return a.first > b.first; });
+
+    for(const auto& [res, light_id] : m_point_shadow_map_requests)
     {
-        setDebugObjectName(m_per_frame_data[i].point_shadow_maps[shadow_map_id].framebuffer, "PointShadowMapFramebuffer_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].point_shadow_maps[shadow_map_id].depth_img.img, "PointShadowMapImg_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].point_shadow_maps[shadow_map_id].depth_img.img_view, "PointShadowMapImgView_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-        setDebugObjectName(m_per_frame_data[i].point_shadow_maps[shadow_map_id].depth_img.mem, "PointShadowMapImgMem_" + std::to_string(i) + "_" + std::to_string(shadow_map_id));
-    }
-#endif
+        uint32_t tier = 0;
+        while((tier < POINT_SHADOW_MAP_TIER_COUNT - 1) && (static_cast<float>(m_point_shadow_map_tiers[tier].res) > res))
+        {
+            tier++;
+        }
+
+        //if the desired tier is full fall back to the lower resolution ones
+        uint32_t shadow_map_id = POINT_SHADOW_MAP_ID_NONE;
+        for(; (tier < POINT_SHADOW_MAP_TIER_COUNT) && (shadow_map_id == POINT_SHADOW_MAP_ID_NONE); tier++)
+        {
+            shadow_map_id = acquirePointShadowMap(tier, light_id);
+        }
 
-    m_point_shadow_maps_valid[shadow_map_id] = true;
+        const uint32_t prev_shadow_map_id = m_point_lights[light_id].shadow_map_id;
 
-    return shadow_map_id;
+        if(shadow_map_id == POINT_SHADOW_MAP_ID_NONE)
+        {
+            //all slots are taken by more important lights this frame - keep the previous slot if no one took it
+            if(prev_shadow_map_id != POINT_SHADOW_MAP_ID_NONE)
+            {
+                m_point_shadow_maps[prev_shadow_map_id].last_used_frame = m_point_shadow_map_frame;
+            }
+        }
+        else if(shadow_map_id != prev_shadow_map_id)
+        {
+            releasePointShadowMap(light_id);
+
+            m_point_shadow_maps[shadow_map_id].light_id = light_id;
+            m_point_shadow_maps[shadow_map_id].last_used_frame = m_point_shadow_map_frame;
+            m_point_lights[light_id].shadow_map_id = shadow_map_id;
+            m_point_lights_to_update.push_back(light_id);
+        }
+    }
 }
 
-void Renderer::markDirShadowMapForDestroy(uint32_t id)
+//returns the slot the light already has in the given tier, otherwise a free one,
+//otherwise the least recently used one that hasn't been claimed this frame yet
+uint32_t Renderer::acquirePointShadowMap(uint32_t tier, PointLightId light_id)
 {
-    for(auto& per_frame_data : m_per_frame_data)
+    const auto& shadow_map_tier = m_point_shadow_map_tiers[tier];
+
+    uint32_t free_id = POINT_SHADOW_MAP_ID_NONE;
+    uint32_t lru_id = POINT_SHADOW_MAP_ID_NONE;
+
+    for(uint32_t id = shadow_map_tier.first_slot; id < shadow_map_tier.first_slot + shadow_map_tier.slot_count; id++)
+    {
+        auto& shadow_map = m_point_shadow_maps[id];
+
+        if(shadow_map.light_id == light_id)
+        {
+            shadow_map.last_used_frame = m_point_shadow_map_frame;
+            return id;
+        }
+
+        if(shadow_map.light_id == POINT_LIGHT_ID_NONE)
+        {
+            if(free_id == POINT_SHADOW_MAP_ID_NONE)
+            {
+                free_id = id;
+            }
+        }
+        else if((shadow_map.last_used_frame != m_point_shadow_map_frame) &&
+                ((lru_id == POINT_SHADOW_MAP_ID_NONE) || (shadow_map.last_used_frame < m_point_shadow_maps[lru_id].last_used_frame)))
+        {
+            lru_id = id;
+        }
+    }
+
+    if(free_id != POINT_SHADOW_MAP_ID_NONE)
     {
-        per_frame_data.dir_shadow_maps_to_destroy.push_back(id);
-        m_dir_shadow_map_free_id_frame_ids[id] = m_frame_id;
-        m_dir_shadow_maps_valid[id] = false;
+        return free_id;
     }
+
+    if(lru_id != POINT_SHADOW_MAP_ID_NONE)
+    {
+        //evict the previous owner
+        const PointLightId evicted_light_id = m_point_shadow_maps[lru_id].light_id;
+        m_point_lights[evicted_light_id].shadow_map_id = POINT_SHADOW_MAP_ID_NONE;
+        m_point_shadow_maps[lru_id].light_id = POINT_LIGHT_ID_NONE;
+        m_point_lights_to_update.push_back(evicted_light_id);
+    }
+
+    return lru_id;
 }
 
-void Renderer::markPointShadowMapForDestroy(uint32_t id)
+void Renderer::releasePointShadowMap(PointLightId light_id)
 {
-    for(auto& per_frame_data : m_per_frame_data)
+    const uint32_t shadow_map_id = m_point_lights[light_id].shadow_map_id;
+
+    if(shadow_map_id != POINT_SHADOW_MAP_ID_NONE)
     {
-        per_frame_data.point_shadow_maps_to_destroy.push_back(id);
-        m_point_shadow_map_free_id_frame_ids[id] = m_frame_id;
-        m_point_shadow_maps_valid[id] = false;
+        m_point_shadow_maps[shadow_map_id].light_id = POINT_LIGHT_ID_NONE;
+        m_point_lights[light_id].shadow_map_id = POINT_SHADOW_MAP_ID_NONE;
     }
 }
 
-void Renderer::destroyDirShadowMap(DirShadowMap& shadow_map)
+//the most recently submitted frame is the last one that could have used the shadow map,
+//so it gets destroyed once that frame's fence is waited on
+void Renderer::markDirShadowMapForDestroy(uint32_t id)
 {
-    destroyImage(shadow_map.depth_img);
-    vkDestroyFramebuffer(m_device, shadow_map.framebuffer, NULL);
-    shadow_map.framebuffer = VK_NULL_HANDLE;
+    m_per_frame_data[m_frame_id].dir_shadow_maps_to_destroy.push_back(id);
+    m_dir_shadow_maps_valid[id] = false;
 }
 
-void Renderer::destroyPointShadowMap(PointShadowMap& shadow_map)
+void Renderer::destroyDirShadowMap(DirShadowMap& shadow_map)
 {
     destroyImage(shadow_map.depth_img);
     vkDestroyFramebuffer(m_device, shadow_map.framebuffer, NULL);
@@ -5403,6 +6940,14 @@ void Renderer::destroyPipelines() noexcept
         vkDestroyPipeline(m_device, p, NULL);
     }
     m_pipelines_ui.clear();
+
+    vkDestroyPipeline(m_device, m_light_clustering_pipeline, NULL);
+    m_light_clustering_pipeline = VK_NULL_HANDLE;
+
+    vkDestroyPipeline(m_device, m_terrain_brush_pipeline, NULL);
+    m_terrain_brush_pipeline = VK_NULL_HANDLE;
+    vkDestroyPipeline(m_device, m_terrain_slope_map_pipeline, NULL);
+    m_terrain_slope_map_pipeline = VK_NULL_HANDLE;
 }
 
 void Renderer::destroySynchronizationPrimitives() noexcept
@@ -5417,6 +6962,15 @@ void Renderer::destroySynchronizationPrimitives() noexcept
     vkDestroyFence(m_device, m_transfer_cmd_buf_fence, NULL);
 }
 
+void Renderer::destroyQueryPools() noexcept
+{
+    for(auto& per_frame_data : m_per_frame_data)
+    {
+        vkDestroyQueryPool(m_device, per_frame_data.timestamp_query_pool, NULL);
+        per_frame_data.timestamp_query_pool = VK_NULL_HANDLE;
+    }
+}
+
 void Renderer::destroyRenderTargets() noexcept
 {
     for(auto& rt : m_render_targets)
@@ -5446,28 +7000,35 @@ void Renderer::destroySamplers() noexcept
 
 void Renderer::destroyShadowMaps()
 {
-    for(auto& per_frame_data : m_per_frame_data)
+    for(auto& dir_shadow_map : m_dir_shadow_maps)
     {
-        for(auto& dir_shadow_map : per_frame_data.dir_shadow_maps)
-        {
-            destroyDirShadowMap(dir_shadow_map);
-        }
+        destroyDirShadowMap(dir_shadow_map);
+    }
 
-        for(auto& point_shadow_map : per_frame_data.point_shadow_maps)
-        {
-            destroyPointShadowMap(point_shadow_map);
-        }
+    for(auto& point_shadow_map : m_point_shadow_maps)
+    {
+        vkDestroyFramebuffer(m_device, point_shadow_map.framebuffer, NULL);
+        point_shadow_map.framebuffer = VK_NULL_HANDLE;
+        vkDestroyImageView(m_device, point_shadow_map.img_view, NULL);
+        point_shadow_map.img_view = VK_NULL_HANDLE;
+        point_shadow_map.light_id = POINT_LIGHT_ID_NONE;
     }
 
-    while(!m_dir_shadow_maps_free_ids.empty())
+    for(auto& tier : m_point_shadow_map_tiers)
     {
-        m_dir_shadow_maps_free_ids.pop();
+        destroyImage(tier.depth_img);
+    }
+
+    for(auto& per_frame_data : m_per_frame_data)
+    {
+        per_frame_data.dir_shadow_maps_to_destroy.clear();
     }
 
-    while(!m_point_shadow_maps_free_ids.empty())
+    while(!m_dir_shadow_maps_free_ids.empty())
     {
-        m_point_shadow_maps_free_ids.pop();
+        m_dir_shadow_maps_free_ids.pop();
     }
+
 }
 
 /*---------------- debug callback ----------------*/
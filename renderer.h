@@ -21,12 +21,69 @@
 #include "camera.h"
 #include <queue>
 #include <span>
+#include <typeindex>
 #include "shader_data.h"
 #include "vk_buffer_wrapper.h"
 
 using DirLightId = uint32_t;
 using PointLightId = uint32_t;
 
+constexpr PointLightId POINT_LIGHT_ID_NONE = 0xffffffff;
+
+//identifies which pass a render batch is drawn in, so geometry can be culled separately for the camera and every shadow map
+using RenderViewId = uint32_t;
+
+constexpr RenderViewId RENDER_VIEW_ALL = 0xffffffff;
+//every dir and point shadow map, but not the camera
+constexpr RenderViewId RENDER_VIEW_SHADOW_MAPS = 0xfffffffe;
+constexpr RenderViewId RENDER_VIEW_CAMERA = 0;
+constexpr RenderViewId RENDER_VIEW_DIR_SHADOW_MAP = 1;
+constexpr RenderViewId RENDER_VIEW_POINT_SHADOW_MAP = RENDER_VIEW_DIR_SHADOW_MAP + MAX_DIR_SHADOW_MAP_COUNT;
+
+struct RenderView
+{
+    RenderViewId id = RENDER_VIEW_CAMERA;
+    vec3 pos;
+    //how many pixels a unit long segment at distance 1 covers on screen, 0 for shadow map views
+    float pixels_per_unit = 0.0f;
+    //a dir shadow map is rendered with one frustum per cascade, geometry is visible if it intersects any of them
+    uint32_t frustum_count = 0;
+    std::array<std::array<vec4, 6>, MAX_DIR_SHADOW_MAP_PARTITIONS> frusta;
+};
+
+//terrain heightmaps live in the layers of a single array image, every layer holds one patch
+//the heights are stored as 16 bit unorms, which the shaders map to the height range of the patch
+constexpr uint32_t TERRAIN_HEIGHTMAP_RES = static_cast<uint32_t>(MAX_TESS_LEVEL) + 1;
+//heightmaps and splat maps are streamed in through per frame staging buffers of this many layers
+constexpr uint32_t MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME = 16;
+//the editor brush runs on the GPU and the heightmaps it changes are read back through a per frame buffer of this many heightmaps
+constexpr uint32_t MAX_TERRAIN_BRUSH_DISPATCHES_PER_FRAME = 16;
+//how many pixels a mesh lod's error can cover on screen before a finer lod is drawn, at a lod bias of 0
+constexpr float MESH_LOD_PIXEL_ERROR = 1.0f;
+
+struct TerrainHeightmapRegion
+{
+    uint32_t slot;
+    uvec2 offset;
+    uvec2 extent;
+};
+
+//virtual texture pages are uploaded through a per frame staging buffer of this many pages
+constexpr uint32_t MAX_TERRAIN_VT_UPLOADS_PER_FRAME = 16;
+
+//a page copied into a slot of the virtual texture cache, the page that lived in the slot before is dropped from the page table
+struct TerrainVTPageUpload
+{
+    uint32_t cache_slot;
+    //TERRAIN_VT_PADDED_PAGE_RES x TERRAIN_VT_PADDED_PAGE_RES packed RGBA8 texels
+    const uint32_t* data;
+    uint32_t mip;
+    uvec2 page;
+    bool evicted;
+    uint32_t evicted_mip;
+    uvec2 evicted_page;
+};
+
 struct VertexBuffer : VkBufferWrapper
 {
     VertexBuffer() : VkBufferWrapper(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
@@ -41,25 +98,64 @@ struct VertexBufferAllocation
     uint32_t size = 0;
 };
 
+struct IndexBuffer : VkBufferWrapper
+{
+    IndexBuffer(VkIndexType index_type_) : VkBufferWrapper(VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, false, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT)
+                                         , index_type(index_type_)
+    {}
+
+    const VkIndexType index_type;
+};
+
+struct IndexBufferAllocation
+{
+    IndexBuffer* ib = nullptr;
+    uint64_t data_offset = 0;
+    uint32_t first_index = 0;
+    uint32_t size = 0;
+};
+
 class Renderer
 {
     struct RenderBatch
     {
         RenderBatch() = default;
 
-        RenderBatch(RenderMode render_mode_, VertexBuffer* vb_, uint32_t vertex_offset_, uint32_t vertex_count_, uint32_t instance_id_)
+        RenderBatch(RenderMode render_mode_, VertexBuffer* vb_, uint32_t vertex_offset_, uint32_t vertex_count_, uint32_t instance_id_, RenderViewId view_)
             : render_mode(render_mode_)
             , vb(vb_)
             , vertex_offset(vertex_offset_)
             , vertex_count(vertex_count_)
             , instance_id(instance_id_)
+            , view(view_)
+        {}
+
+        RenderBatch(RenderMode render_mode_, VertexBuffer* vb_, uint32_t vertex_offset_, IndexBuffer* ib_, uint32_t first_index_, uint32_t index_count_, uint32_t instance_id_, RenderViewId view_)
+            : render_mode(render_mode_)
+            , vb(vb_)
+            , vertex_offset(vertex_offset_)
+            , ib(ib_)
+            , first_index(first_index_)
+            , index_count(index_count_)
+            , instance_id(instance_id_)
+            , view(view_)
         {}
 
+        bool drawnIn(RenderViewId view_) const
+        {
+            return (view == RENDER_VIEW_ALL) || (view == view_) || ((view == RENDER_VIEW_SHADOW_MAPS) && (view_ != RENDER_VIEW_CAMERA));
+        }
+
         RenderMode render_mode;
         VertexBuffer* vb = nullptr;
         uint32_t vertex_offset = 0;
         uint32_t vertex_count = 0;
+        //indexed batches have an index buffer, vertex_offset is then added to every index
+        IndexBuffer* ib = nullptr;
+        uint32_t first_index = 0;
+        uint32_t index_count = 0;
         uint32_t instance_id = 0;
+        RenderViewId view = RENDER_VIEW_ALL;
     };
 
     struct RenderBatchUi
@@ -125,8 +221,11 @@ class Renderer
         mat4x4 P;
         mat4x4 tex_P;
         float z;
+        //fraction of the camera's tessellation levels the terrain is drawn with in this cascade
+        float terrain_tess_scale;
     };
 
+    //a single cube map slot of a PointShadowMapTier
     struct PointShadowMap
     {
         PointShadowMap() = default;
@@ -135,11 +234,22 @@ class Renderer
         PointShadowMap(PointShadowMap&& other) = default;
         PointShadowMap& operator=(PointShadowMap&&) = default;
 
-        VkImageWrapper depth_img;
+        VkImageView img_view = VK_NULL_HANDLE; //view of the 6 faces of this slot, used as the framebuffer attachment
         VkFramebuffer framebuffer = VK_NULL_HANDLE;
         VkRenderPassBeginInfo render_pass_begin_info;
 
+        uint32_t tier = 0;
+        uint32_t layer = 0; //cube map index within the tier's cube map array
+        PointLightId light_id = POINT_LIGHT_ID_NONE;
+        uint64_t last_used_frame = 0;
+    };
+
+    struct PointShadowMapTier
+    {
+        VkImageWrapper depth_img; //cube map array holding all the slots of the tier
         uint32_t res = 0;
+        uint32_t first_slot = 0;
+        uint32_t slot_count = 0;
     };
 
     struct alignas(16) PointShadowMapData
@@ -163,6 +273,15 @@ class Renderer
         std::queue<uint32_t> free_ids;
     };
 
+    struct TerrainHeightmapReadback
+    {
+        TerrainHeightmapRegion region;
+        uint64_t buffer_offset;
+        uint16_t* dst;
+        vec2 height_range;
+        vec2* height_range_dst;
+    };
+
     struct PerFrameData
     {
         PerFrameData() = default;
@@ -174,23 +293,25 @@ class Renderer
         VkSemaphore image_acquire_semaphore = VK_NULL_HANDLE;
         VkSemaphore rendering_finished_semaphore = VK_NULL_HANDLE;
         VkFence cmd_buf_ready_fence = VK_NULL_HANDLE;
-        std::array<DirShadowMap, MAX_DIR_SHADOW_MAP_COUNT> dir_shadow_maps;
-        std::array<PointShadowMap, MAX_POINT_SHADOW_MAP_COUNT> point_shadow_maps;
-        //TODO: could use a better structure for lights_to_update than std::vector?
-        std::vector<DirLightId> dir_lights_to_update;
-        std::vector<PointLightId> point_lights_to_update;
+        //two timestamps bracketing the shadow map passes
+        VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
+        bool timestamps_written = false;
+        //shadow maps are shared between frames in flight, so they can only be destroyed
+        //once the last frame that could have used them has finished executing
         std::vector<uint32_t> dir_shadow_maps_to_destroy;
-        std::vector<uint32_t> point_shadow_maps_to_destroy;
         std::vector<VkBufferWrapper*> bufs_to_destroy;
 
         /*buffers*/
         std::unique_ptr<VkBufferWrapper> common_buffer;
-        //TODO: we should only have one on each of these (like VBs now), not one per frame in flight
-        //unless we can tell that some will be fully updated every frame (like dir shadow map buffer?)(?)
-        std::unique_ptr<VkBufferWrapper> dir_light_buffer;
-        std::unique_ptr<VkBufferWrapper> dir_light_valid_buffer;
-        std::unique_ptr<VkBufferWrapper> point_light_buffer;
-        std::unique_ptr<VkBufferWrapper> point_light_valid_buffer;
+        std::unique_ptr<VkBufferWrapper> terrain_heightmap_staging_buffer;
+        std::unique_ptr<VkBufferWrapper> terrain_splat_map_staging_buffer;
+        std::unique_ptr<VkBufferWrapper> terrain_vt_staging_buffer;
+        //written by the terrain fragment shader, read back once the frame has finished executing
+        std::unique_ptr<VkBufferWrapper> terrain_vt_feedback_buffer;
+        bool terrain_vt_feedback_written = false;
+        std::unique_ptr<VkBufferWrapper> terrain_heightmap_readback_buffer;
+        //brush results copied into the readback buffer by this frame's previous submission
+        std::vector<TerrainHeightmapReadback> terrain_heightmap_readbacks;
     };
 
     struct BufferUpdateReq
@@ -215,12 +336,27 @@ public:
     Renderer& operator=(const Renderer&) = delete;
     Renderer& operator=(const Renderer&&) = delete;
 
+    void updateViews(const Camera& camera);
     void updateAndRender(const RenderData&, const Camera& camera);
 
     void onWindowResize(uint32_t width, uint32_t height);
     void onSceneLoad(const SceneInitData&);
     void setSampleCount(VkSampleCountFlagBits);
     bool enableVsync(bool vsync);
+    bool enableLayeredShadows(bool layered_shadows);
+    float shadowPassGpuTime() const noexcept;
+    //terrain is tessellated less in the dir shadow maps, every cascade draws it with its own fraction of the camera's tessellation levels
+    void setTerrainShadowTessScale(uint32_t cascade, float scale);
+    //the cascades from this one on draw the terrain's low resolution shadow mesh instead of the tessellated patches,
+    //MAX_DIR_SHADOW_MAP_PARTITIONS draws the patches into all of them
+    void setTerrainShadowMeshCascade(uint32_t cascade);
+    uint32_t terrainShadowMeshCascade() const noexcept;
+    //every step of lod bias doubles the screen space error allowed for mesh lods, the shadow maps have their own bias
+    //since nobody looks at a shadow closely enough to tell
+    void setMeshLodBias(float bias);
+    void setMeshShadowLodBias(float bias);
+    float meshLodPixelError() const noexcept;
+    float meshShadowLodPixelError() const noexcept;
 
     void initStaticVB(uint64_t data_size);
     void finalizeStaticVB();
@@ -229,30 +365,73 @@ public:
     VertexBufferAllocation reqVBAlloc(uint32_t vertex_count)
     {
         VertexBufferAllocation alloc;
-        alloc.vb = &m_vertex_buffers[sizeof(VertexType)];
+        alloc.vb = &m_vertex_buffers[typeid(VertexType)];
         alloc.size = vertex_count * sizeof(VertexType);
         alloc.data_offset = alloc.vb->alloc(alloc.size);
         alloc.vertex_offset = alloc.data_offset / sizeof(VertexType);
         return alloc;
     }
+    template<class IndexType>
+    IndexBufferAllocation reqIBAlloc(uint32_t index_count)
+    {
+        static_assert((sizeof(IndexType) == sizeof(uint16_t)) || (sizeof(IndexType) == sizeof(uint32_t)));
+
+        IndexBufferAllocation alloc;
+        alloc.ib = (sizeof(IndexType) == sizeof(uint16_t)) ? &m_index_buffer16 : &m_index_buffer32;
+        alloc.size = index_count * sizeof(IndexType);
+        alloc.data_offset = alloc.ib->alloc(alloc.size);
+        alloc.first_index = alloc.data_offset / sizeof(IndexType);
+        return alloc;
+    }
     uint32_t reqInstanceVBAlloc(uint32_t instance_count);
     uint32_t reqBoneBufAlloc(uint32_t bone_count);
-    void reqTerrainBufAlloc(uint64_t size);
 
     void freeVertexBufferAllocation(const VertexBufferAllocation&);
+    void freeIndexBufferAllocation(const IndexBufferAllocation&);
     void freeInstanceVertexBufferAllocation(uint32_t instance_id, uint32_t instance_count);
     void freeBoneTransformBufferAllocation(uint32_t bone_id, uint32_t bone_count);
-    void freeTerrainBufferAllocation();
 
     void requestBufferUpdate(VkBufferWrapper* buf, uint64_t data_offset, uint64_t data_size, const void* data);
     //TODO: rename these to request*Update
     void updateVertexData(VertexBuffer* vb, uint64_t data_offset, uint64_t data_size, const void* data);
+    void updateIndexData(IndexBuffer* ib, uint64_t data_offset, uint64_t data_size, const void* data);
     void updateInstanceVertexData(uint32_t instance_id, uint32_t instance_count, const void* data);
     void updateBoneTransformData(uint32_t bone_offset, uint32_t bone_count, const mat4x4* data);
-    void updateTerrainData(void* data, uint64_t offset, uint64_t size);
-    std::vector<uint32_t> requestTerrainHeightmaps(std::span<std::pair<float*, uint32_t>> heightmap_data);
-
-    void draw(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, uint32_t instance_id);
+    //every heightmap slot also holds the splat map of its patch, kept_slots[i] is the old slot whose maps end up in slot i,
+    //every other slot starts out empty and the requests queued for the dropped slots are dropped with them
+    void reqTerrainHeightmapSlots(uint32_t slot_count, std::span<const uint32_t> kept_slots = {});
+    //the data is read when the frame is recorded, so it has to stay valid until the next updateAndRender call
+    //height_range is the range the heightmap is quantized to, the slope map of the slot is recalculated with it
+    void updateTerrainHeightmap(uint32_t slot, const uint16_t* data, const vec2& height_range);
+    //the splat map is TERRAIN_SPLAT_MAP_RES x TERRAIN_SPLAT_MAP_RES packed RGBA8 texels, it has to stay valid just like the heightmaps
+    void updateTerrainSplatMap(uint32_t slot, const uint32_t* data);
+    void setTerrainMaterials(const std::array<uint32_t, TERRAIN_MATERIAL_COUNT>& tex_ids);
+    //adds dh to the texels of the slot that are within radius of center in a compute shader, requantizing the whole heightmap
+    //from old_height_range to new_height_range on the way, so the new range has to be wide enough to hold the result
+    //only the rectangle of texels at offset is dispatched and read back, it has to cover the brush - and the whole heightmap
+    //when the range changes, since every texel moves then
+    //the rectangle is copied back into readback_dst and new_height_range into height_range_dst once the frame has finished executing
+    void brushTerrainHeightmap(uint32_t slot, const vec2& patch_origin, float cell_size, const vec2& old_height_range, const vec2& new_height_range,
+                               const uvec2& offset, const uvec2& extent, const vec3& center, float radius, float dh, uint16_t* readback_dst, vec2* height_range_dst);
+    //the heightmaps that have been copied back since the last call
+    std::vector<TerrainHeightmapRegion> takeFinishedTerrainHeightmapReadbacks();
+    //creates the page table and the page cache of a terrain virtual texture with page_count x page_count pages on its first mip,
+    //0 destroys them and the terrain goes back to blending its materials with the splat maps
+    void reqTerrainVirtualTexture(uint32_t page_count);
+    //the square of the xz plane the virtual texture is stretched over
+    void setTerrainVirtualTextureArea(const vec2& origin, float size);
+    //the data is read when the frame is recorded, so it has to stay valid until the next updateAndRender call
+    void uploadTerrainVTPage(const TerrainVTPageUpload& upload);
+    //one bit per page id for every page the terrain was drawn with in the frames finished since the last call, empty if there were none
+    std::vector<uint32_t> takeTerrainVTFeedback();
+    //waits for the GPU and copies back the brush results of all frames in flight, the brushes and uploads still queued are
+    //dispatched and copied back too, so none are left when it returns
+    void finishTerrainHeightmapReadbacks();
+
+    void draw(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, uint32_t instance_id, RenderViewId view = RENDER_VIEW_ALL);
+    void drawIndexed(RenderMode render_mode, VertexBuffer* vb, uint32_t vertex_offset, IndexBuffer* ib, uint32_t first_index, uint32_t index_count, uint32_t instance_id, RenderViewId view = RENDER_VIEW_ALL);
+    const RenderView& cameraView() const noexcept;
+    const std::vector<RenderView>& shadowViews() const noexcept;
     void drawUi(RenderModeUi render_mode, VertexBuffer* vb, uint32_t vertex_offset, uint32_t vertex_count, const Quad& scissor);
 
     DirLightId addDirLight(const DirLight& dir_light);
@@ -266,6 +445,8 @@ public:
     std::vector<uint32_t> loadTextures(const std::vector<std::string_view>& texture_filenames);
     uint32_t loadNormalMap(std::string_view texture_filename);
     std::vector<uint32_t> loadNormalMaps(const std::vector<std::string_view>& texture_filenames);
+    //the path a loaded texture was read from
+    std::string textureFilename(uint32_t tex_id) const;
 
 private:
     void resizeBuffers();
@@ -317,19 +498,25 @@ private:
     void createPipelines();
     void createCommandBuffers();
     void createSynchronizationPrimitives();
+    void createQueryPools();
     void createRenderTargets();
     void createSamplers();
     void createBuffers();
 
     uint32_t createDirShadowMap(const DirLight& light);
-    uint32_t createPointShadowMap(const PointLight& light);
+    void createPointShadowMaps();
     void markDirShadowMapForDestroy(uint32_t id);
-    void markPointShadowMapForDestroy(uint32_t id);
     void destroyDirShadowMap(DirShadowMap& shadow_map);
-    void destroyPointShadowMap(PointShadowMap& shadow_map);
 
     void updateDirShadowMap(const Camera& camera, const DirLightShaderData& dir_light);
     void updatePointShadowMap(const PointLightShaderData& point_light);
+    void cullLights(const Camera& camera);
+    void drawShadowMapBatch(VkCommandBuffer cmd_buf, const RenderBatch& rb, uint32_t first_layer, uint32_t layer_count);
+    //binds the batch's index buffer for indexed batches, the vertex buffer has to be bound already
+    void drawBatch(VkCommandBuffer cmd_buf, const RenderBatch& rb, uint32_t instance_count, uint32_t first_instance);
+    void assignPointShadowMaps(const Camera& camera);
+    uint32_t acquirePointShadowMap(uint32_t tier, PointLightId light_id);
+    void releasePointShadowMap(PointLightId light_id);
 
     /*----------------- destroy methods ------------------*/
     void destroy() noexcept;
@@ -343,6 +530,7 @@ private:
     void destroyPipelineLayout() noexcept;
     void destroyPipelines() noexcept;
     void destroySynchronizationPrimitives() noexcept;
+    void destroyQueryPools() noexcept;
     void destroyRenderTargets() noexcept;
     void destroySamplers() noexcept;
 
@@ -356,6 +544,9 @@ private:
     VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
     std::vector<VkPipeline> m_pipelines;
     std::vector<VkPipeline> m_pipelines_ui;
+    VkPipeline m_light_clustering_pipeline = VK_NULL_HANDLE;
+    VkPipeline m_terrain_brush_pipeline = VK_NULL_HANDLE;
+    VkPipeline m_terrain_slope_map_pipeline = VK_NULL_HANDLE;
 
     VkCommandBuffer m_transfer_cmd_buf = VK_NULL_HANDLE;
     VkFence m_transfer_cmd_buf_fence = VK_NULL_HANDLE;
@@ -384,14 +575,14 @@ private:
     uint32_t m_dir_lights_desc_count = 0;
     const VkDescriptorType m_dir_lights_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 
-    uint32_t m_dir_lights_valid_desc_count = 0;
-    const VkDescriptorType m_dir_lights_valid_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+    uint32_t m_dir_light_ids_desc_count = 0;
+    const VkDescriptorType m_dir_light_ids_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
 
     uint32_t m_point_lights_desc_count = 0;
     const VkDescriptorType m_point_lights_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 
-    uint32_t m_point_lights_valid_desc_count = 0;
-    const VkDescriptorType m_point_lights_valid_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+    uint32_t m_point_light_ids_desc_count = 0;
+    const VkDescriptorType m_point_light_ids_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
 
     uint32_t m_dir_sm_buf_desc_count = 0;
     const VkDescriptorType m_dir_sm_buf_desc_type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -405,15 +596,36 @@ private:
     uint32_t m_point_sm_desc_count = 0;
     const VkDescriptorType m_point_sm_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
-    uint32_t m_terrain_buf_desc_count = 0;
-    const VkDescriptorType m_terrain_buf_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    uint32_t m_terrain_splat_map_desc_count = 0;
+    const VkDescriptorType m_terrain_splat_map_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    uint32_t m_terrain_vt_page_table_desc_count = 0;
+    const VkDescriptorType m_terrain_vt_page_table_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    uint32_t m_terrain_vt_cache_desc_count = 0;
+    const VkDescriptorType m_terrain_vt_cache_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    uint32_t m_terrain_vt_feedback_desc_count = 0;
+    const VkDescriptorType m_terrain_vt_feedback_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
     uint32_t m_terrain_heightmap_desc_count = 0;
     const VkDescriptorType m_terrain_heightmap_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 
+    uint32_t m_terrain_heightmap_storage_desc_count = 0;
+    const VkDescriptorType m_terrain_heightmap_storage_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+    uint32_t m_terrain_slope_map_desc_count = 0;
+    const VkDescriptorType m_terrain_slope_map_desc_type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+
+    uint32_t m_terrain_slope_map_storage_desc_count = 0;
+    const VkDescriptorType m_terrain_slope_map_storage_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
     uint32_t m_bone_transform_buf_desc_count = 0;
     const VkDescriptorType m_bone_transform_buf_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 
+    uint32_t m_light_cluster_buf_desc_count = 0;
+    const VkDescriptorType m_light_cluster_buf_desc_type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+
     /*---------------------- device ----------------------*/
     VkPhysicalDeviceProperties m_physical_device_properties;
     VkPhysicalDeviceFeatures m_physical_device_features;
@@ -445,17 +657,26 @@ private:
     VkClearValue m_shadow_map_clear_value = {};
 
     uint32_t m_dir_shadow_map_count = 0;
-    uint32_t m_point_shadow_map_count = 0;
     std::array<bool, MAX_DIR_SHADOW_MAP_COUNT> m_dir_shadow_maps_valid = {};
-    std::array<bool, MAX_POINT_SHADOW_MAP_COUNT> m_point_shadow_maps_valid = {};
     std::queue<uint32_t> m_dir_shadow_maps_free_ids;
-    std::queue<uint32_t> m_point_shadow_maps_free_ids;
-    std::array<uint8_t, MAX_DIR_SHADOW_MAP_COUNT> m_dir_shadow_map_free_id_frame_ids;
-    std::array<uint8_t, MAX_POINT_SHADOW_MAP_COUNT> m_point_shadow_map_free_id_frame_ids;
+    std::array<DirShadowMap, MAX_DIR_SHADOW_MAP_COUNT> m_dir_shadow_maps;
+
+    std::array<PointShadowMapTier, POINT_SHADOW_MAP_TIER_COUNT> m_point_shadow_map_tiers;
+    std::array<PointShadowMap, MAX_POINT_SHADOW_MAP_COUNT> m_point_shadow_maps;
+    std::vector<std::pair<float, PointLightId>> m_point_shadow_map_requests;
+    uint64_t m_point_shadow_map_frame = 0;
 
     std::array<std::array<DirShadowMapData, MAX_DIR_SHADOW_MAP_PARTITIONS>, MAX_DIR_SHADOW_MAP_COUNT> m_dir_shadow_map_data;
     std::array<PointShadowMapData, MAX_POINT_SHADOW_MAP_COUNT> m_point_shadow_map_data;
 
+    std::array<float, MAX_DIR_SHADOW_MAP_PARTITIONS> m_terrain_shadow_tess_scales = {0.5f, 0.25f, 0.125f, 0.0625f};
+    uint32_t m_terrain_shadow_mesh_cascade = MAX_DIR_SHADOW_MAP_PARTITIONS - 1;
+    float m_mesh_lod_pixel_error = MESH_LOD_PIXEL_ERROR;
+    float m_mesh_shadow_lod_pixel_error = 4.0f * MESH_LOD_PIXEL_ERROR;
+
+    RenderView m_camera_view;
+    std::vector<RenderView> m_shadow_views;
+
     bool m_update_descriptors = false;
 
     /*-------------------- resources ---------------------*/
@@ -466,29 +687,109 @@ private:
     std::unordered_map<VkBufferWrapper*, std::vector<BufferUpdateReq>> m_buffer_update_reqs;
 
     /*--- vertex buffers ---*/
-    std::unordered_map<uint32_t, VertexBuffer> m_vertex_buffers;
+    //one per vertex type, types of the same size still get their own buffers
+    std::unordered_map<std::type_index, VertexBuffer> m_vertex_buffers;
     VertexBuffer m_instance_vertex_buffer;
 
+    /*--- index buffers ---*/
+    IndexBuffer m_index_buffer16{VK_INDEX_TYPE_UINT16};
+    IndexBuffer m_index_buffer32{VK_INDEX_TYPE_UINT32};
+
     /*--- buffers ---*/
     VkBufferWrapper m_dir_shadow_map_buffer;
     VkBufferWrapper m_point_shadow_map_buffer;
     VkBufferWrapper m_bone_transform_buffer;
 
     /*--- dir lights ---*/
+    VkBufferWrapper m_dir_light_buffer;
+    //ids of the lights the fragment shader should loop over this frame
+    VkBufferWrapper m_dir_light_ids_buffer;
+    //TODO: could use a better structure for lights_to_update than std::vector?
+    std::vector<DirLightId> m_dir_lights_to_update;
     std::queue<DirLightId> m_dir_light_free_ids;
     std::array<DirLightShaderData, MAX_DIR_LIGHT_COUNT> m_dir_lights;
     std::array<uint8_t, MAX_DIR_LIGHT_COUNT> m_dir_lights_valid = {};
+    std::array<uint16_t, MAX_DIR_LIGHT_COUNT> m_visible_dir_light_ids = {};
     /*--- point lights ---*/
+    VkBufferWrapper m_point_light_buffer;
+    //ids of the lights whose sphere of influence intersects the view frustum this frame
+    VkBufferWrapper m_point_light_ids_buffer;
+    std::vector<PointLightId> m_point_lights_to_update;
     std::queue<PointLightId> m_point_light_free_ids;
     std::array<PointLightShaderData, MAX_POINT_LIGHT_COUNT> m_point_lights;
     std::array<uint8_t, MAX_POINT_LIGHT_COUNT> m_point_lights_valid = {};
-    /*--- terrain ---*/
-    VkBufferWrapper m_terrain_buffer;
+    std::array<uint16_t, MAX_POINT_LIGHT_COUNT> m_visible_point_light_ids = {};
+    /*--- light clusters ---*/
+    //written by the light clustering compute shader every frame, shared between frames in flight
+    VkBufferWrapper m_light_cluster_buffer;
 
     /*---------------------- assets ----------------------*/
     TextureCollection m_textures;
     TextureCollection m_normal_maps;
-    std::vector<VkImageWrapper> m_terrain_heightmaps;
+    VkImageWrapper m_terrain_heightmaps;
+    //the height differences between the neighbours of every heightmap texel along x and z, the terrain normals are built from them
+    //with a single fetch - they're recalculated in a compute shader whenever a slot is uploaded or brushed
+    VkImageWrapper m_terrain_slope_maps;
+    //the material weights of every patch, in the same layers as the heightmaps
+    VkImageWrapper m_terrain_splat_maps;
+    uint32_t m_terrain_heightmap_slot_count = 0;
+    struct TerrainHeightmapUpdateReq
+    {
+        uint32_t slot;
+        const uint16_t* data;
+        vec2 height_range;
+    };
+
+    std::vector<TerrainHeightmapUpdateReq> m_terrain_heightmap_update_reqs;
+
+    struct TerrainSplatMapUpdateReq
+    {
+        uint32_t slot;
+        const uint32_t* data;
+    };
+
+    std::vector<TerrainSplatMapUpdateReq> m_terrain_splat_map_update_reqs;
+
+    //the cache slot every page of the virtual texture is in, TERRAIN_VT_PAGE_NONE if it's not resident, with a mip per virtual texture mip
+    VkImageWrapper m_terrain_vt_page_table;
+    //the resident pages with their borders, TERRAIN_VT_CACHE_PAGES x TERRAIN_VT_CACHE_PAGES of them
+    VkImageWrapper m_terrain_vt_cache;
+    std::vector<TerrainVTPageUpload> m_terrain_vt_upload_reqs;
+    std::vector<uint32_t> m_terrain_vt_feedback;
+    void readBackTerrainVTFeedback(PerFrameData& per_frame_data);
+    void destroyTerrainVirtualTexture();
+
+    struct TerrainBrushReq
+    {
+        uint32_t slot;
+        vec2 patch_origin;
+        float cell_size;
+        vec2 old_height_range;
+        vec2 new_height_range;
+        uvec2 offset;
+        uvec2 extent;
+        vec3 center;
+        float radius;
+        float dh;
+        uint16_t* readback_dst;
+        vec2* height_range_dst;
+    };
+
+    std::vector<TerrainBrushReq> m_terrain_brush_reqs;
+
+    struct TerrainSlopeMapReq
+    {
+        uint32_t slot;
+        vec2 height_range;
+    };
+
+    //the slots changed while recording the current frame, a slot changed more than once is only recalculated with its last height range
+    std::vector<TerrainSlopeMapReq> m_terrain_slope_map_reqs;
+    void reqTerrainSlopeMap(uint32_t slot, const vec2& height_range);
+    std::vector<TerrainHeightmapRegion> m_finished_terrain_heightmap_readbacks;
+    //the queued heightmap and splat map uploads, brushes and slope maps, as many as fit in the buffers of a frame
+    void recordTerrainHeightmapUpdates(VkCommandBuffer cmd_buf, PerFrameData& per_frame_data);
+    void readBackTerrainHeightmaps(PerFrameData& per_frame_data);
 
     std::vector<Texture> m_font_textures;
 
@@ -497,6 +798,10 @@ private:
     VkSampleCountFlagBits m_sample_count = VK_SAMPLE_COUNT_1_BIT;
     bool m_vsync_disable_support = false;
     bool m_vsync = true;
+    bool m_layered_shadow_support = false;
+    bool m_layered_shadows = false;
+    bool m_timestamp_support = false;
+    float m_shadow_pass_gpu_time = 0.0f;
 
     std::vector<VkSemaphore> m_wait_semaphores;
     std::vector<VkPipelineStageFlags> m_submit_wait_flags;
@@ -520,6 +825,20 @@ private:
         uint32_t dir_light_count = 0;
         uint32_t point_light_count = 0;
         uint32_t cur_terrain_intersection;
+        uint32_t visible_dir_light_count = 0;
+        uint32_t visible_point_light_count = 0;
+        alignas(8)  vec2 tan_half_fov;
+                    float camera_near;
+                    float camera_far;
+                    float pixels_per_unit;
+        //the texture of every terrain material, the splat maps hold their weights
+        alignas(16) uvec4 terrain_material_tex_ids = uvec4(0, 0, 0, 0);
+        //the virtual texture is off while its page count is 0
+        alignas(8)  vec2 terrain_vt_origin;
+                    float terrain_vt_size = 0.0f;
+                    uint32_t terrain_vt_page_count = 0;
+                    uint32_t terrain_vt_mip_count = 0;
+                    uint32_t terrain_vt_feedback_phase = 0;
     } m_common_buffer_data;
 
     /*------------------- push constants -----------------*/
@@ -527,11 +846,39 @@ private:
     {
         uint32_t shadow_map_count;
         uint32_t shadow_map_offset;
+        //dir shadow maps only draw the cascades [first_shadow_map, shadow_map_count), the terrain draws its far cascades separately
+        uint32_t first_shadow_map;
     } push_const;
 
+    //follows the graphics push constants instead of overlapping them, so pushing either doesn't require the other's stages
+    struct TerrainBrushPushConstants
+    {
+        alignas(16) vec3 center;
+                    float radius;
+        vec2 patch_origin;
+        float cell_size;
+        float dh;
+        vec2 old_height_range;
+        vec2 new_height_range;
+        //the first texel of the dispatched rectangle
+        uvec2 offset;
+        uint32_t slot;
+    };
+
+    struct TerrainSlopeMapPushConstants
+    {
+        vec2 height_range;
+        uint32_t slot;
+    };
+
+    static_assert(sizeof(PushConstants) <= TERRAIN_COMPUTE_PUSH_CONST_OFFSET);
+    //the terrain compute shaders share one range, the brush has the largest push constants
+    static_assert(sizeof(TerrainSlopeMapPushConstants) <= sizeof(TerrainBrushPushConstants));
+
     const std::vector<VkPushConstantRange> push_const_ranges
     {
-        {VK_SHADER_STAGE_GEOMETRY_BIT, 0, sizeof(push_const)},
+        {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_GEOMETRY_BIT, 0, sizeof(push_const)},
+        {VK_SHADER_STAGE_COMPUTE_BIT, TERRAIN_COMPUTE_PUSH_CONST_OFFSET, sizeof(TerrainBrushPushConstants)},
     };
 
     /*---------------------- debug -----------------------*/
@@ -34,16 +34,17 @@ void Scene::loadFromFile(std::string_view filename)
 
         uint32_t mesh_count = 0;
         scene_file.read(reinterpret_cast<char*>(&mesh_count), sizeof(uint32_t));
-        for(uint32_t mesh_id = 0; mesh_id < mesh_count; mesh_id++)
+        std::vector<std::string> mesh_filenames(mesh_count);
+        for(auto& mesh_filename : mesh_filenames)
         {
             uint8_t mesh_filename_length = 0;
             scene_file.read(reinterpret_cast<char*>(&mesh_filename_length), sizeof(uint8_t));
-            std::string mesh_filename;
             mesh_filename.resize(mesh_filename_length);
             scene_file.read(reinterpret_cast<char*>(mesh_filename.data()), mesh_filename_length);
-            m_mesh_manager.loadMeshData(m_renderer, mesh_filename);
         }
 
+        m_mesh_manager.loadMeshData(m_renderer, mesh_filenames);
+
         m_renderer.finalizeStaticVB();
 
         uint32_t obj_count = 0;
@@ -136,6 +137,11 @@ Terrain& Scene::terrain() noexcept
     return *m_terrain;
 }
 
+const MeshManager& Scene::meshManager() const noexcept
+{
+    return m_mesh_manager;
+}
+
 
 #if EDITOR_ENABLE
 
@@ -35,6 +35,7 @@ public:
     void updateDirLight(DirLightId id, const DirLight& dir_light) const;
 
     Terrain& terrain() noexcept;
+    const MeshManager& meshManager() const noexcept;
 
 #if EDITOR_ENABLE
     Object* pickObject(const Ray& rayW, float& d);
@@ -1,6 +1,7 @@
 import bpy
 import bmesh
 import struct
+import io
 import os
 import bpy_extras.io_utils
 from math import radians
@@ -8,7 +9,6 @@ from mathutils import Matrix
 from mathutils import Euler
 from mathutils import Vector
 from mathutils import Quaternion
-import numpy as np
 
     
 #matrix for axis conversion (makes 'y' point up and 'z' forward)
@@ -38,33 +38,57 @@ def convertMatrixNoScaling(matrix):
     
     return T
 
-#collision classes
-class AABB:
-    def __init__(self, min, max, verts):
-        self.min = min
-        self.max = max
-        self.verts = verts
+#mesh file format, has to match MeshManager in mesh.h
+#the exporter writes plain triangle lists of full precision vertices as version 2, the game packs and deduplicates the vertices,
+#builds the index buffer, generates the lods and reorders everything for the GPU the first time it loads the file and keeps the result in its asset cache
+MESH_FILE_MAGIC = 0x4853454d
+MESH_FILE_VERSION = 2
+MESH_CHUNK_ALIGNMENT = 16
+
+CHUNK_TEXTURE = 0
+CHUNK_NORMAL_MAP = 1
+CHUNK_VERTICES = 2
+CHUNK_BONE_PARENTS = 3
+CHUNK_BONE_OFFSETS = 4
+CHUNK_POSE = 5
+CHUNK_ANIMATION = 6
+
+class Chunk:
+    def __init__(self, type, name = "", payload = b"", key_frame_count = 0):
+        self.type = type
+        self.name = bytearray(name, encoding='utf-8')
+        self.payload = payload
+        self.key_frame_count = key_frame_count
+
+#helper functions
+def alignChunk(offset):
+    return (offset + MESH_CHUNK_ALIGNMENT - 1) // MESH_CHUNK_ALIGNMENT * MESH_CHUNK_ALIGNMENT
+
+#header, chunk table, chunk names and then the payloads, each one aligned so the game can use them straight out of the mapped file
+def writeChunks(outfile, chunks, bone_count):
+    outfile.write(struct.pack('<IIII', MESH_FILE_MAGIC, MESH_FILE_VERSION, len(chunks), bone_count))
+    
+    offset = 16 + 40 * len(chunks)
+    name_offsets = []
+    for chunk in chunks:
+        name_offsets.append(offset)
+        offset += len(chunk.name)
         
-class BB:
-    def __init__(self, verts):
-        self.verts = verts
+    payload_offsets = []
+    for chunk in chunks:
+        offset = alignChunk(offset)
+        payload_offsets.append(offset)
+        offset += len(chunk.payload)
         
-class Sphere:
-    def __init__(self, center, radius):
-        self.center = center
-        self.radius = radius
+    for i, chunk in enumerate(chunks):
+        outfile.write(struct.pack('<IIQQQQ', chunk.type, chunk.key_frame_count, payload_offsets[i], len(chunk.payload), name_offsets[i], len(chunk.name)))
         
-#helper functions
-def exportString(outfile, s):
-    length = len(s)
-    
-    if length > 255:
-        raise Exception("String exceeds 255 character limit!")
-    
-    outfile.write(length.to_bytes(1, byteorder='little', signed=False))
-    
-    if length > 0:
-        outfile.write(bytearray(s, encoding='utf-8'))
+    for chunk in chunks:
+        outfile.write(chunk.name)
+        
+    for i, chunk in enumerate(chunks):
+        outfile.write(bytes(payload_offsets[i] - outfile.tell()))
+        outfile.write(chunk.payload)
 
 def actionIsAnimation(action):
     return action.name != 'PoseLib' and action.frame_range[1] > 2.0
@@ -72,7 +96,7 @@ def actionIsAnimation(action):
 def actionIsPose(action):
     return action.name != 'PoseLib' and action.frame_range[1] <= 2.0
 
-def exportAction(outfile, action, bones):
+def exportAction(action, bones):
     if len(action.groups) == 0:
         raise Exception("Action has no action groups!")
 
@@ -95,18 +119,20 @@ def exportAction(outfile, action, bones):
                 if c.keyframe_points[keyframe_point_id].co[0] != action.groups[0].channels[0].keyframe_points[keyframe_point_id].co[0]:
                     raise Exception("Timepoint mismatch between keyframes!")
             
-    exportString(outfile, action.name)
+    outfile = io.BytesIO()
 
     #at this point we know that each channel in each action group has the same keyframes so we can grab timepoints from any channel in any group
     keyframe_points = [x.co[0] for x in action.groups[0].channels[0].keyframe_points]
     
     if actionIsAnimation(action):
-        outfile.write(len(keyframe_points).to_bytes(1, byteorder='little', signed=False))
         for keyframe_point in keyframe_points:
             #TODO: read the 25.0 from scene/render settings to calculate correct timepoint
             t = keyframe_point / 25.0
             outfile.write(struct.pack('f', t))
         
+        #the key frames are aligned too
+        outfile.write(bytes(alignChunk(outfile.tell()) - outfile.tell()))
+        
     for bone in bones:
         action_group = action.groups[bone.name]
         
@@ -126,8 +152,13 @@ def exportAction(outfile, action, bones):
             
             outfile.write(struct.pack('ffff', q[0], q[1], q[2], q[3]))
             outfile.write(struct.pack('fff', pos[0], pos[2], pos[1]))
+            
+    if actionIsAnimation(action):
+        return Chunk(CHUNK_ANIMATION, action.name, outfile.getvalue(), len(keyframe_points))
+    else:
+        return Chunk(CHUNK_POSE, action.name, outfile.getvalue())
 
-def exportMaterial(outfile, object):
+def exportMaterial(object):
     color_texture = ""
     normal_map = ""
     
@@ -149,61 +180,28 @@ def exportMaterial(outfile, object):
                                     color_texture = node.image
                                 break
             
+    chunks = []
+            
     if not color_texture:
-        exportString(outfile, "default.png")
+        chunks.append(Chunk(CHUNK_TEXTURE, "default.png"))
     else:
         #full_path = bpy.path.abspath(tex.filepath, library=tex.library)
         #norm_path = os.path.normpath(full_path)
         path = bpy.path.basename(color_texture.filepath)
-        exportString(outfile, path)
+        chunks.append(Chunk(CHUNK_TEXTURE, path))
         
-    if not normal_map:
-        exportString(outfile, "")
-    else:
+    if normal_map:
         path = bpy.path.basename(normal_map.filepath)
-        exportString(outfile, path)
+        chunks.append(Chunk(CHUNK_NORMAL_MAP, path))
+        
+    return chunks
 
 def isRenderable(object):
     return (object.type == 'MESH') and ((object.parent is None) or (object.rigid_body is None) or (object.rigid_body.collision_shape == 'COMPOUND'))
 
-def getObjectCollisionShapes(object, aabbs, bbs, spheres):
-    bb_min = object.bound_box[0]
-    bb_max = object.bound_box[0]
-    for i in range(1, len(object.bound_box)):
-        bb_min = np.minimum(object.bound_box[i], bb_min)
-        bb_max = np.maximum(object.bound_box[i], bb_max)
-        
-    if object.parent is not None and object.parent.rigid_body is not None:
-        T = M @ object.parent.matrix_world.inverted() @ object.matrix_world
-    else:
-        T = M
-                
-    bb_min = T @ Vector(bb_min)
-    bb_max = T @ Vector(bb_max)
-                
-    if object.rigid_body.collision_shape == "BOX":
-        verts = []
-        for vert in object.bound_box:
-            v = T @ Vector((vert[0], vert[1], vert[2]))
-            verts.append(v[0])
-            verts.append(v[1])
-            verts.append(v[2])
-        #if object has no rotation we can export its collision box as AABB
-        if object.rotation_euler == Euler() and (object.parent is None or object.parent.rotation_euler == Euler()):
-            aabbs.append(AABB(bb_min, bb_max, verts))
-        else:
-            bbs.append(BB(verts))
-    elif object.rigid_body.collision_shape == "SPHERE":
-        center = (bb_min + bb_max) / 2.0
-        diagonal = bb_max - bb_min
-        radius = max(diagonal) / 2.0
-        spheres.append(Sphere(center, radius))
-    elif object.rigid_body.collision_shape == "COMPOUND":
-        for child in object.children:
-            if child.rigid_body is not None:
-                getObjectCollisionShapes(child, aabbs, bbs, spheres)
+def exportObject(object):
+    outfile = io.BytesIO()
     
-def exportObject(outfile, object):
     if isRenderable(object):
         me = object.data.copy()
         bm = bmesh.new()
@@ -231,12 +229,6 @@ def exportObject(outfile, object):
         elif any(object.rotation_euler):
             raise Exception("Object has non-zero rotation!")
 
-        #material info
-        exportMaterial(outfile, object)
-        
-        #vertex count
-        outfile.write(len(me.loops).to_bytes(8, byteorder='little', signed=False))
-        
         #for f in bm.faces:
         #    for v in f.verts:
         #        outfile.write(struct.pack('fff', v.co.x, v.co.z, v.co.y))
@@ -303,10 +295,14 @@ def exportObject(outfile, object):
                 
                 if not bone_found:
                     raise Exception("Couldn't find a bone named: ." + bone_name)
+                    
+    return outfile.getvalue()
                 
 
 #main export scene function
 def exportScene(context, outfile):
+    chunks = []
+    bone_count = 0
     
     #export animations
     if len(bpy.data.armatures) > 1:
@@ -314,13 +310,15 @@ def exportScene(context, outfile):
         
     if len(bpy.data.armatures) == 1:
         armature = bpy.data.armatures[0]
-        #bone count
         bones = armature.bones
         bone_count = len(bones)
-        outfile.write(bone_count.to_bytes(1, byteorder='little', signed=False))
+        
+        if bone_count > 255:
+            raise Exception("More than 255 bones in the armature!")
         
         if bone_count > 0:
             #bone parent ids
+            payload = io.BytesIO()
             for bone in bones:
                 if bone.parent is None:
                     bone_parent_id = -1
@@ -330,103 +328,34 @@ def exportScene(context, outfile):
                             bone_parent_id = i
                             break
                         
-                outfile.write(bone_parent_id.to_bytes(1, byteorder='little', signed=True))
+                payload.write(bone_parent_id.to_bytes(1, byteorder='little', signed=True))
+            chunks.append(Chunk(CHUNK_BONE_PARENTS, "", payload.getvalue()))
         
             #bone offset transforms
+            payload = io.BytesIO()
             for bone in bones:                
                 bone_offset_T = convertMatrixNoScaling(bone.matrix_local).inverted()
                 bone_offset_T.transpose()
                 
                 for vec in bone_offset_T:
-                    outfile.write(struct.pack('ffff', *vec))
-            
-            pose_count = 0
-            action_count = 0
-            for action in bpy.data.actions:
-                if actionIsAnimation(action):
-                    action_count += 1
-                elif actionIsPose(action):
-                    pose_count += 1
-            
-            #write pose count 
-            outfile.write(pose_count.to_bytes(1, byteorder='little', signed=False))
+                    payload.write(struct.pack('ffff', *vec))
+            chunks.append(Chunk(CHUNK_BONE_OFFSETS, "", payload.getvalue()))
                             
-            #poses
+            #poses and animations
             for action in bpy.data.actions:
-                if actionIsPose(action):
-                    exportAction(outfile, action, bones)
-            
-            #write action count 
-            outfile.write(action_count.to_bytes(1, byteorder='little', signed=False))
-                            
-            #animations
-            for action in bpy.data.actions:
-                if actionIsAnimation(action):
-                    exportAction(outfile, action, bones)
-    
-    else:
-        outfile.write((0).to_bytes(1, byteorder='little', signed=False))
-        
-    #export meshes
-    obj_count = 0
-    
-    for object in context.scene.objects:
-        if isRenderable(object):
-            obj_count += 1
-    
-    outfile.write(obj_count.to_bytes(8, byteorder='little', signed=False))
-    
-    for object in context.scene.objects:
-         exportObject(outfile, object)
-    
-    #export collision data
-    
-    #bound sphere (frustum culling)    
-    for object in context.scene.objects:
-        if isRenderable(object):
-            bb_min = object.bound_box[0]
-            bb_max = object.bound_box[0]
-            break
-    
-    for object in context.scene.objects:
-        for i in range(1, len(object.bound_box)):
-            bb_min = np.minimum(object.bound_box[i], bb_min)
-            bb_max = np.maximum(object.bound_box[i], bb_max)
-            
-    center = (bb_min + bb_max) / 2.0
-    diagonal = bb_max - bb_min
-    radius = max(diagonal) / 2.0
-            
-    outfile.write(struct.pack('fff', center[0], center[2], center[1]))
-    outfile.write(struct.pack('f', radius))
-                    
-    #collision
-    aabbs = []
-    bbs = []
-    spheres = []
-        
-    for object in context.scene.objects:
-        if object.rigid_body:
-            getObjectCollisionShapes(object, aabbs, bbs, spheres)
+                if actionIsPose(action) or actionIsAnimation(action):
+                    chunks.append(exportAction(action, bones))
         
-    outfile.write((len(aabbs)).to_bytes(1, byteorder='little', signed=False))
-    for aabb in aabbs:
-        outfile.write(struct.pack('fff', aabb.min[0], aabb.min[1], aabb.min[2]))
-        outfile.write(struct.pack('fff', aabb.max[0], aabb.max[1], aabb.max[2]))
-        outfile.write(struct.pack('%sf' % len(aabb.verts), *aabb.verts))
+    #export the mesh, the game loads one mesh per file
+    objects = [object for object in context.scene.objects if isRenderable(object)]
     
-    outfile.write((len(bbs)).to_bytes(1, byteorder='little', signed=False))
-    for bb in bbs:
-        outfile.write(struct.pack('%sf' % len(bb.verts), *bb.verts))
-        outfile.write(struct.pack('fff', 1.0, 0.0, 0.0))
-        outfile.write(struct.pack('fff', 0.0, 1.0, 0.0))
-        outfile.write(struct.pack('fff', 0.0, 0.0, 1.0))
+    if len(objects) != 1:
+        raise Exception("The scene has to have exactly 1 renderable object!")
     
-    outfile.write((len(spheres)).to_bytes(1, byteorder='little', signed=False))
-    for s in spheres:
-        outfile.write(struct.pack('fff', s.center[0], s.center[1], s.center[2]))
-        outfile.write(struct.pack('f', s.radius))
+    chunks += exportMaterial(objects[0])
+    chunks.append(Chunk(CHUNK_VERTICES, "", exportObject(objects[0])))
     
+    writeChunks(outfile, chunks, bone_count)
     outfile.close()
 
     
@@ -15,8 +15,11 @@ constexpr auto VS_QUAD_FILENAME = "shaders/vs_quad.spv";
 constexpr auto VS_DEFAULT_FILENAME = "shaders/vs_default.spv";
 constexpr auto VS_BILLBOARD_FILENAME = "shaders/vs_billboard.spv";
 constexpr auto VS_SHADOWMAP_FILENAME = "shaders/vs_shadowmap.spv";
+constexpr auto VS_SHADOWMAP_LAYERED_FILENAME = "shaders/vs_shadowmap_layered.spv";
 constexpr auto VS_HIGHLIGHT_FILENAME = "shaders/vs_highlight.spv";
 constexpr auto VS_TERRAIN_FILENAME = "shaders/vs_terrain.spv";
+constexpr auto VS_TERRAIN_SHADOW_MESH_FILENAME = "shaders/vs_terrain_shadow_mesh.spv";
+constexpr auto VS_TERRAIN_SHADOW_MESH_LAYERED_FILENAME = "shaders/vs_terrain_shadow_mesh_layered.spv";
 
 /*--- Geometry Shaders ---*/
 constexpr auto GS_UI_FILENAME = "shaders/gs_ui.spv";
@@ -28,6 +31,7 @@ constexpr auto GS_POINT_SHADOW_MAP_FILENAME = "shaders/gs_point_shadowmap.spv";
 constexpr auto TCS_TERRAIN_FILENAME = "shaders/tcs_terrain.spv";
 constexpr auto TES_TERRAIN_FILENAME = "shaders/tes_terrain.spv";
 constexpr auto TES_TERRAIN_SHADOWMAP_FILENAME = "shaders/tes_terrain_shadowmap.spv";
+constexpr auto TES_TERRAIN_SHADOWMAP_LAYERED_FILENAME = "shaders/tes_terrain_shadowmap_layered.spv";
 constexpr auto TES_TERRAIN_WIREFRAME_FILENAME = "shaders/tes_terrain_wireframe.spv";
 
 /*--- Fragment Shaders ---*/
@@ -39,6 +43,11 @@ constexpr auto FS_POINT_SHADOW_MAP_FILENAME = "shaders/fs_point_shadowmap.spv";
 constexpr auto FS_COLOR_FILENAME = "shaders/fs_color.spv";
 constexpr auto FS_TERRAIN_EDITOR_FILENAME = "shaders/fs_terrain_editor.spv";
 
+/*--- Compute Shaders ---*/
+constexpr auto CS_LIGHT_CLUSTERING_FILENAME = "shaders/cs_light_clustering.spv";
+constexpr auto CS_TERRAIN_BRUSH_FILENAME = "shaders/cs_terrain_brush.spv";
+constexpr auto CS_TERRAIN_SLOPE_MAP_FILENAME = "shaders/cs_terrain_slope_map.spv";
+
 /*--------------------------------------- structures ---------------------------------------*/
 
 struct alignas(16) DirLightShaderData
@@ -101,7 +110,7 @@ struct alignas(16) PointLightShaderData
     float a0 = 0.0f;
     float a1 = 0.0f;
     float a2 = 0.0f;
-    uint32_t shadow_map_id = 0;
+    uint32_t shadow_map_id = POINT_SHADOW_MAP_ID_NONE; //assigned by the renderer every frame, POINT_SHADOW_MAP_ID_NONE if the light currently has no shadow map
 };
 static_assert(sizeof(PointLight) == sizeof(PointLightShaderData));
 
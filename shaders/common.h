@@ -15,4 +15,33 @@ layout(set = 0, binding = COMMON_BUF_BINDING) uniform readonly restrict CommonBu
     uint dir_light_count;
     uint point_light_count;
     uint cur_terrain_intersection;
+    uint visible_dir_light_count;
+    uint visible_point_light_count;
+    vec2 tan_half_fov;
+    float camera_near;
+    float camera_far;
+    float pixels_per_unit;
+    uvec4 terrain_material_tex_ids;
+    vec2 terrain_vt_origin;
+    float terrain_vt_size;
+    uint terrain_vt_page_count;
+    uint terrain_vt_mip_count;
+    uint terrain_vt_feedback_phase;
 } common_buf;
+
+//the id of a virtual texture page in the feedback buffer, the mips are stored one after another starting from the most detailed one
+uint terrainVTPageId(uint mip, uvec2 page)
+{
+    const uint mip_page_count = common_buf.terrain_vt_page_count >> mip;
+    const uint mip_offset = (4 * common_buf.terrain_vt_page_count * common_buf.terrain_vt_page_count - 4 * mip_page_count * mip_page_count) / 3;
+    return mip_offset + page.y * mip_page_count + page.x;
+}
+
+//the normals and tangents of VertexDefault are octahedral encoded
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    const float t = max(-n.z, 0.0f);
+    n.xy += vec2((n.x >= 0.0f) ? -t : t, (n.y >= 0.0f) ? -t : t);
+    return normalize(n);
+}
@@ -20,7 +20,7 @@ layout(constant_id = 2) const uint dir_shadow_map_count = 1;
 layout(set = 0, binding = DIR_SM_BINDING) uniform sampler2DArrayShadow dir_shadow_maps[dir_shadow_map_count];
 
 layout(constant_id = 3) const uint point_shadow_map_count = 1;
-layout(set = 0, binding = POINT_SM_BINDING) uniform samplerCube point_shadow_maps[point_shadow_map_count];
+layout(set = 0, binding = POINT_SM_BINDING) uniform samplerCubeArray point_shadow_maps[point_shadow_map_count];
 
 struct DirLight
 {
@@ -49,20 +49,27 @@ layout(set = 0, binding = DIR_LIGHTS_BINDING) uniform readonly restrict DirLight
     DirLight lights[MAX_DIR_LIGHT_COUNT];
 } dir_light_buf;
 
-layout(set = 0, binding = DIR_LIGHTS_VALID_BINDING) uniform usamplerBuffer dir_lights_valid_buf;
+//ids of the lights to loop over, compacted on the cpu every frame
+layout(set = 0, binding = DIR_LIGHT_IDS_BINDING) uniform usamplerBuffer dir_light_ids_buf;
 
 layout(set = 0, binding = POINT_LIGHTS_BINDING) uniform readonly restrict PointLightBuffer
 {
     PointLight lights[MAX_POINT_LIGHT_COUNT];
 } point_light_buf;
 
-layout(set = 0, binding = POINT_LIGHTS_VALID_BINDING) uniform usamplerBuffer point_lights_valid_buf;
+//point lights binned into view space clusters by the light clustering compute shader
+layout(set = 0, binding = LIGHT_CLUSTER_BUF_BINDING) readonly restrict buffer LightClusterBuffer
+{
+    uint light_counts[LIGHT_CLUSTER_COUNT];
+    uint light_ids[LIGHT_CLUSTER_COUNT * MAX_LIGHTS_PER_LIGHT_CLUSTER];
+} light_cluster_buf;
 
 struct DirShadowMapData
 {
     mat4x4 P;
     mat4x4 tex_P;
     float z;
+    float terrain_tess_scale;
 };
 
 layout(set = 0, binding = DIR_SM_BUF_BINDING) uniform readonly restrict DirShadowMapBuffer
@@ -70,42 +77,29 @@ layout(set = 0, binding = DIR_SM_BUF_BINDING) uniform readonly restrict DirShado
     DirShadowMapData data[MAX_DIR_SHADOW_MAP_COUNT * MAX_DIR_SHADOW_MAP_PARTITIONS];
 } dir_shadow_map_buf;
 
-void shadeDefault()
+uint lightClusterId()
 {
-    const vec3 to_camera = normalize(common_buf.camera_pos - world_pos_in);
-    const vec4 object_col = texture(textures[tex_ids[0]], tex_coords);
+    const uvec2 cluster_xy = min(uvec2(gl_FragCoord.xy * common_buf.ui_scale * vec2(LIGHT_CLUSTER_COUNT_X, LIGHT_CLUSTER_COUNT_Y)),
+                                 uvec2(LIGHT_CLUSTER_COUNT_X - 1, LIGHT_CLUSTER_COUNT_Y - 1));
 
-    if(object_col.a < 0.5f)
-    {
-        discard;
-    }
+    const float z_slice = log(max(view_z_in, common_buf.camera_near) / common_buf.camera_near) / log(common_buf.camera_far / common_buf.camera_near);
+    const uint cluster_z = min(uint(z_slice * LIGHT_CLUSTER_COUNT_Z), uint(LIGHT_CLUSTER_COUNT_Z - 1));
 
-    const float ka = 0.2f;
-
-    vec3 N;
-
-    if(tex_ids[1] == NORMAL_MAP_ID_NONE)
-    {
-        N = norm_in;
-    }
-    else
-    {
-        N = normalize(2.0f * texture(normal_maps[tex_ids[1]], tex_coords).rgb - 1.0f);
+    return cluster_xy.x + LIGHT_CLUSTER_COUNT_X * (cluster_xy.y + LIGHT_CLUSTER_COUNT_Y * cluster_z);
+}
 
-        mat3x3 TBN = mat3x3(tan_in, bitan_in, norm_in);
-        N = TBN * N;
-    }
+//lights the fragment with the given albedo and world space normal
+void shade(vec4 object_col, vec3 N)
+{
+    const vec3 to_camera = normalize(common_buf.camera_pos - world_pos_in);
+    const float ka = 0.2f;
 
     out_col = vec4(0, 0, 0, 0);
 
     //directional lights
-    for(uint i = 0; i < common_buf.dir_light_count; i++)
+    for(uint visible_id = 0; visible_id < common_buf.visible_dir_light_count; visible_id++)
     {
-        const uint valid = texelFetch(dir_lights_valid_buf, int(i)).r;
-        if(valid == 0)
-        {
-            continue;
-        }
+        const uint i = texelFetch(dir_light_ids_buf, int(visible_id)).r;
 
         const vec4 light_col = vec4(dir_light_buf.lights[i].color, 1.0f);
 
@@ -163,13 +157,12 @@ void shadeDefault()
     }
 
     //point lights
-    for(uint i = 0; i < common_buf.point_light_count; i++)
+    const uint cluster_id = lightClusterId();
+    const uint cluster_light_count = light_cluster_buf.light_counts[cluster_id];
+
+    for(uint cluster_light_id = 0; cluster_light_id < cluster_light_count; cluster_light_id++)
     {
-        const uint valid = texelFetch(point_lights_valid_buf, int(i)).r;
-        if(valid == 0)
-        {
-            continue;
-        }
+        const uint i = light_cluster_buf.light_ids[cluster_id * MAX_LIGHTS_PER_LIGHT_CLUSTER + cluster_light_id];
 
         vec3 light_dir = world_pos_in - point_light_buf.lights[i].pos;
         const float d = length(light_dir);
@@ -184,9 +177,26 @@ void shadeDefault()
 
         out_col += object_col * light_col * ka;
 
-        if(point_light_buf.lights[i].shadow_map_res != 0)
+        const uint shadow_map_id = point_light_buf.lights[i].shadow_map_id;
+
+        if(shadow_map_id != POINT_SHADOW_MAP_ID_NONE)
         {
-            float shadow_map_d = point_light_buf.lights[i].max_d * texture(point_shadow_maps[point_light_buf.lights[i].shadow_map_id], light_dir).x;
+            uint tier = 0;
+            uint layer = shadow_map_id;
+
+            if(layer >= POINT_SHADOW_MAP_TIER_0_SLOT_COUNT)
+            {
+                layer -= POINT_SHADOW_MAP_TIER_0_SLOT_COUNT;
+                tier = 1;
+
+                if(layer >= POINT_SHADOW_MAP_TIER_1_SLOT_COUNT)
+                {
+                    layer -= POINT_SHADOW_MAP_TIER_1_SLOT_COUNT;
+                    tier = 2;
+                }
+            }
+
+            float shadow_map_d = point_light_buf.lights[i].max_d * texture(point_shadow_maps[tier], vec4(light_dir, float(layer))).x;
 
             if(shadow_map_d < d)
             {
@@ -203,3 +213,29 @@ void shadeDefault()
         out_col += object_col * light_col * kd + object_col * light_col * ks;
     }
 }
+
+void shadeDefault()
+{
+    const vec4 object_col = texture(textures[tex_ids[0]], tex_coords);
+
+    if(object_col.a < 0.5f)
+    {
+        discard;
+    }
+
+    vec3 N;
+
+    if(tex_ids[1] == NORMAL_MAP_ID_NONE)
+    {
+        N = norm_in;
+    }
+    else
+    {
+        N = normalize(2.0f * texture(normal_maps[tex_ids[1]], tex_coords).rgb - 1.0f);
+
+        mat3x3 TBN = mat3x3(tan_in, bitan_in, norm_in);
+        N = TBN * N;
+    }
+
+    shade(object_col, N);
+}
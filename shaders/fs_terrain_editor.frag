@@ -1,8 +1,87 @@
 #version 450
 #include "fs_common.h"
 
+//the virtual texture feedback is written from here, so only the fragments that pass the depth test may run -
+//otherwise the pages of hidden terrain get requested too
+layout(early_fragment_tests) in;
+
+//the terrain passes the heightmap slot of the patch in tex_ids[0], its splat map lives in the same layer
+layout(set = 0, binding = TERRAIN_SPLAT_MAP_BINDING) uniform sampler2DArray splat_maps;
+
+layout(set = 0, binding = TERRAIN_VT_PAGE_TABLE_BINDING) uniform usampler2D vt_page_table;
+layout(set = 0, binding = TERRAIN_VT_CACHE_BINDING) uniform sampler2D vt_cache;
+
+layout(set = 0, binding = TERRAIN_VT_FEEDBACK_BINDING) buffer restrict TerrainVTFeedbackBuffer
+{
+    uint pages[];
+} vt_feedback;
+
+vec4 blendMaterials()
+{
+    //the splat map texels sit on the patch vertices, so the patch uv is remapped to go from the center of the first texel to the center of the last one
+    const vec2 patch_uv = vec2(tex_coords.x, 1.0f - tex_coords.y);
+    const vec2 splat_uv = (patch_uv * (TERRAIN_SPLAT_MAP_RES - 1) + 0.5f) / TERRAIN_SPLAT_MAP_RES;
+    const vec4 weights = texture(splat_maps, vec3(splat_uv, tex_ids[0]));
+
+    vec4 object_col = vec4(0.0f, 0.0f, 0.0f, 0.0f);
+
+    for(uint i = 0; i < TERRAIN_MATERIAL_COUNT; i++)
+    {
+        if(weights[i] > 0.0f)
+        {
+            object_col += weights[i] * texture(textures[common_buf.terrain_material_tex_ids[i]], tex_coords);
+        }
+    }
+
+    //the weights don't have to add up to 1, a texel without any weight falls back to the first material
+    const float weight_sum = dot(weights, vec4(1.0f));
+    return (weight_sum > 0.0f) ? object_col / weight_sum : texture(textures[common_buf.terrain_material_tex_ids[0]], tex_coords);
+}
+
+//vt_texels_dx and vt_texels_dy are the screen space derivatives of the position in mip 0 texels
+vec4 sampleVirtualTexture(vec2 vt_uv, vec2 vt_texels_dx, vec2 vt_texels_dy)
+{
+    const uint page_count = common_buf.terrain_vt_page_count;
+    const uint max_mip = common_buf.terrain_vt_mip_count - 1;
+    uint mip = uint(clamp(0.5f * log2(max(dot(vt_texels_dx, vt_texels_dx), dot(vt_texels_dy, vt_texels_dy))), 0.0f, float(max_mip)));
+
+    if((uint(gl_FragCoord.x) % TERRAIN_VT_FEEDBACK_STRIDE) + TERRAIN_VT_FEEDBACK_STRIDE * (uint(gl_FragCoord.y) % TERRAIN_VT_FEEDBACK_STRIDE) == common_buf.terrain_vt_feedback_phase)
+    {
+        const uvec2 page = min(uvec2(vt_uv * (page_count >> mip)), uvec2((page_count >> mip) - 1));
+        const uint page_id = terrainVTPageId(mip, page);
+        atomicOr(vt_feedback.pages[page_id / 32], 1u << (page_id % 32));
+    }
+
+    //pages that aren't resident yet are drawn from the closest resident mip above them, the last mip is always resident
+    uvec2 page;
+    uint cache_slot;
+
+    for(;; mip++)
+    {
+        const uint mip_page_count = page_count >> mip;
+        page = min(uvec2(vt_uv * mip_page_count), uvec2(mip_page_count - 1));
+        cache_slot = texelFetch(vt_page_table, ivec2(page), int(mip)).r;
+
+        if((cache_slot != TERRAIN_VT_PAGE_NONE) || (mip == max_mip))
+        {
+            break;
+        }
+    }
+
+    const vec2 page_uv = clamp(vt_uv * float(page_count >> mip) - vec2(page), 0.0f, 1.0f);
+    const vec2 cache_pos = vec2(cache_slot % TERRAIN_VT_CACHE_PAGES, cache_slot / TERRAIN_VT_CACHE_PAGES) * TERRAIN_VT_PADDED_PAGE_RES + TERRAIN_VT_PAGE_BORDER + page_uv * TERRAIN_VT_PAGE_RES;
+
+    return textureLod(vt_cache, cache_pos / (TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_PADDED_PAGE_RES), 0.0f);
+}
+
 void main()
 {
+    //taken before any branching, derivatives are undefined in non uniform control flow
+    const vec2 vt_uv = (world_pos_in.xz - common_buf.terrain_vt_origin) / common_buf.terrain_vt_size;
+    const vec2 vt_texels = vt_uv * float(common_buf.terrain_vt_page_count * TERRAIN_VT_PAGE_RES);
+    const vec2 vt_texels_dx = dFdx(vt_texels);
+    const vec2 vt_texels_dy = dFdy(vt_texels);
+
     if(common_buf.cur_terrain_intersection != 0)
     {
         const float r = distance(world_pos_in, common_buf.cur_pos_terrain);
@@ -14,5 +93,7 @@ void main()
         }
     }
 
-    shadeDefault();
+    const vec4 object_col = (common_buf.terrain_vt_page_count > 0) ? sampleVirtualTexture(vt_uv, vt_texels_dx, vt_texels_dy) : blendMaterials();
+
+    shade(object_col, norm_in);
 }
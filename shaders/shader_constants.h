@@ -3,16 +3,23 @@
 #define NORMAL_MAP_BINDING          2
 #define FONT_BINDING                3
 #define DIR_LIGHTS_BINDING          4
-#define DIR_LIGHTS_VALID_BINDING    5
+#define DIR_LIGHT_IDS_BINDING       5
 #define POINT_LIGHTS_BINDING        6
-#define POINT_LIGHTS_VALID_BINDING  7
+#define POINT_LIGHT_IDS_BINDING     7
 #define DIR_SM_BUF_BINDING          8
 #define DIR_SM_BINDING              9
 #define POINT_SM_BUF_BINDING        10
 #define POINT_SM_BINDING            11
 #define BONE_TRANSFORM_BUF_BINDING  12
-#define TERRAIN_BUF_BINDING         13
+#define TERRAIN_SPLAT_MAP_BINDING   13
 #define TERRAIN_HEIGHTMAP_BINDING   14
+#define LIGHT_CLUSTER_BUF_BINDING   15
+#define TERRAIN_HEIGHTMAP_STORAGE_BINDING 16
+#define TERRAIN_SLOPE_MAP_BINDING   17
+#define TERRAIN_SLOPE_MAP_STORAGE_BINDING 18
+#define TERRAIN_VT_PAGE_TABLE_BINDING 19
+#define TERRAIN_VT_CACHE_BINDING    20
+#define TERRAIN_VT_FEEDBACK_BINDING 21
 
 #define MAX_DIR_SHADOW_MAP_PARTITIONS 4
 
@@ -24,4 +31,50 @@
 #define MAX_DIR_SHADOW_MAP_COUNT 4
 #define MAX_POINT_SHADOW_MAP_COUNT 64
 
+//point shadow maps are allocated from one cube map array per resolution tier
+//slot ids are laid out tier after tier, from the highest resolution tier to the lowest
+#define POINT_SHADOW_MAP_TIER_COUNT 3
+#define POINT_SHADOW_MAP_TIER_0_RES 1024
+#define POINT_SHADOW_MAP_TIER_0_SLOT_COUNT 4
+#define POINT_SHADOW_MAP_TIER_1_RES 512
+#define POINT_SHADOW_MAP_TIER_1_SLOT_COUNT 16
+#define POINT_SHADOW_MAP_TIER_2_RES 256
+#define POINT_SHADOW_MAP_TIER_2_SLOT_COUNT 44
+
+#define POINT_SHADOW_MAP_ID_NONE 0xffffffff
+
+//point lights are binned into a grid of view space clusters (screen tiles x exponential depth slices)
+#define LIGHT_CLUSTER_COUNT_X 16
+#define LIGHT_CLUSTER_COUNT_Y 9
+#define LIGHT_CLUSTER_COUNT_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_COUNT_X * LIGHT_CLUSTER_COUNT_Y * LIGHT_CLUSTER_COUNT_Z)
+#define MAX_LIGHTS_PER_LIGHT_CLUSTER 128
+#define LIGHT_CLUSTERING_GROUP_SIZE 64
+
 #define MAX_TESS_LEVEL 64.0f
+//target on screen length of a terrain triangle edge in pixels
+#define TERRAIN_TESS_TRIANGLE_PIXELS 8.0f
+//point shadow maps don't need as much detail, the tessellation levels are scaled down for them
+//dir shadow maps get a scale per cascade, see DirShadowMapData::terrain_tess_scale
+#define TERRAIN_SHADOW_TESS_SCALE 0.25f
+
+//every terrain patch has an RGBA8 splat map holding the weights of the terrain materials,
+//its texels sit on every other heightmap vertex so the edges shared by neighbouring patches line up
+#define TERRAIN_MATERIAL_COUNT 4
+#define TERRAIN_SPLAT_MAP_RES 33
+
+//the terrain virtual texture is split into pages of TERRAIN_VT_PAGE_RES x TERRAIN_VT_PAGE_RES texels on every mip, stored with a border
+//copied from their neighbours so they can be filtered bilinearly - the resident ones live in a cache of TERRAIN_VT_CACHE_PAGES x TERRAIN_VT_CACHE_PAGES pages
+#define TERRAIN_VT_PAGE_RES 128
+#define TERRAIN_VT_PAGE_BORDER 4
+#define TERRAIN_VT_PADDED_PAGE_RES (TERRAIN_VT_PAGE_RES + 2 * TERRAIN_VT_PAGE_BORDER)
+#define TERRAIN_VT_CACHE_PAGES 32
+#define TERRAIN_VT_PAGES_PER_PATCH 4
+#define TERRAIN_VT_PAGE_NONE 0xffff
+//only one pixel out of every TERRAIN_VT_FEEDBACK_STRIDE x TERRAIN_VT_FEEDBACK_STRIDE reports the page it needs, a different one every frame
+#define TERRAIN_VT_FEEDBACK_STRIDE 4
+
+#define TERRAIN_BRUSH_GROUP_SIZE 8
+#define TERRAIN_SLOPE_MAP_GROUP_SIZE 8
+//the parameters of the terrain compute shaders are pushed right after the graphics push constants
+#define TERRAIN_COMPUTE_PUSH_CONST_OFFSET 16
@@ -2,13 +2,15 @@
 #include "common.h"
 
 layout(location = 0) in vec3 pos_in;
-layout(location = 1) in vec3 norm_in;
-layout(location = 2) in vec3 tan_in;
+layout(location = 1) in vec2 norm_in;
+layout(location = 2) in vec2 tan_in;
 layout(location = 3) in vec2 tex_coords_in;
 layout(location = 4) in uint bone_id_in;
 layout(location = 5) in mat4x4 W_in;
 layout(location = 9) in uvec2 tex_ids_in;
 layout(location = 10) in uint bone_offset_in;
+layout(location = 11) in vec3 pos_offset_in;
+layout(location = 12) in vec3 pos_scale_in;
 
 layout(location = 0) out vec3 norm_out;
 layout(location = 1) out vec3 tan_out;
@@ -27,13 +29,13 @@ void main()
 {
     const mat4x4 W = W_in * bone_transforms.Ts[bone_offset_in + bone_id_in];
 
-    norm_out = normalize(vec3(vec4(norm_in, 0.0f) * inverse(W)));
-    tan_out = normalize(vec3(vec4(tan_in, 0.0f) * inverse(W)));
+    norm_out = normalize(vec3(vec4(octDecode(norm_in), 0.0f) * inverse(W)));
+    tan_out = normalize(vec3(vec4(octDecode(tan_in), 0.0f) * inverse(W)));
     bitan_out = normalize(cross(norm_out, tan_out));
     tex_coords_out = tex_coords_in;
     tex_ids_out = tex_ids_in;
 
-    world_pos_out = vec3(W * vec4(pos_in, 1.0f));
+    world_pos_out = vec3(W * vec4(pos_offset_in + pos_in * pos_scale_in, 1.0f));
     view_z_out = (common_buf.V * vec4(world_pos_out, 1.0f)).z;
     gl_Position = common_buf.VP * vec4(world_pos_out, 1.0f);
 }
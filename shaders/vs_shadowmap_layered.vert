@@ -0,0 +1,78 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+#include "common.h"
+
+//the same shader is used for both dir and point shadow maps
+layout(constant_id = 0) const bool point_shadow_map = false;
+
+layout(location = 0) in vec3 pos_in;
+layout(location = 4) in uint bone_id_in;
+layout(location = 5) in mat4x4 W_in;
+layout(location = 10) in uint bone_offset_in;
+layout(location = 11) in vec3 pos_offset_in;
+layout(location = 12) in vec3 pos_scale_in;
+
+layout(location = 0) out vec3 world_pos_out;
+layout(location = 1) flat out uint shadow_map_id_out;
+
+layout(set = 0, binding = BONE_TRANSFORM_BUF_BINDING) buffer readonly restrict BoneTransformData
+{
+    mat4x4 Ts[];
+} bone_transforms;
+
+struct DirShadowMapData
+{
+    mat4x4 P;
+    mat4x4 tex_P;
+    float z;
+    float terrain_tess_scale;
+};
+
+layout(set = 0, binding = DIR_SM_BUF_BINDING) uniform readonly restrict DirShadowMapBuffer
+{
+    DirShadowMapData shadow_maps[455];
+} dir_shadow_map_buf;
+
+struct PointShadowMapData
+{
+    mat4x4 P[6];
+    vec3 light_pos;
+    float max_d;
+};
+
+layout(set = 0, binding = POINT_SM_BUF_BINDING) uniform readonly restrict PointShadowMapBuffer
+{
+    PointShadowMapData data[163];
+} point_shadow_map_buf;
+
+layout(push_constant) uniform pushConstants
+{
+    uint shadow_map_count;
+    uint shadow_map_offset;
+} push_const;
+
+void main()
+{
+    const mat4x4 W = W_in * bone_transforms.Ts[bone_offset_in + bone_id_in];
+    const vec4 world_pos = W * vec4(pos_offset_in + pos_in * pos_scale_in, 1.0f);
+
+    //every instance of the draw renders into one layer of the shadow map
+    gl_Layer = gl_InstanceIndex;
+
+    if(point_shadow_map)
+    {
+        world_pos_out = vec3(world_pos);
+        shadow_map_id_out = push_const.shadow_map_offset;
+        gl_Position = point_shadow_map_buf.data[push_const.shadow_map_offset].P[gl_InstanceIndex] * world_pos;
+    }
+    else
+    {
+        gl_Position = dir_shadow_map_buf.shadow_maps[push_const.shadow_map_offset + gl_InstanceIndex].P * world_pos;
+    }
+}
+
+//unused
+layout(location = 1) in vec2 norm_in;
+layout(location = 2) in vec2 tan_in;
+layout(location = 3) in vec2 tex_coords_in;
+layout(location = 9) in uvec2 tex_ids_in;
@@ -2,11 +2,16 @@
 
 layout(location = 0) in vec2 pos_in;
 layout(location = 1) in uint heightmap_id_in;
+layout(location = 2) in vec2 height_range_in;
 
 layout(location = 0) out uint heightmap_id_out;
+//only used by the layered shadow map pipelines, where each instance renders into one layer
+layout(location = 1) out uint layer_out;
 
 void main()
 {
     heightmap_id_out = heightmap_id_in;
-    gl_Position = vec4(pos_in, 0.0f, 0.0f);
+    layer_out = gl_InstanceIndex;
+    //the height range rides along in zw, the tessellation evaluation shaders dequantize the heightmap with it
+    gl_Position = vec4(pos_in, height_range_in);
 }
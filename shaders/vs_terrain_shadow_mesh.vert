@@ -0,0 +1,9 @@
+#version 450
+
+//the low resolution terrain mesh drawn into the far dir shadow map cascades instead of the tessellated patches
+layout(location = 0) in vec3 pos_in;
+
+void main()
+{
+    gl_Position = vec4(pos_in, 1.0f);
+}
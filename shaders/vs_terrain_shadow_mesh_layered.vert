@@ -0,0 +1,32 @@
+#version 450
+#extension GL_ARB_shader_viewport_layer_array : require
+#include "common.h"
+
+//the low resolution terrain mesh drawn into the far dir shadow map cascades instead of the tessellated patches
+layout(location = 0) in vec3 pos_in;
+
+struct DirShadowMapData
+{
+    mat4x4 P;
+    mat4x4 tex_P;
+    float z;
+    float terrain_tess_scale;
+};
+
+layout(set = 0, binding = DIR_SM_BUF_BINDING) uniform readonly restrict DirShadowMapBuffer
+{
+    DirShadowMapData shadow_maps[455];
+} dir_shadow_map_buf;
+
+layout(push_constant) uniform pushConstants
+{
+    uint shadow_map_count;
+    uint shadow_map_offset;
+} push_const;
+
+void main()
+{
+    //every instance of the draw renders into one cascade, the draw starts at the first cascade that uses the mesh
+    gl_Layer = gl_InstanceIndex;
+    gl_Position = dir_shadow_map_buf.shadow_maps[push_const.shadow_map_offset + gl_InstanceIndex].P * vec4(pos_in, 1.0f);
+}
@@ -1,18 +1,30 @@
 #include "terrain.h"
+#include "mapped_file.h"
+#include "parallel.h"
+#include "texture_loader.h"
 #include <game_utils.h>
 #include <print>
 #include <format>
+#include <bit>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <map>
+#include <chrono>
+#include <exception>
+#include <zlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 Terrain::Terrain(Renderer& renderer)
 {
 #if EDITOR_ENABLE
+    if(!std::filesystem::exists(TERRAIN_FILENAME))
     {
-        std::ifstream in(TERRAIN_FILENAME, std::ios::binary);
-        if(!in)
-        {
-            std::println("Failed to open terrain file {}. Creating new terrain...", TERRAIN_FILENAME);
-            createNew();
-        }
+        std::println("Failed to open terrain file {}. Creating new terrain...", TERRAIN_FILENAME);
+        createNew();
     }
 #endif
 
@@ -25,559 +37,2831 @@ void Terrain::calcXYFromSize() noexcept
     m_z = -0.5f * m_size;
 }
 
-#if EDITOR_ENABLE
-void Terrain::createNew()
+const Terrain::Tile& Terrain::tile(uint32_t patch_id) const
 {
-    m_size = DEFAULT_SIZE;
-    calcXYFromSize();
-    m_patch_count = DEFAULT_PATCH_COUNT;
-    m_patch_size = m_size / static_cast<float>(m_patch_count);
+    const uint32_t chunk_id = patch_id / PATCHES_PER_CHUNK;
+    uint32_t slot = m_chunk_slot_ids[chunk_id];
 
-    m_patch_vertices.resize(m_patch_count * m_patch_count);
-    m_bounding_ys.resize(m_patch_vertices.size(), vec2(0.0f, 0.0f));
-    m_vertex_data.resize((MAX_TESS_LEVEL + 1) * (MAX_TESS_LEVEL + 1) * m_patch_count * m_patch_count);
-    m_heightmaps.resize(m_patch_vertices.size());
-    for(auto& heightmap : m_heightmaps)
+    if(SLOT_NONE == slot)
     {
-        std::ranges::fill(heightmap, 0.0f);
-    }
+        auto tiles = std::make_unique_for_overwrite<Tile[]>(PATCHES_PER_CHUNK);
 
-    for(uint32_t z = 0; z < m_patch_count; z++)
-    {
-        for(uint32_t x = 0; x < m_patch_count; x++)
+        if(!decompressChunk(chunk_id, tiles.get()))
         {
-            const uint32_t patch_id = z * m_patch_count + x;
-
-            m_patch_vertices[patch_id].pos = vec2(m_x + x * m_patch_size, m_z + z * m_patch_size);
-            m_patch_vertices[patch_id].heightmap_id = patch_id;
+            error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
         }
+
+        slot = cacheChunk(chunk_id, std::move(tiles));
+    }
+
+    ChunkSlot& chunk_slot = m_chunk_slots[slot];
+
+    //only written when it changes, the threads reading the tiles the main thread has cached this frame never write it
+    if(chunk_slot.last_used_frame != m_frame)
+    {
+        chunk_slot.last_used_frame = m_frame;
     }
 
-    saveToFile();
+    return chunk_slot.tiles[patch_id % PATCHES_PER_CHUNK];
+}
+
+#if EDITOR_ENABLE
+Terrain::Tile& Terrain::editTile(uint32_t patch_id)
+{
+    const Tile& patch_tile = tile(patch_id);
+    m_chunk_slots[m_chunk_slot_ids[patch_id / PATCHES_PER_CHUNK]].dirty = true;
+
+    return const_cast<Tile&>(patch_tile);
 }
 #endif
 
-void Terrain::loadFromFile(Renderer& renderer)
+uint32_t Terrain::cacheChunk(uint32_t chunk_id, std::unique_ptr<Tile[]> tiles) const
 {
-    std::ifstream in(TERRAIN_FILENAME, std::ios::binary);
+    uint32_t slot = SLOT_NONE;
 
-    //TODO: do better file opening error handlng here
-    if(!in)
+    if(m_chunk_slots.size() < DEFAULT_CHUNK_CACHE_SIZE)
     {
-        error(std::format("Failed to open file {}.", TERRAIN_FILENAME));
+        slot = static_cast<uint32_t>(m_chunk_slots.size());
+        m_chunk_slots.emplace_back();
     }
+    else
+    {
+        auto evictable = [this](const ChunkSlot& chunk_slot)
+        {
+#if EDITOR_ENABLE
+            if(chunk_slot.dirty)
+            {
+                return false;
+            }
+#endif
+            return chunk_slot.last_used_frame != m_frame;
+        };
 
-    in.read(reinterpret_cast<char*>(&m_size), sizeof(m_size));
-    in.read(reinterpret_cast<char*>(&m_patch_count), sizeof(m_patch_count));
+        auto lru_slot = m_chunk_slots.end();
 
-    calcXYFromSize();
-    m_patch_size = m_size / static_cast<float>(m_patch_count);
+        for(auto it = m_chunk_slots.begin(); it != m_chunk_slots.end(); it++)
+        {
+            if(evictable(*it) && ((lru_slot == m_chunk_slots.end()) || (it->last_used_frame < lru_slot->last_used_frame)))
+            {
+                lru_slot = it;
+            }
+        }
+
+        if(lru_slot != m_chunk_slots.end())
+        {
+            slot = static_cast<uint32_t>(std::distance(m_chunk_slots.begin(), lru_slot));
+            m_chunk_slot_ids[lru_slot->chunk_id] = SLOT_NONE;
+            *lru_slot = ChunkSlot{};
+        }
+        else
+        {
+            slot = static_cast<uint32_t>(m_chunk_slots.size());
+            m_chunk_slots.emplace_back();
+        }
+    }
 
-    uint64_t bounding_ys_count = 0;
-    in.read(reinterpret_cast<char*>(&bounding_ys_count), sizeof(uint64_t));
-    m_bounding_ys.resize(bounding_ys_count);
-    in.read(reinterpret_cast<char*>(m_bounding_ys.data()), m_bounding_ys.size() * sizeof(vec2));
+    m_chunk_slots[slot].chunk_id = chunk_id;
+    m_chunk_slots[slot].last_used_frame = m_frame;
+    m_chunk_slots[slot].tiles = std::move(tiles);
+    m_chunk_slot_ids[chunk_id] = slot;
 
-    uint64_t vertex_data_count = 0;
-    in.read(reinterpret_cast<char*>(&vertex_data_count), sizeof(uint64_t));
-    m_vertex_data.resize(vertex_data_count);
-    in.read(reinterpret_cast<char*>(m_vertex_data.data()), m_vertex_data.size() * sizeof(VertexData));
+    return slot;
+}
+
+void Terrain::trimChunkCache()
+{
+    if(m_chunk_slots.size() <= DEFAULT_CHUNK_CACHE_SIZE)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> evictable_slots;
 
-    m_patch_vertices.resize(m_patch_count * m_patch_count);
-    in.read(reinterpret_cast<char*>(m_patch_vertices.data()), m_patch_vertices.size() * sizeof(VertexTerrain));
+    for(uint32_t slot = 0; slot < m_chunk_slots.size(); slot++)
+    {
+#if EDITOR_ENABLE
+        if(m_chunk_slots[slot].dirty)
+        {
+            continue;
+        }
+#endif
+        if(m_chunk_slots[slot].last_used_frame != m_frame)
+        {
+            evictable_slots.push_back(slot);
+        }
+    }
 
-    m_heightmaps.resize(m_patch_vertices.size());
-    in.read(reinterpret_cast<char*>(m_heightmaps.data()), m_heightmaps.size() * sizeof(m_heightmaps[0]));
+    const size_t evict_count = std::min(evictable_slots.size(), m_chunk_slots.size() - DEFAULT_CHUNK_CACHE_SIZE);
+    std::ranges::partial_sort(evictable_slots, evictable_slots.begin() + evict_count, {}, [this](uint32_t slot)
+    {
+        return m_chunk_slots[slot].last_used_frame;
+    });
 
-    m_vb_alloc = renderer.reqVBAlloc<VertexTerrain>(m_patch_vertices.size());
-    renderer.updateVertexData(m_vb_alloc.vb, m_vb_alloc.data_offset, sizeof(VertexTerrain) * m_patch_vertices.size(), m_patch_vertices.data());
+    for(size_t i = 0; i < evict_count; i++)
+    {
+        ChunkSlot& chunk_slot = m_chunk_slots[evictable_slots[i]];
+        m_chunk_slot_ids[chunk_slot.chunk_id] = SLOT_NONE;
+        chunk_slot.chunk_id = CHUNK_ID_NONE;
+    }
 
-    renderer.reqTerrainBufAlloc(m_vertex_data.size() * sizeof(VertexData));
-    renderer.updateTerrainData(m_vertex_data.data(), 0, m_vertex_data.size() * sizeof(VertexData));
+    //the tiles don't move, only the slots they're in
+    std::erase_if(m_chunk_slots, [](const ChunkSlot& chunk_slot){ return chunk_slot.chunk_id == CHUNK_ID_NONE; });
 
-    //TODO:don't do this after we add proper patch streaming
-    std::vector<std::pair<float*, uint32_t>> heightmap_reqs(m_heightmaps.size());
-    for(size_t i = 0; i < m_heightmaps.size(); i++)
+    for(uint32_t slot = 0; slot < m_chunk_slots.size(); slot++)
     {
-        heightmap_reqs[i] = std::make_pair(m_heightmaps[i].data(), i);
+        m_chunk_slot_ids[m_chunk_slots[slot].chunk_id] = slot;
     }
-    renderer.requestTerrainHeightmaps(heightmap_reqs);
 }
 
-void Terrain::draw(Renderer& renderer)
+bool Terrain::copyChunk(uint32_t chunk_id, Tile* tiles) const
 {
-    //TODO: do frustum culling (both camera and light sources views!) and only draw visible patches, also stream heightmaps onto GPU
-    //try and compare the following approaches:
-    //1. Update vertex buffer with only the patches to draw this frame (the ones that passed frustum culling) and draw the whole VB in a single draw call
-    //2. Always have all patch vertex data on the GPU and use an index buffer and update it with indices of vertices that passed frustum culling and are to be drawn this frame and draw in a single draw call
-    //3. Always have all patch vertex data on the GPU and issue multiple draw calls to pick the vertices to be drawn this frame that passed frustum culling
-    renderer.updateVertexData(m_vb_alloc.vb, m_vb_alloc.data_offset, sizeof(VertexTerrain) * m_patch_vertices.size(), m_patch_vertices.data());
-    renderer.draw(m_render_mode, m_vb_alloc.vb, m_vb_alloc.vertex_offset, m_patch_vertices.size(), 0);
+    const uint32_t slot = m_chunk_slot_ids[chunk_id];
+
+    if(SLOT_NONE == slot)
+    {
+        return decompressChunk(chunk_id, tiles);
+    }
+
+    std::copy_n(m_chunk_slots[slot].tiles.get(), chunkPatchCount(chunk_id, m_patch_count * m_patch_count), tiles);
+    return true;
 }
 
-float Terrain::patchSize() const
+uint32_t Terrain::chunkPatchCount(uint32_t chunk_id, uint32_t total_patch_count) noexcept
 {
-    return m_patch_size;
+    return std::min(PATCHES_PER_CHUNK, total_patch_count - chunk_id * PATCHES_PER_CHUNK);
 }
 
-float Terrain::collision(const AABB& aabb, const float max_dh) const
+bool Terrain::decompressChunk(uint32_t chunk_id, Tile* tiles) const
 {
-    const float min_x_coord = std::max<float>((aabb.min().x - m_x) / m_patch_size, 0);
-    const float max_x_coord = std::min<float>((aabb.max().x - m_x) / m_patch_size, m_patch_count);
-    const float min_z_coord = std::max<float>((aabb.min().z - m_z) / m_patch_size, 0);
-    const float max_z_coord = std::min<float>((aabb.max().z - m_z) / m_patch_size, m_patch_count);
+    const ChunkInfo& chunk = m_chunk_infos[chunk_id];
+    const uint32_t chunk_patch_count = chunkPatchCount(chunk_id, m_patch_count * m_patch_count);
+    const uint64_t raw_size = chunk_patch_count * STORED_TILE_SIZE;
 
-    const uint32_t min_patch_x = static_cast<uint32_t>(min_x_coord);
-    const uint32_t max_patch_x = std::min<uint32_t>(max_x_coord, m_patch_count - 1);
-    const uint32_t min_patch_z = static_cast<uint32_t>(min_z_coord);
-    const uint32_t max_patch_z = std::min<uint32_t>(max_z_coord, m_patch_count - 1);
+    std::vector<uint8_t> shuffled(raw_size);
+    uLongf uncompressed_size = static_cast<uLongf>(raw_size);
 
-    const float min_vx = min_x_coord - static_cast<float>(min_patch_x);
-    const float max_vx = max_x_coord - static_cast<float>(max_patch_x);
-    const float min_vz = min_z_coord - static_cast<float>(min_patch_z);
-    const float max_vz = max_z_coord - static_cast<float>(max_patch_z);
+    if((uncompress(shuffled.data(), &uncompressed_size, m_file.data() + chunk.offset, static_cast<uLong>(chunk.compressed_size)) != Z_OK) || (uncompressed_size != raw_size))
+    {
+        return false;
+    }
 
-    float dh = std::numeric_limits<float>::lowest();
+    unpackChunk(shuffled.data(), chunk_patch_count, tiles);
 
-    for(uint32_t patch_z = min_patch_z; patch_z <= max_patch_z; patch_z++)
+    //only the heightmaps are stored, the height pyramids are rebuilt from them
+    for(uint32_t i = 0; i < chunk_patch_count; i++)
     {
-        for(uint32_t patch_x = min_patch_x; patch_x <= max_patch_x; patch_x++)
-        {
-            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
-            //TODO: is bounding_ys even worth using here?
-            // const vec2& bounding_ys = m_bounding_ys[patch_id];
+        buildHeightPyramid(tiles[i]);
+    }
 
-//            if((bounding_ys[0] >= aabb.min().y) && (bounding_ys[1] <= aabb.max().y))
-            {
-                const uint32_t min_patch_vx = (patch_x == static_cast<uint32_t>(min_patch_x)) ? static_cast<uint32_t>(MAX_TESS_LEVEL * min_vx) : 0;
-                const uint32_t min_patch_vz = (patch_z == static_cast<uint32_t>(min_patch_z)) ? static_cast<uint32_t>(MAX_TESS_LEVEL * min_vz) : 0;
-                const uint32_t max_patch_vx = (patch_x == static_cast<uint32_t>(max_patch_x)) ? std::min<uint32_t>(MAX_TESS_LEVEL, static_cast<uint32_t>(MAX_TESS_LEVEL * max_vx) + 1) : MAX_TESS_LEVEL;
-                const uint32_t max_patch_vz = (patch_z == static_cast<uint32_t>(max_patch_z)) ? std::min<uint32_t>(MAX_TESS_LEVEL, static_cast<uint32_t>(MAX_TESS_LEVEL * max_vz) + 1) : MAX_TESS_LEVEL;
+    return true;
+}
 
-                for(uint32_t vz = min_patch_vz; vz <= max_patch_vz; vz++)
-                {
-                    for(uint32_t vx = min_patch_vx; vx <= max_patch_vx; vx++)
-                    {
-                        const float h = m_heightmaps[patch_id][vz * (MAX_TESS_LEVEL + 1) + vx];
-                        const float dh_ = h - aabb.min().y;
-                        if(dh_ > dh)
-                        {
-                            //early out TODO: check if optimal
-                            if(dh_ > max_dh)
-                            {
-                                return dh_;
-                            }
-                            dh = dh_;
-                        }
-                    }
-                }
-            }
-        }
+void Terrain::startPageInThread()
+{
+    m_page_in_thread = std::jthread([this](std::stop_token stop_token){ pageInChunks(stop_token); });
+}
+
+void Terrain::stopPageInThread()
+{
+    if(m_page_in_thread.joinable())
+    {
+        m_page_in_thread.request_stop();
+        m_page_in_thread.join();
     }
 
-    return dh;
+    m_page_in_reqs.clear();
+    m_paged_in_chunks.clear();
+}
 
-#if 0
-    const float min_x_coord = std::max<float>((aabb.min().x - m_x) / m_patch_size, 0);
-    const float max_x_coord = std::min<float>((aabb.max().x - m_x) / m_patch_size, m_patch_count);
-    const float min_z_coord = std::max<float>((aabb.min().z - m_z) / m_patch_size, 0);
-    const float max_z_coord = std::min<float>((aabb.max().z - m_z) / m_patch_size, m_patch_count);
+void Terrain::pageInChunks(std::stop_token stop_token)
+{
+    while(true)
+    {
+        uint32_t chunk_id;
 
-    const uint32_t min_patch_x = min_x_coord;
-    const uint32_t max_patch_x = std::min<uint32_t>(max_x_coord, m_patch_count - 1);
-    const uint32_t min_patch_z = min_z_coord;
-    const uint32_t max_patch_z = std::min<uint32_t>(max_z_coord, m_patch_count - 1);
+        {
+            std::unique_lock lock(m_page_in_mutex);
 
-    const float min_vx = min_x_coord - static_cast<float>(min_patch_x);
-    const float max_vx = max_x_coord - static_cast<float>(max_patch_x);
-    const float min_vz = min_z_coord - static_cast<float>(min_patch_z);
-    const float max_vz = max_z_coord - static_cast<float>(max_patch_z);
+            if(!m_page_in_cv.wait(lock, stop_token, [this]{ return !m_page_in_reqs.empty(); }))
+            {
+                return;
+            }
 
-    float max_dh = std::numeric_limits<float>::lowest();
+            chunk_id = m_page_in_reqs.front();
+            m_page_in_reqs.pop_front();
+        }
 
-    auto height_cmp = [&](float h)
-    {
-        const float dh = h - aabb.min().y;
-        if(dh > dh_out)
+        //the main thread reports a corrupted chunk when it finds it empty, errors can't leave this thread
+        auto tiles = std::make_unique_for_overwrite<Tile[]>(PATCHES_PER_CHUNK);
+
+        if(!decompressChunk(chunk_id, tiles.get()))
         {
-            return true;
+            tiles.reset();
         }
-        else if(dh > max_dh)
+
+        std::lock_guard lock(m_page_in_mutex);
+        m_paged_in_chunks.emplace_back(chunk_id, std::move(tiles));
+    }
+}
+
+//zlib does a lot better on numbers when the bytes of the same significance are next to each other,
+//so the chunks are stored with the first byte of every word first, then the second byte of every word and so on
+static void shuffleBytes(const uint8_t* src, uint8_t* dst, uint64_t word_count, uint64_t word_size)
+{
+    for(uint64_t i = 0; i < word_count; i++)
+    {
+        for(uint64_t b = 0; b < word_size; b++)
         {
-            max_dh = dh;
+            dst[b * word_count + i] = src[i * word_size + b];
         }
-        return false;
-    };
+    }
+}
 
-    for(uint32_t patch_z = min_patch_z; patch_z <= max_patch_z; patch_z++)
+static void unshuffleBytes(const uint8_t* src, uint8_t* dst, uint64_t word_count, uint64_t word_size)
+{
+    for(uint64_t i = 0; i < word_count; i++)
     {
-        for(uint32_t patch_x = min_patch_x; patch_x <= max_patch_x; patch_x++)
+        for(uint64_t b = 0; b < word_size; b++)
         {
-            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
-            //TODO: is bounding_ys even worth using here?
-            const vec2& bounding_ys = m_bounding_ys[patch_id];
+            dst[i * word_size + b] = src[b * word_count + i];
+        }
+    }
+}
 
-//            if((bounding_ys[0] >= aabb.min().y) && (bounding_ys[1] <= aabb.max().y))
-            {
-                const uint32_t res_u32 = static_cast<uint32_t>(m_patch_vertices[patch_id].res);
+static constexpr float MAX_QUANTIZED_HEIGHT = 65535.0f;
 
-                const uint32_t min_patch_vx = (patch_x == static_cast<uint32_t>(min_patch_x)) ? static_cast<uint32_t>(m_patch_vertices[patch_id].res * min_vx) : 0;
-                const uint32_t min_patch_vz = (patch_z == static_cast<uint32_t>(min_patch_z)) ? static_cast<uint32_t>(m_patch_vertices[patch_id].res * min_vz) : 0;
-                const uint32_t max_patch_vx = (patch_x == static_cast<uint32_t>(max_patch_x)) ? std::min<uint32_t>(res_u32, static_cast<uint32_t>(m_patch_vertices[patch_id].res * max_vx) + 1) : res_u32;
-                const uint32_t max_patch_vz = (patch_z == static_cast<uint32_t>(max_patch_z)) ? std::min<uint32_t>(res_u32, static_cast<uint32_t>(m_patch_vertices[patch_id].res * max_vz) + 1) : res_u32;
+float Terrain::height(const Tile& tile, uint32_t v)
+{
+    //same as the tessellation evaluation shaders, so collision matches what's drawn
+    return glm::mix(tile.height_range.x, tile.height_range.y, tile.heightmap[v] / MAX_QUANTIZED_HEIGHT);
+}
 
-                /*test the vertices inside the bounding volume*/
-                if((max_patch_vz - min_patch_vz) > 4 && (max_patch_vx - min_patch_vx) > 4)
-                {
-                    for(uint32_t vz = min_patch_vz + 2; vz <= max_patch_vz - 2; vz++)
-                    {
-                        for(uint32_t vx = min_patch_vx + 2; vx <= max_patch_vx - 2; vx++)
-                        {
-                            const float vy = m_vertex_data[m_patch_vertices[patch_id].vertex_offset + vz * (res_u32 + 1) + vx].height;
-                            if(height_cmp(vy)) return CollisionResult::Collision;
-                        }
-                    }
-                }
+static uint16_t quantizeHeight(float height, const vec2& height_range)
+{
+    const float range = height_range.y - height_range.x;
 
-                /*test the outer triangles*/
-                const vec2 aabb_v0(aabb.min().x, aabb.min().z);
-                const vec2 aabb_v1(aabb.min().x, aabb.max().z);
-                const vec2 aabb_v2(aabb.max().x, aabb.max().z);
-                const vec2 aabb_v3(aabb.max().x, aabb.min().z);
+    //flat patches have an empty range, everything maps to its min
+    return (range > 0.0f) ? static_cast<uint16_t>((height - height_range.x) / range * MAX_QUANTIZED_HEIGHT + 0.5f) : 0;
+}
 
-                auto right_tri = [&](const vec3& t0, const vec3& t1, const vec3& t2)
-                {
-                    const float tan_z = (t1.z - t2.z) / (t1.x - t0.x);
-                    const float tan_x = 1.0f / tan_z;
+void Terrain::quantizeHeightmap(Tile& tile, const float* heights)
+{
+    const auto [min_height, max_height] = std::minmax_element(heights, heights + TOTAL_PATCH_VERTEX_COUNT);
+    tile.height_range = vec2(*min_height, *max_height);
 
-                    //top-right vertex
-                    const vec2 v2(std::min<float>(aabb_v2.x, t1.x), std::min<float>(aabb_v2.y, t1.z));
-                    const float h = triHeightAtPoint(t0, t1, t2, v2);
-                    if(height_cmp(h)) return true;
+    for(uint32_t v = 0; v < TOTAL_PATCH_VERTEX_COUNT; v++)
+    {
+        tile.heightmap[v] = quantizeHeight(heights[v], tile.height_range);
+    }
+}
 
-                    //bottom-right vertex
-                    const float z = t2.z + tan_z * (t2.x - v2.x);
+void Terrain::dequantizeHeightmap(const Tile& tile, float* heights)
+{
+    for(uint32_t v = 0; v < TOTAL_PATCH_VERTEX_COUNT; v++)
+    {
+        heights[v] = height(tile, v);
+    }
+}
 
-                    //if vertex outside the triangle, find its intersection point with the triangle
-                    if(aabb_v3.y < z)
-                    {
-                        const vec2 v3(v2.x, z);
-                        const float h = triHeightAtPoint(t0, t1, t2, v3);
-                        if(height_cmp(h)) return true;
-                    }
-                    else
-                    {
-                        //if vertex inside the triangle, take it as it is
-                        const vec2 v3(v2.x, aabb_v3.y);
-                        float h = triHeightAtPoint(t0, t1, t2, v3);
-                        if(height_cmp(h)) return true;
-
-                        //then take the intersection of the triangle diagonal edge with rectangle's v0-v3 edge
-                        const float x = t2.x - tan_x * (v3.y - t2.z);
-                        const vec2 v0(x, v3.y);
-                        h = triHeightAtPoint(t0, t1, t2, v0);
-                        if(height_cmp(h)) return true;
-                    }
+//the height ranges of all the tiles come first, then their splat maps and then their heightmaps,
+//so each part is made of words of the same size and can be shuffled as such
+void Terrain::packChunk(const Tile* tiles, uint32_t tile_count, uint8_t* dst)
+{
+    const uint64_t splat_map_offset = tile_count * sizeof(Tile::height_range);
+    const uint64_t heightmap_offset = splat_map_offset + tile_count * sizeof(Tile::splat_map);
 
-                    //top_left vertex
-                    const float x = t2.x - tan_x * (v2.y - t2.z);
+    std::vector<uint8_t> raw(tile_count * STORED_TILE_SIZE);
 
-                    //if vertex outside the triangle, find its intersection point with the triangle
-                    if(aabb_v1.x < x)
-                    {
-                        const vec2 v1(x, v2.y);
-                        const float h = triHeightAtPoint(t0, t1, t2, v1);
-                        if(height_cmp(h)) return true;
-                    }
-                    else
-                    {
-                        //if vertex inside the triangle, take it as it is
-                        const vec2 v1(aabb_v1.x, v2.y);
-                        float h = triHeightAtPoint(t0, t1, t2, v1);
-                        if(height_cmp(h)) return true;
-
-                        //then take the intersection of the triangle diagonal edge with rectangle's v0-v1 edge
-                        const float z = t2.z + tan_z * (t2.x - v1.x);
-                        const vec2 v0(v1.x, z);
-                        h = triHeightAtPoint(t0, t1, t2, v0);
-                        if(height_cmp(h)) return true;
-                    }
+    for(uint32_t i = 0; i < tile_count; i++)
+    {
+        std::memcpy(raw.data() + i * sizeof(Tile::height_range), &tiles[i].height_range, sizeof(Tile::height_range));
+        std::memcpy(raw.data() + splat_map_offset + i * sizeof(Tile::splat_map), tiles[i].splat_map.data(), sizeof(Tile::splat_map));
+        std::memcpy(raw.data() + heightmap_offset + i * sizeof(Tile::heightmap), tiles[i].heightmap.data(), sizeof(Tile::heightmap));
+    }
 
-                    return false;
-                };
+    shuffleBytes(raw.data(), dst, heightmap_offset / 4, 4);
+    shuffleBytes(raw.data() + heightmap_offset, dst + heightmap_offset, tile_count * TOTAL_PATCH_VERTEX_COUNT, 2);
+}
 
-                auto left_tri = [&](const vec3& t0, const vec3& t1, const vec3& t2)
-                {
-                    const float tan_z = (t0.z - t1.z) / (t2.x - t1.x);
-                    const float tan_x = 1.0f / tan_z;
+void Terrain::unpackChunk(const uint8_t* src, uint32_t tile_count, Tile* tiles)
+{
+    const uint64_t splat_map_offset = tile_count * sizeof(Tile::height_range);
+    const uint64_t heightmap_offset = splat_map_offset + tile_count * sizeof(Tile::splat_map);
+
+    std::vector<uint8_t> raw(tile_count * STORED_TILE_SIZE);
+    unshuffleBytes(src, raw.data(), heightmap_offset / 4, 4);
+    unshuffleBytes(src + heightmap_offset, raw.data() + heightmap_offset, tile_count * TOTAL_PATCH_VERTEX_COUNT, 2);
+
+    for(uint32_t i = 0; i < tile_count; i++)
+    {
+        std::memcpy(&tiles[i].height_range, raw.data() + i * sizeof(Tile::height_range), sizeof(Tile::height_range));
+        std::memcpy(tiles[i].splat_map.data(), raw.data() + splat_map_offset + i * sizeof(Tile::splat_map), sizeof(Tile::splat_map));
+        std::memcpy(tiles[i].heightmap.data(), raw.data() + heightmap_offset + i * sizeof(Tile::heightmap), sizeof(Tile::heightmap));
+    }
+}
 
-                    //bottom-left vertex
-                    const vec2 v0(std::max<float>(aabb_v0.x, t1.x), std::max<float>(aabb_v0.y, t1.z));
-                    const float h = triHeightAtPoint(t0, t1, t2, v0);
-                    if(height_cmp(h)) return true;
+void Terrain::writeFile(const char* filename, float size, uint32_t patch_count, const std::array<uint32_t, TERRAIN_MATERIAL_COUNT>& materials, const ChunkFiller& fill_chunk)
+{
+    //enough chunks to keep all cores busy, only this many of them are ever in memory
+    constexpr uint32_t batch_chunk_count = 256;
 
-                    //top-left vertex
-                    const float z = t1.z + tan_z * (t2.x - v0.x);
+    const uint32_t total_patch_count = patch_count * patch_count;
+    const uint32_t chunk_count = (total_patch_count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
 
-                    //if vertex outside the triangle, find its intersection point with the triangle
-                    if(aabb_v1.y > z)
-                    {
-                        const vec2 v1(v0.x, z);
-                        const float h = triHeightAtPoint(t0, t1, t2, v1);
-                        if(height_cmp(h)) return true;
-                    }
-                    else
-                    {
-                        //if vertex inside the triangle, take it as it is
-                        const vec2 v1(v0.x, aabb_v1.y);
-                        float h = triHeightAtPoint(t0, t1, t2, v1);
-                        if(height_cmp(h)) return true;
-
-                        //then take the intersection of the triangle diagonal edge with rectangle's v0-v1 edge
-                        const float x = t2.x - tan_x * (v1.y - t2.z);
-                        const vec2 v2(x, v1.y);
-                        h = triHeightAtPoint(t0, t1, t2, v2);
-                        if(height_cmp(h)) return true;
-                    }
+    std::vector<ChunkInfo> chunk_infos(chunk_count);
+    std::vector<vec2> bounding_ys(total_patch_count);
+    std::vector<float> shadow_mesh_heights(static_cast<uint64_t>(total_patch_count) * SHADOW_MESH_PATCH_HEIGHT_COUNT);
+    std::vector<std::vector<uint8_t>> chunks(std::min(batch_chunk_count, chunk_count));
 
-                    //bottom_right vertex
-                    const float x = t2.x - tan_x * (v0.y - t2.z);
+    std::ofstream out(filename, std::ios::binary);
 
-                    //if vertex outside the triangle, find its intersection point with the triangle
-                    if(aabb_v3.x > x)
-                    {
-                        const vec2 v3(x, v0.y);
-                        const float h = triHeightAtPoint(t0, t1, t2, v3);
-                        if(height_cmp(h)) return true;
-                    }
-                    else
-                    {
-                        //if vertex inside the triangle, take it as it is
-                        const vec2 v3(aabb_v3.x, v0.y);
-                        float h = triHeightAtPoint(t0, t1, t2, v3);
-                        if(height_cmp(h)) return true;
-
-                        //then take the intersection of the triangle diagonal edge with rectangle's v0-v3 edge
-                        const float z = t2.z + tan_z * (t2.x - v3.x);
-                        const vec2 v2(v3.x, z);
-                        h = triHeightAtPoint(t0, t1, t2, v2);
-                        if(height_cmp(h)) return true;
-                    }
+    const FileHeader header{TERRAIN_FILE_MAGIC, TERRAIN_FILE_VERSION, size, patch_count, materials};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-                    return false;
-                };
+    //the tables are only known once all the chunks are written, they go into the gap left for them at the end
+    const uint64_t tables_size = chunk_infos.size() * sizeof(ChunkInfo) + bounding_ys.size() * sizeof(vec2) + shadow_mesh_heights.size() * sizeof(float);
+    uint64_t chunk_offset = sizeof(FileHeader) + tables_size;
+    out.seekp(chunk_offset);
 
-                /*test triangles*/
-                const float dx = m_patch_size / m_patch_vertices[patch_id].res;
-                const float dz = m_patch_size / m_patch_vertices[patch_id].res;
+    for(uint32_t first_chunk = 0; first_chunk < chunk_count; first_chunk += batch_chunk_count)
+    {
+        const uint32_t chunk_batch_size = std::min(batch_chunk_count, chunk_count - first_chunk);
+        std::vector<std::exception_ptr> exceptions(chunk_batch_size);
 
-                auto test_triangles = [&](float vx, float vz)
-                {
-                    const uint32_t base_vid = m_patch_vertices[patch_id].vertex_offset + vz * (res_u32 + 1) + vx;
-                    const vec3 v0(m_x + m_patch_size * patch_x + dx * vx, m_vertex_data[base_vid].height, m_z + m_patch_size * patch_z + dz * vz);
-                    const vec3 v1(m_x + m_patch_size * patch_x + dx * vx, m_vertex_data[base_vid + res_u32 + 1].height, m_z + m_patch_size * patch_z + dz * (vz + 1));
-                    const vec3 v2(m_x + m_patch_size * patch_x + dx * (vx + 1), m_vertex_data[base_vid + res_u32 + 2].height, m_z + m_patch_size * patch_z + dz * (vz + 1));
-                    const vec3 v3(m_x + m_patch_size * patch_x + dx * (vx + 1), m_vertex_data[base_vid + 1].height, m_z + m_patch_size * patch_z + dz * vz);
-
-                    if(left_tri(v1, v0, v3)) return true;
-                    if(right_tri(v1, v2, v3)) return true;
-                    return false;
-                };
+        parallelFor(chunk_batch_size, [&](uint32_t i)
+        {
+            try
+            {
+                const uint32_t chunk_id = first_chunk + i;
+                const uint32_t first_patch = chunk_id * PATCHES_PER_CHUNK;
+                const uint32_t chunk_patch_count = chunkPatchCount(chunk_id, total_patch_count);
+                const uint64_t raw_size = chunk_patch_count * STORED_TILE_SIZE;
 
-                //bottom row
-                for(uint32_t vx = min_patch_vx; vx < max_patch_vx; vx++)
+                auto tiles = std::make_unique_for_overwrite<Tile[]>(chunk_patch_count);
+
+                if(!fill_chunk(first_patch, chunk_patch_count, tiles.get()))
                 {
-                    if(test_triangles(vx, min_patch_vz)) return CollisionResult::Collision;
+                    error(std::format("Failed to read the terrain to write into {}.", filename));
                 }
 
-                //internal rows
-                for(uint32_t vz = min_patch_vz + 1; vz < max_patch_vz - 1; vz++)
+                for(uint32_t t = 0; t < chunk_patch_count; t++)
                 {
-                    if(test_triangles(min_patch_vx, vz)) return CollisionResult::Collision;
-                    if(test_triangles(max_patch_vx - 1, vz)) return CollisionResult::Collision;
+                    buildHeightPyramid(tiles[t]);
+                    bounding_ys[first_patch + t] = vec2(tiles[t].min_heights[0], tiles[t].max_heights[0]);
+                    sampleShadowMeshHeights(tiles[t], &shadow_mesh_heights[static_cast<uint64_t>(first_patch + t) * SHADOW_MESH_PATCH_HEIGHT_COUNT]);
                 }
 
-                //top row
-                for(uint32_t vx = min_patch_vx; vx < max_patch_vx; vx++)
+                std::vector<uint8_t> shuffled(raw_size);
+                packChunk(tiles.get(), chunk_patch_count, shuffled.data());
+
+                auto& chunk = chunks[i];
+                uLongf compressed_size = compressBound(static_cast<uLong>(raw_size));
+                chunk.resize(compressed_size);
+
+                if(compress2(chunk.data(), &compressed_size, shuffled.data(), static_cast<uLong>(raw_size), Z_DEFAULT_COMPRESSION) != Z_OK)
                 {
-                    if(test_triangles(vx, max_patch_vz - 1)) return CollisionResult::Collision;
+                    error(std::format("Failed to compress terrain file {}.", filename));
                 }
+
+                chunk.resize(compressed_size);
+            }
+            catch(...)
+            {
+                exceptions[i] = std::current_exception();
+            }
+        });
+
+        for(const auto& exception : exceptions)
+        {
+            if(exception)
+            {
+                std::rethrow_exception(exception);
             }
         }
+
+        for(uint32_t i = 0; i < chunk_batch_size; i++)
+        {
+            chunk_infos[first_chunk + i] = {chunk_offset, chunks[i].size()};
+            out.write(reinterpret_cast<const char*>(chunks[i].data()), chunks[i].size());
+            chunk_offset += chunks[i].size();
+        }
     }
 
-    if(max_dh >= -dh_out)
+    out.seekp(sizeof(FileHeader));
+    out.write(reinterpret_cast<const char*>(chunk_infos.data()), chunk_infos.size() * sizeof(ChunkInfo));
+    out.write(reinterpret_cast<const char*>(bounding_ys.data()), bounding_ys.size() * sizeof(vec2));
+    out.write(reinterpret_cast<const char*>(shadow_mesh_heights.data()), shadow_mesh_heights.size() * sizeof(float));
+
+    if(!out)
     {
-        dh_out = max_dh;
-        return CollisionResult::ResolvedCollision;
+        error(std::format("Failed to write terrain file {}.", filename));
     }
-
-    return CollisionResult::Airborne;
-#endif
 }
 
 #if EDITOR_ENABLE
-
-void Terrain::saveToFile()
+static vec4 unpackRGBA8(uint32_t texel)
 {
-    //TODO: add error handling
-    std::ofstream out(TERRAIN_FILENAME, std::ios::binary);
-
-    out.write(reinterpret_cast<const char*>(&m_size), sizeof(m_size));
-    out.write(reinterpret_cast<const char*>(&m_patch_count), sizeof(m_patch_count));
-
-    const uint64_t bounding_ys_count = m_bounding_ys.size();
-    out.write(reinterpret_cast<const char*>(&bounding_ys_count), sizeof(uint64_t));
-    out.write(reinterpret_cast<const char*>(m_bounding_ys.data()), m_bounding_ys.size() * sizeof(vec2));
-    const uint64_t vertex_data_count = m_vertex_data.size();
-    out.write(reinterpret_cast<const char*>(&vertex_data_count), sizeof(uint64_t));
-    out.write(reinterpret_cast<const char*>(m_vertex_data.data()), m_vertex_data.size() * sizeof(VertexData));
-    out.write(reinterpret_cast<const char*>(m_patch_vertices.data()), m_patch_vertices.size() * sizeof(VertexTerrain));
-    out.write(reinterpret_cast<const char*>(m_heightmaps.data()), m_heightmaps.size() * sizeof(m_heightmaps[0]));
+    return vec4(texel & 0xff, (texel >> 8) & 0xff, (texel >> 16) & 0xff, texel >> 24) / 255.0f;
 }
 
-void Terrain::setSize(Renderer& renderer, float size)
+static uint32_t packRGBA8(const vec4& col)
 {
-    m_size = size;
-    m_x = -0.5f * m_size;
-    m_z = -0.5f * m_size;
-    m_patch_size = m_size / static_cast<float>(m_patch_count);
+    const uvec4 texel = uvec4(glm::clamp(col, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return texel.r | (texel.g << 8) | (texel.b << 16) | (texel.a << 24);
+}
 
-    for(uint32_t z = 0; z < m_patch_count; z++)
-    {
-        for(uint32_t x = 0; x < m_patch_count; x++)
-        {
-            const uint32_t patch_id = z * m_patch_count + x;
-            const vec3 pos = vec3(m_x + x * m_patch_size, 0.0f, m_z + z * m_patch_size);
+/*--- generator ---*/
+static constexpr uint32_t GENERATOR_OCTAVE_COUNT = 8;
 
-            m_patch_vertices[patch_id].pos = vec2(pos.x, pos.z);
-        }
-    }
+static uint32_t latticeHash(int32_t x, int32_t z, uint32_t seed)
+{
+    uint32_t h = (static_cast<uint32_t>(x) * 0x8da6b343u) ^ (static_cast<uint32_t>(z) * 0xd8163841u) ^ (seed * 0xcb1ab31fu);
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h;
+}
 
-    renderer.updateVertexData(m_vb_alloc.vb, m_vb_alloc.data_offset, sizeof(VertexTerrain) * m_patch_vertices.size(), m_patch_vertices.data());
+static float latticeValue(int32_t x, int32_t z, uint32_t seed)
+{
+    return static_cast<float>(latticeHash(x, z, seed) >> 8) * (2.0f / 16777216.0f) - 1.0f;
 }
 
-bool Terrain::rayIntersection(const Ray& ray, float& d) const
+//value noise in [-1, 1] with its derivatives in x and z
+static vec3 valueNoise(const vec2& p, uint32_t seed)
 {
-#if 0
-    d = std::numeric_limits<float>::max();
-    bool intersection_found = false;
+    const vec2 cell = glm::floor(p);
+    const ivec2 i(cell);
+    const vec2 f = p - cell;
+    const vec2 u = f * f * f * (f * (f * 6.0f - 15.0f) + 10.0f);
+    const vec2 du = 30.0f * f * f * (f * (f - 2.0f) + 1.0f);
+
+    const float a = latticeValue(i.x, i.y, seed);
+    const float ba = latticeValue(i.x + 1, i.y, seed) - a;
+    const float ca = latticeValue(i.x, i.y + 1, seed) - a;
+    const float k = latticeValue(i.x + 1, i.y + 1, seed) - a - ba - ca;
+
+    return vec3(a + ba * u.x + ca * u.y + k * u.x * u.y, du.x * (ba + k * u.y), du.y * (ca + k * u.x));
+}
 
-    const uint32_t res_u32 = static_cast<uint32_t>(MAX_TESS_LEVEL);
-    const float dx = m_patch_size / MAX_TESS_LEVEL;
-    const float dz = m_patch_size / MAX_TESS_LEVEL;
+//fractal noise with every octave damped by the slope of the ones before it, which keeps the valleys smooth and the ridges sharp a bit like erosion does
+//without having to simulate it over the whole terrain - everything stays a function of the position, so the patches can be generated on their own
+static float erodedFbm(vec2 p, uint32_t seed)
+{
+    float h = 0.0f;
+    float amplitude = 0.5f;
+    vec2 slope(0.0f, 0.0f);
 
-    for(uint32_t patch_z = 0; patch_z < m_patch_count; patch_z++)
+    for(uint32_t i = 0; i < GENERATOR_OCTAVE_COUNT; i++)
     {
-        for(uint32_t patch_x = 0; patch_x < m_patch_count; patch_x++)
-        {
-            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
-            const AABB aabb(vec3(m_x + m_patch_size * patch_x, m_bounding_ys[patch_id][0], m_z + m_patch_size * patch_z), vec3(m_x + m_patch_size * (patch_x + 1.0f), m_bounding_ys[patch_id][1], m_z + m_patch_size * (patch_z + 1.0f)));
+        const vec3 n = valueNoise(p, seed + i);
+        slope += vec2(n.y, n.z);
+        h += amplitude * n.x / (1.0f + glm::dot(slope, slope));
+        amplitude *= 0.5f;
 
-            if(intersect(ray, aabb))
-            {
-                for(uint32_t x = 0; x < static_cast<uint32_t>(m_patch_vertices[patch_id].res); x++)
-                {
-                    for(uint32_t z = 0; z < static_cast<uint32_t>(m_patch_vertices[patch_id].res); z++)
-                    {
-                        const vec3 v0 = vec3(m_x + m_patch_size * patch_x + dx * x,
-                                             m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + z * (res_u32 + 1) + x].height,
-                                             m_z + m_patch_size * patch_z + dz * z);
-                        const vec3 v1 = vec3(m_x + m_patch_size * patch_x + dx * (x + 1),
-                                             m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + z * (res_u32 + 1) + (x + 1)].height,
-                                             m_z + m_patch_size * patch_z + dz * z);
-                        const vec3 v2 = vec3(m_x + m_patch_size * patch_x + dx * x,
-                                             m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + (z + 1) * (res_u32 + 1) + x].height,
-                                             m_z + m_patch_size * patch_z + dz * (z + 1));
-                        const vec3 v3 = vec3(m_x + m_patch_size * patch_x + dx * (x + 1),
-                                             m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + (z + 1) * (res_u32 + 1) + (x + 1)].height,
-                                             m_z + m_patch_size * patch_z + dz * (z + 1));
-
-                        float temp_d;
-
-                        if(intersect(ray, v0, v1, v2, temp_d))
-                        {
-                            if(temp_d < d)
-                            {
-                                d = temp_d;
-                            }
+        //twice the frequency and rotated, so the lattices of the octaves don't line up
+        p = vec2(1.6f * p.x - 1.2f * p.y, 1.2f * p.x + 1.6f * p.y);
+    }
 
-                            intersection_found = true;
-                        }
+    return h;
+}
 
-                        if(intersect(ray, v1, v2, v3, temp_d))
-                        {
-                            if(temp_d < d)
-                            {
-                                d = temp_d;
-                            }
+#ifdef __SSE2__
+//SSE2 has no 32 bit multiply that keeps the low halves, it's put together from two 64 bit ones
+static __m128i mulLo32(__m128i a, __m128i b)
+{
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
 
-                            intersection_found = true;
-                        }
-                    }
-                }
-            }
-        }
-    }
+static __m128 latticeValue4(__m128i x, __m128i z, uint32_t seed)
+{
+    __m128i h = _mm_xor_si128(_mm_xor_si128(mulLo32(x, _mm_set1_epi32(static_cast<int32_t>(0x8da6b343u))), mulLo32(z, _mm_set1_epi32(static_cast<int32_t>(0xd8163841u)))),
+                              _mm_set1_epi32(static_cast<int32_t>(seed * 0xcb1ab31fu)));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+    h = mulLo32(h, _mm_set1_epi32(0x5bd1e995));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
 
-    return intersection_found;
-#endif
+    return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 8)), _mm_set1_ps(2.0f / 16777216.0f)), _mm_set1_ps(1.0f));
 }
 
-void Terrain::toolEdit(Renderer& renderer, const vec3& center, float radius, float dh)
+//same as valueNoise for 4 points at once
+static void valueNoise4(__m128 px, __m128 pz, uint32_t seed, __m128& n, __m128& dx, __m128& dz)
 {
-#if 0
-    const float min_x_coord = std::max<float>((center.x - radius - m_x) / m_patch_size, 0);
-    const float max_x_coord = std::min<float>((center.x + radius - m_x) / m_patch_size, m_patch_count);
-    const float min_z_coord = std::max<float>((center.z - radius - m_z) / m_patch_size, 0);
-    const float max_z_coord = std::min<float>((center.z + radius - m_z) / m_patch_size, m_patch_count);
+    //the conversion truncates towards 0, the negative ones with a fraction are one too high
+    __m128i ix = _mm_cvttps_epi32(px);
+    __m128i iz = _mm_cvttps_epi32(pz);
+    ix = _mm_add_epi32(ix, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(ix), px)));
+    iz = _mm_add_epi32(iz, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(iz), pz)));
 
-    const uint32_t min_patch_x = min_x_coord;
-    const uint32_t max_patch_x = std::min<uint32_t>(max_x_coord, m_patch_count - 1);
-    const uint32_t min_patch_z = min_z_coord;
-    const uint32_t max_patch_z = std::min<uint32_t>(max_z_coord, m_patch_count - 1);;
+    const __m128 fx = _mm_sub_ps(px, _mm_cvtepi32_ps(ix));
+    const __m128 fz = _mm_sub_ps(pz, _mm_cvtepi32_ps(iz));
 
-    const float min_vx = min_x_coord - static_cast<float>(min_patch_x);
+    auto fade = [](__m128 f)
+    {
+        return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(f, f), f), _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f)));
+    };
+
+    auto fadeDerivative = [](__m128 f)
+    {
+        return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(30.0f), _mm_mul_ps(f, f)), _mm_add_ps(_mm_mul_ps(f, _mm_sub_ps(f, _mm_set1_ps(2.0f))), _mm_set1_ps(1.0f)));
+    };
+
+    const __m128 ux = fade(fx);
+    const __m128 uz = fade(fz);
+    const __m128 dux = fadeDerivative(fx);
+    const __m128 duz = fadeDerivative(fz);
+
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128 a = latticeValue4(ix, iz, seed);
+    const __m128 ba = _mm_sub_ps(latticeValue4(_mm_add_epi32(ix, one), iz, seed), a);
+    const __m128 ca = _mm_sub_ps(latticeValue4(ix, _mm_add_epi32(iz, one), seed), a);
+    const __m128 k = _mm_sub_ps(_mm_sub_ps(_mm_sub_ps(latticeValue4(_mm_add_epi32(ix, one), _mm_add_epi32(iz, one), seed), a), ba), ca);
+
+    n = _mm_add_ps(_mm_add_ps(_mm_add_ps(a, _mm_mul_ps(ba, ux)), _mm_mul_ps(ca, uz)), _mm_mul_ps(_mm_mul_ps(k, ux), uz));
+    dx = _mm_mul_ps(dux, _mm_add_ps(ba, _mm_mul_ps(k, uz)));
+    dz = _mm_mul_ps(duz, _mm_add_ps(ca, _mm_mul_ps(k, ux)));
+}
+
+//same as erodedFbm for 4 points at once
+static __m128 erodedFbm4(__m128 px, __m128 pz, uint32_t seed)
+{
+    __m128 h = _mm_setzero_ps();
+    __m128 slope_x = _mm_setzero_ps();
+    __m128 slope_z = _mm_setzero_ps();
+    float amplitude = 0.5f;
+
+    for(uint32_t i = 0; i < GENERATOR_OCTAVE_COUNT; i++)
+    {
+        __m128 n, dx, dz;
+        valueNoise4(px, pz, seed + i, n, dx, dz);
+
+        slope_x = _mm_add_ps(slope_x, dx);
+        slope_z = _mm_add_ps(slope_z, dz);
+        const __m128 damping = _mm_add_ps(_mm_set1_ps(1.0f), _mm_add_ps(_mm_mul_ps(slope_x, slope_x), _mm_mul_ps(slope_z, slope_z)));
+        h = _mm_add_ps(h, _mm_div_ps(_mm_mul_ps(_mm_set1_ps(amplitude), n), damping));
+        amplitude *= 0.5f;
+
+        const __m128 next_px = _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(1.6f), px), _mm_mul_ps(_mm_set1_ps(1.2f), pz));
+        pz = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(1.2f), px), _mm_mul_ps(_mm_set1_ps(1.6f), pz));
+        px = next_px;
+    }
+
+    return h;
+}
+#endif
+
+void Terrain::generateTile(Tile& tile, const uvec2& patch, float vertex_spacing, float wavelength, float max_height, uint32_t seed)
+{
+    constexpr uint32_t row_size = PATCH_CELL_COUNT + 1;
+    //the heights of the patch and a ring of vertices around it, so the slopes on its edges come out the same as in its neighbours
+    constexpr uint32_t padded_row_size = row_size + 2;
+    constexpr uint32_t padded_vertex_count = padded_row_size * padded_row_size;
+
+    std::array<float, roundUp(padded_vertex_count, 4u)> padded_heights;
+    const ivec2 first_vertex = ivec2(patch * PATCH_CELL_COUNT) - 1;
+    //positions are taken from integer vertex coordinates, a vertex shared by two patches gets exactly the same height in both
+    const float scale = vertex_spacing / wavelength;
+
+#ifdef __SSE2__
+    for(uint32_t v = 0; v < padded_vertex_count; v += 4)
+    {
+        alignas(16) std::array<int32_t, 4> xs;
+        alignas(16) std::array<int32_t, 4> zs;
+
+        for(uint32_t i = 0; i < 4; i++)
+        {
+            xs[i] = first_vertex.x + static_cast<int32_t>((v + i) % padded_row_size);
+            zs[i] = first_vertex.y + static_cast<int32_t>((v + i) / padded_row_size);
+        }
+
+        const __m128 px = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(xs.data()))), _mm_set1_ps(scale));
+        const __m128 pz = _mm_mul_ps(_mm_cvtepi32_ps(_mm_load_si128(reinterpret_cast<const __m128i*>(zs.data()))), _mm_set1_ps(scale));
+
+        _mm_storeu_ps(&padded_heights[v], _mm_mul_ps(erodedFbm4(px, pz, seed), _mm_set1_ps(max_height)));
+    }
+#else
+    for(uint32_t v = 0; v < padded_vertex_count; v++)
+    {
+        const ivec2 vertex = first_vertex + ivec2(v % padded_row_size, v / padded_row_size);
+        padded_heights[v] = erodedFbm(vec2(vertex) * scale, seed) * max_height;
+    }
+#endif
+
+    std::array<float, TOTAL_PATCH_VERTEX_COUNT> heights;
+
+    for(uint32_t z = 0; z < row_size; z++)
+    {
+        std::memcpy(&heights[z * row_size], &padded_heights[(z + 1) * padded_row_size + 1], row_size * sizeof(float));
+    }
+
+    quantizeHeightmap(tile, heights.data());
+
+    //flat ground on the first material, slopes on the second and the peaks on the third
+    for(uint32_t z = 0; z < TERRAIN_SPLAT_MAP_RES; z++)
+    {
+        for(uint32_t x = 0; x < TERRAIN_SPLAT_MAP_RES; x++)
+        {
+            const uint32_t v = (2 * z + 1) * padded_row_size + 2 * x + 1;
+            const vec2 gradient(padded_heights[v + 1] - padded_heights[v - 1], padded_heights[v + padded_row_size] - padded_heights[v - padded_row_size]);
+            const float slope = glm::length(gradient) / (2.0f * vertex_spacing);
+
+            const float steep = glm::smoothstep(0.5f, 1.0f, slope);
+            const float peak = (1.0f - steep) * glm::smoothstep(0.35f, 0.6f, padded_heights[v] / max_height);
+
+            tile.splat_map[z * TERRAIN_SPLAT_MAP_RES + x] = packRGBA8(vec4(1.0f - steep - peak, steep, peak, 0.0f));
+        }
+    }
+}
+
+void Terrain::generate(Renderer& renderer, uint32_t patch_count, float size, uint32_t seed)
+{
+    //brush results still in flight belong to the old tiles
+    finishEdits(renderer);
+
+    const float vertex_spacing = size / static_cast<float>(patch_count) / static_cast<float>(PATCH_CELL_COUNT);
+    const float wavelength = std::min(0.5f * size, GENERATOR_MAX_WAVELENGTH);
+    const float max_height = GENERATOR_HEIGHT_RATIO * wavelength;
+
+    //the tiles are generated chunk by chunk on all cores right into the file layout, the whole terrain is never in memory at once
+    writeFile(TERRAIN_TEMP_FILENAME, size, patch_count, m_materials, [&](uint32_t first_patch, uint32_t chunk_patch_count, Tile* tiles)
+    {
+        for(uint32_t i = 0; i < chunk_patch_count; i++)
+        {
+            const uint32_t patch_id = first_patch + i;
+            generateTile(tiles[i], uvec2(patch_id % patch_count, patch_id / patch_count), vertex_spacing, wavelength, max_height, seed);
+        }
+
+        return true;
+    });
+
+    unmapFile();
+    std::filesystem::rename(TERRAIN_TEMP_FILENAME, TERRAIN_FILENAME);
+
+    //baked from the old splat maps
+    m_virtual_texture.close(renderer);
+    std::filesystem::remove(VIRTUAL_TEXTURE_FILENAME);
+
+    m_shadow_mesh_dirty_patches.clear();
+    loadFromFile(renderer);
+}
+
+void Terrain::createNew()
+{
+    //flat and covered with the first material only
+    writeFile(TERRAIN_TEMP_FILENAME, DEFAULT_SIZE, DEFAULT_PATCH_COUNT, {}, [](uint32_t, uint32_t chunk_patch_count, Tile* tiles)
+    {
+        for(uint32_t i = 0; i < chunk_patch_count; i++)
+        {
+            tiles[i].height_range = vec2(0.0f, 0.0f);
+            tiles[i].heightmap.fill(0);
+            tiles[i].splat_map.fill(0xff);
+        }
+
+        return true;
+    });
+
+    //written to a temporary file first like every other terrain file, so a failed write doesn't leave a broken terrain behind
+    std::filesystem::rename(TERRAIN_TEMP_FILENAME, TERRAIN_FILENAME);
+}
+#endif
+
+//rewrites an older terrain file in the current format:
+//version 0 is the layout from before the tiles were introduced, which stored all the vertex data first and all the heightmaps after it
+//versions 1 and 2 stored the bounding ys and then one uncompressed, page aligned tile per patch, version 1 had no height pyramids in the tiles
+//version 3 had the same chunks as now, but with the heightmap of each patch stored in front of its vertex data and without height ranges
+//versions 0 to 3 stored the heights as floats
+//version 4 had the chunks of today, but with a texture id per heightmap vertex in place of the splat maps and no materials in the header
+//version 5 had no tables, the bounding ys were rebuilt from the decompressed tiles on load
+void Terrain::convertFile(uint32_t version) const
+{
+    std::println("Converting terrain file {} from version {} to {}...", TERRAIN_FILENAME, version, TERRAIN_FILE_VERSION);
+
+    //the old file is mapped, so the chunks of the new one can be read out of it on all cores a few at a time
+    MappedFile in;
+    in.open(TERRAIN_FILENAME);
+
+    auto read = [&in](uint64_t offset, void* dst, uint64_t size)
+    {
+        if(offset + size > in.size())
+        {
+            return false;
+        }
+
+        std::memcpy(dst, in.data() + offset, size);
+        return true;
+    };
+
+    //the header of every version before the materials were added
+    struct OldFileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        float size;
+        uint32_t patch_count;
+    };
+
+    constexpr uint64_t old_heightmap_size = TOTAL_PATCH_VERTEX_COUNT * sizeof(float);
+    //all of the versions before 5 had a 4 byte texture id per heightmap vertex, they're turned into splat maps when the chunks are written
+    constexpr uint64_t old_vertex_data_size = TOTAL_PATCH_VERTEX_COUNT * sizeof(uint32_t);
+
+    float size = 0.0f;
+    uint32_t patch_count = 0;
+    std::array<uint32_t, TERRAIN_MATERIAL_COUNT> materials = {};
+    //where the heightmap and the vertex data of the first patch are and how far apart they are for consecutive patches, for versions 0 to 2
+    uint64_t heightmap_offset = 0;
+    uint64_t heightmap_stride = 0;
+    uint64_t vertex_data_offset = 0;
+    uint64_t vertex_data_stride = 0;
+    //where the chunk table is, for versions 3 to 5
+    uint64_t chunk_table_offset = 0;
+
+    if(0 == version)
+    {
+        uint64_t bounding_ys_count = 0;
+        uint64_t vertex_data_count = 0;
+
+        const bool header_read = read(0, &size, sizeof(size)) && read(sizeof(size), &patch_count, sizeof(patch_count)) &&
+                                 read(sizeof(size) + sizeof(patch_count), &bounding_ys_count, sizeof(uint64_t));
+        const uint64_t vertex_data_count_offset = sizeof(size) + sizeof(patch_count) + sizeof(uint64_t) + bounding_ys_count * sizeof(vec2);
+        const uint64_t total_patch_count = static_cast<uint64_t>(patch_count) * patch_count;
+
+        if(!header_read || !read(vertex_data_count_offset, &vertex_data_count, sizeof(uint64_t)) || (bounding_ys_count != total_patch_count) ||
+           (vertex_data_count != total_patch_count * TOTAL_PATCH_VERTEX_COUNT))
+        {
+            error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+        }
+
+        //the patch vertices are skipped, their heightmap ids always matched the patch ids and the positions follow from the grid
+        //back then a patch vertex was just the position and the heightmap id
+        const uint64_t old_patch_vertex_size = sizeof(vec2) + sizeof(uint32_t);
+
+        vertex_data_offset = vertex_data_count_offset + sizeof(uint64_t);
+        vertex_data_stride = old_vertex_data_size;
+        heightmap_offset = vertex_data_offset + vertex_data_count * sizeof(uint32_t) + total_patch_count * old_patch_vertex_size;
+        heightmap_stride = old_heightmap_size;
+    }
+    else if(version < 5)
+    {
+        OldFileHeader old_header;
+
+        if(!read(0, &old_header, sizeof(old_header)))
+        {
+            error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+        }
+
+        size = old_header.size;
+        patch_count = old_header.patch_count;
+
+        if(version < 3)
+        {
+            const uint64_t bounding_ys_size = static_cast<uint64_t>(patch_count) * patch_count * sizeof(vec2);
+            const uint64_t height_pyramids_size = sizeof(Tile::min_heights) + sizeof(Tile::max_heights);
+            const uint64_t old_tile_size = old_heightmap_size + old_vertex_data_size + ((1 == version) ? 0 : height_pyramids_size);
+
+            //the tiles were aligned to 4KB pages whatever the page size of the system that wrote them
+            constexpr uint64_t old_tile_alignment = 4096;
+
+            heightmap_offset = roundUp<uint64_t>(sizeof(OldFileHeader) + bounding_ys_size, old_tile_alignment);
+            heightmap_stride = roundUp<uint64_t>(old_tile_size, old_tile_alignment);
+            vertex_data_offset = heightmap_offset + old_heightmap_size;
+            vertex_data_stride = heightmap_stride;
+        }
+        else
+        {
+            chunk_table_offset = sizeof(OldFileHeader);
+        }
+    }
+    else
+    {
+        FileHeader header;
+
+        if(!read(0, &header, sizeof(header)))
+        {
+            error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+        }
+
+        size = header.size;
+        patch_count = header.patch_count;
+        materials = header.materials;
+        chunk_table_offset = sizeof(FileHeader);
+    }
+
+    const uint32_t total_patch_count = patch_count * patch_count;
+
+    //the heights and texture ids of the given patches for versions 0 to 4, or just the stored part of their tiles for version 5
+    auto readChunk = [&](uint32_t first_patch, uint32_t chunk_patch_count, Tile* tiles, uint32_t* tex_ids)
+    {
+        std::array<float, TOTAL_PATCH_VERTEX_COUNT> heights;
+
+        if(version < 3)
+        {
+            for(uint32_t i = 0; i < chunk_patch_count; i++)
+            {
+                const uint64_t patch_id = first_patch + i;
+
+                if(!read(heightmap_offset + patch_id * heightmap_stride, heights.data(), old_heightmap_size) ||
+                   !read(vertex_data_offset + patch_id * vertex_data_stride, tex_ids + i * TOTAL_PATCH_VERTEX_COUNT, old_vertex_data_size))
+                {
+                    return false;
+                }
+
+                quantizeHeightmap(tiles[i], heights.data());
+            }
+
+            return true;
+        }
+
+        const uint32_t chunk_id = first_patch / PATCHES_PER_CHUNK;
+        const uint64_t old_tile_size = (3 == version) ? (old_heightmap_size + old_vertex_data_size)
+                                     : (4 == version) ? (sizeof(Tile::height_range) + old_vertex_data_size + sizeof(Tile::heightmap)) : STORED_TILE_SIZE;
+        const uint64_t raw_size = chunk_patch_count * old_tile_size;
+
+        ChunkInfo chunk;
+
+        if(!read(chunk_table_offset + chunk_id * sizeof(ChunkInfo), &chunk, sizeof(chunk)) || (chunk.offset + chunk.compressed_size > in.size()))
+        {
+            return false;
+        }
+
+        std::vector<uint8_t> shuffled(raw_size);
+        uLongf uncompressed_size = static_cast<uLongf>(raw_size);
+
+        if((uncompress(shuffled.data(), &uncompressed_size, in.data() + chunk.offset, static_cast<uLong>(chunk.compressed_size)) != Z_OK) || (uncompressed_size != raw_size))
+        {
+            return false;
+        }
+
+        if(5 == version)
+        {
+            unpackChunk(shuffled.data(), chunk_patch_count, tiles);
+            return true;
+        }
+
+        std::vector<uint8_t> raw(raw_size);
+
+        if(3 == version)
+        {
+            //version 3 shuffled the whole chunk as 4 byte words
+            unshuffleBytes(shuffled.data(), raw.data(), raw_size / 4, 4);
+
+            for(uint32_t i = 0; i < chunk_patch_count; i++)
+            {
+                std::memcpy(heights.data(), raw.data() + i * old_tile_size, old_heightmap_size);
+                quantizeHeightmap(tiles[i], heights.data());
+                std::memcpy(tex_ids + i * TOTAL_PATCH_VERTEX_COUNT, raw.data() + i * old_tile_size + old_heightmap_size, old_vertex_data_size);
+            }
+        }
+        else
+        {
+            //version 4 was laid out and shuffled like packChunk, with the texture ids in place of the splat maps
+            const uint64_t chunk_vertex_data_offset = chunk_patch_count * sizeof(Tile::height_range);
+            const uint64_t chunk_heightmap_offset = chunk_vertex_data_offset + chunk_patch_count * old_vertex_data_size;
+
+            unshuffleBytes(shuffled.data(), raw.data(), chunk_heightmap_offset / 4, 4);
+            unshuffleBytes(shuffled.data() + chunk_heightmap_offset, raw.data() + chunk_heightmap_offset, chunk_patch_count * TOTAL_PATCH_VERTEX_COUNT, 2);
+
+            for(uint32_t i = 0; i < chunk_patch_count; i++)
+            {
+                std::memcpy(&tiles[i].height_range, raw.data() + i * sizeof(Tile::height_range), sizeof(Tile::height_range));
+                std::memcpy(tex_ids + i * TOTAL_PATCH_VERTEX_COUNT, raw.data() + chunk_vertex_data_offset + i * old_vertex_data_size, old_vertex_data_size);
+                std::memcpy(tiles[i].heightmap.data(), raw.data() + chunk_heightmap_offset + i * sizeof(Tile::heightmap), sizeof(Tile::heightmap));
+            }
+        }
+
+        return true;
+    };
+
+    //every splat map texel takes the texture of the heightmap vertex it sits on
+    auto splatTexId = [](const uint32_t* patch_tex_ids, uint32_t texel)
+    {
+        return patch_tex_ids[2 * (texel / TERRAIN_SPLAT_MAP_RES) * (PATCH_CELL_COUNT + 1) + 2 * (texel % TERRAIN_SPLAT_MAP_RES)];
+    };
+
+    uint32_t material_count = TERRAIN_MATERIAL_COUNT;
+
+    //the first TERRAIN_MATERIAL_COUNT distinct texture ids become the materials, so they're gathered in a pass over the chunks in order
+    //before any of them is written, any further ids are folded into the last material
+    if(version < 5)
+    {
+        const uint32_t chunk_count = (total_patch_count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
+        auto tiles = std::make_unique_for_overwrite<Tile[]>(PATCHES_PER_CHUNK);
+        std::vector<uint32_t> tex_ids(PATCHES_PER_CHUNK * TOTAL_PATCH_VERTEX_COUNT);
+
+        material_count = 0;
+
+        for(uint32_t chunk_id = 0; chunk_id < chunk_count; chunk_id++)
+        {
+            const uint32_t chunk_patch_count = chunkPatchCount(chunk_id, total_patch_count);
+
+            if(!readChunk(chunk_id * PATCHES_PER_CHUNK, chunk_patch_count, tiles.get(), tex_ids.data()))
+            {
+                error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+            }
+
+            for(uint32_t i = 0; (i < chunk_patch_count) && (material_count < TERRAIN_MATERIAL_COUNT); i++)
+            {
+                for(uint32_t texel = 0; (texel < SPLAT_MAP_TEXEL_COUNT) && (material_count < TERRAIN_MATERIAL_COUNT); texel++)
+                {
+                    const uint32_t tex_id = splatTexId(tex_ids.data() + i * TOTAL_PATCH_VERTEX_COUNT, texel);
+
+                    if(std::find(materials.begin(), materials.begin() + material_count, tex_id) == materials.begin() + material_count)
+                    {
+                        materials[material_count++] = tex_id;
+                    }
+                }
+            }
+        }
+    }
+
+    writeFile(TERRAIN_TEMP_FILENAME, size, patch_count, materials, [&](uint32_t first_patch, uint32_t chunk_patch_count, Tile* tiles)
+    {
+        if(5 == version)
+        {
+            return readChunk(first_patch, chunk_patch_count, tiles, nullptr);
+        }
+
+        std::vector<uint32_t> tex_ids(chunk_patch_count * TOTAL_PATCH_VERTEX_COUNT);
+
+        if(!readChunk(first_patch, chunk_patch_count, tiles, tex_ids.data()))
+        {
+            return false;
+        }
+
+        //at full weight
+        for(uint32_t i = 0; i < chunk_patch_count; i++)
+        {
+            for(uint32_t texel = 0; texel < SPLAT_MAP_TEXEL_COUNT; texel++)
+            {
+                const uint32_t tex_id = splatTexId(tex_ids.data() + i * TOTAL_PATCH_VERTEX_COUNT, texel);
+                const auto material = std::find(materials.begin(), materials.begin() + material_count, tex_id);
+                const uint32_t material_id = std::min<uint32_t>(static_cast<uint32_t>(std::distance(materials.begin(), material)), TERRAIN_MATERIAL_COUNT - 1);
+
+                tiles[i].splat_map[texel] = 0xffu << (8 * material_id);
+            }
+        }
+
+        return true;
+    });
+
+    in.close();
+    std::filesystem::rename(TERRAIN_TEMP_FILENAME, TERRAIN_FILENAME);
+}
+
+void Terrain::mapFile()
+{
+    m_file.open(TERRAIN_FILENAME);
+
+    const auto* header = reinterpret_cast<const FileHeader*>(m_file.data());
+
+    if((m_file.size() < sizeof(FileHeader)) || (header->magic != TERRAIN_FILE_MAGIC))
+    {
+        error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+    }
+
+    if(header->version != TERRAIN_FILE_VERSION)
+    {
+        error(std::format("Unsupported terrain file version {}.", header->version));
+    }
+
+    const uint64_t total_patch_count = static_cast<uint64_t>(header->patch_count) * header->patch_count;
+    const uint64_t chunk_count = (total_patch_count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
+    const uint64_t shadow_mesh_heights_offset = sizeof(FileHeader) + chunk_count * sizeof(ChunkInfo) + total_patch_count * sizeof(vec2);
+
+    if(m_file.size() < shadow_mesh_heights_offset + total_patch_count * SHADOW_MESH_PATCH_HEIGHT_COUNT * sizeof(float))
+    {
+        error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+    }
+
+    m_chunk_infos = reinterpret_cast<const ChunkInfo*>(m_file.data() + sizeof(FileHeader));
+    m_file_shadow_mesh_heights = reinterpret_cast<const float*>(m_file.data() + shadow_mesh_heights_offset);
+
+    //checked once here, so decompressing a chunk never reads past the end of the file
+    for(uint64_t chunk_id = 0; chunk_id < chunk_count; chunk_id++)
+    {
+        if(m_chunk_infos[chunk_id].offset + m_chunk_infos[chunk_id].compressed_size > m_file.size())
+        {
+            error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+        }
+    }
+}
+
+void Terrain::unmapFile()
+{
+    stopPageInThread();
+
+    m_file.close();
+    m_chunk_infos = nullptr;
+    m_file_shadow_mesh_heights = nullptr;
+}
+
+void Terrain::loadFromFile(Renderer& renderer)
+{
+    unmapFile();
+
+    m_file.open(TERRAIN_FILENAME);
+
+    const auto* header = reinterpret_cast<const FileHeader*>(m_file.data());
+    const bool versioned = (m_file.size() >= sizeof(FileHeader)) && (header->magic == TERRAIN_FILE_MAGIC);
+
+    if(!versioned || (header->version < TERRAIN_FILE_VERSION))
+    {
+        const uint32_t version = versioned ? header->version : 0;
+
+        m_file.close();
+        convertFile(version);
+    }
+
+    //only the header and the tables are read, the chunks are decompressed out of the mapped file once their tiles are needed
+    mapFile();
+    header = reinterpret_cast<const FileHeader*>(m_file.data());
+
+    m_size = header->size;
+    m_patch_count = header->patch_count;
+    m_materials = header->materials;
+    renderer.setTerrainMaterials(m_materials);
+
+    calcXYFromSize();
+    m_patch_size = m_size / static_cast<float>(m_patch_count);
+
+    const uint32_t total_patch_count = m_patch_count * m_patch_count;
+    const uint32_t chunk_count = (total_patch_count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
+
+    //the bounding ys table follows the chunk table
+    const auto* bounding_ys = reinterpret_cast<const vec2*>(m_chunk_infos + chunk_count);
+    m_bounding_ys.assign(bounding_ys, bounding_ys + total_patch_count);
+
+    //the tiles of a terrain loaded before are dropped with any edits that weren't saved
+    m_chunk_slots.clear();
+    m_chunk_slot_ids.assign(chunk_count, SLOT_NONE);
+
+    buildQuadtree();
+
+    //the slots of a terrain loaded before don't carry over to this one
+    m_patch_slots.assign(total_patch_count, SLOT_NONE);
+    m_slots.clear();
+
+    //the vertex buffer only holds the patches selected for drawing, it grows in draw() when more are needed
+    //a terrain loaded again after being generated still has the allocation of the old one
+    if(m_vb_alloc.vb != nullptr)
+    {
+        renderer.freeVertexBufferAllocation(m_vb_alloc);
+    }
+
+    m_vb_alloc_vertex_count = std::bit_ceil(std::min<uint32_t>(total_patch_count, DEFAULT_HEIGHTMAP_BUDGET));
+    m_vb_alloc = renderer.reqVBAlloc<VertexTerrain>(m_vb_alloc_vertex_count);
+
+    setHeightmapBudget(renderer, DEFAULT_HEIGHTMAP_BUDGET);
+    buildShadowMesh(renderer);
+    openVirtualTexture(renderer);
+
+    startPageInThread();
+}
+
+float Terrain::patchDistance(uint32_t patch_id, const vec3& pos) const
+{
+    const vec2 patch_min(m_x + (patch_id % m_patch_count) * m_patch_size, m_z + (patch_id / m_patch_count) * m_patch_size);
+    const vec2 closest_point = glm::clamp(vec2(pos.x, pos.z), patch_min, patch_min + m_patch_size);
+
+    return glm::distance(vec2(pos.x, pos.z), closest_point);
+}
+
+void Terrain::updateStreaming(Renderer& renderer)
+{
+    const vec3& pos = renderer.cameraView().pos;
+
+    trimChunkCache();
+
+    //the chunks the page-in thread has decompressed since the last frame, unless the main thread has needed one of them sooner
+    {
+        std::lock_guard lock(m_page_in_mutex);
+
+        for(auto& [chunk_id, tiles] : m_paged_in_chunks)
+        {
+            if(!tiles)
+            {
+                error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+            }
+
+            if(SLOT_NONE == m_chunk_slot_ids[chunk_id])
+            {
+                cacheChunk(chunk_id, std::move(tiles));
+            }
+        }
+
+        m_paged_in_chunks.clear();
+    }
+
+    //gather the patches within the streaming radius, the nearest ones get uploaded first
+    //and anything beyond the budget is left out since it wouldn't fit on the GPU anyway
+    const float min_x_coord = std::max<float>((pos.x - m_streaming_radius - m_x) / m_patch_size, 0);
+    const float max_x_coord = std::min<float>((pos.x + m_streaming_radius - m_x) / m_patch_size, m_patch_count - 1);
+    const float min_z_coord = std::max<float>((pos.z - m_streaming_radius - m_z) / m_patch_size, 0);
+    const float max_z_coord = std::min<float>((pos.z + m_streaming_radius - m_z) / m_patch_size, m_patch_count - 1);
+
+    m_streaming_candidates.clear();
+
+    for(int32_t patch_z = static_cast<int32_t>(min_z_coord); patch_z <= static_cast<int32_t>(max_z_coord); patch_z++)
+    {
+        for(int32_t patch_x = static_cast<int32_t>(min_x_coord); patch_x <= static_cast<int32_t>(max_x_coord); patch_x++)
+        {
+            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
+            const float d = patchDistance(patch_id, pos);
+
+            if(d <= m_streaming_radius)
+            {
+                m_streaming_candidates.emplace_back(d, patch_id);
+            }
+        }
+    }
+
+    const size_t candidate_count = std::min(m_streaming_candidates.size(), m_slots.size());
+    std::ranges::partial_sort(m_streaming_candidates, m_streaming_candidates.begin() + candidate_count);
+    m_streaming_candidates.resize(candidate_count);
+
+    //upload the candidates that aren't resident yet, a slot can only be reused if it wasn't drawn this frame
+    uint32_t upload_count = 0;
+
+    for(const auto& [d, patch_id] : m_streaming_candidates)
+    {
+        if(upload_count == MAX_TERRAIN_HEIGHTMAP_UPLOADS_PER_FRAME)
+        {
+            break;
+        }
+
+        //the patches whose chunks aren't cached yet are uploaded once the page-in thread has decompressed them
+        if((m_patch_slots[patch_id] != SLOT_NONE) || (SLOT_NONE == m_chunk_slot_ids[patch_id / PATCHES_PER_CHUNK]))
+        {
+            continue;
+        }
+
+        uint32_t slot = SLOT_NONE;
+
+        if(!m_free_slots.empty())
+        {
+            slot = m_free_slots.back();
+            m_free_slots.pop_back();
+        }
+        else
+        {
+            //slots with brush results still in flight can't be evicted, the readback has to find the same patch in them
+            auto lru_slot = std::ranges::min_element(m_slots, {}, [](const HeightmapSlot& slot)
+            {
+                return (slot.pending_readbacks > 0) ? std::numeric_limits<uint64_t>::max() : slot.last_used_frame;
+            });
+
+            if((lru_slot->last_used_frame == m_frame) || (lru_slot->pending_readbacks > 0))
+            {
+                break;
+            }
+
+            slot = static_cast<uint32_t>(std::distance(m_slots.begin(), lru_slot));
+
+            m_patch_slots[lru_slot->patch_id] = SLOT_NONE;
+        }
+
+        const Tile& patch_tile = tile(patch_id);
+
+        m_slots[slot].patch_id = patch_id;
+        m_slots[slot].last_used_frame = m_frame;
+        m_slots[slot].height_range = patch_tile.height_range;
+        m_patch_slots[patch_id] = slot;
+
+        renderer.updateTerrainHeightmap(slot, patch_tile.heightmap.data(), patch_tile.height_range);
+        renderer.updateTerrainSplatMap(slot, patch_tile.splat_map.data());
+
+        upload_count++;
+    }
+
+    //a chunk the camera has moved away from is dropped from the requests before it's decompressed
+    {
+        std::lock_guard lock(m_page_in_mutex);
+        m_page_in_reqs.clear();
+
+        for(const auto& [d, patch_id] : m_streaming_candidates)
+        {
+            const uint32_t chunk_id = patch_id / PATCHES_PER_CHUNK;
+
+            if(m_page_in_reqs.size() == MAX_PAGE_IN_REQS)
+            {
+                break;
+            }
+
+            if((SLOT_NONE == m_patch_slots[patch_id]) && (SLOT_NONE == m_chunk_slot_ids[chunk_id]) && (std::ranges::find(m_page_in_reqs, chunk_id) == m_page_in_reqs.end()))
+            {
+                m_page_in_reqs.push_back(chunk_id);
+            }
+        }
+    }
+
+    m_page_in_cv.notify_one();
+}
+
+void Terrain::setStreamingRadius(float radius)
+{
+    m_streaming_radius = radius;
+}
+
+float Terrain::streamingRadius() const noexcept
+{
+    return m_streaming_radius;
+}
+
+void Terrain::setHeightmapBudget(Renderer& renderer, uint32_t slot_count)
+{
+#if EDITOR_ENABLE
+    //the heightmap image is recreated, so brush results still in flight have to land in the tiles first
+    finishEdits(renderer);
+#endif
+
+    slot_count = std::max<uint32_t>(slot_count, 1);
+
+    //the most recently used patches that still fit stay resident, packed into the first slots of the new image
+    std::vector<uint32_t> kept_slots;
+
+    for(uint32_t slot = 0; slot < m_slots.size(); slot++)
+    {
+        if(m_slots[slot].patch_id != PATCH_ID_NONE)
+        {
+            kept_slots.push_back(slot);
+        }
+    }
+
+    if(kept_slots.size() > slot_count)
+    {
+        std::ranges::nth_element(kept_slots, kept_slots.begin() + slot_count, std::ranges::greater(), [this](uint32_t slot)
+        {
+            return m_slots[slot].last_used_frame;
+        });
+
+        for(auto it = kept_slots.begin() + slot_count; it != kept_slots.end(); it++)
+        {
+            m_patch_slots[m_slots[*it].patch_id] = SLOT_NONE;
+        }
+
+        kept_slots.resize(slot_count);
+    }
+
+    std::vector<HeightmapSlot> slots(slot_count);
+
+    for(uint32_t slot = 0; slot < kept_slots.size(); slot++)
+    {
+        slots[slot] = m_slots[kept_slots[slot]];
+        m_patch_slots[slots[slot].patch_id] = slot;
+    }
+
+    m_slots = std::move(slots);
+    m_free_slots.clear();
+
+    //handed out from the back, so the first slot after the kept ones goes first
+    for(uint32_t slot = slot_count; slot-- > kept_slots.size();)
+    {
+        m_free_slots.push_back(slot);
+    }
+
+    renderer.reqTerrainHeightmapSlots(slot_count, kept_slots);
+}
+
+uint32_t Terrain::heightmapBudget() const noexcept
+{
+    return static_cast<uint32_t>(m_slots.size());
+}
+
+void Terrain::buildQuadtree()
+{
+    m_quadtree.clear();
+    m_quadtree.emplace_back();
+
+    uint32_t leaf_count = 0;
+    buildQuadtreeNode(0, 0, 0, std::bit_ceil(m_patch_count), leaf_count);
+}
+
+void Terrain::buildQuadtreeNode(uint32_t node_id, uint32_t patch_x, uint32_t patch_z, uint32_t patch_span, uint32_t& leaf_count)
+{
+    //the patch count doesn't have to be a power of 2, so the nodes on the far edges get clipped to the grid
+    const uint32_t max_patch_x = std::min(patch_x + patch_span, m_patch_count);
+    const uint32_t max_patch_z = std::min(patch_z + patch_span, m_patch_count);
+    const uint32_t first_leaf = leaf_count;
+
+    vec2 bounding_ys;
+
+    if(patch_span == 1)
+    {
+        bounding_ys = m_bounding_ys[patch_z * m_patch_count + patch_x];
+        leaf_count++;
+    }
+    else
+    {
+        const uint32_t child_span = patch_span / 2;
+        const uint32_t first_child = static_cast<uint32_t>(m_quadtree.size());
+        std::array<uvec2, 4> child_patches;
+        uint32_t child_count = 0;
+
+        for(uint32_t i = 0; i < 4; i++)
+        {
+            const uvec2 child_patch(patch_x + (i % 2) * child_span, patch_z + (i / 2) * child_span);
+
+            if((child_patch.x < m_patch_count) && (child_patch.y < m_patch_count))
+            {
+                child_patches[child_count++] = child_patch;
+            }
+        }
+
+        //all children are added before recursing so they end up next to each other
+        m_quadtree.resize(m_quadtree.size() + child_count);
+
+        bounding_ys = vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+
+        for(uint32_t i = 0; i < child_count; i++)
+        {
+            buildQuadtreeNode(first_child + i, child_patches[i].x, child_patches[i].y, child_span, leaf_count);
+
+            const AABB& child_aabb = m_quadtree[first_child + i].aabb;
+            bounding_ys[0] = std::min(bounding_ys[0], child_aabb.min().y);
+            bounding_ys[1] = std::max(bounding_ys[1], child_aabb.max().y);
+        }
+
+        m_quadtree[node_id].first_child = first_child;
+        m_quadtree[node_id].child_count = child_count;
+    }
+
+    auto& node = m_quadtree[node_id];
+    node.patch_x = patch_x;
+    node.patch_z = patch_z;
+    node.patch_span = patch_span;
+    node.first_leaf = first_leaf;
+    node.leaf_count = leaf_count - first_leaf;
+    node.aabb = AABB(vec3(m_x + patch_x * m_patch_size, bounding_ys[0], m_z + patch_z * m_patch_size),
+                     vec3(m_x + max_patch_x * m_patch_size, bounding_ys[1], m_z + max_patch_z * m_patch_size));
+}
+
+void Terrain::updateQuadtreeNode(uint32_t node_id, const uvec2& min_patch, const uvec2& max_patch)
+{
+    auto& node = m_quadtree[node_id];
+
+    if((node.patch_x > max_patch.x) || (node.patch_z > max_patch.y) ||
+       (node.patch_x + node.patch_span <= min_patch.x) || (node.patch_z + node.patch_span <= min_patch.y))
+    {
+        return;
+    }
+
+    vec2 bounding_ys;
+
+    if(node.patch_span == 1)
+    {
+        bounding_ys = m_bounding_ys[node.patch_z * m_patch_count + node.patch_x];
+    }
+    else
+    {
+        bounding_ys = vec2(std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest());
+
+        for(uint32_t i = 0; i < node.child_count; i++)
+        {
+            updateQuadtreeNode(node.first_child + i, min_patch, max_patch);
+
+            const AABB& child_aabb = m_quadtree[node.first_child + i].aabb;
+            bounding_ys[0] = std::min(bounding_ys[0], child_aabb.min().y);
+            bounding_ys[1] = std::max(bounding_ys[1], child_aabb.max().y);
+        }
+    }
+
+    //m_quadtree doesn't grow here, so the reference is still valid after recursing
+    node.aabb = AABB(vec3(node.aabb.min().x, bounding_ys[0], node.aabb.min().z), vec3(node.aabb.max().x, bounding_ys[1], node.aabb.max().z));
+}
+
+void Terrain::selectPatches(const RenderView& view)
+{
+    const uint32_t first_vertex = static_cast<uint32_t>(m_draw_vertices.size());
+
+    selectQuadtreeNode(0, view, false);
+
+    const uint32_t vertex_count = static_cast<uint32_t>(m_draw_vertices.size()) - first_vertex;
+
+    if(vertex_count != 0)
+    {
+        m_draw_ranges.emplace_back(view.id, first_vertex, vertex_count);
+    }
+}
+
+void Terrain::selectQuadtreeNode(uint32_t node_id, const RenderView& view, bool inside)
+{
+    const auto& node = m_quadtree[node_id];
+
+    //once a node is inside a frustum all of its children are too, so they don't need to be tested
+    if(!inside)
+    {
+        bool visible = false;
+
+        for(uint32_t i = 0; (i < view.frustum_count) && !inside; i++)
+        {
+            bool inside_frustum;
+
+            if(node.aabb.intersect(view.frusta[i], inside_frustum))
+            {
+                visible = true;
+                inside = inside_frustum;
+            }
+        }
+
+        if(!visible)
+        {
+            return;
+        }
+    }
+
+    bool select = inside || (node.child_count == 0);
+
+    //a node that only covers a few pixels isn't worth culling any finer, all of its patches are selected
+    //and the tessellation shaders bring them down to their lowest level of detail anyway
+    if(!select && (view.pixels_per_unit > 0.0f))
+    {
+        const vec3 closest_point = glm::clamp(view.pos, node.aabb.min(), node.aabb.max());
+        const float d = glm::distance(view.pos, closest_point);
+
+        select = (node.patch_span * m_patch_size * view.pixels_per_unit) < (MIN_CULLED_NODE_PIXELS * d);
+    }
+
+    if(!select)
+    {
+        for(uint32_t i = 0; i < node.child_count; i++)
+        {
+            selectQuadtreeNode(node.first_child + i, view, inside);
+        }
+
+        return;
+    }
+
+    const uint32_t max_patch_x = std::min(node.patch_x + node.patch_span, m_patch_count);
+    const uint32_t max_patch_z = std::min(node.patch_z + node.patch_span, m_patch_count);
+
+    for(uint32_t patch_z = node.patch_z; patch_z < max_patch_z; patch_z++)
+    {
+        for(uint32_t patch_x = node.patch_x; patch_x < max_patch_x; patch_x++)
+        {
+            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
+            const uint32_t slot = m_patch_slots[patch_id];
+
+            //patches that aren't resident yet are skipped until their heightmap is streamed in
+            if(slot != SLOT_NONE)
+            {
+                m_draw_vertices.emplace_back(vec2(m_x + patch_x * m_patch_size, m_z + patch_z * m_patch_size), slot, m_slots[slot].height_range);
+                m_slots[slot].last_used_frame = m_frame;
+            }
+        }
+    }
+}
+
+std::vector<Terrain::CullingBenchmarkResult> Terrain::benchmarkCulling(const Renderer& renderer)
+{
+    constexpr uint32_t iteration_count = 100;
+
+    const RenderView& view = renderer.cameraView();
+    const vec2 height_range(m_quadtree[0].aabb.min().y, m_quadtree[0].aabb.max().y);
+
+    //the page-in thread decompresses the chunks of the real terrain, it's paused while the patch count is changed
+    stopPageInThread();
+
+    //the benchmark terrains take the place of the grid and the quadtree for a moment, every patch is made resident in slot 0 so it gets selected
+    const float x = m_x;
+    const float z = m_z;
+    const uint32_t patch_count = m_patch_count;
+    std::vector<vec2> bounding_ys = std::move(m_bounding_ys);
+    std::vector<QuadtreeNode> quadtree = std::move(m_quadtree);
+    std::vector<uint32_t> patch_slots = std::move(m_patch_slots);
+    const std::vector<HeightmapSlot> slots = m_slots;
+
+    std::vector<CullingBenchmarkResult> results;
+
+    for(uint32_t benchmark_patch_count = 4; benchmark_patch_count <= 256; benchmark_patch_count *= 2)
+    {
+        const uint32_t total_patch_count = benchmark_patch_count * benchmark_patch_count;
+
+        m_patch_count = benchmark_patch_count;
+        m_x = -0.5f * m_patch_size * benchmark_patch_count;
+        m_z = m_x;
+        m_bounding_ys.assign(total_patch_count, height_range);
+        m_patch_slots.assign(total_patch_count, 0);
+        buildQuadtree();
+
+        CullingBenchmarkResult result{};
+        result.patch_count = benchmark_patch_count;
+        result.quadtree_node_count = static_cast<uint32_t>(m_quadtree.size());
+
+        const auto quadtree_start = std::chrono::steady_clock::now();
+
+        for(uint32_t i = 0; i < iteration_count; i++)
+        {
+            m_draw_vertices.clear();
+            m_draw_ranges.clear();
+            selectPatches(view);
+        }
+
+        const auto per_patch_start = std::chrono::steady_clock::now();
+        result.selected_patch_count = static_cast<uint32_t>(m_draw_vertices.size());
+
+        for(uint32_t i = 0; i < iteration_count; i++)
+        {
+            result.visible_patch_count = 0;
+
+            for(uint32_t patch_id = 0; patch_id < total_patch_count; patch_id++)
+            {
+                const vec3 patch_min(m_x + (patch_id % m_patch_count) * m_patch_size, height_range.x, m_z + (patch_id / m_patch_count) * m_patch_size);
+                const AABB aabb(patch_min, vec3(patch_min.x + m_patch_size, height_range.y, patch_min.z + m_patch_size));
+
+                for(uint32_t f = 0; f < view.frustum_count; f++)
+                {
+                    bool inside;
+
+                    if(aabb.intersect(view.frusta[f], inside))
+                    {
+                        result.visible_patch_count++;
+                        break;
+                    }
+                }
+            }
+        }
+
+        const auto end = std::chrono::steady_clock::now();
+
+        result.quadtree_ms = std::chrono::duration<double, std::milli>(per_patch_start - quadtree_start).count() / iteration_count;
+        result.per_patch_ms = std::chrono::duration<double, std::milli>(end - per_patch_start).count() / iteration_count;
+        results.push_back(result);
+    }
+
+    m_x = x;
+    m_z = z;
+    m_patch_count = patch_count;
+    m_bounding_ys = std::move(bounding_ys);
+    m_quadtree = std::move(quadtree);
+    m_patch_slots = std::move(patch_slots);
+    m_slots = slots;
+    m_draw_vertices.clear();
+    m_draw_ranges.clear();
+
+    startPageInThread();
+
+    return results;
+}
+
+uint32_t Terrain::virtualTexturePageCount() const noexcept
+{
+    return std::bit_ceil(m_patch_count * TERRAIN_VT_PAGES_PER_PATCH);
+}
+
+void Terrain::updateVirtualTextureArea(Renderer& renderer) const
+{
+    renderer.setTerrainVirtualTextureArea(vec2(m_x, m_z), m_patch_size * static_cast<float>(virtualTexturePageCount() / TERRAIN_VT_PAGES_PER_PATCH));
+}
+
+void Terrain::openVirtualTexture(Renderer& renderer)
+{
+    if(m_virtual_texture.open(renderer, VIRTUAL_TEXTURE_FILENAME, virtualTexturePageCount()))
+    {
+        updateVirtualTextureArea(renderer);
+        return;
+    }
+
+#if EDITOR_ENABLE
+    if(virtualTexturePageCount() <= MAX_AUTO_BAKED_VT_PAGE_COUNT)
+    {
+        std::println("Terrain virtual texture file {} is missing or out of date. Baking it...", VIRTUAL_TEXTURE_FILENAME);
+        bakeVirtualTexture(renderer);
+        return;
+    }
+#endif
+
+    std::println("Failed to open terrain virtual texture file {}. Terrain materials are blended per pixel.", VIRTUAL_TEXTURE_FILENAME);
+}
+
+uint32_t Terrain::residentVirtualTexturePages() const noexcept
+{
+    return m_virtual_texture.residentPageCount();
+}
+
+void Terrain::sampleShadowMeshHeights(const Tile& tile, float* heights)
+{
+    constexpr uint32_t row_size = PATCH_CELL_COUNT + 1;
+    //heightmap vertices per shadow mesh cell
+    constexpr uint32_t step = PATCH_CELL_COUNT / SHADOW_MESH_CELL_COUNT;
+
+    for(uint32_t z = 0; z <= SHADOW_MESH_CELL_COUNT; z++)
+    {
+        for(uint32_t x = 0; x <= SHADOW_MESH_CELL_COUNT; x++)
+        {
+            heights[z * (SHADOW_MESH_CELL_COUNT + 1) + x] = height(tile, (z * row_size + x) * step);
+        }
+    }
+}
+
+void Terrain::buildShadowMesh(Renderer& renderer)
+{
+    const uint32_t total_patch_count = m_patch_count * m_patch_count;
+
+    //the leaves are single patches
+    m_shadow_mesh_patch_leaves.resize(total_patch_count);
+
+    for(const auto& node : m_quadtree)
+    {
+        if(0 == node.child_count)
+        {
+            m_shadow_mesh_patch_leaves[node.patch_z * m_patch_count + node.patch_x] = node.first_leaf;
+        }
+    }
+
+    ShadowMeshUpload& upload = m_shadow_mesh_uploads.emplace_back(m_frame);
+    upload.vertices.resize(static_cast<uint64_t>(total_patch_count) * SHADOW_MESH_PATCH_VERTEX_COUNT);
+
+    auto patchVertices = [&](uint32_t patch_id)
+    {
+        return &upload.vertices[static_cast<uint64_t>(m_shadow_mesh_patch_leaves[patch_id]) * SHADOW_MESH_PATCH_VERTEX_COUNT];
+    };
+
+    //built from the heights stored in the file, so none of the tiles have to be decompressed for it
+    parallelFor(total_patch_count, [&](uint32_t patch_id)
+    {
+        buildShadowMeshPatch(patch_id, &m_file_shadow_mesh_heights[static_cast<uint64_t>(patch_id) * SHADOW_MESH_PATCH_HEIGHT_COUNT], patchVertices(patch_id));
+    });
+
+#if EDITOR_ENABLE
+    //the edits that haven't been saved yet are only in the cached tiles
+    for(const ChunkSlot& chunk_slot : m_chunk_slots)
+    {
+        if(!chunk_slot.dirty)
+        {
+            continue;
+        }
+
+        for(uint32_t i = 0; i < chunkPatchCount(chunk_slot.chunk_id, total_patch_count); i++)
+        {
+            const uint32_t patch_id = chunk_slot.chunk_id * PATCHES_PER_CHUNK + i;
+
+            std::array<float, SHADOW_MESH_PATCH_HEIGHT_COUNT> heights;
+            sampleShadowMeshHeights(chunk_slot.tiles[i], heights.data());
+            buildShadowMeshPatch(patch_id, heights.data(), patchVertices(patch_id));
+        }
+    }
+#endif
+
+    if(m_shadow_mesh_vb_alloc.vb != nullptr)
+    {
+        renderer.freeVertexBufferAllocation(m_shadow_mesh_vb_alloc);
+    }
+
+    m_shadow_mesh_vb_alloc = renderer.reqVBAlloc<VertexTerrainShadowMesh>(static_cast<uint32_t>(upload.vertices.size()));
+    renderer.updateVertexData(m_shadow_mesh_vb_alloc.vb, m_shadow_mesh_vb_alloc.data_offset, sizeof(VertexTerrainShadowMesh) * upload.vertices.size(), upload.vertices.data());
+
+    //the same for every terrain, each draw points the vertex offset at the first patch of its range
+    if(nullptr == m_shadow_mesh_ib_alloc.ib)
+    {
+        upload.indices.reserve(SHADOW_MESH_DRAW_PATCH_COUNT * SHADOW_MESH_PATCH_INDEX_COUNT);
+
+        for(uint32_t patch = 0; patch < SHADOW_MESH_DRAW_PATCH_COUNT; patch++)
+        {
+            auto vertex = [patch](uint32_t x, uint32_t z)
+            {
+                return static_cast<uint16_t>(patch * SHADOW_MESH_PATCH_VERTEX_COUNT + z * (SHADOW_MESH_CELL_COUNT + 1) + x);
+            };
+
+            for(uint32_t z = 0; z < SHADOW_MESH_CELL_COUNT; z++)
+            {
+                for(uint32_t x = 0; x < SHADOW_MESH_CELL_COUNT; x++)
+                {
+                    upload.indices.insert(upload.indices.end(), {vertex(x, z), vertex(x, z + 1), vertex(x + 1, z),
+                                                                 vertex(x + 1, z), vertex(x, z + 1), vertex(x + 1, z + 1)});
+                }
+            }
+        }
+
+        m_shadow_mesh_ib_alloc = renderer.reqIBAlloc<uint16_t>(static_cast<uint32_t>(upload.indices.size()));
+        renderer.updateIndexData(m_shadow_mesh_ib_alloc.ib, m_shadow_mesh_ib_alloc.data_offset, sizeof(uint16_t) * upload.indices.size(), upload.indices.data());
+    }
+}
+
+void Terrain::buildShadowMeshPatch(uint32_t patch_id, const float* heights, VertexTerrainShadowMesh* dst) const
+{
+    const vec2 patch_origin(m_x + (patch_id % m_patch_count) * m_patch_size, m_z + (patch_id / m_patch_count) * m_patch_size);
+    const float cell_size = m_patch_size / SHADOW_MESH_CELL_COUNT;
+
+    for(uint32_t z = 0; z <= SHADOW_MESH_CELL_COUNT; z++)
+    {
+        for(uint32_t x = 0; x <= SHADOW_MESH_CELL_COUNT; x++)
+        {
+            *dst++ = VertexTerrainShadowMesh{vec3(patch_origin.x + x * cell_size, heights[z * (SHADOW_MESH_CELL_COUNT + 1) + x], patch_origin.y + z * cell_size)};
+        }
+    }
+}
+
+void Terrain::selectShadowMeshNode(uint32_t node_id, const RenderView& view, uint32_t first_frustum, bool inside)
+{
+    const auto& node = m_quadtree[node_id];
+
+    //same as selectQuadtreeNode, but only with the far cascades and down to single patches
+    if(!inside)
+    {
+        bool visible = false;
+
+        for(uint32_t i = first_frustum; (i < view.frustum_count) && !inside; i++)
+        {
+            bool inside_frustum;
+
+            if(node.aabb.intersect(view.frusta[i], inside_frustum))
+            {
+                visible = true;
+                inside = inside_frustum;
+            }
+        }
+
+        if(!visible)
+        {
+            return;
+        }
+    }
+
+    if(!inside && (node.child_count != 0))
+    {
+        for(uint32_t i = 0; i < node.child_count; i++)
+        {
+            selectShadowMeshNode(node.first_child + i, view, first_frustum, inside);
+        }
+
+        return;
+    }
+
+    //the nodes are visited in leaf order, so a node right after the previous one just extends its range
+    if(!m_shadow_mesh_draw_ranges.empty() && (m_shadow_mesh_draw_ranges.back().x + m_shadow_mesh_draw_ranges.back().y == node.first_leaf))
+    {
+        m_shadow_mesh_draw_ranges.back().y += node.leaf_count;
+    }
+    else
+    {
+        m_shadow_mesh_draw_ranges.emplace_back(node.first_leaf, node.leaf_count);
+    }
+}
+
+void Terrain::draw(Renderer& renderer)
+{
+    m_frame++;
+    m_draw_vertices.clear();
+    m_draw_ranges.clear();
+
+    //handed over before the last draw, so the renderer has copied them by now
+    std::erase_if(m_shadow_mesh_uploads, [this](const ShadowMeshUpload& upload){ return upload.frame + 2 <= m_frame; });
+
+#if EDITOR_ENABLE
+    //picked up before selecting the patches so they're culled with the bounds of the edited heights
+    applyHeightmapReadbacks(renderer);
+#endif
+
+#if EDITOR_ENABLE
+    if(!m_shadow_mesh_dirty_patches.empty())
+    {
+        std::ranges::sort(m_shadow_mesh_dirty_patches);
+        const auto duplicates = std::ranges::unique(m_shadow_mesh_dirty_patches);
+        m_shadow_mesh_dirty_patches.erase(duplicates.begin(), duplicates.end());
+
+        ShadowMeshUpload& upload = m_shadow_mesh_uploads.emplace_back(m_frame);
+        upload.vertices.resize(m_shadow_mesh_dirty_patches.size() * SHADOW_MESH_PATCH_VERTEX_COUNT);
+
+        for(uint32_t i = 0; i < m_shadow_mesh_dirty_patches.size(); i++)
+        {
+            const uint32_t patch_id = m_shadow_mesh_dirty_patches[i];
+            VertexTerrainShadowMesh* vertices = &upload.vertices[i * SHADOW_MESH_PATCH_VERTEX_COUNT];
+
+            std::array<float, SHADOW_MESH_PATCH_HEIGHT_COUNT> heights;
+            sampleShadowMeshHeights(tile(patch_id), heights.data());
+            buildShadowMeshPatch(patch_id, heights.data(), vertices);
+
+            const uint64_t first_vertex = static_cast<uint64_t>(m_shadow_mesh_patch_leaves[patch_id]) * SHADOW_MESH_PATCH_VERTEX_COUNT;
+            renderer.updateVertexData(m_shadow_mesh_vb_alloc.vb, m_shadow_mesh_vb_alloc.data_offset + first_vertex * sizeof(VertexTerrainShadowMesh),
+                                      SHADOW_MESH_PATCH_VERTEX_COUNT * sizeof(VertexTerrainShadowMesh), vertices);
+        }
+
+        m_shadow_mesh_dirty_patches.clear();
+    }
+#endif
+
+    //the camera and every shadow map get their own list of patches that's only drawn in their pass
+    selectPatches(renderer.cameraView());
+
+    const uint32_t shadow_mesh_cascade = renderer.terrainShadowMeshCascade();
+
+    for(const auto& view : renderer.shadowViews())
+    {
+        const bool dir_shadow_map = (view.id < RENDER_VIEW_POINT_SHADOW_MAP);
+
+        if(!dir_shadow_map || (view.frustum_count <= shadow_mesh_cascade))
+        {
+            selectPatches(view);
+            continue;
+        }
+
+        //the far cascades draw the shadow mesh, so the patches only have to be selected for the near ones
+        RenderView near_view = view;
+        near_view.frustum_count = shadow_mesh_cascade;
+        selectPatches(near_view);
+
+        //the parts of the shadow mesh in any of the far cascades are drawn into all of them
+        m_shadow_mesh_draw_ranges.clear();
+        selectShadowMeshNode(0, view, shadow_mesh_cascade, false);
+
+        for(const uvec2& range : m_shadow_mesh_draw_ranges)
+        {
+            for(uint32_t first_patch = range.x; first_patch < range.x + range.y; first_patch += SHADOW_MESH_DRAW_PATCH_COUNT)
+            {
+                const uint32_t patch_count = std::min(SHADOW_MESH_DRAW_PATCH_COUNT, range.x + range.y - first_patch);
+
+                renderer.drawIndexed(RenderMode::TerrainDirShadowMapMesh, m_shadow_mesh_vb_alloc.vb, m_shadow_mesh_vb_alloc.vertex_offset + first_patch * SHADOW_MESH_PATCH_VERTEX_COUNT,
+                                     m_shadow_mesh_ib_alloc.ib, m_shadow_mesh_ib_alloc.first_index, patch_count * SHADOW_MESH_PATCH_INDEX_COUNT, 0, view.id);
+            }
+        }
+    }
+
+    //done after selecting the patches so the slots drawn this frame don't get evicted
+    updateStreaming(renderer);
+    m_virtual_texture.update(renderer);
+
+    if(m_draw_vertices.empty())
+    {
+        return;
+    }
+
+    if(m_draw_vertices.size() > m_vb_alloc_vertex_count)
+    {
+        renderer.freeVertexBufferAllocation(m_vb_alloc);
+
+        m_vb_alloc_vertex_count = std::bit_ceil(static_cast<uint32_t>(m_draw_vertices.size()));
+        m_vb_alloc = renderer.reqVBAlloc<VertexTerrain>(m_vb_alloc_vertex_count);
+    }
+
+    renderer.updateVertexData(m_vb_alloc.vb, m_vb_alloc.data_offset, sizeof(VertexTerrain) * m_draw_vertices.size(), m_draw_vertices.data());
+
+    for(const auto& range : m_draw_ranges)
+    {
+        renderer.draw(m_render_mode, m_vb_alloc.vb, m_vb_alloc.vertex_offset + range.first_vertex, range.vertex_count, 0, range.view);
+    }
+}
+
+float Terrain::size() const
+{
+    return m_size;
+}
+
+float Terrain::patchSize() const
+{
+    return m_patch_size;
+}
+
+//interleaves the bits of x and z, with x going into the lower bits
+static uint32_t mortonEncode(uint32_t x, uint32_t z)
+{
+    auto spread = [](uint32_t v)
+    {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+
+    return spread(x) | (spread(z) << 1);
+}
+
+void Terrain::buildHeightPyramid(Tile& tile)
+{
+    updateHeightPyramid(tile, uvec2(0, 0), uvec2(PATCH_CELL_COUNT - 1, PATCH_CELL_COUNT - 1));
+}
+
+void Terrain::updateHeightPyramid(Tile& tile, const uvec2& min_cell, const uvec2& max_cell)
+{
+    constexpr uint32_t leaf_level = HEIGHT_PYRAMID_LEVEL_COUNT - 1;
+    constexpr uint32_t row_size = PATCH_CELL_COUNT + 1;
+
+    for(uint32_t z = min_cell.y; z <= max_cell.y; z++)
+    {
+        for(uint32_t x = min_cell.x; x <= max_cell.x; x++)
+        {
+            const uint32_t v = z * row_size + x;
+            const auto corners = {height(tile, v), height(tile, v + 1), height(tile, v + row_size), height(tile, v + row_size + 1)};
+            const uint32_t node_id = heightPyramidLevelOffset(leaf_level) + mortonEncode(x, z);
+
+            tile.min_heights[node_id] = std::min(corners);
+            tile.max_heights[node_id] = std::max(corners);
+        }
+    }
+
+    //every level up only the parents of the cells changed on the level below need to be recalculated
+    uvec2 level_min = min_cell;
+    uvec2 level_max = max_cell;
+
+    for(uint32_t level = leaf_level; level > 0; level--)
+    {
+        const uint32_t first_node = heightPyramidLevelOffset(level - 1);
+        const uint32_t first_child = heightPyramidLevelOffset(level);
+
+        level_min /= 2u;
+        level_max /= 2u;
+
+        for(uint32_t z = level_min.y; z <= level_max.y; z++)
+        {
+            for(uint32_t x = level_min.x; x <= level_max.x; x++)
+            {
+                const uint32_t node = mortonEncode(x, z);
+                const uint32_t child = first_child + 4 * node;
+
+                tile.min_heights[first_node + node] = std::min({tile.min_heights[child], tile.min_heights[child + 1], tile.min_heights[child + 2], tile.min_heights[child + 3]});
+                tile.max_heights[first_node + node] = std::max({tile.max_heights[child], tile.max_heights[child + 1], tile.max_heights[child + 2], tile.max_heights[child + 3]});
+            }
+        }
+    }
+}
+
+//classifies the 4 children of a height pyramid node against a rectangle of cells all at once, returns the highest max height
+//of the children completely inside the rectangle and sets a bit in partial_mask for every child that only partially overlaps it
+static float childrenMaxHeight(const uvec2& node_min, uint32_t child_span, const uvec2& min_cell, const uvec2& max_cell, const float* max_heights, uint32_t& partial_mask)
+{
+#ifdef __SSE2__
+    const __m128i child_min_x = _mm_add_epi32(_mm_set1_epi32(node_min.x), _mm_setr_epi32(0, child_span, 0, child_span));
+    const __m128i child_min_z = _mm_add_epi32(_mm_set1_epi32(node_min.y), _mm_setr_epi32(0, 0, child_span, child_span));
+    const __m128i child_max_x = _mm_add_epi32(child_min_x, _mm_set1_epi32(child_span - 1));
+    const __m128i child_max_z = _mm_add_epi32(child_min_z, _mm_set1_epi32(child_span - 1));
+    const __m128i min_x = _mm_set1_epi32(min_cell.x);
+    const __m128i min_z = _mm_set1_epi32(min_cell.y);
+    const __m128i max_x = _mm_set1_epi32(max_cell.x);
+    const __m128i max_z = _mm_set1_epi32(max_cell.y);
+
+    const __m128i outside = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(child_min_x, max_x), _mm_cmpgt_epi32(min_x, child_max_x)),
+                                         _mm_or_si128(_mm_cmpgt_epi32(child_min_z, max_z), _mm_cmpgt_epi32(min_z, child_max_z)));
+    const __m128i not_inside = _mm_or_si128(_mm_or_si128(_mm_cmpgt_epi32(min_x, child_min_x), _mm_cmpgt_epi32(child_max_x, max_x)),
+                                            _mm_or_si128(_mm_cmpgt_epi32(min_z, child_min_z), _mm_cmpgt_epi32(child_max_z, max_z)));
+    const __m128 inside = _mm_castsi128_ps(_mm_andnot_si128(not_inside, _mm_set1_epi32(-1)));
+
+    partial_mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_andnot_si128(outside, not_inside)));
+
+    __m128 h = _mm_or_ps(_mm_and_ps(inside, _mm_loadu_ps(max_heights)), _mm_andnot_ps(inside, _mm_set1_ps(std::numeric_limits<float>::lowest())));
+    h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(2, 3, 0, 1)));
+    h = _mm_max_ps(h, _mm_shuffle_ps(h, h, _MM_SHUFFLE(1, 0, 3, 2)));
+
+    return _mm_cvtss_f32(h);
+#else
+    float max_h = std::numeric_limits<float>::lowest();
+    partial_mask = 0;
+
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        const uvec2 child_min = node_min + uvec2(i & 1, i >> 1) * child_span;
+        const uvec2 child_max = child_min + (child_span - 1);
+
+        if(glm::all(glm::greaterThanEqual(child_min, min_cell)) && glm::all(glm::lessThanEqual(child_max, max_cell)))
+        {
+            max_h = std::max(max_h, max_heights[i]);
+        }
+        else if(glm::all(glm::lessThanEqual(child_min, max_cell)) && glm::all(glm::greaterThanEqual(child_max, min_cell)))
+        {
+            partial_mask |= 1u << i;
+        }
+    }
+
+    return max_h;
+#endif
+}
+
+//highest point of the cells of a patch within the given rectangle, stops as soon as it finds one above the limit
+float Terrain::maxHeight(uint32_t patch_id, const uvec2& min_cell, const uvec2& max_cell, float limit) const
+{
+    const Tile& patch_tile = tile(patch_id);
+
+    if((0 == min_cell.x) && (0 == min_cell.y) && (PATCH_CELL_COUNT - 1 == max_cell.x) && (PATCH_CELL_COUNT - 1 == max_cell.y))
+    {
+        return patch_tile.max_heights[0];
+    }
+
+    struct Node
+    {
+        uint32_t level;
+        uint32_t id;
+        uvec2 pos;
+    };
+
+    //every step pops one node and pushes at most 4, so the stack never gets deeper than this
+    std::array<Node, 4 * HEIGHT_PYRAMID_LEVEL_COUNT> stack;
+    uint32_t stack_size = 0;
+    stack[stack_size++] = {0, 0, uvec2(0, 0)};
+
+    float max_h = std::numeric_limits<float>::lowest();
+
+    while(stack_size > 0)
+    {
+        const Node node = stack[--stack_size];
+
+        //nothing under a node lower than what we already have can change the result
+        if(patch_tile.max_heights[heightPyramidLevelOffset(node.level) + node.id] <= max_h)
+        {
+            continue;
+        }
+
+        const uint32_t child_span = PATCH_CELL_COUNT >> (node.level + 1);
+        const uint32_t first_child = 4 * node.id;
+        const float* child_max_heights = &patch_tile.max_heights[heightPyramidLevelOffset(node.level + 1) + first_child];
+        uint32_t partial_mask;
+
+        max_h = std::max(max_h, childrenMaxHeight(node.pos * (2 * child_span), child_span, min_cell, max_cell, child_max_heights, partial_mask));
+
+        if(max_h > limit)
+        {
+            return max_h;
+        }
+
+        for(uint32_t i = 0; i < 4; i++)
+        {
+            if((partial_mask & (1u << i)) && (child_max_heights[i] > max_h))
+            {
+                stack[stack_size++] = {node.level + 1, first_child + i, node.pos * 2u + uvec2(i & 1, i >> 1)};
+            }
+        }
+    }
+
+    return max_h;
+}
+
+float Terrain::collision(const AABB& aabb, const float max_dh) const
+{
+    const float min_x_coord = std::max<float>((aabb.min().x - m_x) / m_patch_size, 0);
+    const float max_x_coord = std::min<float>((aabb.max().x - m_x) / m_patch_size, m_patch_count);
+    const float min_z_coord = std::max<float>((aabb.min().z - m_z) / m_patch_size, 0);
+    const float max_z_coord = std::min<float>((aabb.max().z - m_z) / m_patch_size, m_patch_count);
+
+    if((max_x_coord < min_x_coord) || (max_z_coord < min_z_coord))
+    {
+        return std::numeric_limits<float>::lowest();
+    }
+
+    const uint32_t min_patch_x = static_cast<uint32_t>(min_x_coord);
+    const uint32_t max_patch_x = std::min<uint32_t>(max_x_coord, m_patch_count - 1);
+    const uint32_t min_patch_z = static_cast<uint32_t>(min_z_coord);
+    const uint32_t max_patch_z = std::min<uint32_t>(max_z_coord, m_patch_count - 1);
+
+    const float min_vx = min_x_coord - static_cast<float>(min_patch_x);
     const float max_vx = max_x_coord - static_cast<float>(max_patch_x);
     const float min_vz = min_z_coord - static_cast<float>(min_patch_z);
     const float max_vz = max_z_coord - static_cast<float>(max_patch_z);
 
+    float dh = std::numeric_limits<float>::lowest();
+
+    for(uint32_t patch_z = min_patch_z; patch_z <= max_patch_z; patch_z++)
+    {
+        for(uint32_t patch_x = min_patch_x; patch_x <= max_patch_x; patch_x++)
+        {
+            const uint32_t patch_id = patch_z * m_patch_count + patch_x;
+
+            //the patch bounds are enough to reject the patches that are completely below the box
+            if(m_bounding_ys[patch_id][1] - aabb.min().y <= dh)
+            {
+                continue;
+            }
+
+            const uvec2 min_cell((patch_x == min_patch_x) ? static_cast<uint32_t>(PATCH_CELL_COUNT * min_vx) : 0,
+                                 (patch_z == min_patch_z) ? static_cast<uint32_t>(PATCH_CELL_COUNT * min_vz) : 0);
+            const uvec2 max_cell((patch_x == max_patch_x) ? std::min<uint32_t>(PATCH_CELL_COUNT - 1, static_cast<uint32_t>(PATCH_CELL_COUNT * max_vx)) : PATCH_CELL_COUNT - 1,
+                                 (patch_z == max_patch_z) ? std::min<uint32_t>(PATCH_CELL_COUNT - 1, static_cast<uint32_t>(PATCH_CELL_COUNT * max_vz)) : PATCH_CELL_COUNT - 1);
+
+            dh = std::max(dh, maxHeight(patch_id, min_cell, max_cell, aabb.min().y + max_dh) - aabb.min().y);
+
+            //early out
+            if(dh > max_dh)
+            {
+                return dh;
+            }
+        }
+    }
+
+    return dh;
+}
+
+void Terrain::collision(std::span<const AABB> aabbs, float max_dh, std::span<float> dhs) const
+{
+    if(aabbs.size() != dhs.size())
+    {
+        error(std::format("Terrain collision batch has {} boxes but room for {} results.", aabbs.size(), dhs.size()));
+    }
+
+    const uint32_t query_count = static_cast<uint32_t>(aabbs.size());
+
+    //sorted by the patch under the min corner of the box, the patch id is in the high bits and the query index in the low ones
+    std::vector<uint64_t> order(query_count);
+
+    for(uint32_t i = 0; i < query_count; i++)
+    {
+        const vec3& min = aabbs[i].min();
+        const uint32_t patch_x = static_cast<uint32_t>(std::clamp((min.x - m_x) / m_patch_size, 0.0f, static_cast<float>(m_patch_count - 1)));
+        const uint32_t patch_z = static_cast<uint32_t>(std::clamp((min.z - m_z) / m_patch_size, 0.0f, static_cast<float>(m_patch_count - 1)));
+
+        order[i] = (static_cast<uint64_t>(patch_z * m_patch_count + patch_x) << 32) | i;
+    }
+
+    std::ranges::sort(order);
+
+    auto job = [&](uint32_t job_id)
+    {
+        const uint32_t end = std::min(query_count, (job_id + 1) * COLLISION_JOB_SIZE);
+
+        for(uint32_t i = job_id * COLLISION_JOB_SIZE; i < end; i++)
+        {
+            const uint32_t query = static_cast<uint32_t>(order[i]);
+            dhs[query] = collision(aabbs[query], max_dh);
+        }
+    };
+
+    const uint32_t job_count = (query_count + COLLISION_JOB_SIZE - 1) / COLLISION_JOB_SIZE;
+
+    //handing a single job to the worker threads costs more than running it here
+    if(job_count > 1)
+    {
+        //the jobs can only read the tiles the main thread has already cached this frame, so the ones under the boxes are cached first
+        for(uint64_t query_order : order)
+        {
+            const AABB& aabb = aabbs[static_cast<uint32_t>(query_order)];
+            const uvec2 min_patch = uvec2(glm::clamp((vec2(aabb.min().x, aabb.min().z) - vec2(m_x, m_z)) / m_patch_size, 0.0f, static_cast<float>(m_patch_count - 1)));
+            const uvec2 max_patch = uvec2(glm::clamp((vec2(aabb.max().x, aabb.max().z) - vec2(m_x, m_z)) / m_patch_size, 0.0f, static_cast<float>(m_patch_count - 1)));
+
+            for(uint32_t patch_z = min_patch.y; patch_z <= max_patch.y; patch_z++)
+            {
+                for(uint32_t patch_x = min_patch.x; patch_x <= max_patch.x; patch_x++)
+                {
+                    tile(patch_z * m_patch_count + patch_x);
+                }
+            }
+        }
+
+        parallelFor(job_count, job);
+    }
+    else if(job_count == 1)
+    {
+        job(0);
+    }
+
+#ifdef DEBUG
+    //debug builds check every batch against the boxes one at a time, the results have to be exactly the same
+    for(uint32_t i = 0; i < query_count; i++)
+    {
+        if(const float dh = collision(aabbs[i], max_dh); dhs[i] != dh)
+        {
+            error(std::format("Batched terrain collision gave {} for box {}, a single query gives {}.", dhs[i], i, dh));
+        }
+    }
+#endif
+}
+
+//ray-box slab test against the 4 children of a height pyramid node at once, returns a mask of the boxes hit before max_d
+//and writes the distances at which the ray enters them
+static uint32_t intersectChildren(const Ray& ray, const vec3& inv_dir, const vec2& node_min, float child_size,
+                                  const float* min_heights, const float* max_heights, float max_d, std::array<float, 4>& d)
+{
+#ifdef __SSE2__
+    const __m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node_min.x), _mm_setr_ps(0.0f, child_size, 0.0f, child_size)), _mm_set1_ps(ray.origin.x)), _mm_set1_ps(inv_dir.x));
+    const __m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_add_ps(_mm_set1_ps(node_min.y), _mm_setr_ps(0.0f, 0.0f, child_size, child_size)), _mm_set1_ps(ray.origin.z)), _mm_set1_ps(inv_dir.z));
+    const __m128 tx1 = _mm_add_ps(tx0, _mm_set1_ps(child_size * inv_dir.x));
+    const __m128 tz1 = _mm_add_ps(tz0, _mm_set1_ps(child_size * inv_dir.z));
+    const __m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(min_heights), _mm_set1_ps(ray.origin.y)), _mm_set1_ps(inv_dir.y));
+    const __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(max_heights), _mm_set1_ps(ray.origin.y)), _mm_set1_ps(inv_dir.y));
+
+    const __m128 t_near = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), _mm_setzero_ps()));
+    const __m128 t_far = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), _mm_set1_ps(max_d)));
+
+    _mm_storeu_ps(d.data(), t_near);
+
+    return _mm_movemask_ps(_mm_cmple_ps(t_near, t_far));
+#else
+    uint32_t mask = 0;
+
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        const vec3 child_min(node_min.x + (i & 1) * child_size, min_heights[i], node_min.y + (i >> 1) * child_size);
+        const vec3 child_max(child_min.x + child_size, max_heights[i], child_min.z + child_size);
+        const vec3 t0 = (child_min - ray.origin) * inv_dir;
+        const vec3 t1 = (child_max - ray.origin) * inv_dir;
+        const vec3 t_min = glm::min(t0, t1);
+        const vec3 t_max = glm::max(t0, t1);
+
+        d[i] = std::max({t_min.x, t_min.y, t_min.z, 0.0f});
+
+        if(d[i] <= std::min({t_max.x, t_max.y, t_max.z, max_d}))
+        {
+            mask |= 1u << i;
+        }
+    }
+
+    return mask;
+#endif
+}
+
+bool Terrain::rayIntersectionPatch(uint32_t patch_id, const Ray& ray, const vec3& inv_dir, float& d) const
+{
+    constexpr uint32_t leaf_level = HEIGHT_PYRAMID_LEVEL_COUNT - 1;
+    constexpr uint32_t row_size = PATCH_CELL_COUNT + 1;
+
+    const Tile& patch_tile = tile(patch_id);
+    const vec2 patch_min(m_x + (patch_id % m_patch_count) * m_patch_size, m_z + (patch_id / m_patch_count) * m_patch_size);
+    const float cell_size = m_patch_size / PATCH_CELL_COUNT;
+
+    struct Node
+    {
+        uint32_t level;
+        uint32_t id;
+        uvec2 pos;
+        float d;
+    };
+
+    //every step pops one node and pushes at most 4, so the stack never gets deeper than this
+    std::array<Node, 4 * HEIGHT_PYRAMID_LEVEL_COUNT> stack;
+    uint32_t stack_size = 0;
+    stack[stack_size++] = {0, 0, uvec2(0, 0), 0.0f};
+
+    bool intersection_found = false;
+
+    while(stack_size > 0)
+    {
+        const Node node = stack[--stack_size];
+
+        //a closer intersection might have been found since the node was pushed
+        if(node.d >= d)
+        {
+            continue;
+        }
+
+        if(leaf_level == node.level)
+        {
+            const uint32_t v = node.pos.y * row_size + node.pos.x;
+            const float x = patch_min.x + node.pos.x * cell_size;
+            const float z = patch_min.y + node.pos.y * cell_size;
+
+            const vec3 v0(x, height(patch_tile, v), z);
+            const vec3 v1(x + cell_size, height(patch_tile, v + 1), z);
+            const vec3 v2(x, height(patch_tile, v + row_size), z + cell_size);
+            const vec3 v3(x + cell_size, height(patch_tile, v + row_size + 1), z + cell_size);
+
+            float tri_d;
+
+            if(intersect(ray, v0, v1, v2, tri_d) && (tri_d < d))
+            {
+                d = tri_d;
+                intersection_found = true;
+            }
+
+            if(intersect(ray, v1, v2, v3, tri_d) && (tri_d < d))
+            {
+                d = tri_d;
+                intersection_found = true;
+            }
+
+            continue;
+        }
+
+        const float child_size = m_patch_size / static_cast<float>(1u << (node.level + 1));
+        const uint32_t first_child = 4 * node.id;
+        const uint32_t child_offset = heightPyramidLevelOffset(node.level + 1) + first_child;
+        const vec2 node_min = patch_min + vec2(node.pos) * (2.0f * child_size);
+
+        std::array<float, 4> child_d;
+        const uint32_t hit_mask = intersectChildren(ray, inv_dir, node_min, child_size, &patch_tile.min_heights[child_offset], &patch_tile.max_heights[child_offset], d, child_d);
+
+        //pushed far to near, so the nearest child gets popped first
+        std::array<uint32_t, 4> children;
+        uint32_t child_count = 0;
+
+        for(uint32_t i = 0; i < 4; i++)
+        {
+            if(hit_mask & (1u << i))
+            {
+                children[child_count++] = i;
+            }
+        }
+
+        std::sort(children.begin(), children.begin() + child_count, [&](uint32_t c0, uint32_t c1){ return child_d[c0] > child_d[c1]; });
+
+        for(uint32_t i = 0; i < child_count; i++)
+        {
+            const uint32_t child = children[i];
+            stack[stack_size++] = {node.level + 1, first_child + child, node.pos * 2u + uvec2(child & 1, child >> 1), child_d[child]};
+        }
+    }
+
+    return intersection_found;
+}
+
+//the node's box is already known to be hit by the ray
+void Terrain::rayIntersectionNode(uint32_t node_id, const Ray& ray, const vec3& inv_dir, float& d, bool& found) const
+{
+    const auto& node = m_quadtree[node_id];
+
+    if(0 == node.child_count)
+    {
+        found |= rayIntersectionPatch(node.patch_z * m_patch_count + node.patch_x, ray, inv_dir, d);
+        return;
+    }
+
+    //children are visited near to far, so the farther ones can be skipped once something closer was hit
+    std::array<std::pair<float, uint32_t>, 4> children;
+    uint32_t child_count = 0;
+
+    for(uint32_t i = 0; i < node.child_count; i++)
+    {
+        float child_d;
+
+        if(intersect(ray, m_quadtree[node.first_child + i].aabb, child_d))
+        {
+            children[child_count++] = {child_d, node.first_child + i};
+        }
+    }
+
+    std::sort(children.begin(), children.begin() + child_count);
+
+    for(uint32_t i = 0; i < child_count; i++)
+    {
+        if(children[i].first >= d)
+        {
+            break;
+        }
+
+        rayIntersectionNode(children[i].second, ray, inv_dir, d, found);
+    }
+}
+
+bool Terrain::rayIntersection(const Ray& ray, float& d) const
+{
+    d = std::numeric_limits<float>::max();
+    bool intersection_found = false;
+
+    float root_d;
+
+    if(intersect(ray, m_quadtree[0].aabb, root_d))
+    {
+        rayIntersectionNode(0, ray, 1.0f / ray.dir, d, intersection_found);
+    }
+
+    return intersection_found;
+}
+
+#if EDITOR_ENABLE
+
+void Terrain::saveToFile()
+{
+    //written to a temporary file first, so a failed save doesn't leave a broken terrain behind
+    //the edited chunks come from the cache and the rest are decompressed out of the old file on the way
+    writeFile(TERRAIN_TEMP_FILENAME, m_size, m_patch_count, m_materials, [this](uint32_t first_patch, uint32_t, Tile* tiles)
+    {
+        return copyChunk(first_patch / PATCHES_PER_CHUNK, tiles);
+    });
+
+    //the old file stays mapped until it's replaced, the cached tiles are the same as the ones in the new file
+    unmapFile();
+    std::filesystem::rename(TERRAIN_TEMP_FILENAME, TERRAIN_FILENAME);
+    mapFile();
+
+    for(ChunkSlot& chunk_slot : m_chunk_slots)
+    {
+        chunk_slot.dirty = false;
+    }
+
+    startPageInThread();
+}
+
+//a material texture read back on the CPU with a box filtered mip chain, so every virtual texture mip can sample the level closest to its own resolution
+struct MaterialImage
+{
+    std::vector<std::vector<uint32_t>> levels;
+    std::vector<uvec2> sizes;
+};
+
+static MaterialImage loadMaterialImage(const std::string& filename)
+{
+    MaterialImage image;
+    image.sizes.emplace_back();
+    image.levels.push_back(TextureLoader::loadRGBA8(filename, image.sizes[0]));
+
+    while((image.sizes.back().x > 1) || (image.sizes.back().y > 1))
+    {
+        const uvec2 src_size = image.sizes.back();
+        const uvec2 dst_size = glm::max(src_size / 2u, uvec2(1, 1));
+        const std::vector<uint32_t>& src = image.levels.back();
+        std::vector<uint32_t> dst(dst_size.x * dst_size.y);
+
+        for(uint32_t y = 0; y < dst_size.y; y++)
+        {
+            for(uint32_t x = 0; x < dst_size.x; x++)
+            {
+                const uint32_t x0 = std::min(2 * x, src_size.x - 1);
+                const uint32_t x1 = std::min(2 * x + 1, src_size.x - 1);
+                const uint32_t y0 = std::min(2 * y, src_size.y - 1);
+                const uint32_t y1 = std::min(2 * y + 1, src_size.y - 1);
+
+                dst[y * dst_size.x + x] = packRGBA8(0.25f * (unpackRGBA8(src[y0 * src_size.x + x0]) + unpackRGBA8(src[y0 * src_size.x + x1]) +
+                                                             unpackRGBA8(src[y1 * src_size.x + x0]) + unpackRGBA8(src[y1 * src_size.x + x1])));
+            }
+        }
+
+        image.sizes.push_back(dst_size);
+        image.levels.push_back(std::move(dst));
+    }
+
+    return image;
+}
+
+//bilinear with wrapping, the materials repeat once per patch
+static vec4 sampleMaterialImage(const MaterialImage& image, uint32_t level, const vec2& uv)
+{
+    const uvec2 size = image.sizes[level];
+    const vec2 pos = uv * vec2(size) - 0.5f;
+    const vec2 base = glm::floor(pos);
+    const vec2 f = pos - base;
+
+    auto texel = [&](float x, float y)
+    {
+        const uint32_t wrapped_x = static_cast<uint32_t>(glm::mod(x, static_cast<float>(size.x)));
+        const uint32_t wrapped_y = static_cast<uint32_t>(glm::mod(y, static_cast<float>(size.y)));
+        return unpackRGBA8(image.levels[level][std::min(wrapped_y, size.y - 1) * size.x + std::min(wrapped_x, size.x - 1)]);
+    };
+
+    return glm::mix(glm::mix(texel(base.x, base.y), texel(base.x + 1.0f, base.y), f.x),
+                    glm::mix(texel(base.x, base.y + 1.0f), texel(base.x + 1.0f, base.y + 1.0f), f.x), f.y);
+}
+
+void Terrain::bakeVirtualTexture(Renderer& renderer)
+{
+    //unmapped first, the file gets overwritten
+    m_virtual_texture.close(renderer);
+
+    const uint32_t page_count = virtualTexturePageCount();
+    const uint32_t mip_count = TerrainVirtualTexture::mipCount(page_count);
+
+    //materials sharing a texture only load it once
+    std::map<uint32_t, MaterialImage> images;
+    std::array<const MaterialImage*, TERRAIN_MATERIAL_COUNT> materials;
+    //the material level each virtual texture mip samples
+    std::array<std::vector<uint32_t>, TERRAIN_MATERIAL_COUNT> material_levels;
+
+    for(uint32_t i = 0; i < TERRAIN_MATERIAL_COUNT; i++)
+    {
+        if(!images.contains(m_materials[i]))
+        {
+            images.emplace(m_materials[i], loadMaterialImage(renderer.textureFilename(m_materials[i])));
+        }
+
+        materials[i] = &images.at(m_materials[i]);
+        material_levels[i].resize(mip_count);
+
+        for(uint32_t mip = 0; mip < mip_count; mip++)
+        {
+            const float vt_texels_per_patch = static_cast<float>((TERRAIN_VT_PAGE_RES * TERRAIN_VT_PAGES_PER_PATCH) >> mip);
+            const float level = std::round(std::log2(static_cast<float>(materials[i]->sizes[0].x) / vt_texels_per_patch));
+            material_levels[i][mip] = static_cast<uint32_t>(std::clamp(level, 0.0f, static_cast<float>(materials[i]->sizes.size() - 1)));
+        }
+    }
+
+    const float vt_size = m_patch_size * static_cast<float>(page_count / TERRAIN_VT_PAGES_PER_PATCH);
+
+    //the pages are baked on other threads, which can't cache the tiles, so the splat maps are copied out of the chunks first
+    const uint32_t total_patch_count = m_patch_count * m_patch_count;
+    const uint32_t chunk_count = (total_patch_count + PATCHES_PER_CHUNK - 1) / PATCHES_PER_CHUNK;
+    std::vector<uint32_t> splat_maps(static_cast<uint64_t>(total_patch_count) * SPLAT_MAP_TEXEL_COUNT);
+    std::vector<std::exception_ptr> exceptions(chunk_count);
+
+    parallelFor(chunk_count, [&](uint32_t chunk_id)
+    {
+        try
+        {
+            auto tiles = std::make_unique_for_overwrite<Tile[]>(PATCHES_PER_CHUNK);
+
+            if(!copyChunk(chunk_id, tiles.get()))
+            {
+                error(std::format("Terrain file {} is corrupted.", TERRAIN_FILENAME));
+            }
+
+            for(uint32_t i = 0; i < chunkPatchCount(chunk_id, total_patch_count); i++)
+            {
+                std::ranges::copy(tiles[i].splat_map, &splat_maps[static_cast<uint64_t>(chunk_id * PATCHES_PER_CHUNK + i) * SPLAT_MAP_TEXEL_COUNT]);
+            }
+        }
+        catch(...)
+        {
+            exceptions[chunk_id] = std::current_exception();
+        }
+    });
+
+    for(const auto& exception : exceptions)
+    {
+        if(exception)
+        {
+            std::rethrow_exception(exception);
+        }
+    }
+
+    //same blend as the terrain fragment shader does without a virtual texture
+    TerrainVirtualTexture::bake(VIRTUAL_TEXTURE_FILENAME, page_count, [&](uint32_t mip, const uvec2& page, uint32_t* texels)
+    {
+        const float texel_size = vt_size / static_cast<float>((page_count >> mip) * TERRAIN_VT_PAGE_RES);
+
+        for(uint32_t y = 0; y < TERRAIN_VT_PADDED_PAGE_RES; y++)
+        {
+            for(uint32_t x = 0; x < TERRAIN_VT_PADDED_PAGE_RES; x++)
+            {
+                const vec2 vt_texel = vec2(page) * static_cast<float>(TERRAIN_VT_PAGE_RES) + vec2(x, y) - static_cast<float>(TERRAIN_VT_PAGE_BORDER) + 0.5f;
+                //the border texels and the ones past the far edges of the terrain repeat its edges
+                const vec2 pos = glm::clamp(vt_texel * texel_size, vec2(0.0f, 0.0f), vec2(m_size, m_size)) / m_patch_size;
+                const uvec2 patch = glm::min(uvec2(pos), uvec2(m_patch_count - 1));
+                const vec2 patch_uv = glm::clamp(pos - vec2(patch), 0.0f, 1.0f);
+
+                const uint32_t* splat_map = &splat_maps[static_cast<uint64_t>(patch.y * m_patch_count + patch.x) * SPLAT_MAP_TEXEL_COUNT];
+                const vec2 splat_pos = patch_uv * static_cast<float>(TERRAIN_SPLAT_MAP_RES - 1);
+                const uvec2 s = glm::min(uvec2(splat_pos), uvec2(TERRAIN_SPLAT_MAP_RES - 2));
+                const vec2 f = splat_pos - vec2(s);
+                const uint32_t s00 = s.y * TERRAIN_SPLAT_MAP_RES + s.x;
+                const uint32_t s01 = s00 + TERRAIN_SPLAT_MAP_RES;
+
+                const vec4 weights = glm::mix(glm::mix(unpackRGBA8(splat_map[s00]), unpackRGBA8(splat_map[s00 + 1]), f.x),
+                                              glm::mix(unpackRGBA8(splat_map[s01]), unpackRGBA8(splat_map[s01 + 1]), f.x), f.y);
+
+                const vec2 tex_coords(patch_uv.x, 1.0f - patch_uv.y);
+                vec4 col(0.0f, 0.0f, 0.0f, 0.0f);
+
+                for(uint32_t i = 0; i < TERRAIN_MATERIAL_COUNT; i++)
+                {
+                    if(weights[i] > 0.0f)
+                    {
+                        col += weights[i] * sampleMaterialImage(*materials[i], material_levels[i][mip], tex_coords);
+                    }
+                }
+
+                const float weight_sum = weights.x + weights.y + weights.z + weights.w;
+                col = (weight_sum > 0.0f) ? col / weight_sum : sampleMaterialImage(*materials[0], material_levels[0][mip], tex_coords);
+
+                texels[y * TERRAIN_VT_PADDED_PAGE_RES + x] = packRGBA8(col);
+            }
+        }
+    });
+
+    if(!m_virtual_texture.open(renderer, VIRTUAL_TEXTURE_FILENAME, page_count))
+    {
+        error(std::format("Failed to open the baked terrain virtual texture file {}.", VIRTUAL_TEXTURE_FILENAME));
+    }
+
+    updateVirtualTextureArea(renderer);
+}
+
+void Terrain::setSize(Renderer& renderer, float size)
+{
+    m_size = size;
+    m_x = -0.5f * m_size;
+    m_z = -0.5f * m_size;
+    m_patch_size = m_size / static_cast<float>(m_patch_count);
+
+    buildQuadtree();
+    buildShadowMesh(renderer);
+    updateVirtualTextureArea(renderer);
+}
+
+void Terrain::toolEdit(Renderer& renderer, const vec3& center, float radius, float dh)
+{
+    const float cell_size = m_patch_size / static_cast<float>(PATCH_CELL_COUNT);
+
+    const float min_x_coord = std::max((center.x - radius - m_x) / m_patch_size, 0.0f);
+    const float max_x_coord = std::min((center.x + radius - m_x) / m_patch_size, static_cast<float>(m_patch_count));
+    const float min_z_coord = std::max((center.z - radius - m_z) / m_patch_size, 0.0f);
+    const float max_z_coord = std::min((center.z + radius - m_z) / m_patch_size, static_cast<float>(m_patch_count));
+
+    if((min_x_coord > max_x_coord) || (min_z_coord > max_z_coord))
+    {
+        return;
+    }
+
+    const uint32_t min_patch_x = static_cast<uint32_t>(min_x_coord);
+    const uint32_t max_patch_x = std::min(static_cast<uint32_t>(max_x_coord), m_patch_count - 1);
+    const uint32_t min_patch_z = static_cast<uint32_t>(min_z_coord);
+    const uint32_t max_patch_z = std::min(static_cast<uint32_t>(max_z_coord), m_patch_count - 1);
+
+    bool bounding_ys_changed = false;
+
     for(uint32_t patch_z = min_patch_z; patch_z <= max_patch_z; patch_z++)
     {
         for(uint32_t patch_x = min_patch_x; patch_x <= max_patch_x; patch_x++)
         {
             const uint32_t patch_id = patch_z * m_patch_count + patch_x;
+            const vec2 patch_origin(m_x + patch_x * m_patch_size, m_z + patch_z * m_patch_size);
+
+            //vertices on the edges are shared with the neighbouring patches, each patch keeps its own copy and they all get the same dh
+            auto vertexRange = [&](float min_coord, float max_coord)
+            {
+                const float min_v = std::clamp(std::ceil(min_coord / cell_size), 0.0f, static_cast<float>(PATCH_CELL_COUNT));
+                const float max_v = std::clamp(std::floor(max_coord / cell_size), 0.0f, static_cast<float>(PATCH_CELL_COUNT));
+                return uvec2(static_cast<uint32_t>(min_v), static_cast<uint32_t>(max_v));
+            };
+
+            const uvec2 vx_range = vertexRange(center.x - radius - patch_origin.x, center.x + radius - patch_origin.x);
+            const uvec2 vz_range = vertexRange(center.z - radius - patch_origin.y, center.z + radius - patch_origin.y);
+
+            if((vx_range[0] > vx_range[1]) || (vz_range[0] > vz_range[1]))
+            {
+                continue;
+            }
+
+            Tile& patch_tile = editTile(patch_id);
+            const uint32_t slot = m_patch_slots[patch_id];
+            const uvec2 min_vertex(vx_range[0], vz_range[0]);
+            const uvec2 max_vertex(vx_range[1], vz_range[1]);
+
+            //resident patches are edited on the GPU, the CPU copy catches up when the heightmap is read back a few frames later
+            //the slot is kept resident until then, so the readback can be matched to the patch again
+            if(slot != SLOT_NONE)
+            {
+                HeightmapSlot& heightmap_slot = m_slots[slot];
+
+                //the GPU doesn't know where the heights end up, so the range is only kept if the heights under the brush can't leave it -
+                //they're bounded by the ones in the tile and how far the brushes in flight can have moved them since
+                uint16_t min_quantized = std::numeric_limits<uint16_t>::max();
+                uint16_t max_quantized = 0;
+
+                for(uint32_t vz = vz_range[0]; vz <= vz_range[1]; vz++)
+                {
+                    for(uint32_t vx = vx_range[0]; vx <= vx_range[1]; vx++)
+                    {
+                        min_quantized = std::min(min_quantized, patch_tile.heightmap[vz * (PATCH_CELL_COUNT + 1) + vx]);
+                        max_quantized = std::max(max_quantized, patch_tile.heightmap[vz * (PATCH_CELL_COUNT + 1) + vx]);
+                    }
+                }
+
+                const vec2 brush_dh(std::min(dh, 0.0f), std::max(dh, 0.0f));
+                const vec2 reach = vec2(glm::mix(patch_tile.height_range.x, patch_tile.height_range.y, min_quantized / MAX_QUANTIZED_HEIGHT),
+                                        glm::mix(patch_tile.height_range.x, patch_tile.height_range.y, max_quantized / MAX_QUANTIZED_HEIGHT))
+                                   + heightmap_slot.pending_dh + brush_dh;
+                const vec2 height_range(std::min(heightmap_slot.height_range.x, reach.x), std::max(heightmap_slot.height_range.y, reach.y));
+
+                //a new range requantizes every texel, otherwise only the ones under the brush change
+                const bool range_kept = (height_range == heightmap_slot.height_range);
+                const uvec2 offset = range_kept ? min_vertex : uvec2(0, 0);
+                const uvec2 extent = range_kept ? (max_vertex - min_vertex + 1u) : uvec2(TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES);
+
+                renderer.brushTerrainHeightmap(slot, patch_origin, cell_size, heightmap_slot.height_range, height_range, offset, extent, center, radius, dh,
+                                               patch_tile.heightmap.data(), &patch_tile.height_range);
+                heightmap_slot.height_range = height_range;
+                heightmap_slot.pending_dh += brush_dh;
+                heightmap_slot.pending_readbacks++;
+                continue;
+            }
 
-            const uint32_t res_u32 = static_cast<uint32_t>(m_patch_vertices[patch_id].res);
+            //patches that aren't resident are edited in place and get the edit with the rest of their heightmap once they're streamed in
+            std::array<float, TOTAL_PATCH_VERTEX_COUNT> heights;
+            dequantizeHeightmap(patch_tile, heights.data());
 
-            const uint32_t min_patch_vx = (patch_x == min_patch_x) ? static_cast<uint32_t>(m_patch_vertices[patch_id].res * min_vx) : 0;
-            const uint32_t min_patch_vz = (patch_z == min_patch_z) ? static_cast<uint32_t>(m_patch_vertices[patch_id].res * min_vz) : 0;
-            const uint32_t max_patch_vx = (patch_x == max_patch_x) ? std::min<uint32_t>(res_u32, static_cast<uint32_t>(m_patch_vertices[patch_id].res * max_vx) + 1) : res_u32;
-            const uint32_t max_patch_vz = (patch_z == max_patch_z) ? std::min<uint32_t>(res_u32, static_cast<uint32_t>(m_patch_vertices[patch_id].res * max_vz) + 1) : res_u32;
+            bool edited = false;
+            bool range_kept = true;
 
-            for(uint32_t vz = min_patch_vz; vz <= max_patch_vz; vz++)
+            for(uint32_t vz = vz_range[0]; vz <= vz_range[1]; vz++)
             {
-                for(uint32_t vx = min_patch_vx; vx <= max_patch_vx; vx++)
+                for(uint32_t vx = vx_range[0]; vx <= vx_range[1]; vx++)
                 {
-                    const vec3 v(m_x + m_patch_size * (patch_x + vx / m_patch_vertices[patch_id].res),
-                                 m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + vz * (res_u32 + 1) + vx].height,
-                                 m_z + m_patch_size * (patch_z + vz / m_patch_vertices[patch_id].res));
+                    float& vertex_height = heights[vz * (PATCH_CELL_COUNT + 1) + vx];
+                    const vec3 v(patch_origin.x + vx * cell_size, vertex_height, patch_origin.y + vz * cell_size);
 
                     if(glm::distance(center, v) <= radius)
                     {
-                        m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + vz * (res_u32 + 1) + vx].height += dh;
+                        vertex_height += dh;
+                        edited = true;
+                        range_kept &= (vertex_height >= patch_tile.height_range.x) && (vertex_height <= patch_tile.height_range.y);
+                    }
+                }
+            }
+
+            if(!edited)
+            {
+                continue;
+            }
+
+            //the heights that stay within the range keep it and only the edited ones are quantized again,
+            //a new range moves every quantized height
+            if(range_kept)
+            {
+                for(uint32_t vz = vz_range[0]; vz <= vz_range[1]; vz++)
+                {
+                    for(uint32_t vx = vx_range[0]; vx <= vx_range[1]; vx++)
+                    {
+                        const uint32_t v = vz * (PATCH_CELL_COUNT + 1) + vx;
 
-                        m_bounding_ys[patch_id][0] = std::min(m_bounding_ys[patch_id][0], m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + vz * (res_u32 + 1) + vx].height);
-                        m_bounding_ys[patch_id][1] = std::max(m_bounding_ys[patch_id][1], m_vertex_data[(res_u32 + 1) * (res_u32 + 1) * patch_id + vz * (res_u32 + 1) + vx].height);
+                        if(heights[v] != height(patch_tile, v))
+                        {
+                            patch_tile.heightmap[v] = quantizeHeight(heights[v], patch_tile.height_range);
+                        }
                     }
                 }
+
+                bounding_ys_changed |= heightmapChanged(patch_id, min_vertex, max_vertex);
+            }
+            else
+            {
+                quantizeHeightmap(patch_tile, heights.data());
+                bounding_ys_changed |= heightmapChanged(patch_id, uvec2(0, 0), uvec2(PATCH_CELL_COUNT, PATCH_CELL_COUNT));
             }
         }
     }
 
-    //TODO: only update the data that's changed
-    renderer.updateTerrainData(m_vertex_data.data(), 0, m_vertex_data.size() * sizeof(VertexData));
-#endif
+    if(bounding_ys_changed)
+    {
+        updateQuadtreeNode(0, uvec2(min_patch_x, min_patch_z), uvec2(max_patch_x, max_patch_z));
+    }
+}
+
+bool Terrain::heightmapChanged(uint32_t patch_id, const uvec2& min_vertex, const uvec2& max_vertex)
+{
+    Tile& patch_tile = editTile(patch_id);
+
+    //a vertex is a corner of up to 4 cells
+    const uvec2 min_cell = glm::max(min_vertex, uvec2(1, 1)) - 1u;
+    const uvec2 max_cell = glm::min(max_vertex, uvec2(PATCH_CELL_COUNT - 1, PATCH_CELL_COUNT - 1));
+    updateHeightPyramid(patch_tile, min_cell, max_cell);
+    m_shadow_mesh_dirty_patches.push_back(patch_id);
+
+    const vec2 bounding_ys(patch_tile.min_heights[0], patch_tile.max_heights[0]);
+
+    if(bounding_ys == m_bounding_ys[patch_id])
+    {
+        return false;
+    }
+
+    m_bounding_ys[patch_id] = bounding_ys;
+    return true;
+}
+
+void Terrain::applyHeightmapReadbacks(Renderer& renderer)
+{
+    const auto readbacks = renderer.takeFinishedTerrainHeightmapReadbacks();
+
+    if(readbacks.empty())
+    {
+        return;
+    }
+
+    uvec2 min_patch(m_patch_count, m_patch_count);
+    uvec2 max_patch(0, 0);
+    bool bounding_ys_changed = false;
+
+    for(const auto& readback : readbacks)
+    {
+        HeightmapSlot& slot = m_slots[readback.slot];
+        slot.pending_readbacks--;
+
+        //the tile has caught up with the GPU copy
+        if(0 == slot.pending_readbacks)
+        {
+            slot.pending_dh = vec2(0.0f, 0.0f);
+        }
+
+        const uint32_t patch_id = slot.patch_id;
+        const uvec2 patch(patch_id % m_patch_count, patch_id / m_patch_count);
+
+        if(heightmapChanged(patch_id, readback.offset, readback.offset + readback.extent - 1u))
+        {
+            min_patch = glm::min(min_patch, patch);
+            max_patch = glm::max(max_patch, patch);
+            bounding_ys_changed = true;
+        }
+
+        //the brush only ever widens the range, so once the last stroke has landed the heightmap gets requantized to the heights it really has
+        //with a brush that doesn't change anything - the CPU copy is in sync with the GPU one at this point, so the bounding ys are the real range
+        const vec2& bounding_ys = m_bounding_ys[patch_id];
+        const float slack = (bounding_ys.x - slot.height_range.x) + (slot.height_range.y - bounding_ys.y);
+
+        if((0 == slot.pending_readbacks) && (slack * MAX_QUANTIZED_HEIGHT > slot.height_range.y - slot.height_range.x))
+        {
+            const vec2 patch_origin(m_x + patch.x * m_patch_size, m_z + patch.y * m_patch_size);
+            Tile& patch_tile = editTile(patch_id);
+
+            renderer.brushTerrainHeightmap(readback.slot, patch_origin, m_patch_size / PATCH_CELL_COUNT, slot.height_range, bounding_ys, uvec2(0, 0),
+                                           uvec2(TERRAIN_HEIGHTMAP_RES, TERRAIN_HEIGHTMAP_RES), vec3(0.0f), 0.0f, 0.0f, patch_tile.heightmap.data(), &patch_tile.height_range);
+            slot.height_range = bounding_ys;
+            slot.pending_readbacks++;
+        }
+    }
+
+    if(bounding_ys_changed)
+    {
+        updateQuadtreeNode(0, min_patch, max_patch);
+    }
+}
+
+void Terrain::finishEdits(Renderer& renderer)
+{
+    //applying the results can queue a brush requantizing a heightmap, which takes another pass - a requantized heightmap has no slack left,
+    //so a third pass would never be needed
+    for(uint32_t pass = 0; pass < 2; pass++)
+    {
+        renderer.finishTerrainHeightmapReadbacks();
+        applyHeightmapReadbacks(renderer);
+    }
+
+    if(std::ranges::any_of(m_slots, [](const HeightmapSlot& slot){ return slot.pending_readbacks > 0; }))
+    {
+        error("Terrain brush results are still in flight after finishing the edits.");
+    }
 }
 
 void Terrain::toggleWireframe()
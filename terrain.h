@@ -2,26 +2,72 @@
 #define TERRAIN_H
 
 #include "renderer.h"
+#include "terrain_virtual_texture.h"
 #include "collision.h"
 #include "vertex.h"
+#include "mapped_file.h"
+#include <memory>
+#include <functional>
+#include <span>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 
 class Terrain
 {
 public:
     Terrain(Renderer& renderer);
+    Terrain(const Terrain&) = delete;
+    Terrain& operator=(const Terrain&) = delete;
 
     void draw(Renderer& renderer);
 
+    float size() const;
     float patchSize() const;
 
+    //patches within the radius of the camera are uploaded to the GPU, the nearest ones first
+    void setStreamingRadius(float radius);
+    float streamingRadius() const noexcept;
+    //how many patch heightmaps can be resident on the GPU at once, the most recently drawn patches that fit stay resident
+    void setHeightmapBudget(Renderer& renderer, uint32_t slot_count);
+    uint32_t heightmapBudget() const noexcept;
+
     float collision(const AABB&, float max_dh) const;
+    //collision() for every box, dhs[i] gets the result of aabbs[i] - the boxes are handled in patch order
+    //so neighbouring ones share the cached tiles, and big batches are split over all cores
+    void collision(std::span<const AABB> aabbs, float max_dh, std::span<float> dhs) const;
+    bool rayIntersection(const Ray& ray, float& d) const;
+
+    //0 when there's no virtual texture and the materials are blended per pixel
+    uint32_t residentVirtualTexturePages() const noexcept;
+
+    struct CullingBenchmarkResult
+    {
+        uint32_t patch_count;
+        uint32_t quadtree_node_count;
+        uint32_t selected_patch_count;
+        uint32_t visible_patch_count;
+        double quadtree_ms;
+        double per_patch_ms;
+    };
+
+    //times the patch selection for the camera on flat terrains of 4x4 up to 256x256 patches of the current patch size,
+    //against testing every patch against the frustum on its own
+    std::vector<CullingBenchmarkResult> benchmarkCulling(const Renderer& renderer);
 
 #if EDITOR_ENABLE
+    //the chunks that haven't been edited are decompressed out of the current file again, so finishEdits() has to be called first
     void saveToFile();
+    //bakes the blended materials of the whole terrain into the virtual texture file and reopens it
+    void bakeVirtualTexture(Renderer& renderer);
+    //replaces the terrain with a new one of patch_count x patch_count patches filled with fractal noise, the same seed gives the same terrain
+    void generate(Renderer& renderer, uint32_t patch_count, float size, uint32_t seed);
 
-    bool rayIntersection(const Ray& ray, float& d) const;
     //std::optional<std::pair<PatchType, uint32_t>> pickPatch(const Ray& ray) const;
     void toolEdit(Renderer& renderer, const vec3& center, float radius, float dh);
+    //waits for the brush results still in flight on the GPU, has to be called before the tiles are saved
+    void finishEdits(Renderer& renderer);
 
     void setSize(Renderer& renderer, float size);
 
@@ -31,15 +77,54 @@ public:
 
 private:
     static const inline auto TERRAIN_FILENAME = "terrain.dat";
+    static const inline auto TERRAIN_TEMP_FILENAME = "terrain.dat.tmp";
+    static const inline auto VIRTUAL_TEXTURE_FILENAME = "terrain_vt.dat";
+    static constexpr float DEFAULT_STREAMING_RADIUS = 500.0f;
+    static constexpr uint32_t DEFAULT_HEIGHTMAP_BUDGET = 256;
 #if EDITOR_ENABLE
     static const inline float DEFAULT_SIZE = 100.0f;
     static const inline uint32_t DEFAULT_PATCH_COUNT = 2;
 
     void createNew();
+
+    //the largest features of a generated terrain are at most this wide, and the heights reach GENERATOR_HEIGHT_RATIO of it
+    static constexpr float GENERATOR_MAX_WAVELENGTH = 2000.0f;
+    static constexpr float GENERATOR_HEIGHT_RATIO = 0.2f;
+    //terrains with more virtual texture pages than this on their first mip are only baked on request
+    static constexpr uint32_t MAX_AUTO_BAKED_VT_PAGE_COUNT = 64;
+
+    //updates the height pyramid and bounding ys of a patch after the given (inclusive) rectangle of its heightmap has changed,
+    //returns whether the bounding ys have changed
+    bool heightmapChanged(uint32_t patch_id, const uvec2& min_vertex, const uvec2& max_vertex);
+    void applyHeightmapReadbacks(Renderer& renderer);
 #endif
     static constexpr uint32_t TOTAL_PATCH_VERTEX_COUNT = (MAX_TESS_LEVEL + 1) * (MAX_TESS_LEVEL + 1);
+    //quadtree nodes covering less than this many pixels on screen are selected whole instead of being culled any finer - this only
+    //sets the granularity of the culling, the level of detail of every patch is picked from its screen-space error by the tessellation shaders
+    static constexpr float MIN_CULLED_NODE_PIXELS = 64.0f;
+    //batched collision queries are only spread over the worker threads in jobs of this many boxes
+    static constexpr uint32_t COLLISION_JOB_SIZE = 256;
     void calcXYFromSize() noexcept;
     void loadFromFile(Renderer&);
+    //maps the terrain file and points the tables into it, the file has to be in the current version
+    void mapFile();
+    //stops the page-in thread and unmaps the file, so it can be replaced
+    void unmapFile();
+    void convertFile(uint32_t version) const;
+
+    void updateStreaming(Renderer& renderer);
+    float patchDistance(uint32_t patch_id, const vec3& pos) const;
+
+    void buildQuadtree();
+    void buildQuadtreeNode(uint32_t node_id, uint32_t patch_x, uint32_t patch_z, uint32_t patch_span, uint32_t& leaf_count);
+    //refits the bounding ys of the nodes covering the given patches after they've been edited
+    void updateQuadtreeNode(uint32_t node_id, const uvec2& min_patch, const uvec2& max_patch);
+    void selectPatches(const RenderView& view);
+    void selectQuadtreeNode(uint32_t node_id, const RenderView& view, bool inside);
+
+    float maxHeight(uint32_t patch_id, const uvec2& min_cell, const uvec2& max_cell, float limit) const;
+    void rayIntersectionNode(uint32_t node_id, const Ray& ray, const vec3& inv_dir, float& d, bool& found) const;
+    bool rayIntersectionPatch(uint32_t patch_id, const Ray& ray, const vec3& inv_dir, float& d) const;
 
     float m_size;
     float m_x;
@@ -47,20 +132,239 @@ private:
     uint32_t m_patch_count;
     float m_patch_size;
 
-    struct VertexData
+    /*--- file layout ---*/
+    //header, chunk table, the bounding ys and the shadow mesh heights of every patch and then the chunks, each one holding the height ranges,
+    //splat maps and heightmaps of up to PATCHES_PER_CHUNK consecutive patches - the tables are all a load needs, the chunks are compressed
+    //with zlib on their own and only decompressed once their patches are needed
+    static constexpr uint32_t TERRAIN_FILE_MAGIC = 0x4e525254; //"TRRN"
+    static constexpr uint32_t TERRAIN_FILE_VERSION = 6;
+    static constexpr uint32_t PATCHES_PER_CHUNK = 16;
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        float size;
+        uint32_t patch_count;
+        //the texture id of every material in the splat maps
+        std::array<uint32_t, TERRAIN_MATERIAL_COUNT> materials;
+    };
+
+    struct ChunkInfo
+    {
+        uint64_t offset;
+        uint64_t compressed_size;
+    };
+
+    //min/max heights of the heightmap cells stored as an implicit quadtree, level 0 covers the whole patch and every next level
+    //splits each of its cells in 4 - the cells of a level are in morton order, so the 4 children of a cell are next to each other
+    static constexpr uint32_t PATCH_CELL_COUNT = static_cast<uint32_t>(MAX_TESS_LEVEL);
+    static constexpr uint32_t HEIGHT_PYRAMID_LEVEL_COUNT = 7;
+    static_assert((1u << (HEIGHT_PYRAMID_LEVEL_COUNT - 1)) == PATCH_CELL_COUNT);
+    static constexpr uint32_t heightPyramidLevelOffset(uint32_t level) { return ((1u << (2 * level)) - 1) / 3; }
+    static constexpr uint32_t HEIGHT_PYRAMID_NODE_COUNT = heightPyramidLevelOffset(HEIGHT_PYRAMID_LEVEL_COUNT);
+
+    //the splat map texels sit on every other heightmap vertex, each one packs the RGBA8 weights of the materials with the first one in the low byte
+    static constexpr uint32_t SPLAT_MAP_TEXEL_COUNT = TERRAIN_SPLAT_MAP_RES * TERRAIN_SPLAT_MAP_RES;
+    static_assert((TERRAIN_SPLAT_MAP_RES - 1) * 2 == PATCH_CELL_COUNT);
+
+    //heights are stored as 16 bit fractions of the height range of their patch, which is the same one the GPU copy uses,
+    //so a height is off by at most half a step - (max - min) / 65535 / 2
+    struct Tile
     {
-        uint32_t tex_id = 0;
+        vec2 height_range;
+        std::array<uint16_t, TOTAL_PATCH_VERTEX_COUNT> heightmap;
+        std::array<uint32_t, SPLAT_MAP_TEXEL_COUNT> splat_map;
+        std::array<float, HEIGHT_PYRAMID_NODE_COUNT> min_heights;
+        std::array<float, HEIGHT_PYRAMID_NODE_COUNT> max_heights;
     };
 
+    static float height(const Tile& tile, uint32_t v);
+    //sets the height range to the min and max of the given heights and quantizes them into the heightmap
+    static void quantizeHeightmap(Tile& tile, const float* heights);
+    static void dequantizeHeightmap(const Tile& tile, float* heights);
+
+    static void buildHeightPyramid(Tile& tile);
+    //recalculates the leaf cells in the given (inclusive) rectangle and all of their ancestors
+    static void updateHeightPyramid(Tile& tile, const uvec2& min_cell, const uvec2& max_cell);
+
+    //the part of a tile that's stored in the file
+    static constexpr uint64_t STORED_TILE_SIZE = sizeof(Tile::height_range) + sizeof(Tile::splat_map) + sizeof(Tile::heightmap);
+    //converts between tiles and the uncompressed (but byte shuffled) contents of a chunk
+    static void packChunk(const Tile* tiles, uint32_t tile_count, uint8_t* dst);
+    static void unpackChunk(const uint8_t* src, uint32_t tile_count, Tile* tiles);
+    //fills the stored part of the tiles of the given patches, returns false if their data can't be read - called from several threads at once
+    using ChunkFiller = std::function<bool(uint32_t first_patch, uint32_t patch_count, Tile* tiles)>;
+    //the tiles are filled and compressed a batch of chunks at a time, the tables are worked out from them on the way
+    static void writeFile(const char* filename, float size, uint32_t patch_count, const std::array<uint32_t, TERRAIN_MATERIAL_COUNT>& materials, const ChunkFiller& fill_chunk);
+    static uint32_t chunkPatchCount(uint32_t chunk_id, uint32_t total_patch_count) noexcept;
+    //decompresses a chunk out of the mapped file and builds the height pyramids of its tiles, returns false if it's corrupted
+    bool decompressChunk(uint32_t chunk_id, Tile* tiles) const;
+#if EDITOR_ENABLE
+    //heights and splat weights of a generated patch, every vertex is computed from its position in the whole terrain so the patches line up
+    static void generateTile(Tile& tile, const uvec2& patch, float vertex_spacing, float wavelength, float max_height, uint32_t seed);
+#endif
+
+    MappedFile m_file;
+    const ChunkInfo* m_chunk_infos = nullptr;
+    //the shadow mesh heights as they are in the file, the edits that haven't been saved are only in the tiles
+    const float* m_file_shadow_mesh_heights = nullptr;
+    std::array<uint32_t, TERRAIN_MATERIAL_COUNT> m_materials = {};
     std::vector<vec2> m_bounding_ys;
 
-    std::vector<std::array<float, TOTAL_PATCH_VERTEX_COUNT>> m_heightmaps;
-    std::vector<VertexData> m_vertex_data;
+    /*--- tile cache ---*/
+    //the chunks are decompressed into a cache of DEFAULT_CHUNK_CACHE_SIZE chunks and the least recently used one makes room for the next,
+    //except for the chunks used in the current frame - so a tile stays where it is until the end of the frame - and the chunks with edits
+    //that haven't been saved yet, the cache grows past its size when it's only left with those
+    static constexpr uint32_t DEFAULT_CHUNK_CACHE_SIZE = 64;
+    static constexpr uint32_t CHUNK_ID_NONE = 0xffffffff;
+
+    struct ChunkSlot
+    {
+        uint32_t chunk_id = CHUNK_ID_NONE;
+        uint64_t last_used_frame = 0;
+        std::unique_ptr<Tile[]> tiles;
+#if EDITOR_ENABLE
+        bool dirty = false;
+#endif
+    };
+
+    //decompresses the chunk of the patch on the calling thread if it isn't cached yet, so only the main thread may call it -
+    //other threads can call it for the tiles the main thread has already used this frame
+    const Tile& tile(uint32_t patch_id) const;
+#if EDITOR_ENABLE
+    //same as tile(), but the chunk is kept cached until it's saved
+    Tile& editTile(uint32_t patch_id);
+#endif
+    //moves the tiles of a chunk into a cache slot and returns it
+    uint32_t cacheChunk(uint32_t chunk_id, std::unique_ptr<Tile[]> tiles) const;
+    //drops the least recently used chunks the cache grew by once they can be evicted again
+    void trimChunkCache();
+    //copies the tiles of a chunk out of the cache, or decompresses them if it isn't cached, without caching them - any thread can call it
+    //as long as the main thread doesn't change the cache meanwhile
+    bool copyChunk(uint32_t chunk_id, Tile* tiles) const;
+
+    mutable std::vector<ChunkSlot> m_chunk_slots;
+    //the cache slot of every chunk, SLOT_NONE if it's not cached
+    mutable std::vector<uint32_t> m_chunk_slot_ids;
+
+    //the page-in thread decompresses the chunks streaming is going to upload next, the main thread moves them into the cache
+    void startPageInThread();
+    void stopPageInThread();
+    void pageInChunks(std::stop_token stop_token);
+
+    std::mutex m_page_in_mutex;
+    std::condition_variable_any m_page_in_cv;
+    //at most half the cache, so the chunks paged in ahead of streaming don't push out the ones it's still uploading from
+    static constexpr uint32_t MAX_PAGE_IN_REQS = DEFAULT_CHUNK_CACHE_SIZE / 2;
+    //nearest first, replaced every frame
+    std::deque<uint32_t> m_page_in_reqs;
+    std::vector<std::pair<uint32_t, std::unique_ptr<Tile[]>>> m_paged_in_chunks;
+    //after everything it reads, so it's stopped before any of it is destroyed
+    std::jthread m_page_in_thread;
+
+    /*--- streaming ---*/
+    static constexpr uint32_t SLOT_NONE = 0xffffffff;
+    static constexpr uint32_t PATCH_ID_NONE = 0xffffffff;
+
+    struct HeightmapSlot
+    {
+        uint32_t patch_id = PATCH_ID_NONE;
+        uint64_t last_used_frame = 0;
+        //brushes dispatched on the GPU whose results haven't been read back yet
+        uint32_t pending_readbacks = 0;
+        //the range the GPU copy of the heightmap is quantized to, it runs ahead of the tile's while brush results are in flight
+        vec2 height_range = vec2(0.0f, 0.0f);
+        //the most the brushes in flight can have lowered and raised the heights of the GPU copy past the tile's
+        vec2 pending_dh = vec2(0.0f, 0.0f);
+    };
+
+    float m_streaming_radius = DEFAULT_STREAMING_RADIUS;
+    uint64_t m_frame = 0;
+    std::vector<uint32_t> m_patch_slots;
+    std::vector<HeightmapSlot> m_slots;
+    std::vector<uint32_t> m_free_slots;
+    std::vector<std::pair<float, uint32_t>> m_streaming_candidates;
+
+    struct QuadtreeNode
+    {
+        AABB aabb;
+        uint32_t patch_x = 0;
+        uint32_t patch_z = 0;
+        uint32_t patch_span = 1;
+        //children are stored next to each other, nodes on the far edges of the grid can have less than 4
+        uint32_t first_child = 0;
+        uint32_t child_count = 0;
+        //the leaves are numbered depth first, so the ones under a node are consecutive
+        uint32_t first_leaf = 0;
+        uint32_t leaf_count = 0;
+    };
+
+    std::vector<QuadtreeNode> m_quadtree;
+
+    struct DrawRange
+    {
+        RenderViewId view;
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+    };
 
-    std::vector<VertexTerrain> m_patch_vertices;
+    //the patches selected for the camera and each shadow map are written one list after another
+    std::vector<VertexTerrain> m_draw_vertices;
+    std::vector<DrawRange> m_draw_ranges;
+    uint32_t m_vb_alloc_vertex_count = 0;
     VertexBufferAllocation m_vb_alloc;
     RenderMode m_render_mode = RenderMode::Terrain;
 
+    /*--- virtual texture ---*/
+    //TERRAIN_VT_PAGES_PER_PATCH x TERRAIN_VT_PAGES_PER_PATCH pages per patch on the first mip, with the page count rounded up
+    //to a power of 2 - the virtual texture can reach past the far edges of the terrain
+    uint32_t virtualTexturePageCount() const noexcept;
+    void openVirtualTexture(Renderer& renderer);
+    void updateVirtualTextureArea(Renderer& renderer) const;
+
+    TerrainVirtualTexture m_virtual_texture;
+
+    /*--- shadow mesh ---*/
+    //the far dir shadow map cascades draw the terrain from this mesh instead of tessellating the resident patches,
+    //every patch is a grid of SHADOW_MESH_CELL_COUNT x SHADOW_MESH_CELL_COUNT cells sampled from its heightmap
+    static constexpr uint32_t SHADOW_MESH_CELL_COUNT = 8;
+    static_assert(PATCH_CELL_COUNT % SHADOW_MESH_CELL_COUNT == 0);
+    //the heights of the grid vertices, the file stores them for every patch so the mesh is built without decompressing the tiles
+    static constexpr uint32_t SHADOW_MESH_PATCH_HEIGHT_COUNT = (SHADOW_MESH_CELL_COUNT + 1) * (SHADOW_MESH_CELL_COUNT + 1);
+    static constexpr uint32_t SHADOW_MESH_PATCH_VERTEX_COUNT = SHADOW_MESH_PATCH_HEIGHT_COUNT;
+    static constexpr uint32_t SHADOW_MESH_PATCH_INDEX_COUNT = 6 * SHADOW_MESH_CELL_COUNT * SHADOW_MESH_CELL_COUNT;
+    //the patches are stored in the depth first order of the quadtree leaves, so the patches under every node are one range of the mesh -
+    //the index buffer holds the triangles of this many consecutive patches and longer ranges take several draws
+    static constexpr uint32_t SHADOW_MESH_DRAW_PATCH_COUNT = 64;
+    static_assert(SHADOW_MESH_DRAW_PATCH_COUNT * SHADOW_MESH_PATCH_VERTEX_COUNT <= 65536);
+
+    static void sampleShadowMeshHeights(const Tile& tile, float* heights);
+    void buildShadowMesh(Renderer& renderer);
+    void buildShadowMeshPatch(uint32_t patch_id, const float* heights, VertexTerrainShadowMesh* dst) const;
+    //adds the ranges of the mesh under the nodes in the view's frusta from first_frustum on to m_shadow_mesh_draw_ranges
+    void selectShadowMeshNode(uint32_t node_id, const RenderView& view, uint32_t first_frustum, bool inside);
+
+    //the renderer copies the data at the end of the frame it was handed over in, so it's only kept until then
+    struct ShadowMeshUpload
+    {
+        uint64_t frame;
+        std::vector<VertexTerrainShadowMesh> vertices;
+        std::vector<uint16_t> indices;
+    };
+
+    std::vector<ShadowMeshUpload> m_shadow_mesh_uploads;
+    //the first vertex of every patch in the mesh is its leaf index times SHADOW_MESH_PATCH_VERTEX_COUNT
+    std::vector<uint32_t> m_shadow_mesh_patch_leaves;
+    //first patch and patch count of the ranges of the current view
+    std::vector<uvec2> m_shadow_mesh_draw_ranges;
+    VertexBufferAllocation m_shadow_mesh_vb_alloc;
+    IndexBufferAllocation m_shadow_mesh_ib_alloc;
+#if EDITOR_ENABLE
+    //patches whose heights have changed since their part of the shadow mesh was uploaded
+    std::vector<uint32_t> m_shadow_mesh_dirty_patches;
+#endif
+
 #if EDITOR_ENABLE
     bool m_lod_enabled = true;
 #endif
@@ -0,0 +1,387 @@
+#include "terrain_virtual_texture.h"
+#include "parallel.h"
+#include <zlib.h>
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <limits>
+#include <cstring>
+
+namespace
+{
+
+void pageFromId(uint32_t page_count, uint32_t page_id, uint32_t& mip, uvec2& page)
+{
+    for(mip = 0; page_id >= (page_count >> mip) * (page_count >> mip); mip++)
+    {
+        page_id -= (page_count >> mip) * (page_count >> mip);
+    }
+
+    page = uvec2(page_id % (page_count >> mip), page_id / (page_count >> mip));
+}
+
+}
+
+TerrainVirtualTexture::~TerrainVirtualTexture()
+{
+    //the loader reads straight out of the mapped file, so it has to be gone before the file is unmapped
+    m_loader = {};
+}
+
+bool TerrainVirtualTexture::open(Renderer& renderer, const char* filename, uint32_t page_count)
+{
+    close(renderer);
+
+    if(!std::filesystem::exists(filename))
+    {
+        return false;
+    }
+
+    m_file.open(filename);
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(m_file.data());
+
+    if((m_file.size() < sizeof(FileHeader)) || (header->magic != FILE_MAGIC) || (header->version != FILE_VERSION) ||
+       (header->page_res != TERRAIN_VT_PAGE_RES) || (header->page_border != TERRAIN_VT_PAGE_BORDER) || (header->page_count != page_count))
+    {
+        m_file.close();
+        return false;
+    }
+
+    const uint32_t total_page_count = totalPageCount(page_count);
+
+    if(m_file.size() < sizeof(FileHeader) + total_page_count * sizeof(PageInfo))
+    {
+        error(std::format("Virtual texture file {} is corrupted.", filename));
+    }
+
+    //copied out, the page table isn't 8 byte aligned in the file
+    m_page_infos.resize(total_page_count);
+    std::memcpy(m_page_infos.data(), m_file.data() + sizeof(FileHeader), total_page_count * sizeof(PageInfo));
+
+    for(uint32_t i = 0; i < total_page_count; i++)
+    {
+        if(m_page_infos[i].offset + m_page_infos[i].compressed_size > m_file.size())
+        {
+            error(std::format("Virtual texture file {} is corrupted.", filename));
+        }
+    }
+
+    m_page_count = page_count;
+    m_mip_count = mipCount(page_count);
+    m_frame = 0;
+
+    m_pages.resize(total_page_count);
+    for(uint32_t i = 0; i < total_page_count; i++)
+    {
+        pageFromId(page_count, i, m_pages[i].mip, m_pages[i].pos);
+    }
+
+    m_cache_slots.assign(CACHE_SLOT_COUNT, {});
+    m_free_cache_slots.resize(CACHE_SLOT_COUNT);
+    for(uint32_t i = 0; i < CACHE_SLOT_COUNT; i++)
+    {
+        m_free_cache_slots[i] = CACHE_SLOT_COUNT - 1 - i;
+    }
+
+    renderer.reqTerrainVirtualTexture(page_count);
+
+    //the shaders fall back to the single page of the last mip when nothing better is resident, so it's loaded right away
+    //and goes out with the first update
+    const uint32_t last_page_id = total_page_count - 1;
+    LoadedPage last_page{last_page_id, std::vector<uint32_t>(PAGE_TEXEL_COUNT)};
+    uLongf uncompressed_size = static_cast<uLongf>(PAGE_TEXEL_COUNT * sizeof(uint32_t));
+
+    if((uncompress(reinterpret_cast<uint8_t*>(last_page.texels.data()), &uncompressed_size, m_file.data() + m_page_infos[last_page_id].offset,
+                   static_cast<uLong>(m_page_infos[last_page_id].compressed_size)) != Z_OK) || (uncompressed_size != PAGE_TEXEL_COUNT * sizeof(uint32_t)))
+    {
+        error(std::format("Failed to decompress virtual texture file {}.", filename));
+    }
+
+    m_pages[last_page_id].requested = true;
+    m_pending_uploads.push_back(std::move(last_page));
+
+    m_loader = std::jthread([this](std::stop_token stop_token){ loaderThread(stop_token); });
+
+    return true;
+}
+
+void TerrainVirtualTexture::close(Renderer& renderer)
+{
+    if(!isOpen())
+    {
+        return;
+    }
+
+    m_loader = {};
+
+    m_load_queue.clear();
+    m_loaded_pages.clear();
+    m_pending_uploads.clear();
+    m_uploaded_pages.clear();
+    m_new_requests.clear();
+    m_pages.clear();
+    m_cache_slots.clear();
+    m_free_cache_slots.clear();
+
+    m_page_infos.clear();
+    m_page_count = 0;
+    m_mip_count = 0;
+    m_file.close();
+
+    renderer.reqTerrainVirtualTexture(0);
+}
+
+bool TerrainVirtualTexture::isOpen() const noexcept
+{
+    return m_file.isOpen();
+}
+
+uint32_t TerrainVirtualTexture::residentPageCount() const noexcept
+{
+    return isOpen() ? static_cast<uint32_t>(CACHE_SLOT_COUNT - m_free_cache_slots.size()) : 0;
+}
+
+void TerrainVirtualTexture::loaderThread(std::stop_token stop_token)
+{
+    while(true)
+    {
+        uint32_t page_id;
+
+        {
+            std::unique_lock lock(m_loader_mutex);
+
+            if(!m_loader_cv.wait(lock, stop_token, [this]{ return !m_load_queue.empty(); }))
+            {
+                return;
+            }
+
+            page_id = m_load_queue.front();
+            m_load_queue.pop_front();
+        }
+
+        LoadedPage loaded_page{page_id, std::vector<uint32_t>(PAGE_TEXEL_COUNT)};
+        uLongf uncompressed_size = static_cast<uLongf>(PAGE_TEXEL_COUNT * sizeof(uint32_t));
+
+        //a page that fails to decompress is handed back without texels and never requested again
+        if((uncompress(reinterpret_cast<uint8_t*>(loaded_page.texels.data()), &uncompressed_size, m_file.data() + m_page_infos[page_id].offset,
+                       static_cast<uLong>(m_page_infos[page_id].compressed_size)) != Z_OK) || (uncompressed_size != PAGE_TEXEL_COUNT * sizeof(uint32_t)))
+        {
+            loaded_page.texels.clear();
+        }
+
+        std::lock_guard lock(m_loader_mutex);
+        m_loaded_pages.push_back(std::move(loaded_page));
+    }
+}
+
+void TerrainVirtualTexture::request(uint32_t page_id)
+{
+    Page& page = m_pages[page_id];
+
+    if((page.cache_slot == SLOT_NONE) && !page.requested)
+    {
+        page.requested = true;
+        m_new_requests.push_back(page_id);
+    }
+}
+
+bool TerrainVirtualTexture::makeResident(Renderer& renderer, LoadedPage& loaded_page)
+{
+    TerrainVTPageUpload upload{};
+
+    if(!m_free_cache_slots.empty())
+    {
+        upload.cache_slot = m_free_cache_slots.back();
+        m_free_cache_slots.pop_back();
+    }
+    else
+    {
+        const auto lru_slot = std::ranges::min_element(m_cache_slots, {}, &CacheSlot::last_used_frame);
+
+        //used by this frame's feedback or pinned
+        if(lru_slot->last_used_frame >= m_frame)
+        {
+            return false;
+        }
+
+        Page& evicted_page = m_pages[lru_slot->page_id];
+        evicted_page.cache_slot = SLOT_NONE;
+
+        upload.cache_slot = static_cast<uint32_t>(std::distance(m_cache_slots.begin(), lru_slot));
+        upload.evicted = true;
+        upload.evicted_mip = evicted_page.mip;
+        upload.evicted_page = evicted_page.pos;
+    }
+
+    Page& page = m_pages[loaded_page.page_id];
+    page.cache_slot = upload.cache_slot;
+    page.requested = false;
+
+    //the last mip is pinned to its slot for as long as the texture is open
+    m_cache_slots[upload.cache_slot] = {loaded_page.page_id, (page.mip == m_mip_count - 1) ? std::numeric_limits<uint64_t>::max() : m_frame};
+
+    upload.data = loaded_page.texels.data();
+    upload.mip = page.mip;
+    upload.page = page.pos;
+    renderer.uploadTerrainVTPage(upload);
+
+    return true;
+}
+
+void TerrainVirtualTexture::update(Renderer& renderer)
+{
+    if(!isOpen())
+    {
+        return;
+    }
+
+    m_frame++;
+    //the renderer has recorded last frame's uploads by now
+    m_uploaded_pages.clear();
+
+    const std::vector<uint32_t> feedback = renderer.takeTerrainVTFeedback();
+
+    for(uint32_t word = 0; word < feedback.size(); word++)
+    {
+        for(uint32_t bits = feedback[word]; bits != 0; bits &= bits - 1)
+        {
+            const uint32_t page_id = word * 32 + std::countr_zero(bits);
+
+            if(page_id >= m_pages.size())
+            {
+                break;
+            }
+
+            //the coarser pages covering a needed one are wanted as well, they're what gets drawn until it's loaded
+            const Page& needed_page = m_pages[page_id];
+
+            for(uint32_t mip = needed_page.mip; mip < m_mip_count; mip++)
+            {
+                const uint32_t id = pageId(m_page_count, mip, needed_page.pos >> (mip - needed_page.mip));
+                const uint32_t cache_slot = m_pages[id].cache_slot;
+
+                if(cache_slot == SLOT_NONE)
+                {
+                    request(id);
+                }
+                else if(m_cache_slots[cache_slot].last_used_frame >= m_frame)
+                {
+                    //touched already this frame, and so are all the pages above it
+                    break;
+                }
+                else
+                {
+                    m_cache_slots[cache_slot].last_used_frame = m_frame;
+                }
+            }
+        }
+    }
+
+    if(!m_new_requests.empty())
+    {
+        std::ranges::stable_sort(m_new_requests, std::greater{}, [this](uint32_t id){ return m_pages[id].mip; });
+
+        {
+            std::lock_guard lock(m_loader_mutex);
+            m_load_queue.insert(m_load_queue.end(), m_new_requests.begin(), m_new_requests.end());
+        }
+
+        m_loader_cv.notify_one();
+        m_new_requests.clear();
+    }
+
+    {
+        std::lock_guard lock(m_loader_mutex);
+
+        for(auto& loaded_page : m_loaded_pages)
+        {
+            m_pending_uploads.push_back(std::move(loaded_page));
+        }
+
+        m_loaded_pages.clear();
+    }
+
+    //the rest waits for the next frames, so a burst of loaded pages doesn't stall a single frame with copies
+    while(!m_pending_uploads.empty() && (m_uploaded_pages.size() < MAX_TERRAIN_VT_UPLOADS_PER_FRAME))
+    {
+        LoadedPage& loaded_page = m_pending_uploads.front();
+
+        if(!loaded_page.texels.empty())
+        {
+            if(!makeResident(renderer, loaded_page))
+            {
+                break;
+            }
+
+            m_uploaded_pages.push_back(std::move(loaded_page));
+        }
+
+        m_pending_uploads.pop_front();
+    }
+}
+
+void TerrainVirtualTexture::bake(const char* filename, uint32_t page_count, const PageBaker& bake_page)
+{
+    if(!std::has_single_bit(page_count))
+    {
+        error(std::format("Virtual texture page count {} is not a power of two.", page_count));
+    }
+
+    const uint32_t total_page_count = totalPageCount(page_count);
+
+    std::vector<std::vector<uint8_t>> pages(total_page_count);
+    std::atomic<bool> compression_failed = false;
+
+    parallelFor(total_page_count, [&](uint32_t page_id)
+    {
+        uint32_t mip;
+        uvec2 pos;
+        pageFromId(page_count, page_id, mip, pos);
+
+        std::vector<uint32_t> texels(PAGE_TEXEL_COUNT);
+        bake_page(mip, pos, texels.data());
+
+        const uint64_t raw_size = PAGE_TEXEL_COUNT * sizeof(uint32_t);
+        auto& page = pages[page_id];
+        uLongf compressed_size = compressBound(static_cast<uLong>(raw_size));
+        page.resize(compressed_size);
+
+        if(compress2(page.data(), &compressed_size, reinterpret_cast<const uint8_t*>(texels.data()), static_cast<uLong>(raw_size), Z_DEFAULT_COMPRESSION) != Z_OK)
+        {
+            compression_failed = true;
+            return;
+        }
+
+        page.resize(compressed_size);
+    });
+
+    if(compression_failed)
+    {
+        error(std::format("Failed to compress virtual texture file {}.", filename));
+    }
+
+    std::ofstream out(filename, std::ios::binary);
+
+    const FileHeader header{FILE_MAGIC, FILE_VERSION, TERRAIN_VT_PAGE_RES, TERRAIN_VT_PAGE_BORDER, page_count};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    uint64_t page_offset = sizeof(FileHeader) + total_page_count * sizeof(PageInfo);
+
+    for(const auto& page : pages)
+    {
+        const PageInfo page_info{page_offset, page.size()};
+        out.write(reinterpret_cast<const char*>(&page_info), sizeof(page_info));
+        page_offset += page.size();
+    }
+
+    for(const auto& page : pages)
+    {
+        out.write(reinterpret_cast<const char*>(page.data()), page.size());
+    }
+
+    if(!out)
+    {
+        error(std::format("Failed to write virtual texture file {}.", filename));
+    }
+}
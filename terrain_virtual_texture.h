@@ -0,0 +1,125 @@
+#ifndef TERRAIN_VIRTUAL_TEXTURE_H
+#define TERRAIN_VIRTUAL_TEXTURE_H
+
+#include "renderer.h"
+#include "mapped_file.h"
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <bit>
+
+//the surface of the whole terrain as one texture too big to ever be resident, split into pages of TERRAIN_VT_PAGE_RES x TERRAIN_VT_PAGE_RES
+//texels on every mip - the terrain fragment shader reports the pages it needs, a background thread decompresses them out of the tiled file
+//and they're uploaded into a fixed size cache on the GPU, evicting the least recently used ones
+//everything goes through a page table texture, so there's no need for sparse residency support
+class TerrainVirtualTexture
+{
+public:
+    TerrainVirtualTexture() = default;
+    TerrainVirtualTexture(const TerrainVirtualTexture&) = delete;
+    TerrainVirtualTexture& operator=(const TerrainVirtualTexture&) = delete;
+    ~TerrainVirtualTexture();
+
+    //returns false if there's no file or it was baked for a different page count, the terrain then blends its materials itself
+    bool open(Renderer& renderer, const char* filename, uint32_t page_count);
+    void close(Renderer& renderer);
+    bool isOpen() const noexcept;
+
+    //requests the pages the finished frames needed and uploads the ones loaded since the last call
+    void update(Renderer& renderer);
+
+    uint32_t residentPageCount() const noexcept;
+
+    //fills the TERRAIN_VT_PADDED_PAGE_RES x TERRAIN_VT_PADDED_PAGE_RES packed RGBA8 texels of a page, border included
+    using PageBaker = std::function<void(uint32_t mip, const uvec2& page, uint32_t* texels)>;
+    //bakes every page of a virtual texture with page_count x page_count pages on its first mip, the pages are baked in parallel
+    static void bake(const char* filename, uint32_t page_count, const PageBaker& bake_page);
+
+    static constexpr uint32_t mipCount(uint32_t page_count) { return std::countr_zero(page_count) + 1; }
+    static constexpr uint32_t totalPageCount(uint32_t page_count) { return (4 * page_count * page_count - 1) / 3; }
+    //same as terrainVTPageId in the shaders
+    static constexpr uint32_t pageId(uint32_t page_count, uint32_t mip, const uvec2& page)
+    {
+        const uint32_t mip_page_count = page_count >> mip;
+        return (4 * page_count * page_count - 4 * mip_page_count * mip_page_count) / 3 + page.y * mip_page_count + page.x;
+    }
+
+private:
+    static constexpr uint32_t FILE_MAGIC = 0x54565254; //"TRVT"
+    static constexpr uint32_t FILE_VERSION = 0;
+    static constexpr uint32_t SLOT_NONE = 0xffffffff;
+    static constexpr uint32_t PAGE_ID_NONE = 0xffffffff;
+    static constexpr uint32_t CACHE_SLOT_COUNT = TERRAIN_VT_CACHE_PAGES * TERRAIN_VT_CACHE_PAGES;
+    static constexpr uint64_t PAGE_TEXEL_COUNT = TERRAIN_VT_PADDED_PAGE_RES * TERRAIN_VT_PADDED_PAGE_RES;
+    static_assert(CACHE_SLOT_COUNT < TERRAIN_VT_PAGE_NONE);
+
+    /*--- file layout ---*/
+    //header, page table and then every page compressed with zlib on its own, in page id order
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t page_res;
+        uint32_t page_border;
+        uint32_t page_count;
+    };
+
+    struct PageInfo
+    {
+        uint64_t offset;
+        uint64_t compressed_size;
+    };
+
+    struct Page
+    {
+        uint32_t cache_slot = SLOT_NONE;
+        uint32_t mip = 0;
+        uvec2 pos = uvec2(0, 0);
+        //queued for the loader or loaded and waiting for a cache slot
+        bool requested = false;
+    };
+
+    struct CacheSlot
+    {
+        uint32_t page_id = PAGE_ID_NONE;
+        uint64_t last_used_frame = 0;
+    };
+
+    struct LoadedPage
+    {
+        uint32_t page_id;
+        std::vector<uint32_t> texels;
+    };
+
+    void loaderThread(std::stop_token stop_token);
+    void request(uint32_t page_id);
+    //makes a loaded page resident, returns false if every slot has been used this frame
+    bool makeResident(Renderer& renderer, LoadedPage& loaded_page);
+
+    MappedFile m_file;
+    std::vector<PageInfo> m_page_infos;
+    uint32_t m_page_count = 0;
+    uint32_t m_mip_count = 0;
+    uint64_t m_frame = 0;
+
+    std::vector<Page> m_pages;
+    std::vector<CacheSlot> m_cache_slots;
+    std::vector<uint32_t> m_free_cache_slots;
+    //requests made this frame, handed to the loader from the coarsest mip down so the fallbacks show up first
+    std::vector<uint32_t> m_new_requests;
+    //loaded pages that didn't fit into this frame's uploads
+    std::deque<LoadedPage> m_pending_uploads;
+    //the pages uploaded this frame, the renderer reads their texels when it records the frame
+    std::vector<LoadedPage> m_uploaded_pages;
+
+    /*--- loader thread ---*/
+    std::mutex m_loader_mutex;
+    std::condition_variable_any m_loader_cv;
+    std::deque<uint32_t> m_load_queue;
+    std::vector<LoadedPage> m_loaded_pages;
+    std::jthread m_loader;
+};
+
+#endif // TERRAIN_VIRTUAL_TEXTURE_H
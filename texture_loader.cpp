@@ -1,5 +1,10 @@
 #include "texture_loader.h"
+#include "game_utils.h"
 #include <png.h>
+#include <format>
+#include <cstring>
+#include <bit>
+#include <algorithm>
 
 void TextureLoader::loadTexture(std::string_view filename)
 {
@@ -11,3 +16,162 @@ uvec3 TextureLoader::textureSize(std::string_view filename)
 
 }
 
+std::vector<uint32_t> TextureLoader::loadRGBA8(const std::string& filename, uvec2& size)
+{
+    auto file = std::fopen(filename.data(), "rb");
+
+    if(!file)
+    {
+        error(std::format("Failed to open a texture file: {}", filename));
+    }
+
+    uint8_t sig[8];
+    fread(sig, 1, 8, file);
+
+    if(auto check = png_check_sig(sig, 8); !check)
+    {
+        fclose(file);
+        error(std::format("Texture file {} is not a valid .png file.", filename));
+    }
+
+    auto png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    auto info_ptr = png_create_info_struct(png_ptr);
+
+    png_init_io(png_ptr, file);
+    png_set_sig_bytes(png_ptr, 8);
+    png_read_info(png_ptr, info_ptr);
+
+    const auto w = png_get_image_width(png_ptr, info_ptr);
+    const auto h = png_get_image_height(png_ptr, info_ptr);
+    const auto color_type = png_get_color_type(png_ptr, info_ptr);
+    const auto bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+
+    /*same conversions as the renderer does when it loads textures*/
+    if(16 == bit_depth)
+    {
+        png_set_strip_16(png_ptr);
+    }
+
+    if(color_type == PNG_COLOR_TYPE_PALETTE)
+    {
+        png_set_palette_to_rgb(png_ptr);
+    }
+
+    if((PNG_COLOR_TYPE_GRAY == color_type) && (bit_depth < 8))
+    {
+        png_set_expand_gray_1_2_4_to_8(png_ptr);
+    }
+
+    if(png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+    {
+        png_set_tRNS_to_alpha(png_ptr);
+    }
+
+    if((PNG_COLOR_TYPE_RGB == color_type) || (PNG_COLOR_TYPE_GRAY == color_type) || (PNG_COLOR_TYPE_PALETTE == color_type))
+    {
+        png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+    }
+
+    if((PNG_COLOR_TYPE_GRAY == color_type) || (PNG_COLOR_TYPE_GRAY_ALPHA == color_type))
+    {
+        png_set_gray_to_rgb(png_ptr);
+    }
+
+    png_read_update_info(png_ptr, info_ptr);
+
+    std::vector<uint32_t> texels(static_cast<size_t>(w) * h);
+
+    std::vector<uint8_t*> row_ptrs(h);
+    for(size_t i = 0; i < h; i++)
+    {
+        row_ptrs[i] = reinterpret_cast<uint8_t*>(texels.data() + i*w);
+    }
+
+    png_read_image(png_ptr, row_ptrs.data());
+
+    png_read_end(png_ptr, NULL);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+
+    fclose(file);
+
+    size = uvec2(w, h);
+
+    return texels;
+}
+
+uvec2 TextureLoader::mipSize(const BakedTextureHeader& header, uint32_t mip)
+{
+    return uvec2(std::max(header.width >> mip, 1u), std::max(header.height >> mip, 1u));
+}
+
+std::vector<uint8_t> TextureLoader::bakeTexture(const std::string& filename, bool generate_mipmaps)
+{
+    uvec2 size;
+    std::vector<uint32_t> level = loadRGBA8(filename, size);
+
+    BakedTextureHeader header{size.x, size.y, 1, 0};
+
+    if(generate_mipmaps)
+    {
+        header.mip_count = std::bit_width(std::max(size.x, size.y));
+    }
+
+    uint64_t baked_size = sizeof(BakedTextureHeader);
+
+    for(uint32_t mip = 0; mip < header.mip_count; mip++)
+    {
+        const uvec2 mip_size = mipSize(header, mip);
+        baked_size += uint64_t(mip_size.x) * mip_size.y * sizeof(uint32_t);
+    }
+
+    std::vector<uint8_t> baked(baked_size);
+    std::memcpy(baked.data(), &header, sizeof(BakedTextureHeader));
+    uint64_t offset = sizeof(BakedTextureHeader);
+
+    for(uint32_t mip = 0; mip < header.mip_count; mip++)
+    {
+        const uvec2 mip_size = mipSize(header, mip);
+
+        if(mip > 0)
+        {
+            //every texel is the average of the 2x2 texels above it, an odd last row or column is left out
+            const uvec2 src_size = mipSize(header, mip - 1);
+            std::vector<uint32_t> next_level(size_t(mip_size.x) * mip_size.y);
+
+            for(uint32_t y = 0; y < mip_size.y; y++)
+            {
+                for(uint32_t x = 0; x < mip_size.x; x++)
+                {
+                    const uint32_t x0 = std::min(2 * x, src_size.x - 1);
+                    const uint32_t x1 = std::min(2 * x + 1, src_size.x - 1);
+                    const uint32_t y0 = std::min(2 * y, src_size.y - 1);
+                    const uint32_t y1 = std::min(2 * y + 1, src_size.y - 1);
+                    const std::array<uint32_t, 4> texels{level[y0 * src_size.x + x0], level[y0 * src_size.x + x1], level[y1 * src_size.x + x0], level[y1 * src_size.x + x1]};
+
+                    uint32_t texel = 0;
+
+                    for(uint32_t channel = 0; channel < 32; channel += 8)
+                    {
+                        uint32_t sum = 2;
+
+                        for(uint32_t t : texels)
+                        {
+                            sum += (t >> channel) & 0xff;
+                        }
+
+                        texel |= (sum / 4) << channel;
+                    }
+
+                    next_level[y * mip_size.x + x] = texel;
+                }
+            }
+
+            level = std::move(next_level);
+        }
+
+        std::memcpy(baked.data() + offset, level.data(), level.size() * sizeof(uint32_t));
+        offset += level.size() * sizeof(uint32_t);
+    }
+
+    return baked;
+}
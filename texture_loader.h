@@ -2,6 +2,8 @@
 #define TEXTURE_LOADER_H
 
 #include <string_view>
+#include <string>
+#include <vector>
 #include "geometry.h"
 
 class TextureLoader
@@ -9,6 +11,24 @@ class TextureLoader
 public:
     void loadTexture(std::string_view filename);
     uvec3 textureSize(std::string_view filename);
+
+    //decodes a whole .png file on the CPU into RGBA8 texels packed with the red channel in the low byte
+    static std::vector<uint32_t> loadRGBA8(const std::string& filename, uvec2& size);
+
+    //the GPU ready form of a texture kept in the asset cache, a BakedTextureHeader followed by the RGBA8 texels of every mip, largest first
+    struct BakedTextureHeader
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t mip_count;
+        uint32_t padding;
+    };
+
+    static constexpr uint32_t BAKED_TEXTURE_VERSION = 0;
+
+    //decodes the .png file and box filters the whole mip chain on the CPU, so loading it is just a copy to the GPU
+    static std::vector<uint8_t> bakeTexture(const std::string& filename, bool generate_mipmaps);
+    static uvec2 mipSize(const BakedTextureHeader& header, uint32_t mip);
 };
 
 #endif // TEXTURE_LOADER_H
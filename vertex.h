@@ -4,6 +4,7 @@
 #include <vector>
 #include "geometry.h"
 #include "color.h"
+#include <glm/gtc/type_precision.hpp>
 #include <vulkan/vulkan.h>
 
 //TODO: see if there's any benefit to limiting the number of locations for each vertex format
@@ -76,9 +77,13 @@ struct InstanceVertexData
     uint32_t tex_id = 0;
     uint32_t normal_map_id = 0;
     uint32_t bone_offset = 0;
+    //the mesh's quantized positions go from pos_offset to pos_offset + pos_scale
+    vec3 pos_offset = vec3(0.0f);
+    vec3 pos_scale = vec3(1.0f);
 };
 
-struct VertexDefault
+//the layout the exporter writes, the meshes are packed into VertexDefault when they're first loaded
+struct VertexDefaultUnpacked
 {
     vec3 pos;
     vec3 normal;
@@ -87,13 +92,28 @@ struct VertexDefault
     uint32_t bone_id = 0;
 };
 
+struct VertexDefault
+{
+    //quantized to the bounds of the mesh, w is padding
+    glm::u16vec4 pos;
+    //octahedral encoded, the tangent only orients the normal map so it gets away with less precision
+    glm::i16vec2 normal;
+    glm::i8vec2 tangent;
+    uint8_t bone_id = 0;
+    uint8_t padding = 0;
+    //half floats
+    glm::u16vec2 tex_coords;
+};
+
+static_assert(sizeof(VertexDefault) == 20);
+
 inline const std::vector<VkVertexInputAttributeDescription> vertex_default_attr_desc
 {
-    {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexDefault, pos)}, // pos
-    {1, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexDefault, normal)}, // normal
-    {2, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexDefault, tangent)}, // tangent
-    {3, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexDefault, tex_coords)}, // texcoords
-    {4, 0, VK_FORMAT_R32_UINT, offsetof(VertexDefault, bone_id)}, // bone_id
+    {0, 0, VK_FORMAT_R16G16B16A16_UNORM, offsetof(VertexDefault, pos)}, // pos
+    {1, 0, VK_FORMAT_R16G16_SNORM, offsetof(VertexDefault, normal)}, // normal
+    {2, 0, VK_FORMAT_R8G8_SNORM, offsetof(VertexDefault, tangent)}, // tangent
+    {3, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(VertexDefault, tex_coords)}, // texcoords
+    {4, 0, VK_FORMAT_R8_UINT, offsetof(VertexDefault, bone_id)}, // bone_id
 
     {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceVertexData, W)}, // world matrix row0
     {6, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceVertexData, W) + 4*sizeof(float)}, // world matrix row1
@@ -101,6 +121,8 @@ inline const std::vector<VkVertexInputAttributeDescription> vertex_default_attr_
     {8, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceVertexData, W) + 12*sizeof(float)}, // world matrix row3
     {9, 1, VK_FORMAT_R32G32_UINT, offsetof(InstanceVertexData, tex_id)}, // tex_id, normal_map_id
     {10, 1, VK_FORMAT_R32_UINT, offsetof(InstanceVertexData, bone_offset)}, // bone_offset
+    {11, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceVertexData, pos_offset)}, // pos_offset
+    {12, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(InstanceVertexData, pos_scale)}, // pos_scale
 };
 
 /*----------------------------------------- Vertex Terrain ------------------------------------------*/
@@ -109,12 +131,27 @@ struct VertexTerrain
 {
     vec2 pos;
     uint32_t heightmap_id;
+    //the heights in the heightmap are quantized to this range
+    vec2 height_range;
 };
 
 inline const std::vector<VkVertexInputAttributeDescription> vertex_terrain_attr_desc
 {
     {0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTerrain, pos)}, // pos
     {1, 0, VK_FORMAT_R32_UINT, offsetof(VertexTerrain, heightmap_id)}, // heightmap_id
+    {2, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTerrain, height_range)}, // height_range
+};
+
+/*----------------------------------------- Vertex Terrain Shadow Mesh ------------------------------------------*/
+
+struct VertexTerrainShadowMesh
+{
+    vec3 pos;
+};
+
+inline const std::vector<VkVertexInputAttributeDescription> vertex_terrain_shadow_mesh_attr_desc
+{
+    {0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexTerrainShadowMesh, pos)}, // pos
 };
 
 #endif // VERTEX_H